@@ -20,6 +20,10 @@
 #include "microvium_hal_wifi.h"
 #endif
 
+#ifdef MICROVIUM_HAL_TIMERS
+#include "microvium_hal_timers.h"
+#endif
+
 mvm_TeError microvium_hal_resolveImport(mvm_HostFunctionID hostFunctionID, void *context, mvm_TfHostFunction *out_hostFunction);
 
 #endif /* HAL_MICROVIUM_HAL_H_ */
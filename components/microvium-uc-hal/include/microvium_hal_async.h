@@ -0,0 +1,128 @@
+/*
+ * @file microvium_hal_async.h
+ * @brief microvium async host functions API
+ * @details
+ * Lets one task run many VMs that are each waiting for slow I/O (a Wi-Fi scan,
+ * a flash write, ...) without blocking on any of them.
+ *
+ * An async host function starts its I/O with microvium_hal_async_start and
+ * returns what that returns (MVM_E_HOST_PENDING), which suspends the VM's call
+ * (see mvm_completeHostCall). The blocking part of the I/O (`work`) runs on one
+ * of the I/O tasks of the async context. When it's done, the task that runs the
+ * VMs picks up the completion in microvium_hal_async_run, which calls `finish`
+ * to make the result of the host function and continues the suspended call
+ * with it.
+ *
+ * I/O that completes by itself (e.g. through an event handler) can instead be
+ * reported with microvium_hal_async_complete, from any task.
+ *
+ * Each VM has a single call stack, so it can only have one host call pending at
+ * a time.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef MICROVIUM_HAL_ASYNC_H_
+#define MICROVIUM_HAL_ASYNC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "microvium.h"
+
+typedef struct microvium_hal_async microvium_hal_async_t;
+
+/**
+ * The blocking part of an async host function, run on an I/O task. Must not
+ * use the VM.
+ *
+ * @param arg the argument given to microvium_hal_async_start
+ */
+typedef void (*microvium_hal_async_work_t)(void *arg);
+
+/**
+ * Makes the result of an async host function once its I/O is done, on the
+ * task that runs the VM (e.g. converting the data read to a VM value, and
+ * freeing `arg`).
+ *
+ * @param vm the VM
+ * @param arg the argument given to microvium_hal_async_start
+ * @return the result of the host function
+ */
+typedef mvm_Value (*microvium_hal_async_finish_t)(mvm_VM *vm, void *arg);
+
+/**
+ * Create an async context and start its I/O tasks.
+ *
+ * @param max_pending maximum number of host calls pending at the same time
+ * (at most one per VM)
+ * @param io_tasks number of I/O tasks, which is the number of `work` functions
+ * that can block at the same time
+ * @param priority priority of the I/O tasks
+ * @param stack_size stack size of the I/O tasks (in bytes)
+ * @return the context, or NULL if it could not be created
+ */
+microvium_hal_async_t* microvium_hal_async_create(int max_pending, int io_tasks, int priority, size_t stack_size);
+
+/**
+ * Start the I/O of an async host function. The host function returns the
+ * result of this function.
+ *
+ * @param async the context
+ * @param vm the VM that called the host function
+ * @param work the blocking part of the I/O, or NULL if the I/O is started here
+ * and reported later with microvium_hal_async_complete
+ * @param finish makes the result of the host function
+ * @param arg argument to pass to `work` and `finish`
+ * @return MVM_E_HOST_PENDING, or MVM_E_HOST_ERROR if there are already
+ * `max_pending` calls pending
+ */
+mvm_TeError microvium_hal_async_start(microvium_hal_async_t *async, mvm_VM *vm, microvium_hal_async_work_t work,
+        microvium_hal_async_finish_t finish, void *arg);
+
+/**
+ * Report that the I/O of a host call started with a NULL `work` is done. Can be
+ * called from any task.
+ *
+ * @param async the context
+ * @param vm the VM that called the host function
+ */
+void microvium_hal_async_complete(microvium_hal_async_t *async, mvm_VM *vm);
+
+/**
+ * Wait for the I/O of a pending host call to be done, and continue the VM's
+ * suspended call with the result. Called by the task that runs the VMs, in a
+ * loop.
+ *
+ * @param async the context
+ * @param timeout longest time to wait (in ms)
+ * @param err receives the result of mvm_completeHostCall: MVM_E_SUCCESS if the
+ * call into the VM has returned, MVM_E_HOST_PENDING if it's waiting for another
+ * host call, or an error
+ * @param result receives the result of the call into the VM, if it has returned
+ * @return the VM that was continued, or NULL if no I/O was done in time
+ */
+mvm_VM* microvium_hal_async_run(microvium_hal_async_t *async, uint32_t timeout, mvm_TeError *err, mvm_Value *result);
+
+/**
+ * Number of host calls that are pending.
+ *
+ * @param async the context
+ */
+int microvium_hal_async_pending(microvium_hal_async_t *async);
+
+/**
+ * Stop the I/O tasks and free the context. Any `work` in progress is finished
+ * first. Calls still pending are not continued.
+ *
+ * @param async the context
+ */
+void microvium_hal_async_destroy(microvium_hal_async_t *async);
+
+#endif /* MICROVIUM_HAL_ASYNC_H_ */
@@ -0,0 +1,143 @@
+/*
+ * @file microvium_hal_events.h
+ * @brief microvium event queue API
+ * @details
+ * Delivers events (interrupts, network events, ...) from the host to a script
+ * in batches, rather than with one `mvm_call` per event.
+ *
+ * Events are posted to a fixed-capacity ring that is lock-free for any number
+ * of producers, so they can be posted from interrupt handlers and from other
+ * tasks without blocking. If the ring is full the event is dropped and
+ * counted. The task that runs the VM waits for events and then dispatches all
+ * those waiting (up to a batch size) with a single call of a JS handler, which
+ * gets them as an Int32Array of `[type, value, type, value, ...]`:
+ *
+ *   function onEvents(events) {
+ *     for (let i = 0; i < events.length; i += 2)
+ *       handle(events[i], events[i + 1]);
+ *   }
+ *
+ * The time from posting each event to its dispatch is recorded in a
+ * histogram, along with counts of the events posted, dropped and dispatched.
+ *
+ * Note: on the ESP32, an interrupt handler that can run while the flash cache
+ * is disabled must also have microvium_hal_events_post_from_isr and its ring
+ * in internal RAM.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef MICROVIUM_HAL_EVENTS_H_
+#define MICROVIUM_HAL_EVENTS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "microvium.h"
+
+/**
+ * Maximum number of events dispatched by one call of the handler.
+ */
+#ifndef MICROVIUM_HAL_EVENTS_MAX_BATCH
+#define MICROVIUM_HAL_EVENTS_MAX_BATCH 32
+#endif
+
+/**
+ * Number of buckets of the latency histogram. Bucket 0 counts the events
+ * dispatched less than 2 us after they were posted, bucket `i` those
+ * dispatched 2^i to 2^(i+1) - 1 us after, and the last bucket also all the
+ * later ones.
+ */
+#define MICROVIUM_HAL_EVENTS_LATENCY_BUCKETS 20
+
+typedef struct microvium_hal_events microvium_hal_events_t;
+
+typedef struct microvium_hal_events_stats {
+    uint32_t posted;      /**< events posted, including those dropped */
+    uint32_t dropped;     /**< events dropped because the ring was full */
+    uint32_t dispatched;  /**< events passed to the handler */
+    uint32_t batches;     /**< calls of the handler */
+    uint32_t max_batch;   /**< most events passed to one call of the handler */
+    uint32_t latency[MICROVIUM_HAL_EVENTS_LATENCY_BUCKETS]; /**< time from posting to dispatch (see above) */
+} microvium_hal_events_stats_t;
+
+/**
+ * Create an event queue.
+ *
+ * @param capacity number of events that the ring can hold (rounded up to a
+ * power of 2)
+ * @return the event queue, or NULL if it could not be created
+ */
+microvium_hal_events_t* microvium_hal_events_create(uint32_t capacity);
+
+/**
+ * Post an event from a task. Never blocks.
+ *
+ * @param events the event queue
+ * @param type event type (e.g. the interrupt or the kind of network event)
+ * @param value event data
+ * @return false if the ring was full and the event was dropped
+ */
+bool microvium_hal_events_post(microvium_hal_events_t *events, uint16_t type, int32_t value);
+
+/**
+ * Post an event from an interrupt handler.
+ *
+ * @param events the event queue
+ * @param type event type (e.g. the interrupt or the kind of network event)
+ * @param value event data
+ * @return false if the ring was full and the event was dropped
+ */
+bool microvium_hal_events_post_from_isr(microvium_hal_events_t *events, uint16_t type, int32_t value);
+
+/**
+ * Wait for events to be posted. Only to be called by the task that dispatches
+ * the events.
+ *
+ * @param events the event queue
+ * @param timeout longest time to wait (in ms)
+ * @return true if there are events waiting
+ */
+bool microvium_hal_events_wait(microvium_hal_events_t *events, uint32_t timeout);
+
+/**
+ * Dispatch the events waiting, up to `max_batch` of them, with one call of the
+ * handler. Does nothing if there are no events waiting.
+ *
+ * @param events the event queue
+ * @param vm the VM
+ * @param handler handle holding the JS function to call with the events (a
+ * handle, since passing the events to the VM can collect garbage, which moves
+ * a closure)
+ * @param max_batch most events to dispatch (at most
+ * MICROVIUM_HAL_EVENTS_MAX_BATCH)
+ * @param err receives the result of `mvm_call`, MVM_E_OUT_OF_MEMORY if the
+ * events could not be passed to the VM, or MVM_E_SUCCESS if there were no
+ * events
+ * @return the number of events dispatched (none on MVM_E_OUT_OF_MEMORY, when
+ * the events stay queued for the next call)
+ */
+int microvium_hal_events_dispatch(microvium_hal_events_t *events, mvm_VM *vm, mvm_Handle *handler, int max_batch,
+        mvm_TeError *err);
+
+/**
+ * Get the statistics of the event queue.
+ *
+ * @param events the event queue
+ * @param stats receives the statistics
+ */
+void microvium_hal_events_get_stats(microvium_hal_events_t *events, microvium_hal_events_stats_t *stats);
+
+/**
+ * Free the event queue. No events may be posted after this.
+ *
+ * @param events the event queue
+ */
+void microvium_hal_events_destroy(microvium_hal_events_t *events);
+
+#endif /* MICROVIUM_HAL_EVENTS_H_ */
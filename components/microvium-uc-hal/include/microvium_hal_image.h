@@ -0,0 +1,94 @@
+/*
+ * @file microvium_hal_image.h
+ * @brief microvium bytecode image loader API
+ * @details
+ * A bytecode image is either mapped directly from a raw flash partition, in
+ * which case the VM reads the ROM sections of the bytecode from flash and only
+ * the globals and heap are copied to RAM by `mvm_restore`, or read from a file
+ * into a malloc'd buffer.
+ *
+ * In both cases the image must stay loaded for as long as the VM restored from
+ * it is in use.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef MICROVIUM_HAL_IMAGE_H_
+#define MICROVIUM_HAL_IMAGE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "microvium.h"
+#include "hal_fs.h"
+
+typedef struct microvium_hal_image {
+    MVM_LONG_PTR_TYPE bytecode; /**< bytecode to pass to mvm_restore */
+    size_t size;                /**< bytecode size to pass to mvm_restore */
+    bool mapped;                /**< true if mapped from a partition, false if malloc'd */
+    fs_map_handle_t map;        /**< mapping handle (if mapped) */
+} microvium_hal_image_t;
+
+/**
+ * Map the bytecode image in a raw partition.
+ *
+ * The partition holds the bytecode as-is (e.g. written with
+ * `parttool.py write_partition`), followed by unused space. Fails if the
+ * partition doesn't start with a bytecode header.
+ *
+ * @param image receives the image
+ * @param label partition label
+ * @return true on success
+ */
+bool microvium_hal_image_map(microvium_hal_image_t *image, const char *label);
+
+/**
+ * Map the hibernation image in a raw partition, for mvm_restoreHibernated.
+ *
+ * The image size is the size of the partition. The image itself is validated
+ * by mvm_restoreHibernated.
+ *
+ * @param image receives the image
+ * @param label partition label
+ * @return true on success
+ */
+bool microvium_hal_image_map_hibernated(microvium_hal_image_t *image, const char *label);
+
+/**
+ * Create a hibernation image of a VM (see mvm_hibernate) and write it to a raw
+ * partition.
+ *
+ * The VM must not have been restored from an image mapped from the same
+ * partition.
+ *
+ * @param vm the VM
+ * @param buildId build ID for mvm_hibernate
+ * @param label partition label
+ * @return true on success
+ */
+bool microvium_hal_image_hibernate(mvm_VM *vm, uint32_t buildId, const char *label);
+
+/**
+ * Read the bytecode image from a file into RAM.
+ *
+ * @param image receives the image
+ * @param file file name (see fs_open)
+ * @return true on success
+ */
+bool microvium_hal_image_read(microvium_hal_image_t *image, const char *file);
+
+/**
+ * Release an image loaded with microvium_hal_image_map or
+ * microvium_hal_image_read.
+ *
+ * @param image the image
+ */
+void microvium_hal_image_release(microvium_hal_image_t *image);
+
+#endif /* MICROVIUM_HAL_IMAGE_H_ */
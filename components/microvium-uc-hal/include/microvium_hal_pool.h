@@ -0,0 +1,130 @@
+/*
+ * @file microvium_hal_pool.h
+ * @brief microvium VM pool API
+ * @details
+ * Runs several independent VMs (different scripts, or the same script with
+ * its data split between them) on a pool of worker tasks, one pinned to each
+ * processor core by default.
+ *
+ * The host gives work to a VM by posting a job, which is a function that is
+ * called with the VM (typically to `mvm_call` one of its exports). Each VM has
+ * its own queue of jobs, which are run in order and never at the same time as
+ * each other, since a VM can only be used by one task at a time. Different VMs
+ * run in parallel on different workers.
+ *
+ * A VM with jobs waiting is queued on a worker: the one that it last ran on,
+ * or its home worker to begin with. A worker runs one job of the VM at the
+ * front of its queue and then moves the VM to the back if it has more jobs,
+ * so that the VMs on a worker take turns. A worker with nothing queued takes
+ * a waiting VM from another worker's queue instead ("work stealing"), so that
+ * no core is left idle while there is work to do.
+ *
+ * The pool measures the time spent running the jobs of each VM, and how long
+ * they waited to start (see microvium_hal_pool_get_stats).
+ *
+ * Note: jobs on different VMs run at the same time, so host functions called
+ * by the scripts must be safe to call from several tasks.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef MICROVIUM_HAL_POOL_H_
+#define MICROVIUM_HAL_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "microvium.h"
+
+/**
+ * Maximum number of jobs waiting for each VM.
+ */
+#ifndef MICROVIUM_HAL_POOL_QUEUE_SIZE
+#define MICROVIUM_HAL_POOL_QUEUE_SIZE 8
+#endif
+
+typedef struct microvium_hal_pool microvium_hal_pool_t;
+
+/**
+ * A job for a VM in the pool.
+ *
+ * @param vm the VM
+ * @param arg the argument given to microvium_hal_pool_post
+ */
+typedef void (*microvium_hal_pool_job_t)(mvm_VM *vm, void *arg);
+
+typedef struct microvium_hal_pool_stats {
+    uint64_t cpu_us;      /**< total time spent running the jobs of the VM */
+    uint32_t jobs;        /**< number of jobs run */
+    uint32_t steals;      /**< number of jobs run by a worker that took the VM from another worker */
+    uint32_t max_wait_us; /**< longest time from a job being posted to it starting */
+} microvium_hal_pool_stats_t;
+
+/**
+ * Create a pool and start its workers.
+ *
+ * @param workers number of worker tasks, pinned to the cores in turn (0 for
+ * one per core)
+ * @param max_vms maximum number of VMs that can be added to the pool
+ * @param priority priority of the worker tasks
+ * @param stack_size stack size of the worker tasks (in bytes)
+ * @return the pool, or NULL if it could not be created
+ */
+microvium_hal_pool_t* microvium_hal_pool_create(int workers, int max_vms, int priority, size_t stack_size);
+
+/**
+ * Add a VM to the pool. The VM remains owned by the caller, who must not use
+ * it directly while it's in the pool, other than from jobs.
+ *
+ * @param pool the pool
+ * @param vm the VM
+ * @param home_worker the worker that the VM is queued on until it has first
+ * run (e.g. to spread the VMs over the cores)
+ * @return the ID of the VM in the pool, or -1 if the pool is full
+ */
+int microvium_hal_pool_add(microvium_hal_pool_t *pool, mvm_VM *vm, int home_worker);
+
+/**
+ * Post a job to a VM in the pool. The job is run by one of the workers after
+ * the jobs that were posted to the VM before it.
+ *
+ * @param pool the pool
+ * @param id the ID of the VM
+ * @param job the job
+ * @param arg argument to pass to the job
+ * @return false if the VM already has MICROVIUM_HAL_POOL_QUEUE_SIZE jobs
+ * waiting
+ */
+bool microvium_hal_pool_post(microvium_hal_pool_t *pool, int id, microvium_hal_pool_job_t job, void *arg);
+
+/**
+ * Wait until all the jobs posted to the pool have been run.
+ *
+ * @param pool the pool
+ */
+void microvium_hal_pool_wait_idle(microvium_hal_pool_t *pool);
+
+/**
+ * Get the statistics of a VM in the pool.
+ *
+ * @param pool the pool
+ * @param id the ID of the VM
+ * @param stats receives the statistics
+ */
+void microvium_hal_pool_get_stats(microvium_hal_pool_t *pool, int id, microvium_hal_pool_stats_t *stats);
+
+/**
+ * Wait until all the jobs posted to the pool have been run, then stop the
+ * workers and free the pool. The VMs are not freed.
+ *
+ * @param pool the pool
+ */
+void microvium_hal_pool_destroy(microvium_hal_pool_t *pool);
+
+#endif /* MICROVIUM_HAL_POOL_H_ */
@@ -0,0 +1,116 @@
+/*
+ * @file microvium_hal_timers.h
+ * @brief microvium HAL timers module API
+ * @details
+ * `setTimeout`, `setInterval` and `clearTimeout` (also for intervals) for
+ * scripts, on the task-level events of a TIM device (see hal_tim.h). Scripts
+ * import them from js/microvium_hal_timers.js:
+ *
+ *   import { setTimeout, setInterval, clearInterval } from '../components/microvium-uc-hal/js/microvium_hal_timers.js';
+ *
+ * A timer may run its callback up to `slack_ms` after it is due. Timers whose
+ * windows overlap share one TIM event, which is scheduled for the end of the
+ * first window, so timers due close together are run by one wake of the task
+ * rather than one each. With a slack of 0 every timer runs when it is due.
+ *
+ * The task that runs the VM sleeps for the time given by
+ * microvium_hal_timers_next, or until it has other work, and then calls
+ * microvium_hal_timers_run, which runs `TIM_TaskEventProc` and the callbacks of
+ * the timers that are due. For example, with an event queue (see
+ * microvium_hal_events.h):
+ *
+ *   while (1) {
+ *       if (microvium_hal_events_wait(events, microvium_hal_timers_next(timers, 1000)))
+ *           microvium_hal_events_dispatch(events, vm, &handler, 0, &err);
+ *       microvium_hal_timers_run(timers, &err);
+ *   }
+ *
+ * The TIM device must have been initialized with `TIM_Init`. All the VMs whose
+ * timers use the same TIM device must be run by the same task, since
+ * `TIM_TaskEventProc` runs the events of the whole device.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef MICROVIUM_HAL_TIMERS_H_
+#define MICROVIUM_HAL_TIMERS_H_
+
+#include <stdint.h>
+
+#include "hal_tim.h"
+#include "microvium.h"
+
+enum MICROVIUM_HAL_ID_TIMERS {
+    MICROVIUM_HAL_ID_TIMERS_SET_TIMEOUT  = 65531,
+    MICROVIUM_HAL_ID_TIMERS_SET_INTERVAL = 65530,
+    MICROVIUM_HAL_ID_TIMERS_CLEAR        = 65529,
+};
+
+typedef struct microvium_hal_timers microvium_hal_timers_t;
+
+typedef struct microvium_hal_timers_stats {
+    uint32_t set;         /**< timers set */
+    uint32_t callbacks;   /**< callbacks run */
+    uint32_t wakes;       /**< TIM events scheduled */
+    uint32_t coalesced;   /**< timers that shared a TIM event already scheduled */
+    uint32_t late_max_us; /**< most time from a timer being due to its callback running */
+} microvium_hal_timers_stats_t;
+
+/**
+ * Create the timers of a VM.
+ *
+ * @param vm the VM
+ * @param tim TIM device with task-level events, one for each timer
+ * @param max_timers most timers the script can have at the same time
+ * @param slack_ms time after a timer is due within which its callback may run
+ * @return the timers, or NULL if they could not be created
+ */
+microvium_hal_timers_t* microvium_hal_timers_create(mvm_VM *vm, TIMDevice tim, int max_timers, uint32_t slack_ms);
+
+/**
+ * Time until the timers next need microvium_hal_timers_run.
+ *
+ * @param timers the timers
+ * @param timeout value returned if no timer is set
+ * @return time in ms (0 if timers are due)
+ */
+uint32_t microvium_hal_timers_next(microvium_hal_timers_t *timers, uint32_t timeout);
+
+/**
+ * Run the task-level events of the TIM device and the callbacks of the timers
+ * that are due. Timers set by the callbacks run at the earliest on the next
+ * call. A timer whose callback fails is cleared, and the remaining callbacks
+ * are left for the next call.
+ *
+ * @param timers the timers
+ * @param err receives the result of the `mvm_call` of the last callback run, or
+ * MVM_E_SUCCESS if none was run
+ * @return the number of callbacks run
+ */
+int microvium_hal_timers_run(microvium_hal_timers_t *timers, mvm_TeError *err);
+
+/**
+ * Get the statistics of the timers.
+ *
+ * @param timers the timers
+ * @param stats receives the statistics
+ */
+void microvium_hal_timers_get_stats(microvium_hal_timers_t *timers, microvium_hal_timers_stats_t *stats);
+
+/**
+ * Clear all timers and free them. Must be called before `mvm_free` of the VM.
+ *
+ * @param timers the timers
+ */
+void microvium_hal_timers_destroy(microvium_hal_timers_t *timers);
+
+mvm_TeError microvium_timers_set_timeout(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount);
+mvm_TeError microvium_timers_set_interval(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount);
+mvm_TeError microvium_timers_clear(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount);
+
+#endif /* MICROVIUM_HAL_TIMERS_H_ */
@@ -0,0 +1,16 @@
+/*
+ * @file microvium_hal_timers.js
+ * @brief Javascript timers microvium HAL glue API
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+export const setTimeout    = vmImport(65531);
+export const setInterval   = vmImport(65530);
+export const clearTimeout  = vmImport(65529);
+export const clearInterval = clearTimeout;
@@ -14,5 +14,6 @@
 #define MICROVIUM_HAL_CONFIGURE_H_
 
 #define MICROVIUM_HAL_WIFI  /**< enable WIFI module */
+//#define MICROVIUM_HAL_TIMERS  /**< enable timers module (needs the TIM module and a TIM device) */
 
 #endif /* MICROVIUM_HAL_CONFIGURE_H_ */
@@ -29,6 +29,17 @@ mvm_TeError microvium_hal_resolveImport(mvm_HostFunctionID hostFunctionID, void
             *out_hostFunction = &microvium_wifi_scan;
             break;
 #endif
+#ifdef MICROVIUM_HAL_TIMERS
+        case MICROVIUM_HAL_ID_TIMERS_SET_TIMEOUT:
+            *out_hostFunction = &microvium_timers_set_timeout;
+            break;
+        case MICROVIUM_HAL_ID_TIMERS_SET_INTERVAL:
+            *out_hostFunction = &microvium_timers_set_interval;
+            break;
+        case MICROVIUM_HAL_ID_TIMERS_CLEAR:
+            *out_hostFunction = &microvium_timers_clear;
+            break;
+#endif
 
         default:
             return MVM_E_FUNCTION_NOT_FOUND;
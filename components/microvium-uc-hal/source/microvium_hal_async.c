@@ -0,0 +1,246 @@
+/*
+ * @file microvium_hal_async.c
+ * @brief microvium async host functions
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdlib.h>
+
+#include "hal_os.h"
+#include "microvium_hal_async.h"
+
+// Semaphores and mutexes are taken with a timeout and retried, since the OS
+// port has no "wait forever" that works for every tick rate
+#define ASYNC_WAIT_MS 1000
+
+typedef enum async_call_state {
+    ASYNC_CALL_FREE,    /**< slot not in use */
+    ASYNC_CALL_QUEUED,  /**< waiting for an I/O task */
+    ASYNC_CALL_RUNNING, /**< an I/O task is running its `work` */
+    ASYNC_CALL_STARTED, /**< waiting for microvium_hal_async_complete */
+    ASYNC_CALL_DONE,    /**< waiting for microvium_hal_async_run */
+} async_call_state_t;
+
+typedef struct async_call {
+    mvm_VM *vm;
+    microvium_hal_async_work_t work;
+    microvium_hal_async_finish_t finish;
+    void *arg;
+    uint8_t state; /**< async_call_state_t */
+} async_call_t;
+
+// Ring of slot indexes
+typedef struct async_ring {
+    int *slots;
+    int head;
+    int count;
+} async_ring_t;
+
+struct microvium_hal_async {
+    int max_pending;
+    int io_tasks;
+    async_call_t *calls;
+    async_ring_t queued;   /**< calls waiting for an I/O task */
+    async_ring_t done;     /**< calls waiting for microvium_hal_async_run */
+    OSCntSem work_ready;   /**< number of calls in `queued` */
+    OSCntSem done_ready;   /**< number of calls in `done` */
+    OSCntSem exited;       /**< given by each I/O task as it stops */
+    OSMutex lock;          /**< protects the fields below */
+    int pending;
+    volatile bool stopping;
+};
+
+static void async_take(OSCntSem sem) {
+    while (OSCNTSEM_Take(sem, ASYNC_WAIT_MS) != 0)
+        ;
+}
+
+static void async_lock(OSMutex mutex) {
+    while (OSMUTEX_Take(mutex, ASYNC_WAIT_MS) != 0)
+        ;
+}
+
+// The caller holds the lock
+static void async_push(microvium_hal_async_t *async, async_ring_t *ring, int slot) {
+    ring->slots[(ring->head + ring->count) % async->max_pending] = slot;
+    ring->count++;
+}
+
+// The caller holds the lock and has taken the ring's semaphore
+static int async_pop(microvium_hal_async_t *async, async_ring_t *ring) {
+    int slot = ring->slots[ring->head];
+    ring->head = (ring->head + 1) % async->max_pending;
+    ring->count--;
+    return slot;
+}
+
+static void async_io_task(void *arg) {
+    microvium_hal_async_t *async = (microvium_hal_async_t*) arg;
+
+    while (1) {
+        async_take(async->work_ready);
+        if (async->stopping)
+            break;
+
+        async_lock(async->lock);
+        int slot = async_pop(async, &async->queued);
+        async_call_t *call = &async->calls[slot];
+        call->state = ASYNC_CALL_RUNNING;
+        OSMUTEX_Give(async->lock);
+
+        call->work(call->arg);
+
+        async_lock(async->lock);
+        call->state = ASYNC_CALL_DONE;
+        async_push(async, &async->done, slot);
+        OSMUTEX_Give(async->lock);
+        OSCNTSEM_Give(async->done_ready);
+    }
+
+    OSCNTSEM_Give(async->exited);
+    OSTASK_Destroy(NULL);
+}
+
+static void async_free(microvium_hal_async_t *async) {
+    if (async->work_ready != NULL)
+        OSCNTSEM_Destroy(async->work_ready);
+    if (async->done_ready != NULL)
+        OSCNTSEM_Destroy(async->done_ready);
+    if (async->exited != NULL)
+        OSCNTSEM_Destroy(async->exited);
+    if (async->lock != NULL)
+        OSMUTEX_Destroy(async->lock);
+    free(async->queued.slots);
+    free(async->done.slots);
+    free(async->calls);
+    free(async);
+}
+
+// Stop the first `started` I/O tasks
+static void async_stop(microvium_hal_async_t *async, int started) {
+    async->stopping = true;
+    for (int i = 0; i < started; i++)
+        OSCNTSEM_Give(async->work_ready);
+    for (int i = 0; i < started; i++)
+        async_take(async->exited);
+}
+
+microvium_hal_async_t* microvium_hal_async_create(int max_pending, int io_tasks, int priority, size_t stack_size) {
+    if (max_pending <= 0 || io_tasks <= 0)
+        return NULL;
+
+    microvium_hal_async_t *async = calloc(1, sizeof(*async));
+    if (async == NULL)
+        return NULL;
+
+    async->max_pending = max_pending;
+    async->io_tasks = io_tasks;
+    async->calls = calloc(max_pending, sizeof(*async->calls));
+    async->queued.slots = calloc(max_pending, sizeof(int));
+    async->done.slots = calloc(max_pending, sizeof(int));
+    // Stopping gives one more to each I/O task
+    async->work_ready = OSCNTSEM_Create(0, max_pending + io_tasks);
+    async->done_ready = OSCNTSEM_Create(0, max_pending);
+    async->exited = OSCNTSEM_Create(0, io_tasks);
+    async->lock = OSMUTEX_Create();
+    if (async->calls == NULL || async->queued.slots == NULL || async->done.slots == NULL || async->work_ready == NULL
+            || async->done_ready == NULL || async->exited == NULL || async->lock == NULL) {
+        async_free(async);
+        return NULL;
+    }
+
+    for (int i = 0; i < io_tasks; i++) {
+        if (OSTASK_Create(async_io_task, priority, stack_size, async) == NULL) {
+            async_stop(async, i);
+            async_free(async);
+            return NULL;
+        }
+    }
+
+    return async;
+}
+
+mvm_TeError microvium_hal_async_start(microvium_hal_async_t *async, mvm_VM *vm, microvium_hal_async_work_t work,
+        microvium_hal_async_finish_t finish, void *arg) {
+    async_lock(async->lock);
+    int slot = 0;
+    while (slot < async->max_pending && async->calls[slot].state != ASYNC_CALL_FREE)
+        slot++;
+    if (slot == async->max_pending) {
+        OSMUTEX_Give(async->lock);
+        return MVM_E_HOST_ERROR;
+    }
+
+    async_call_t *call = &async->calls[slot];
+    call->vm = vm;
+    call->work = work;
+    call->finish = finish;
+    call->arg = arg;
+    call->state = work != NULL ? ASYNC_CALL_QUEUED : ASYNC_CALL_STARTED;
+    if (work != NULL)
+        async_push(async, &async->queued, slot);
+    async->pending++;
+    OSMUTEX_Give(async->lock);
+
+    if (work != NULL)
+        OSCNTSEM_Give(async->work_ready);
+
+    return MVM_E_HOST_PENDING;
+}
+
+void microvium_hal_async_complete(microvium_hal_async_t *async, mvm_VM *vm) {
+    bool found = false;
+
+    async_lock(async->lock);
+    for (int slot = 0; slot < async->max_pending; slot++) {
+        async_call_t *call = &async->calls[slot];
+        if (call->vm == vm && call->state == ASYNC_CALL_STARTED) {
+            call->state = ASYNC_CALL_DONE;
+            async_push(async, &async->done, slot);
+            found = true;
+            break;
+        }
+    }
+    OSMUTEX_Give(async->lock);
+
+    if (found)
+        OSCNTSEM_Give(async->done_ready);
+}
+
+mvm_VM* microvium_hal_async_run(microvium_hal_async_t *async, uint32_t timeout, mvm_TeError *err, mvm_Value *result) {
+    if (OSCNTSEM_Take(async->done_ready, timeout) != 0)
+        return NULL;
+
+    async_lock(async->lock);
+    int slot = async_pop(async, &async->done);
+    async_call_t call = async->calls[slot];
+    async->calls[slot].state = ASYNC_CALL_FREE;
+    async->pending--;
+    OSMUTEX_Give(async->lock);
+
+    // Nothing can allocate between making the value and it being stored on the
+    // VM's stack, so it doesn't need a handle
+    mvm_Value value = call.finish != NULL ? call.finish(call.vm, call.arg) : mvm_undefined;
+    *err = mvm_completeHostCall(call.vm, value, result);
+
+    return call.vm;
+}
+
+int microvium_hal_async_pending(microvium_hal_async_t *async) {
+    async_lock(async->lock);
+    int pending = async->pending;
+    OSMUTEX_Give(async->lock);
+
+    return pending;
+}
+
+void microvium_hal_async_destroy(microvium_hal_async_t *async) {
+    async_stop(async, async->io_tasks);
+    async_free(async);
+}
@@ -0,0 +1,224 @@
+/*
+ * @file microvium_hal_events.c
+ * @brief microvium event queue
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "hal_os.h"
+#include "microvium_hal_events.h"
+
+/*
+ * The ring is a bounded queue where each cell has a sequence number, which
+ * tells the producers and the consumer whose turn it is to use the cell: it is
+ * `pos` when the cell is free for the producer that claims position `pos`, and
+ * `pos + 1` once that producer has written the event. Producers claim positions
+ * by advancing `tail` with compare-and-swap; only the consumer moves `head`.
+ * An event whose producer has claimed its position but not yet written it holds
+ * up the consumer (the events are delivered in order), but never the other
+ * producers.
+ */
+typedef struct events_cell {
+    atomic_uint seq;
+    uint16_t type;
+    int32_t value;
+    uint32_t posted_us;
+} events_cell_t;
+
+struct microvium_hal_events {
+    events_cell_t *cells;
+    uint32_t mask;
+    atomic_uint tail;      /**< next position to post to */
+    uint32_t head;         /**< next position to dispatch (consumer only) */
+    atomic_uint posted;
+    atomic_uint dropped;
+    atomic_bool wake;      /**< set by the first producer since the consumer last looked */
+    OSSem ready;           /**< given when `wake` is set */
+    microvium_hal_events_stats_t stats; /**< consumer side statistics */
+};
+
+static inline uint32_t events_now_us(void) {
+    return (uint32_t) OS_GetTimeUs();
+}
+
+typedef enum events_push_result {
+    EVENTS_DROPPED,
+    EVENTS_QUEUED,
+    EVENTS_QUEUED_WAKE, /**< queued, and the consumer needs waking */
+} events_push_result_t;
+
+static events_push_result_t events_push(microvium_hal_events_t *events, uint16_t type, int32_t value) {
+    atomic_fetch_add_explicit(&events->posted, 1, memory_order_relaxed);
+
+    uint32_t pos = atomic_load_explicit(&events->tail, memory_order_relaxed);
+    events_cell_t *cell;
+    while (1) {
+        cell = &events->cells[pos & events->mask];
+        uint32_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int32_t diff = (int32_t) (seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&events->tail, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // The cell still holds the event from one lap ago
+            atomic_fetch_add_explicit(&events->dropped, 1, memory_order_relaxed);
+            return EVENTS_DROPPED;
+        } else {
+            pos = atomic_load_explicit(&events->tail, memory_order_relaxed);
+        }
+    }
+
+    cell->type = type;
+    cell->value = value;
+    cell->posted_us = events_now_us();
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    if (atomic_exchange_explicit(&events->wake, true, memory_order_acq_rel))
+        return EVENTS_QUEUED;
+    return EVENTS_QUEUED_WAKE;
+}
+
+static bool events_empty(microvium_hal_events_t *events) {
+    events_cell_t *cell = &events->cells[events->head & events->mask];
+    return atomic_load_explicit(&cell->seq, memory_order_acquire) != events->head + 1;
+}
+
+static uint8_t events_latency_bucket(uint32_t us) {
+    uint8_t bucket = 0;
+    while (us > 1 && bucket < MICROVIUM_HAL_EVENTS_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+microvium_hal_events_t* microvium_hal_events_create(uint32_t capacity) {
+    if (capacity < 2)
+        capacity = 2;
+    uint32_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    microvium_hal_events_t *events = calloc(1, sizeof(*events));
+    if (events == NULL)
+        return NULL;
+
+    events->cells = calloc(size, sizeof(*events->cells));
+    events->ready = OSSEM_Create();
+    if (events->cells == NULL || events->ready == NULL) {
+        if (events->ready != NULL)
+            OSSEM_Destroy(events->ready);
+        free(events->cells);
+        free(events);
+        return NULL;
+    }
+
+    events->mask = size - 1;
+    for (uint32_t i = 0; i < size; i++)
+        atomic_init(&events->cells[i].seq, i);
+    atomic_init(&events->tail, 0);
+    atomic_init(&events->posted, 0);
+    atomic_init(&events->dropped, 0);
+    atomic_init(&events->wake, false);
+
+    return events;
+}
+
+bool microvium_hal_events_post(microvium_hal_events_t *events, uint16_t type, int32_t value) {
+    events_push_result_t result = events_push(events, type, value);
+    if (result == EVENTS_QUEUED_WAKE)
+        OSSEM_Give(events->ready);
+    return result != EVENTS_DROPPED;
+}
+
+bool microvium_hal_events_post_from_isr(microvium_hal_events_t *events, uint16_t type, int32_t value) {
+    events_push_result_t result = events_push(events, type, value);
+    if (result == EVENTS_QUEUED_WAKE)
+        OSSEM_GiveFromISR(events->ready);
+    return result != EVENTS_DROPPED;
+}
+
+bool microvium_hal_events_wait(microvium_hal_events_t *events, uint32_t timeout) {
+    // Clearing `wake` before looking means that a producer that posts after we
+    // look will give the semaphore
+    atomic_store_explicit(&events->wake, false, memory_order_seq_cst);
+    if (!events_empty(events))
+        return true;
+
+    OSSEM_Take(events->ready, timeout);
+    return !events_empty(events);
+}
+
+int microvium_hal_events_dispatch(microvium_hal_events_t *events, mvm_VM *vm, mvm_Handle *handler, int max_batch,
+        mvm_TeError *err) {
+    int32_t batch[MICROVIUM_HAL_EVENTS_MAX_BATCH * 2];
+    int count = 0;
+
+    if (max_batch <= 0 || max_batch > MICROVIUM_HAL_EVENTS_MAX_BATCH)
+        max_batch = MICROVIUM_HAL_EVENTS_MAX_BATCH;
+
+    *err = MVM_E_SUCCESS;
+    // The cells are read without freeing them, so that if the events can't be
+    // passed to the VM they stay queued
+    while (count < max_batch) {
+        uint32_t pos = events->head + count;
+        events_cell_t *cell = &events->cells[pos & events->mask];
+        if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1)
+            break;
+        batch[count * 2] = cell->type;
+        batch[count * 2 + 1] = cell->value;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+
+    // Nothing can allocate between creating the array and the call pushing it
+    // to the VM's stack, so it doesn't need a handle. Creating it can collect
+    // garbage, which moves the handler, so the handler is only read after.
+    mvm_Value arg = mvm_typedArrayFromElements(vm, MVM_TA_INT32, batch, count * 2);
+    if (mvm_typeOf(vm, arg) != VM_T_TYPED_ARRAY) {
+        *err = MVM_E_OUT_OF_MEMORY;
+        return 0;
+    }
+
+    uint32_t now = events_now_us();
+    for (int i = 0; i < count; i++) {
+        events_cell_t *cell = &events->cells[events->head & events->mask];
+        // Events posted since `now` count as no wait
+        int32_t latency = (int32_t) (now - cell->posted_us);
+        events->stats.latency[events_latency_bucket(latency > 0 ? (uint32_t) latency : 0)]++;
+        // Free the cell for the producer one lap ahead
+        atomic_store_explicit(&cell->seq, events->head + events->mask + 1, memory_order_release);
+        events->head++;
+    }
+    events->stats.dispatched += count;
+    events->stats.batches++;
+    if ((uint32_t) count > events->stats.max_batch)
+        events->stats.max_batch = count;
+
+    mvm_Value result;
+    *err = mvm_call(vm, mvm_handleGet(handler), &result, &arg, 1);
+
+    return count;
+}
+
+void microvium_hal_events_get_stats(microvium_hal_events_t *events, microvium_hal_events_stats_t *stats) {
+    *stats = events->stats;
+    stats->posted = atomic_load_explicit(&events->posted, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&events->dropped, memory_order_relaxed);
+}
+
+void microvium_hal_events_destroy(microvium_hal_events_t *events) {
+    OSSEM_Destroy(events->ready);
+    free(events->cells);
+    free(events);
+}
@@ -0,0 +1,97 @@
+/*
+ * @file microvium_hal_image.c
+ * @brief microvium bytecode image loader
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "microvium_hal_image.h"
+
+// Offsets in the bytecode header (mvm_TsBytecodeHeader)
+#define HEADER_BYTECODE_VERSION 0
+#define HEADER_BYTECODE_SIZE    4
+#define HEADER_MIN_SIZE         8
+
+bool microvium_hal_image_map_hibernated(microvium_hal_image_t *image, const char *label) {
+    size_t partitionSize;
+
+    memset(image, 0, sizeof(*image));
+    const void *p = fs_map(label, &partitionSize, &image->map);
+    if (p == NULL)
+        return false;
+
+    image->bytecode = MVM_LONG_PTR_NEW((void*) p);
+    image->size = partitionSize;
+    image->mapped = true;
+    return true;
+}
+
+bool microvium_hal_image_map(microvium_hal_image_t *image, const char *label) {
+    if (!microvium_hal_image_map_hibernated(image, label))
+        return false;
+
+    // The partition is larger than the bytecode, and mvm_restore needs the
+    // exact size, so take it from the header. Erased flash reads as 0xFF.
+    const uint8_t *p = (const uint8_t*) MVM_LONG_PTR_TRUNCATE(image->bytecode);
+    size_t size = (size_t) p[HEADER_BYTECODE_SIZE] | ((size_t) p[HEADER_BYTECODE_SIZE + 1] << 8);
+    if (p[HEADER_BYTECODE_VERSION] == 0xFF || size < HEADER_MIN_SIZE || size > image->size) {
+        microvium_hal_image_release(image);
+        return false;
+    }
+
+    image->size = size;
+    return true;
+}
+
+bool microvium_hal_image_hibernate(mvm_VM *vm, uint32_t buildId, const char *label) {
+    size_t size;
+    void *data = mvm_hibernate(vm, buildId, &size);
+    if (data == NULL)
+        return false;
+
+    bool ok = fs_write_partition(label, data, size) == 0;
+    free(data);
+    return ok;
+}
+
+bool microvium_hal_image_read(microvium_hal_image_t *image, const char *file) {
+    memset(image, 0, sizeof(*image));
+    FILE *f = fs_open(file, "rb");
+    if (f == NULL)
+        return false;
+
+    fseek(f, 0L, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data == NULL || fread(data, 1, size, f) != (size_t) size) {
+        free(data);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    image->bytecode = MVM_LONG_PTR_NEW(data);
+    image->size = size;
+    return true;
+}
+
+void microvium_hal_image_release(microvium_hal_image_t *image) {
+    if (image->mapped)
+        fs_unmap(image->map);
+    else
+        free(MVM_LONG_PTR_TRUNCATE(image->bytecode));
+
+    memset(image, 0, sizeof(*image));
+}
@@ -0,0 +1,340 @@
+/*
+ * @file microvium_hal_pool.c
+ * @brief microvium VM pool
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hal_os.h"
+#include "microvium_hal_pool.h"
+
+// Semaphores and mutexes are taken with a timeout and retried, since the OS
+// port has no "wait forever" that works for every tick rate
+#define POOL_WAIT_MS 1000
+
+typedef enum pool_vm_state {
+    POOL_VM_IDLE,    /**< no jobs waiting */
+    POOL_VM_QUEUED,  /**< in the ready queue of a worker */
+    POOL_VM_RUNNING, /**< a worker is running one of its jobs */
+} pool_vm_state_t;
+
+typedef struct pool_job {
+    microvium_hal_pool_job_t job;
+    void *arg;
+    uint64_t posted_us;
+} pool_job_t;
+
+typedef struct pool_vm {
+    mvm_VM *vm;
+    OSMutex lock;                                  /**< protects the fields below */
+    pool_job_t jobs[MICROVIUM_HAL_POOL_QUEUE_SIZE]; /**< run queue (ring) */
+    uint8_t head;
+    uint8_t count;
+    uint8_t state;                                 /**< pool_vm_state_t */
+    int worker;                                    /**< worker that the VM is queued on or last ran on */
+    microvium_hal_pool_stats_t stats;
+} pool_vm_t;
+
+typedef struct pool_worker {
+    microvium_hal_pool_t *pool;
+    int index;
+    OSMutex lock; /**< protects the ready queue */
+    int *ready;   /**< IDs of the VMs waiting to run (ring of max_vms) */
+    int head;
+    int count;
+} pool_worker_t;
+
+struct microvium_hal_pool {
+    int worker_count;
+    int max_vms;
+    pool_worker_t *workers;
+    pool_vm_t *vms;
+    OSCntSem ready;        /**< number of VMs in the ready queues of all the workers */
+    OSCntSem exited;       /**< given by each worker as it stops */
+    OSSem idle;            /**< given when the last pending job is done */
+    OSMutex lock;          /**< protects the fields below */
+    int vm_count;
+    uint32_t pending;      /**< jobs posted and not yet done */
+    volatile bool stopping;
+};
+
+static void pool_take(OSCntSem sem) {
+    while (OSCNTSEM_Take(sem, POOL_WAIT_MS) != 0)
+        ;
+}
+
+static void pool_lock(OSMutex mutex) {
+    while (OSMUTEX_Take(mutex, POOL_WAIT_MS) != 0)
+        ;
+}
+
+// Queue a VM on a worker. The caller holds the VM lock.
+static void pool_enqueue(microvium_hal_pool_t *pool, int worker, int id) {
+    pool_worker_t *w = &pool->workers[worker];
+
+    pool_lock(w->lock);
+    w->ready[(w->head + w->count) % pool->max_vms] = id;
+    w->count++;
+    OSMUTEX_Give(w->lock);
+
+    OSCNTSEM_Give(pool->ready);
+}
+
+// Take the next VM from the worker's own queue, or failing that from another
+// worker's queue. The caller has taken `pool->ready`, so there is a VM queued
+// somewhere.
+static int pool_dequeue(microvium_hal_pool_t *pool, int worker, bool *stolen) {
+    while (1) {
+        for (int i = 0; i < pool->worker_count; i++) {
+            pool_worker_t *w = &pool->workers[(worker + i) % pool->worker_count];
+            int id = -1;
+
+            pool_lock(w->lock);
+            if (w->count > 0) {
+                id = w->ready[w->head];
+                w->head = (w->head + 1) % pool->max_vms;
+                w->count--;
+            }
+            OSMUTEX_Give(w->lock);
+
+            if (id >= 0) {
+                *stolen = i != 0;
+                return id;
+            }
+        }
+
+        // The VM is being queued by another task
+        OSTASK_Yield();
+    }
+}
+
+static void pool_job_done(microvium_hal_pool_t *pool) {
+    pool_lock(pool->lock);
+    bool idle = --pool->pending == 0;
+    OSMUTEX_Give(pool->lock);
+
+    if (idle)
+        OSSEM_Give(pool->idle);
+}
+
+static void pool_worker_task(void *arg) {
+    pool_worker_t *self = (pool_worker_t*) arg;
+    microvium_hal_pool_t *pool = self->pool;
+
+    while (1) {
+        pool_take(pool->ready);
+        if (pool->stopping)
+            break;
+
+        bool stolen;
+        int id = pool_dequeue(pool, self->index, &stolen);
+        pool_vm_t *v = &pool->vms[id];
+
+        pool_lock(v->lock);
+        pool_job_t job = v->jobs[v->head];
+        v->head = (v->head + 1) % MICROVIUM_HAL_POOL_QUEUE_SIZE;
+        v->count--;
+        v->state = POOL_VM_RUNNING;
+        v->worker = self->index;
+        OSMUTEX_Give(v->lock);
+
+        uint64_t start = OS_GetTimeUs();
+        job.job(v->vm, job.arg);
+        uint64_t end = OS_GetTimeUs();
+
+        pool_lock(v->lock);
+        v->stats.cpu_us += end - start;
+        v->stats.jobs++;
+        if (stolen)
+            v->stats.steals++;
+        if (start - job.posted_us > v->stats.max_wait_us)
+            v->stats.max_wait_us = (uint32_t) (start - job.posted_us);
+
+        // To the back of the queue, so that the other VMs on this worker get
+        // a turn first
+        if (v->count > 0) {
+            v->state = POOL_VM_QUEUED;
+            pool_enqueue(pool, self->index, id);
+        } else {
+            v->state = POOL_VM_IDLE;
+        }
+        OSMUTEX_Give(v->lock);
+
+        pool_job_done(pool);
+    }
+
+    OSCNTSEM_Give(pool->exited);
+    OSTASK_Destroy(NULL);
+}
+
+static void pool_free(microvium_hal_pool_t *pool) {
+    if (pool->workers != NULL) {
+        for (int i = 0; i < pool->worker_count; i++) {
+            if (pool->workers[i].lock != NULL)
+                OSMUTEX_Destroy(pool->workers[i].lock);
+            free(pool->workers[i].ready);
+        }
+    }
+    if (pool->vms != NULL) {
+        for (int i = 0; i < pool->vm_count; i++)
+            OSMUTEX_Destroy(pool->vms[i].lock);
+    }
+    if (pool->ready != NULL)
+        OSCNTSEM_Destroy(pool->ready);
+    if (pool->exited != NULL)
+        OSCNTSEM_Destroy(pool->exited);
+    if (pool->idle != NULL)
+        OSSEM_Destroy(pool->idle);
+    if (pool->lock != NULL)
+        OSMUTEX_Destroy(pool->lock);
+    free(pool->workers);
+    free(pool->vms);
+    free(pool);
+}
+
+// Stop the first `started` workers
+static void pool_stop(microvium_hal_pool_t *pool, int started) {
+    pool->stopping = true;
+    for (int i = 0; i < started; i++)
+        OSCNTSEM_Give(pool->ready);
+    for (int i = 0; i < started; i++)
+        pool_take(pool->exited);
+}
+
+microvium_hal_pool_t* microvium_hal_pool_create(int workers, int max_vms, int priority, size_t stack_size) {
+    if (workers <= 0)
+        workers = OS_CORE_COUNT;
+    if (max_vms <= 0)
+        return NULL;
+
+    microvium_hal_pool_t *pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->worker_count = workers;
+    pool->max_vms = max_vms;
+    pool->workers = calloc(workers, sizeof(*pool->workers));
+    pool->vms = calloc(max_vms, sizeof(*pool->vms));
+    // Each VM is queued on at most one worker, and stopping gives one more to
+    // each worker
+    pool->ready = OSCNTSEM_Create(0, max_vms + workers);
+    pool->exited = OSCNTSEM_Create(0, workers);
+    pool->idle = OSSEM_Create();
+    pool->lock = OSMUTEX_Create();
+    if (pool->workers == NULL || pool->vms == NULL || pool->ready == NULL || pool->exited == NULL || pool->idle == NULL
+            || pool->lock == NULL) {
+        pool_free(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        pool_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->index = i;
+        w->lock = OSMUTEX_Create();
+        w->ready = calloc(max_vms, sizeof(int));
+        if (w->lock == NULL || w->ready == NULL) {
+            pool_free(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (OSTASK_CreatePinned(pool_worker_task, priority, stack_size, &pool->workers[i], i % OS_CORE_COUNT) == NULL) {
+            pool_stop(pool, i);
+            pool_free(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+int microvium_hal_pool_add(microvium_hal_pool_t *pool, mvm_VM *vm, int home_worker) {
+    OSMutex lock = OSMUTEX_Create();
+    if (lock == NULL)
+        return -1;
+
+    pool_lock(pool->lock);
+    int id = pool->vm_count;
+    if (id < pool->max_vms) {
+        pool_vm_t *v = &pool->vms[id];
+        memset(v, 0, sizeof(*v));
+        v->vm = vm;
+        v->lock = lock;
+        v->state = POOL_VM_IDLE;
+        v->worker = home_worker % pool->worker_count;
+        pool->vm_count++;
+    } else {
+        id = -1;
+    }
+    OSMUTEX_Give(pool->lock);
+
+    if (id < 0)
+        OSMUTEX_Destroy(lock);
+    return id;
+}
+
+bool microvium_hal_pool_post(microvium_hal_pool_t *pool, int id, microvium_hal_pool_job_t job, void *arg) {
+    pool_vm_t *v = &pool->vms[id];
+
+    pool_lock(v->lock);
+    if (v->count == MICROVIUM_HAL_POOL_QUEUE_SIZE) {
+        OSMUTEX_Give(v->lock);
+        return false;
+    }
+
+    pool_lock(pool->lock);
+    pool->pending++;
+    OSMUTEX_Give(pool->lock);
+
+    pool_job_t *j = &v->jobs[(v->head + v->count) % MICROVIUM_HAL_POOL_QUEUE_SIZE];
+    j->job = job;
+    j->arg = arg;
+    j->posted_us = OS_GetTimeUs();
+    v->count++;
+
+    // A running VM is queued again by its worker when the job is done
+    if (v->state == POOL_VM_IDLE) {
+        v->state = POOL_VM_QUEUED;
+        pool_enqueue(pool, v->worker, id);
+    }
+    OSMUTEX_Give(v->lock);
+
+    return true;
+}
+
+void microvium_hal_pool_wait_idle(microvium_hal_pool_t *pool) {
+    while (1) {
+        pool_lock(pool->lock);
+        uint32_t pending = pool->pending;
+        OSMUTEX_Give(pool->lock);
+        if (pending == 0)
+            return;
+
+        // May have been given for an earlier idle moment, hence the loop
+        OSSEM_Take(pool->idle, POOL_WAIT_MS);
+    }
+}
+
+void microvium_hal_pool_get_stats(microvium_hal_pool_t *pool, int id, microvium_hal_pool_stats_t *stats) {
+    pool_vm_t *v = &pool->vms[id];
+
+    pool_lock(v->lock);
+    *stats = v->stats;
+    OSMUTEX_Give(v->lock);
+}
+
+void microvium_hal_pool_destroy(microvium_hal_pool_t *pool) {
+    microvium_hal_pool_wait_idle(pool);
+    pool_stop(pool, pool->worker_count);
+    pool_free(pool);
+}
@@ -0,0 +1,402 @@
+/*
+ * @file microvium_hal_timers.c
+ * @brief microvium HAL timers module
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "microvium_hal_configure.h"
+
+#ifdef MICROVIUM_HAL_TIMERS
+
+#include "hal_core.h"
+#include "microvium_hal_timers.h"
+
+typedef enum timers_state {
+    TIMER_FREE,
+    TIMER_ACTIVE,
+    TIMER_FIRING,  /**< its callback is running */
+    TIMER_CLEARED, /**< cleared by its own callback */
+} timers_state_t;
+
+typedef struct timers_timer {
+    mvm_Handle callback;
+    uint64_t due;      /**< in TIM ticks */
+    uint64_t interval; /**< in TIM ticks, 0 for a timeout */
+    int32_t id;
+    int wake;          /**< index of the wake that runs it, or -1 */
+    uint8_t state;     /**< timers_state_t */
+} timers_timer_t;
+
+/*
+ * A timer picked to run by microvium_hal_timers_run. The ID tells whether the
+ * slot still holds the same timer when its turn comes, since an earlier
+ * callback can clear it and set another timer that takes its slot.
+ */
+typedef struct timers_firing {
+    int index;
+    int32_t id;
+} timers_firing_t;
+
+/*
+ * A wake is a TIM event scheduled for the end of the window of a timer. The
+ * timers that are due before it and whose window includes it share it.
+ */
+typedef struct timers_wake {
+    TIM_EventID event;
+    uint64_t at;       /**< in TIM ticks */
+    int timers;        /**< number of timers that it runs */
+    bool scheduled;    /**< in the TIM device's queue */
+} timers_wake_t;
+
+struct microvium_hal_timers {
+    mvm_VM *vm;
+    TIMDevice tim;
+    uint64_t counter_range; /**< CounterRange + 1 */
+    uint64_t slack;         /**< in TIM ticks */
+    int max_timers;
+    timers_timer_t *timers;
+    timers_wake_t *wakes;   /**< `max_timers` of them */
+    timers_firing_t *firing; /**< timers being run by microvium_hal_timers_run */
+    int32_t next_id;
+    microvium_hal_timers_stats_t stats;
+    struct microvium_hal_timers *next;
+};
+
+// Timers of all VMs, for the host functions and TIM event handlers to find
+static microvium_hal_timers_t *timers_list = NULL;
+
+static microvium_hal_timers_t* timers_find(mvm_VM *vm) {
+    microvium_hal_timers_t *timers;
+
+    CORE_EnterCritical();
+    for (timers = timers_list; timers != NULL && timers->vm != vm; timers = timers->next)
+        ;
+    CORE_ExitCritical();
+
+    return timers;
+}
+
+static uint64_t timers_now(microvium_hal_timers_t *timers) {
+    TIM_Time time = TIM_GetTimeElapsed(timers->tim);
+    return time.counter_periods * timers->counter_range + time.counter_ticks;
+}
+
+static TIM_Time timers_tim_time(microvium_hal_timers_t *timers, uint64_t ticks) {
+    TIM_Time time = { (uint32_t) (ticks / timers->counter_range), (uint32_t) (ticks % timers->counter_range) };
+    return time;
+}
+
+static uint64_t timers_ms_to_ticks(microvium_hal_timers_t *timers, uint32_t ms) {
+    return (uint64_t) ms * 1000000u / timers->tim->TickTimeBase;
+}
+
+// Rounded up, so that sleeping that long gets past the time
+static uint64_t timers_ticks_to_us(microvium_hal_timers_t *timers, uint64_t ticks) {
+    return (ticks * timers->tim->TickTimeBase + 999) / 1000;
+}
+
+static void timers_event(TIMDevice tim, TIM_EventID event_id, TIM_Time expire_time) {
+    // Only marks the wake: the callbacks are run by microvium_hal_timers_run
+    // once TIM_TaskEventProc returns
+    CORE_EnterCritical();
+    for (microvium_hal_timers_t *timers = timers_list; timers != NULL; timers = timers->next) {
+        if (timers->tim != tim)
+            continue;
+        for (int i = 0; i < timers->max_timers; i++) {
+            if (timers->wakes[i].event.id == event_id.id)
+                timers->wakes[i].scheduled = false;
+        }
+    }
+    CORE_ExitCritical();
+}
+
+// Remove a wake that no timer needs from the TIM device's queue
+static void timers_cancel_wake(microvium_hal_timers_t *timers, timers_wake_t *wake) {
+    if (!wake->scheduled)
+        return;
+
+    TIM_DeinitEvent(timers->tim, wake->event);
+    wake->event = TIM_InitEvent(timers->tim, timers_event, TIM_EVENT_TYPE_TASK);
+    wake->scheduled = false;
+}
+
+static void timers_detach(microvium_hal_timers_t *timers, timers_timer_t *timer) {
+    if (timer->wake < 0)
+        return;
+
+    timers_wake_t *wake = &timers->wakes[timer->wake];
+    timer->wake = -1;
+    if (--wake->timers == 0)
+        timers_cancel_wake(timers, wake);
+}
+
+// Give the timer a wake within its window: one already scheduled if there is
+// one, or else a new one at the end of the window
+static void timers_attach(microvium_hal_timers_t *timers, timers_timer_t *timer) {
+    uint64_t latest = timer->due + timers->slack;
+    timers_wake_t *free_wake = NULL;
+
+    for (int i = 0; i < timers->max_timers; i++) {
+        timers_wake_t *wake = &timers->wakes[i];
+        if (wake->scheduled && wake->at >= timer->due && wake->at <= latest) {
+            timer->wake = i;
+            wake->timers++;
+            timers->stats.coalesced++;
+            return;
+        }
+        if (!wake->scheduled && wake->timers == 0 && wake->event.id != TIM_NO_EVENT && free_wake == NULL)
+            free_wake = wake;
+    }
+
+    // There is a wake for each timer, so one is free unless its TIM event was
+    // lost in timers_cancel_wake; then the timer runs on other wakes only
+    if (free_wake == NULL)
+        return;
+
+    free_wake->at = latest;
+    if (TIM_ScheduleEventAt(timers->tim, free_wake->event, timers_tim_time(timers, latest)) != 0)
+        return;
+    free_wake->scheduled = true;
+    free_wake->timers = 1;
+    timer->wake = free_wake - timers->wakes;
+    timers->stats.wakes++;
+}
+
+static void timers_release(microvium_hal_timers_t *timers, timers_timer_t *timer) {
+    timers_detach(timers, timer);
+    mvm_releaseHandle(timers->vm, &timer->callback);
+    timer->state = TIMER_FREE;
+}
+
+static mvm_TeError timers_set(mvm_VM *vm, mvm_Value *result, mvm_Value *args, uint8_t argCount, bool repeat) {
+    microvium_hal_timers_t *timers = timers_find(vm);
+    if (timers == NULL)
+        return MVM_E_HOST_ERROR;
+    if (argCount < 1 || mvm_typeOf(vm, args[0]) != VM_T_FUNCTION)
+        return MVM_E_TYPE_ERROR;
+
+    int32_t delay = argCount > 1 ? mvm_toInt32(vm, args[1]) : 0;
+    if (delay < 0)
+        delay = 0;
+
+    timers_timer_t *timer = NULL;
+    for (int i = 0; i < timers->max_timers && timer == NULL; i++) {
+        if (timers->timers[i].state == TIMER_FREE)
+            timer = &timers->timers[i];
+    }
+    if (timer == NULL)
+        return MVM_E_HOST_ERROR;
+
+    mvm_initializeHandle(vm, &timer->callback);
+    mvm_handleSet(&timer->callback, args[0]);
+    timer->due = timers_now(timers) + timers_ms_to_ticks(timers, delay);
+    // An interval of 0 would run on every microvium_hal_timers_run
+    timer->interval = repeat ? timers_ms_to_ticks(timers, delay > 0 ? delay : 1) : 0;
+    if (repeat && timer->interval == 0)
+        timer->interval = 1;
+    timer->id = timers->next_id;
+    timer->wake = -1;
+    timer->state = TIMER_ACTIVE;
+    timers->next_id = timers->next_id == INT32_MAX ? 1 : timers->next_id + 1;
+    timers->stats.set++;
+    timers_attach(timers, timer);
+
+    *result = mvm_newInt32(vm, timer->id);
+    return MVM_E_SUCCESS;
+}
+
+mvm_TeError microvium_timers_set_timeout(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return timers_set(vm, result, args, argCount, false);
+}
+
+mvm_TeError microvium_timers_set_interval(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return timers_set(vm, result, args, argCount, true);
+}
+
+mvm_TeError microvium_timers_clear(mvm_VM *vm, mvm_HostFunctionID hostFunctionID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    microvium_hal_timers_t *timers = timers_find(vm);
+    if (timers == NULL)
+        return MVM_E_HOST_ERROR;
+    // Like in a browser, clearing a timer that isn't set does nothing
+    if (argCount < 1 || mvm_typeOf(vm, args[0]) != VM_T_NUMBER)
+        return MVM_E_SUCCESS;
+
+    int32_t id = mvm_toInt32(vm, args[0]);
+    for (int i = 0; i < timers->max_timers; i++) {
+        timers_timer_t *timer = &timers->timers[i];
+        if (timer->id != id)
+            continue;
+        if (timer->state == TIMER_ACTIVE)
+            timers_release(timers, timer);
+        else if (timer->state == TIMER_FIRING)
+            timer->state = TIMER_CLEARED;
+        break;
+    }
+
+    return MVM_E_SUCCESS;
+}
+
+microvium_hal_timers_t* microvium_hal_timers_create(mvm_VM *vm, TIMDevice tim, int max_timers, uint32_t slack_ms) {
+    TIM_Capabilities caps;
+
+    if (max_timers <= 0)
+        return NULL;
+
+    microvium_hal_timers_t *timers = calloc(1, sizeof(*timers));
+    if (timers == NULL)
+        return NULL;
+
+    timers->vm = vm;
+    timers->tim = tim;
+    timers->max_timers = max_timers;
+    timers->next_id = 1;
+    TIM_GetCapabilities(tim, &caps);
+    timers->counter_range = (uint64_t) caps.CounterRange + 1;
+    timers->slack = timers_ms_to_ticks(timers, slack_ms);
+    timers->timers = calloc(max_timers, sizeof(*timers->timers));
+    timers->wakes = calloc(max_timers, sizeof(*timers->wakes));
+    timers->firing = calloc(max_timers, sizeof(*timers->firing));
+    if (timers->timers == NULL || timers->wakes == NULL || timers->firing == NULL) {
+        microvium_hal_timers_destroy(timers);
+        return NULL;
+    }
+
+    for (int i = 0; i < max_timers; i++)
+        timers->wakes[i].event.id = TIM_NO_EVENT;
+    for (int i = 0; i < max_timers; i++) {
+        timers->wakes[i].event = TIM_InitEvent(tim, timers_event, TIM_EVENT_TYPE_TASK);
+        if (timers->wakes[i].event.id == TIM_NO_EVENT) {
+            microvium_hal_timers_destroy(timers);
+            return NULL;
+        }
+    }
+
+    CORE_EnterCritical();
+    timers->next = timers_list;
+    timers_list = timers;
+    CORE_ExitCritical();
+
+    return timers;
+}
+
+uint32_t microvium_hal_timers_next(microvium_hal_timers_t *timers, uint32_t timeout) {
+    uint64_t now = timers_now(timers);
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < timers->max_timers; i++) {
+        timers_timer_t *timer = &timers->timers[i];
+        if (timer->state != TIMER_ACTIVE)
+            continue;
+        // A timer without a wake runs when it is due
+        uint64_t at = timer->wake >= 0 ? timers->wakes[timer->wake].at : timer->due;
+        if (at < next)
+            next = at;
+    }
+
+    if (next == UINT64_MAX)
+        return timeout;
+    if (next <= now)
+        return 0;
+
+    uint64_t ms = (timers_ticks_to_us(timers, next - now) + 999) / 1000;
+    return ms < timeout ? (uint32_t) ms : timeout;
+}
+
+int microvium_hal_timers_run(microvium_hal_timers_t *timers, mvm_TeError *err) {
+    int count = 0;
+    int ran = 0;
+
+    *err = MVM_E_SUCCESS;
+    TIM_TaskEventProc(timers->tim);
+
+    // The timers that are due, in the order they are due. Any that is due runs,
+    // not only those whose wake has come, so that a wake for some timers (or
+    // for other work) saves the wake for the others.
+    uint64_t now = timers_now(timers);
+    for (int i = 0; i < timers->max_timers; i++) {
+        timers_timer_t *timer = &timers->timers[i];
+        if (timer->state != TIMER_ACTIVE || timer->due > now)
+            continue;
+        int j = count++;
+        while (j > 0 && timers->timers[timers->firing[j - 1].index].due > timer->due) {
+            timers->firing[j] = timers->firing[j - 1];
+            j--;
+        }
+        timers->firing[j].index = i;
+        timers->firing[j].id = timer->id;
+    }
+
+    for (int i = 0; i < count && *err == MVM_E_SUCCESS; i++) {
+        timers_timer_t *timer = &timers->timers[timers->firing[i].index];
+        mvm_Value result;
+
+        // Cleared by an earlier callback, and maybe replaced by a timer that
+        // it set, which isn't due yet as far as this run is concerned
+        if (timer->state != TIMER_ACTIVE || timer->id != timers->firing[i].id)
+            continue;
+
+        uint64_t late_us = timers_ticks_to_us(timers, now - timer->due);
+        if (late_us > timers->stats.late_max_us)
+            timers->stats.late_max_us = late_us > UINT32_MAX ? UINT32_MAX : (uint32_t) late_us;
+
+        timers_detach(timers, timer);
+        timer->state = TIMER_FIRING;
+        *err = mvm_call(timers->vm, mvm_handleGet(&timer->callback), &result, NULL, 0);
+        timers->stats.callbacks++;
+        ran++;
+
+        if (timer->interval != 0 && timer->state == TIMER_FIRING && *err == MVM_E_SUCCESS) {
+            // Keep to the original schedule, unless it fell a whole interval
+            // behind
+            timer->due += timer->interval;
+            if (timer->due <= now)
+                timer->due = now + timer->interval;
+            timer->state = TIMER_ACTIVE;
+            timers_attach(timers, timer);
+        } else {
+            timers_release(timers, timer);
+        }
+    }
+
+    return ran;
+}
+
+void microvium_hal_timers_get_stats(microvium_hal_timers_t *timers, microvium_hal_timers_stats_t *stats) {
+    *stats = timers->stats;
+}
+
+void microvium_hal_timers_destroy(microvium_hal_timers_t *timers) {
+    CORE_EnterCritical();
+    for (microvium_hal_timers_t **link = &timers_list; *link != NULL; link = &(*link)->next) {
+        if (*link == timers) {
+            *link = timers->next;
+            break;
+        }
+    }
+    CORE_ExitCritical();
+
+    for (int i = 0; timers->timers != NULL && i < timers->max_timers; i++) {
+        if (timers->timers[i].state != TIMER_FREE)
+            mvm_releaseHandle(timers->vm, &timers->timers[i].callback);
+    }
+    for (int i = 0; timers->wakes != NULL && i < timers->max_timers; i++) {
+        if (timers->wakes[i].event.id != TIM_NO_EVENT)
+            TIM_DeinitEvent(timers->tim, timers->wakes[i].event);
+    }
+
+    free(timers->firing);
+    free(timers->wakes);
+    free(timers->timers);
+    free(timers);
+}
+
+#endif // MICROVIUM_HAL_TIMERS
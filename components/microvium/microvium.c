@@ -205,6 +205,24 @@ typedef struct mvm_TsBytecodeHeader {
   uint16_t sectionOffsets[BCS_SECTION_COUNT];
 } mvm_TsBytecodeHeader;
 
+#if MVM_INCLUDE_SNAPSHOT_CAPABILITY
+#define MVM_HIBERNATION_MAGIC 0x484D564D // "MVMH"
+
+/**
+ * Header of a hibernation image (see mvm_hibernate). The header is followed by
+ * the resolved import table (`importCount` native function pointers) and then
+ * by a snapshot of the VM (a bytecode image of `bytecodeSize` bytes).
+ */
+typedef struct mvm_TsHibernationHeader {
+  uint32_t magic; // MVM_HIBERNATION_MAGIC
+  uint32_t buildId; // As given to mvm_hibernate
+  uint16_t importCount;
+  uint16_t bytecodeSize;
+  uint16_t crc; // CCITT16 of the import table
+  uint16_t bytecodeCrc; // The CRC in the header of the snapshot
+} mvm_TsHibernationHeader;
+#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
+
 typedef enum mvm_TeFeatureFlags {
   FF_FLOAT_SUPPORT = 0,
 } mvm_TeFeatureFlags;
@@ -491,6 +509,37 @@ typedef enum vm_TeOpcodeEx4 {
   VM_OP4_END
 } vm_TeOpcodeEx4;
 
+// Superinstructions (MVM_SUPERINSTRUCTIONS). The compiler never emits these:
+// they reuse reserved opcodes, and only appear in the RAM copy of the bytecode
+// after vm_fuseFunction has rewritten a sequence of instructions in place. A
+// superinstruction occupies the same bytes as the sequence it replaces and
+// continues after the end of it.
+typedef enum vm_TeFusedOpcode {
+  // LOAD_VAR_1 a; LOAD_VAR_1 b
+  // Encoded as [0x64] [a << 4 | b]
+  VM_OP1_FUSED_LOAD_VAR_2          = VM_OP1_RESERVED_VIRTUAL_NEW,
+
+  // STORE_VAR_1 s; LOAD_VAR_1 l
+  // Encoded as [0x74] [s << 4 | l]
+  VM_OP2_FUSED_STORE_LOAD_VAR      = VM_OP2_ARRAY_GET_2_RESERVED,
+
+  // LOAD_VAR_1 v; LOAD_SMALL_LITERAL l; NUM_OP op
+  // Encoded as [0x83] [v << 4 | l] [NUM_OP op]
+  VM_OP3_FUSED_LOAD_VAR_NUM_OP     = VM_OP3_AWAIT_RESERVED,
+
+  // LOAD_LITERAL k; OBJECT_GET_1
+  // Encoded as [0x84] [k] [k] [OBJECT_GET_1]
+  VM_OP3_FUSED_LOAD_LITERAL_GET    = VM_OP3_AWAIT_CALL_RESERVED,
+
+  // LOAD_ARG_1 a; LOAD_LITERAL k; OBJECT_GET_1
+  // Encoded as [0x85] [a] [k] [k] [OBJECT_GET_1]
+  VM_OP3_FUSED_LOAD_ARG_GET        = VM_OP3_ASYNC_RETURN_RESERVED,
+
+  // LOAD_VAR_1 v; LOAD_LITERAL k; OBJECT_GET_1
+  // Encoded as [0x86] [v] [k] [k] [OBJECT_GET_1]
+  VM_OP3_FUSED_LOAD_VAR_GET        = VM_OP3_RESERVED_3,
+} vm_TeFusedOpcode;
+
 
 // Number operations. These are operations which take one or two arguments from
 // the stack and coerce them to numbers. Each of these will have two
@@ -904,6 +953,151 @@ typedef MVM_LONG_PTR_TYPE LongPtr;
 #define MVM_CASE(value) case value
 #endif
 
+#ifndef MVM_COMPUTED_GOTO
+#define MVM_COMPUTED_GOTO 0
+#endif
+
+// Computed goto relies on the GCC "labels as values" extension (also supported
+// by clang). Other compilers fall back to dispatching with MVM_SWITCH.
+#if MVM_COMPUTED_GOTO && !defined(__GNUC__)
+#undef MVM_COMPUTED_GOTO
+#define MVM_COMPUTED_GOTO 0
+#endif
+
+#ifndef MVM_PROPERTY_CACHE_SIZE
+#define MVM_PROPERTY_CACHE_SIZE 0
+#endif
+
+#ifndef MVM_SCOPE_CACHE_SIZE
+#define MVM_SCOPE_CACHE_SIZE 0
+#endif
+
+#ifndef MVM_HANDLE_PAGE_SIZE
+#define MVM_HANDLE_PAGE_SIZE 16
+#endif
+
+#ifndef MVM_INTERN_INDEX
+#define MVM_INTERN_INDEX 0
+#endif
+
+#ifndef MVM_GENERATIONAL_GC
+#define MVM_GENERATIONAL_GC 0
+#endif
+
+#if MVM_GENERATIONAL_GC
+  // The nursery is identified by its range of heap offsets, which relies on
+  // ShortPtr being encoded as an offset into the heap.
+  #if MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE
+    #error MVM_GENERATIONAL_GC is not supported with MVM_NATIVE_POINTER_IS_16_BIT or MVM_USE_SINGLE_RAM_PAGE
+  #endif
+  #ifndef MVM_GC_NURSERY_SIZE
+  #define MVM_GC_NURSERY_SIZE MVM_ALLOCATION_BUCKET_SIZE
+  #endif
+  #ifndef MVM_GC_REMEMBERED_SET_SIZE
+  #define MVM_GC_REMEMBERED_SET_SIZE 16
+  #endif
+#endif // MVM_GENERATIONAL_GC
+
+#ifndef MVM_INCREMENTAL_GC
+#define MVM_INCREMENTAL_GC 0
+#endif
+
+#ifndef MVM_GC_POLICY
+#define MVM_GC_POLICY 0
+#endif
+
+#ifdef MVM_GC_CLOCK_US
+#define GC_CLOCK() ((uint32_t)MVM_GC_CLOCK_US())
+#else
+#define GC_CLOCK() ((uint32_t)0)
+#endif
+
+#ifndef MVM_PROFILE
+#define MVM_PROFILE 0
+#endif
+
+#if MVM_PROFILE
+  #ifndef MVM_PROFILE_MAX_FUNCTIONS
+  #define MVM_PROFILE_MAX_FUNCTIONS 32
+  #endif
+  #if MVM_PROFILE_MAX_FUNCTIONS > 254
+    #error MVM_PROFILE_MAX_FUNCTIONS must be at most 254
+  #endif
+  #ifdef MVM_PROFILE_CLOCK
+  #define PROFILE_CLOCK() ((uint32_t)MVM_PROFILE_CLOCK())
+  #else
+  #define PROFILE_CLOCK() ((uint32_t)0)
+  #endif
+#endif // MVM_PROFILE
+
+#ifndef MVM_SAMPLING_PROFILER
+#define MVM_SAMPLING_PROFILER 0
+#endif
+
+#if MVM_SAMPLING_PROFILER
+  #ifndef MVM_SAMPLE_RING_SIZE
+  #define MVM_SAMPLE_RING_SIZE 64
+  #endif
+  #ifndef MVM_SAMPLE_MAX_DEPTH
+  #define MVM_SAMPLE_MAX_DEPTH 8
+  #endif
+#endif // MVM_SAMPLING_PROFILER
+
+#ifndef MVM_HEAP_PROFILE
+#define MVM_HEAP_PROFILE 0
+#endif
+
+#if MVM_HEAP_PROFILE
+  #ifndef MVM_HEAP_PROFILE_MAX_SITES
+  #define MVM_HEAP_PROFILE_MAX_SITES 32
+  #endif
+  #if MVM_HEAP_PROFILE_MAX_SITES > 255
+    #error MVM_HEAP_PROFILE_MAX_SITES must be at most 255
+  #endif
+  // Allocations are tagged by heap offset, which is what a ShortPtr is only in
+  // this mode
+  #if MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE
+    #error MVM_HEAP_PROFILE requires ShortPtr to be a heap offset
+  #endif
+#endif // MVM_HEAP_PROFILE
+
+#ifndef MVM_HEAP_DUMP
+#define MVM_HEAP_DUMP 0
+#endif
+
+// The dump encodes references as heap offsets (see pointerOffsetInHeap)
+#if MVM_HEAP_DUMP && !(MVM_INCLUDE_SNAPSHOT_CAPABILITY || (!MVM_NATIVE_POINTER_IS_16_BIT && !MVM_USE_SINGLE_RAM_PAGE))
+  #error MVM_HEAP_DUMP requires MVM_INCLUDE_SNAPSHOT_CAPABILITY on this platform
+#endif
+
+#ifndef MVM_SUPERINSTRUCTIONS
+#define MVM_SUPERINSTRUCTIONS 0
+#endif
+
+#if MVM_SUPERINSTRUCTIONS
+  #ifndef MVM_SUPERINSTRUCTION_MASK
+  #define MVM_SUPERINSTRUCTION_MASK MVM_SUPERINSTRUCTION_ALL
+  #endif
+#endif // MVM_SUPERINSTRUCTIONS
+
+#ifndef MVM_RECYCLE_NUMBER_BOXES
+#define MVM_RECYCLE_NUMBER_BOXES 0
+#endif
+
+#ifndef MVM_STRING_ROPES
+#define MVM_STRING_ROPES 0
+#endif
+
+#if MVM_STRING_ROPES
+  #ifndef MVM_ROPE_MIN_SIZE
+  #define MVM_ROPE_MIN_SIZE 64
+  #endif
+#endif // MVM_STRING_ROPES
+
+#ifndef MVM_EXTERNAL_BUFFERS
+#define MVM_EXTERNAL_BUFFERS 0
+#endif
+
 /**
  * Type code indicating the type of data.
  *
@@ -985,8 +1179,8 @@ typedef enum TeTypeCode {
   TC_REF_DIVIDER_CONTAINER_TYPES,  // <--- Marker. Types after or including this point but less than 0x10 are container types
 
   TC_REF_CLASS              = 0x9, // TsClass
-  TC_REF_VIRTUAL            = 0xA, // Reserved: TsVirtual
-  TC_REF_RESERVED_1         = 0xB, // Reserved
+  TC_REF_TYPED_ARRAY        = 0xA, // TsTypedArray
+  TC_REF_ROPE               = 0xB, // TsRope - Deferred string concatenation
   TC_REF_PROPERTY_LIST      = 0xC, // TsPropertyList - Object represented as linked list of properties
   TC_REF_ARRAY              = 0xD, // TsArray
   TC_REF_FIXED_LENGTH_ARRAY = 0xE, // TsFixedLengthArray
@@ -1157,17 +1351,65 @@ typedef struct TsClass {
 } TsClass;
 
 /**
- * TsVirtual (at the time of this writing, this is just a placeholder type)
+ * A TsTypedArray (TC_REF_TYPED_ARRAY) is an Int16Array, Uint16Array, Int32Array
+ * or Float32Array, created by the host with mvm_typedArrayFromElements (the
+ * compiler only knows about Uint8Array). The elements are stored natively in a
+ * Uint8Array, and this is a container so that the GC traces the buffer.
+ *
+ * The elements are only 2-byte aligned, since that's all the GC guarantees, so
+ * 4-byte elements are accessed with memcpy.
+ *
+ * With MVM_EXTERNAL_BUFFERS, the elements may instead be in host memory (see
+ * mvm_typedArrayFromExternal), in which case `buffer` is an Int14 index into
+ * `vm->pExternalBuffers`. Use vm_typedArrayElements to find the elements.
+ *
+ * Note: this type code was previously reserved for TsVirtual.
+ */
+typedef struct TsTypedArray {
+  Value buffer; // TC_REF_UINT8_ARRAY holding the elements, or Int14 external index
+  Value kind; // Int14: mvm_TeTypedArrayKind
+} TsTypedArray;
+
+#if MVM_EXTERNAL_BUFFERS
+/**
+ * Host memory referenced by an external typed array. These are kept in a table
+ * outside the GC heap, and `view` is a weak reference to the TsTypedArray: it
+ * doesn't keep the array alive, but each collection updates it if the array
+ * moved, or releases the entry if it wasn't reached (see
+ * gc_processExternalBuffers).
+ */
+typedef struct TsExternalBuffer {
+  ShortPtr view; // VM_VALUE_UNDEFINED if the entry is free
+  uint16_t length; // Number of elements
+  void* data;
+  mvm_TfReleaseExternal release;
+  void* context;
+} TsExternalBuffer;
+#endif // MVM_EXTERNAL_BUFFERS
+
+/**
+ * A TsRope (TC_REF_ROPE) is a string that is the concatenation of two other
+ * strings, either of which may itself be a rope. `vm_concat` produces ropes
+ * (see MVM_STRING_ROPES) so that building up a string with `+` in a loop
+ * doesn't copy the whole string so far on every iteration.
+ *
+ * A rope is only flattened into a contiguous TC_REF_STRING when something
+ * needs the bytes in one piece (mvm_toStringUtf8 or using the string as a
+ * property key). The flat string is then kept in `left` and `right` is set to
+ * VM_VALUE_DELETED, so that other references to the same rope share the flat
+ * copy, and the next GC collection replaces those references with references
+ * to the flat string itself (see gc_processShortPtrValue).
+ *
+ * Code that reads strings without allocating (equality, conversion to a
+ * number) walks the leaves of the rope instead (see vm_stringSegment).
  *
- * This is a placeholder for an idea to have something like a "low-level proxy"
- * type. See my private notes for details (if you have access to them). The
- * `type` and `state` fields correspond roughly to the "handler" and "target"
- * fields respectively in a normal ES `Proxy`.
+ * Ropes are always in RAM, since the compiler never produces them.
  */
-typedef struct TsVirtual {
-  Value state;
-  Value type;
-} TsVirtual;
+typedef struct TsRope {
+  Value left; // String or rope, or the flat string once flattened
+  Value right; // String or rope, or VM_VALUE_DELETED once flattened
+  Value length; // Int14: size of the whole string in bytes
+} TsRope;
 
 // External function by index in import table
 typedef struct TsHostFunc {
@@ -1205,6 +1447,181 @@ typedef struct TsBreakpoint {
   uint16_t bytecodeAddress;
 } TsBreakpoint;
 
+// Link of a handle table entry that is in use
+#define HANDLE_IN_USE 0xFFFE
+// End of the handle free list
+#define HANDLE_NONE 0xFFFF
+
+/**
+ * A page of the handle table (see mvm_initializeHandle). Handles point directly
+ * at their slot in `values`, so pages never move once allocated.
+ *
+ * A slot that is not in use holds `undefined`, so the GC can scan every slot of
+ * every page as a root without checking which ones are in use. Its link is the
+ * index of the next free slot in the table (or HANDLE_NONE), and the link of a
+ * slot that is in use is HANDLE_IN_USE.
+ */
+typedef struct TsHandlePage {
+  Value values[MVM_HANDLE_PAGE_SIZE];
+  uint16_t links[MVM_HANDLE_PAGE_SIZE];
+  #if MVM_INCREMENTAL_GC
+  // For the handle accessors, which only get the handle (see mvm_handleGet)
+  VM* vm;
+  #endif
+} TsHandlePage;
+
+#if MVM_PROPERTY_CACHE_SIZE
+/**
+ * An entry in the inline property cache. Records where property `key` of
+ * `object` was found the last time the instruction at `site` read it. The
+ * object may own the property or inherit it from a prototype.
+ *
+ * `lpValue` points directly at the value slot (i.e. the property list segment
+ * plus the offset of the slot within it), so writes to an existing property
+ * don't affect the entry. The entries are cleared whenever something could
+ * move or shadow a slot: a GC collection, or a new property being added.
+ */
+typedef struct TsPropertyCacheEntry {
+  uint16_t site; // Bytecode offset of the reading instruction, or 0 if unused
+  Value object;
+  Value key;
+  LongPtr lpValue;
+} TsPropertyCacheEntry;
+#endif // MVM_PROPERTY_CACHE_SIZE
+
+#if MVM_SCOPE_CACHE_SIZE
+/**
+ * An entry in the scoped variable cache. Records the slot that scoped variable
+ * `index` resolved to the last time it was accessed with `closure` as the
+ * current closure, so that the access doesn't need to walk the scope chain
+ * again.
+ *
+ * A closure's parent is fixed when the closure is created, so the slot can
+ * only change if the closure or one of its parents moves. The entries are
+ * cleared at each GC collection.
+ */
+typedef struct TsScopeCacheEntry {
+  Value closure; // The current closure, or 0 if unused
+  uint16_t index;
+  LongPtr lpVar;
+} TsScopeCacheEntry;
+#endif // MVM_SCOPE_CACHE_SIZE
+
+#if MVM_PROFILE
+// Profile slots for each opcode. The container opcodes (VM_OP_EXTENDED_x,
+// VM_OP_NUM_OP, VM_OP_BIT_OP and VM_OP2_EXTENDED_4) are counted under the
+// sub-opcode that they dispatch to, so their own slots stay at zero.
+#define PROFILE_SLOT_OP   0
+#define PROFILE_SLOT_OP1  (PROFILE_SLOT_OP + VM_OP_END)
+#define PROFILE_SLOT_OP2  (PROFILE_SLOT_OP1 + VM_OP1_END)
+#define PROFILE_SLOT_OP3  (PROFILE_SLOT_OP2 + VM_OP2_END)
+#define PROFILE_SLOT_OP4  (PROFILE_SLOT_OP3 + VM_OP3_END)
+#define PROFILE_SLOT_NUM  (PROFILE_SLOT_OP4 + VM_OP4_END)
+#define PROFILE_SLOT_BIT  (PROFILE_SLOT_NUM + VM_NUM_OP_END)
+#define PROFILE_SLOT_END  (PROFILE_SLOT_BIT + VM_BIT_OP_END)
+#define PROFILE_SLOT_NONE 0xFF
+
+typedef struct vm_TsProfileCounter {
+  uint32_t count;
+  uint32_t cycles;
+} vm_TsProfileCounter;
+
+/**
+ * Counters for MVM_PROFILE. Each instruction is charged the PROFILE_CLOCK time
+ * until the next instruction starts (or until mvm_call returns), so host calls
+ * and collections are included in the instruction that caused them.
+ *
+ * Functions are recorded with their extent in the bytecode (from the header of
+ * the function allocation) when they are first called, and kept sorted by
+ * address so that the function containing the program counter can be found
+ * with a binary search. Index 0 collects the time in functions that didn't
+ * fit in the table.
+ */
+typedef struct vm_TsProfile {
+  vm_TsProfileCounter ops[PROFILE_SLOT_END];
+  vm_TsProfileCounter functions[MVM_PROFILE_MAX_FUNCTIONS + 1];
+  uint16_t functionAddresses[MVM_PROFILE_MAX_FUNCTIONS + 1];
+  uint16_t functionEnds[MVM_PROFILE_MAX_FUNCTIONS + 1];
+  uint8_t functionCount; // Including index 0
+  uint8_t currentSlot; // Slot of the instruction being timed, or PROFILE_SLOT_NONE
+  uint8_t currentFunction;
+  uint32_t lastClock;
+  // Number of times each candidate superinstruction (mvm_TeSuperinstruction)
+  // ran as separate instructions. Sequences are recognized from the opcode
+  // bytes of the last few instructions, as long as they were consecutive in
+  // the bytecode (not the target of a jump or a call).
+  uint32_t superinstructionCounts[MVM_SUPERINSTRUCTION_COUNT];
+  uint16_t nextAddress; // Address after the last instruction, or 0 if unknown
+  uint8_t history[2]; // Opcode bytes of the last two instructions, most recent first
+  uint8_t historyLength;
+} vm_TsProfile;
+#endif // MVM_PROFILE
+
+#if MVM_SAMPLING_PROFILER
+/**
+ * A call stack recorded by the sampling profiler. addresses[0] is the address
+ * of the instruction that was about to execute, followed by the return
+ * address of each caller, innermost first. `truncated` is set if there were
+ * more than MVM_SAMPLE_MAX_DEPTH frames.
+ */
+typedef struct vm_TsSample {
+  uint8_t depth;
+  bool truncated;
+  uint16_t addresses[MVM_SAMPLE_MAX_DEPTH];
+} vm_TsSample;
+
+// Samples waiting for mvm_drainFoldedStacks, oldest at `head`
+typedef struct vm_TsSampleRing {
+  uint16_t head;
+  uint16_t count;
+  uint32_t dropped; // Samples lost because the ring was full
+  vm_TsSample samples[MVM_SAMPLE_RING_SIZE];
+} vm_TsSampleRing;
+#endif // MVM_SAMPLING_PROFILER
+
+#if MVM_HEAP_PROFILE
+/**
+ * Counters for one allocation site of the heap profiler. A site is the pair of
+ * the allocating instruction and the type of the allocation. Sizes include the
+ * allocation header.
+ *
+ * The allocations of a site are in three groups: `young` ones were allocated
+ * since the last collection, `live` ones survived it, and `moved` ones have been
+ * moved by the collection in progress (if there is one).
+ */
+typedef struct vm_TsHeapProfileSite {
+  uint16_t address;
+  uint8_t typeCode;
+  uint32_t allocationCount;
+  uint32_t allocatedBytes;
+  uint32_t liveCount;
+  uint32_t liveBytes;
+  uint32_t youngCount;
+  uint32_t youngBytes;
+  uint32_t movedCount;
+  uint32_t movedBytes;
+  uint32_t survivedBytes;
+  uint32_t reclaimedBytes;
+} vm_TsHeapProfileSite;
+
+/**
+ * State of the heap profiler. `tags` has an entry for each 2-byte word of the
+ * heap, holding the index of the site of the allocation that starts at that
+ * offset (the offset of its body, as in a ShortPtr). A collection writes the
+ * tags of tospace into `toTags` as it moves allocations, and then the two are
+ * swapped. Site 0 collects the allocations that predate mvm_startHeapProfile
+ * or don't fit in the site table.
+ */
+typedef struct vm_TsHeapProfile {
+  uint8_t siteCount; // Including site 0
+  uint8_t lastSite; // Site of the last allocation, checked first
+  uint8_t* tags;
+  uint8_t* toTags;
+  vm_TsHeapProfileSite sites[MVM_HEAP_PROFILE_MAX_SITES + 1];
+  uint8_t tagSpace[2][MVM_MAX_HEAP_SIZE / 2];
+} vm_TsHeapProfile;
+#endif // MVM_HEAP_PROFILE
+
 /*
   Minimum size:
     - 6 pointers + 1 long pointer + 4 words
@@ -1227,8 +1644,14 @@ struct mvm_VM {
   TsBucket* pLastBucket;
   // End of the capacity of the last bucket of GC memory
   uint16_t* pLastBucketEndCapacity;
-  // Handles - values to treat as GC roots
-  mvm_Handle* gc_handles;
+  // Handles - values to treat as GC roots. The table of pages is malloc'd from
+  // the host and doubled when it's full, and is NULL if no handle has been
+  // initialized yet.
+  TsHandlePage** gc_handlePages;
+  uint16_t gc_handlePageCount;
+  uint16_t gc_handlePageCapacity;
+  // Index of the first free slot in the handle table, or HANDLE_NONE
+  uint16_t gc_handleFreeList;
 
   void* context;
 
@@ -1239,8 +1662,22 @@ struct mvm_VM {
 
   #ifdef MVM_GAS_COUNTER
   int32_t stopAfterNInstructions; // Set to -1 to disable
+  // Set by mvm_yieldAfterNInstructions, so that reaching the count suspends
+  // the outermost call rather than unwinding it
+  bool yieldOnInstructionCount;
   #endif // MVM_GAS_COUNTER
 
+  // The outermost call is suspended (see mvm_resume). Its registers are in
+  // `stack->reg`.
+  bool suspended;
+  // Set by mvm_resume, for the mvm_call that it makes to continue the
+  // suspended call
+  bool resuming;
+  // If the suspended call is waiting for an async host function to complete,
+  // the argCountAndFlags of the host call, otherwise 0. The result slot of the
+  // host call is at the top of the stack.
+  uint16_t pendingHostCall;
+
   uint16_t heapSizeUsedAfterLastGC;
   uint16_t stackHighWaterMark;
   uint16_t heapHighWaterMark;
@@ -1254,6 +1691,123 @@ struct mvm_VM {
   // A number that increments at every possible opportunity for a GC cycle
   uint8_t gc_potentialCycleNumber;
   #endif // MVM_SAFE_MODE
+
+  #if MVM_PROPERTY_CACHE_SIZE
+  // Direct-mapped by bytecode offset of the reading instruction
+  TsPropertyCacheEntry propertyCache[MVM_PROPERTY_CACHE_SIZE];
+  #endif // MVM_PROPERTY_CACHE_SIZE
+
+  #if MVM_SCOPE_CACHE_SIZE
+  // Direct-mapped by the current closure and the variable index
+  TsScopeCacheEntry scopeCache[MVM_SCOPE_CACHE_SIZE];
+  #endif // MVM_SCOPE_CACHE_SIZE
+
+  #if MVM_INTERN_INDEX
+  // Open-addressed hash index over the RAM interned strings (the
+  // BIN_INTERNED_STRINGS list). Slots hold the ShortPtr of the string, or 0 if
+  // empty. Malloc'd from the host and rebuilt after every GC collection, since
+  // the collection moves the strings. NULL if not yet built.
+  ShortPtr* internIndex;
+  uint16_t internIndexCapacity; // Power of 2
+  uint16_t internIndexCount;
+  #endif // MVM_INTERN_INDEX
+
+  #if MVM_GENERATIONAL_GC
+  // Allocations at heap offsets from `gc_nurseryStart` onwards are young. The
+  // old generation ends with `gc_pOldLastBucket`, which is "sealed" at the end
+  // of each collection so that new allocations go into new buckets and its
+  // spare capacity (up to `gc_oldEndCapacity`) is kept for promotions.
+  TsBucket* gc_pOldLastBucket;
+  uint16_t* gc_oldEndCapacity;
+  uint16_t gc_nurseryStart;
+  // Heap offsets of slots in the old generation that have been written with
+  // pointers to young allocations since the last collection
+  uint16_t gc_rememberedSet[MVM_GC_REMEMBERED_SET_SIZE];
+  uint8_t gc_rememberedCount;
+  // If the remembered set fills up, the next minor collection scans the whole
+  // old generation instead
+  bool gc_rememberedSetOverflow;
+  #endif // MVM_GENERATIONAL_GC
+
+  // Collection statistics reported by mvm_getMemoryStats. Pause times are in
+  // microseconds if the port file defines MVM_GC_CLOCK_US, otherwise zero.
+  // gc_allocatedBytes is the heap growth between collections, summed at the
+  // start of each collection, so that counting it costs nothing per allocation.
+  uint32_t gc_allocatedBytes;
+  uint32_t gc_majorCount;
+  uint32_t gc_majorPauseTotal;
+  uint32_t gc_majorPauseMax;
+  #if MVM_GENERATIONAL_GC
+  uint32_t gc_minorCount;
+  uint32_t gc_minorPauseTotal;
+  uint32_t gc_minorPauseMax;
+  #endif // MVM_GENERATIONAL_GC
+
+  #if MVM_INCREMENTAL_GC
+  // The collection started by mvm_gcStep, or NULL if there isn't one in
+  // progress. While a collection is in progress, the VM's buckets are the
+  // fromspace and contain tombstones, so nothing may read or allocate in the
+  // heap until the collection is completed (see gc_completeIncremental).
+  struct gc_TsIncrementalState* gc_pIncremental;
+  uint32_t gc_stepCount;
+  uint32_t gc_stepPauseTotal;
+  uint32_t gc_stepPauseMax;
+  #endif // MVM_INCREMENTAL_GC
+
+  #if MVM_GC_POLICY
+  // Set by mvm_setGCPolicy. The policy is measured from the last major
+  // collection (heapSizeUsedAfterLastGC is also reset by minor collections):
+  // the heap size after it, the value of gc_allocatedBytes at the time, and
+  // GC_CLOCK() when it finished.
+  mvm_TsGCPolicy gc_policy;
+  uint16_t gc_policyBaseSize;
+  uint32_t gc_policyBaseAllocated;
+  uint32_t gc_policyBaseTime;
+  uint32_t gc_policyCount;
+  #endif // MVM_GC_POLICY
+
+  #if MVM_PROFILE
+  vm_TsProfile profile;
+  #endif // MVM_PROFILE
+
+  #if MVM_SAMPLING_PROFILER
+  // Set by mvm_requestSample (e.g. from a timer interrupt) and cleared when the
+  // run loop takes the sample at the start of the next instruction
+  volatile uint8_t sampleRequested;
+  vm_TsSampleRing* pSamples; // NULL unless mvm_startSampling was called
+  #endif // MVM_SAMPLING_PROFILER
+
+  #if MVM_HEAP_PROFILE
+  vm_TsHeapProfile* pHeapProfile; // NULL unless mvm_startHeapProfile was called
+  #endif // MVM_HEAP_PROFILE
+
+  #if MVM_SUPERINSTRUCTIONS
+  // `lpBytecode` points to a RAM copy of the bytecode image, in which each
+  // function is rewritten with superinstructions when it's first called (see
+  // vm_fuseFunction). The original image is kept for snapshots. The copy is
+  // followed by a bitmap with a bit for each word of the ROM section, set once
+  // the function at that address has been fused.
+  LongPtr lpOriginalBytecode;
+  uint8_t* pBytecodeCopy;
+  uint8_t* pFusedFunctions;
+  uint8_t superinstructionMask;
+  #endif // MVM_SUPERINSTRUCTIONS
+
+  #if MVM_RECYCLE_NUMBER_BOXES
+  // The last box allocated for the result of an arithmetic instruction, and
+  // the address of the instruction after it, or 0 if there's no such box or it
+  // may have moved since (see vm_recycleNumberBox). Cleared by each collection.
+  ShortPtr numberBox;
+  LongPtr lpAfterNumberBox;
+  uint32_t numberBoxesRecycled;
+  #endif // MVM_RECYCLE_NUMBER_BOXES
+
+  #if MVM_EXTERNAL_BUFFERS
+  // Malloc'd from the host and grown as needed. NULL if there have never been
+  // any external buffers.
+  TsExternalBuffer* pExternalBuffers;
+  uint16_t externalBufferCapacity;
+  #endif // MVM_EXTERNAL_BUFFERS
 };
 
 typedef struct TsInternedStringCell {
@@ -1345,8 +1899,26 @@ typedef struct gc_TsGCCollectionState {
   TsBucket* firstBucket;
   TsBucket* lastBucket;
   uint16_t* lastBucketEndCapacity;
+  #if MVM_GENERATIONAL_GC
+  // Pointers below this heap offset are not moved (0 for a major collection)
+  uint16_t nurseryStart;
+  #endif
 } gc_TsGCCollectionState;
 
+#if MVM_INCREMENTAL_GC
+typedef struct gc_TsIncrementalState {
+  gc_TsGCCollectionState gc;
+  // Position of the Cheney scan in tospace. Everything before it has been
+  // processed.
+  TsBucket* scanBucket;
+  uint16_t* scanCursor;
+  // The next root to process (see gc_getRoot), and whether they're all done.
+  // The scan of tospace only starts after the roots.
+  uint32_t rootCursor;
+  bool rootsDone;
+} gc_TsIncrementalState;
+#endif // MVM_INCREMENTAL_GC
+
 #define TOMBSTONE_HEADER ((TC_REF_TOMBSTONE << 12) | 2)
 
 // A CALL instruction saves the current registers to the stack. I'm calling this
@@ -1362,6 +1934,7 @@ typedef struct gc_TsGCCollectionState {
 
 static inline mvm_HostFunctionID vm_getHostFunctionId(VM*vm, uint16_t hostFunctionIndex);
 static TeError vm_createStackAndRegisters(VM* vm);
+static void vm_resetRegisters(VM* vm, vm_TsRegisters* reg);
 static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t sizeRequiredInWords);
 static Value vm_convertToString(VM* vm, Value value);
 static Value vm_concat(VM* vm, Value* left, Value* right);
@@ -1371,14 +1944,69 @@ static int32_t vm_readInt32(VM* vm, TeTypeCode type, Value value);
 static TeError vm_resolveExport(VM* vm, mvm_VMExportID id, Value* result);
 static inline mvm_TfHostFunction* vm_getResolvedImports(VM* vm);
 static void gc_createNextBucket(VM* vm, uint16_t bucketSize, uint16_t minBucketSize);
+#if MVM_GC_POLICY
+static bool gc_policyWantsCollection(VM* vm, uint16_t heapSize, uint16_t bucketSize);
+#endif
 static void* gc_allocateWithHeader(VM* vm, uint16_t sizeBytes, TeTypeCode typeCode);
 static void gc_freeGCMemory(VM* vm);
+static void gc_processRoots(gc_TsGCCollectionState* gc);
+static void gc_processAllocations(gc_TsGCCollectionState* gc, TsBucket* bucket, uint16_t* p);
+static inline uint16_t* gc_processAllocation(gc_TsGCCollectionState* gc, uint16_t* p);
+static uint16_t gc_beginCollection(VM* vm, gc_TsGCCollectionState* gc);
+static void gc_adoptToSpace(VM* vm, gc_TsGCCollectionState* gc);
+static void gc_endCollection(VM* vm);
+#if MVM_EXTERNAL_BUFFERS
+static void gc_processExternalBuffers(gc_TsGCCollectionState* gc);
+static void vm_releaseExternalBuffer(TsExternalBuffer* pExternal);
+#endif
+static void gc_recordPause(uint32_t* pCount, uint32_t* pTotal, uint32_t* pMax, uint32_t start);
+static inline void gc_writeBarrier(VM* vm, Value* pSlot, Value value);
+#if MVM_GENERATIONAL_GC
+static void gc_runMinor(VM* vm);
+static void gc_sealOldGeneration(VM* vm);
+static void gc_processOldGeneration(gc_TsGCCollectionState* gc, TsBucket* pOldLastBucket, uint16_t* pOldEnd);
+#endif // MVM_GENERATIONAL_GC
+#if MVM_INCREMENTAL_GC
+static void gc_finishIncremental(VM* vm);
+#endif // MVM_INCREMENTAL_GC
+static inline void gc_completeIncremental(VM* vm);
+#if MVM_PROFILE
+static void vm_profileInstruction(VM* vm, LongPtr lpProgramCounter);
+static void vm_profileEnterFunction(VM* vm, uint16_t functionAddress);
+static void vm_profileStop(VM* vm);
+#endif // MVM_PROFILE
+#if MVM_SAMPLING_PROFILER
+static void vm_takeSample(VM* vm, LongPtr lpProgramCounter, uint16_t* pFrameBase);
+#endif // MVM_SAMPLING_PROFILER
+#if MVM_HEAP_PROFILE
+static void vm_heapProfileAllocation(VM* vm, TsBucket* pBucket, uint16_t* p, uint16_t header);
+static void vm_heapProfileFree(VM* vm, ShortPtr sp, uint16_t sizeIncludingHeader);
+static void vm_heapProfileBeginCollection(VM* vm, uint16_t nurseryStart);
+static inline void vm_heapProfileMove(VM* vm, ShortPtr spOld, ShortPtr spNew, uint16_t sizeIncludingHeader);
+static void vm_heapProfileEndCollection(VM* vm, bool minor);
+#endif // MVM_HEAP_PROFILE
+#if MVM_PROFILE || MVM_SUPERINSTRUCTIONS
+static uint8_t vm_instructionSize(LongPtr lpInstruction);
+static uint8_t vm_superinstruction2(uint8_t first, uint8_t second);
+static uint8_t vm_superinstruction3(uint8_t first, uint8_t second, uint8_t third);
+#endif // MVM_PROFILE || MVM_SUPERINSTRUCTIONS
+#if MVM_SUPERINSTRUCTIONS
+static TeError vm_copyBytecode(VM* vm);
+static inline uint16_t vm_fusedFunctionsSize(VM* vm);
+static void vm_fuseFunction(VM* vm, uint16_t functionAddress);
+#endif // MVM_SUPERINSTRUCTIONS
 static Value vm_allocString(VM* vm, size_t sizeBytes, void** data);
-static TeError getProperty(VM* vm, Value* pObjectValue, Value* pPropertyName, Value* out_propertyValue);
+static TeError getProperty(VM* vm, Value* pObjectValue, Value* pPropertyName, Value* out_propertyValue, uint16_t cacheSite);
 static TeError setProperty(VM* vm, Value* pOperands);
 static TeError toPropertyName(VM* vm, Value* value);
 static void toInternedString(VM* vm, Value* pValue);
 static uint16_t vm_stringSizeUtf8(VM* vm, Value str);
+static LongPtr vm_stringSegment(VM* vm, Value str, uint16_t offset, uint16_t* out_size);
+static void vm_stringCopy(VM* vm, uint8_t* target, Value str);
+static Value vm_flattenRope(VM* vm, Value rope);
+#if MVM_STRING_ROPES
+static Value vm_newRope(VM* vm, Value* left, Value* right, uint16_t size);
+#endif // MVM_STRING_ROPES
 static bool vm_ramStringIsNonNegativeInteger(VM* vm, Value str);
 static TeError toInt32Internal(mvm_VM* vm, mvm_Value value, int32_t* out_result);
 static inline uint16_t vm_getAllocationSizeExcludingHeaderFromHeaderWord(uint16_t headerWord);
@@ -1386,6 +2014,10 @@ static inline LongPtr LongPtr_add(LongPtr lp, int16_t offset);
 static inline uint16_t LongPtr_read2_aligned(LongPtr lp);
 static inline uint16_t LongPtr_read2_unaligned(LongPtr lp);
 static void memcpy_long(void* target, LongPtr source, size_t size);
+static TeError vm_restore(mvm_VM** result, LongPtr lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport, LongPtr lpSavedImports);
+#if MVM_INCLUDE_SNAPSHOT_CAPABILITY
+static void* vm_createSnapshot(mvm_VM* vm, uint16_t prefixSize, size_t* out_size);
+#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
 static void loadPointers(VM* vm, uint8_t* heapStart);
 static inline ShortPtr ShortPtr_encode(VM* vm, void* ptr);
 static inline uint8_t LongPtr_read1(LongPtr lp);
@@ -1410,11 +2042,13 @@ static TeError vm_validatePortFileMacros(MVM_LONG_PTR_TYPE lpBytecode, mvm_TsByt
 static LongPtr vm_toStringUtf8_long(VM* vm, Value value, size_t* out_sizeBytes);
 static LongPtr vm_findScopedVariable(VM* vm, uint16_t index);
 static Value vm_cloneContainer(VM* vm, Value* pArr);
+#if MVM_SAFE_MODE
 static Value vm_safePop(VM* vm, Value* pStackPointerAfterDecr);
+static bool DynamicPtr_isRomPtr(VM* vm, DynamicPtr dp);
+#endif
 static LongPtr vm_getStringData(VM* vm, Value value);
 static inline VirtualInt14 VirtualInt14_encode(VM* vm, int16_t i);
 static inline TeTypeCode vm_getTypeCodeFromHeaderWord(uint16_t headerWord);
-static bool DynamicPtr_isRomPtr(VM* vm, DynamicPtr dp);
 static inline void vm_checkValueAccess(VM* vm, uint8_t potentialCycleNumber);
 static inline uint16_t vm_getAllocationSize(void* pAllocation);
 static inline uint16_t vm_getAllocationSize_long(LongPtr lpAllocation);
@@ -1427,12 +2061,34 @@ static inline uint16_t* getTopOfStackSpace(vm_TsStack* stack);
 static inline Value* getHandleTargetOrNull(VM* vm, Value value);
 static TeError vm_objectKeys(VM* vm, Value* pObject);
 static mvm_TeError vm_uint8ArrayNew(VM* vm, Value* slot);
+static uint8_t* vm_typedArrayElements(VM* vm, Value typedArray, mvm_TeTypedArrayKind* out_kind, uint16_t* out_length);
+static Value vm_typedArrayRead(VM* vm, mvm_TeTypedArrayKind kind, const uint8_t* pElement);
+static void vm_typedArrayWrite(VM* vm, mvm_TeTypedArrayKind kind, uint8_t* pElement, Value value);
 static Value getBuiltin(VM* vm, mvm_TeBuiltins builtinID);
 
 #if MVM_SAFE_MODE
 static inline uint16_t vm_getResolvedImportCount(VM* vm);
 #endif // MVM_SAFE_MODE
 
+#if MVM_PROPERTY_CACHE_SIZE
+static inline LongPtr vm_propertyCacheLookup(VM* vm, uint16_t site, Value object, Value key);
+static void vm_propertyCacheFill(VM* vm, uint16_t site, Value object, Value key, LongPtr lpValue);
+static void vm_propertyCacheInvalidate(VM* vm);
+#endif // MVM_PROPERTY_CACHE_SIZE
+#if MVM_SCOPE_CACHE_SIZE
+static void vm_scopeCacheInvalidate(VM* vm);
+#endif // MVM_SCOPE_CACHE_SIZE
+
+#if MVM_INTERN_INDEX
+static uint16_t vm_internIndexHash(const void* pStr, uint16_t size);
+static void vm_internIndexRebuild(VM* vm);
+static void vm_internIndexInsert(VM* vm, Value str);
+#endif // MVM_INTERN_INDEX
+
+#if MVM_RECYCLE_NUMBER_BOXES
+static void vm_recycleNumberBox(VM* vm, LongPtr lpProgramCounter, Value left, Value right);
+#endif // MVM_RECYCLE_NUMBER_BOXES
+
 static const Value smallLiterals[] = {
   /* VM_SLV_UNDEFINED */    VM_VALUE_DELETED,
   /* VM_SLV_UNDEFINED */    VM_VALUE_UNDEFINED,
@@ -1470,6 +2126,16 @@ static const uint8_t typeStringOffsetByType[VM_T_END] = {
   32, /* VM_T_CLASS       */
   48, /* VM_T_SYMBOL      */
   55, /* VM_T_BIG_INT     */
+  41, /* VM_T_TYPED_ARRAY */
+};
+
+// mvm_TeTypedArrayKind -> size of each element in bytes
+static const uint8_t typedArrayElementSize[MVM_TA_END] = {
+  2, /* MVM_TA_INT16   */
+  2, /* MVM_TA_UINT16  */
+  4, /* MVM_TA_INT32   */
+  4, /* MVM_TA_FLOAT32 */
+  1, /* MVM_TA_UINT8   */
 };
 
 // TeTypeCode -> mvm_TeType
@@ -1484,8 +2150,8 @@ static const uint8_t typeByTC[TC_END] = {
   VM_T_UINT8_ARRAY, /* TC_REF_UINT8_ARRAY        */
   VM_T_SYMBOL,      /* TC_REF_SYMBOL             */
   VM_T_CLASS,       /* TC_REF_CLASS              */
-  VM_T_END,         /* TC_REF_VIRTUAL            */
-  VM_T_END,         /* TC_REF_RESERVED_1         */
+  VM_T_TYPED_ARRAY, /* TC_REF_TYPED_ARRAY        */
+  VM_T_STRING,      /* TC_REF_ROPE               */
   VM_T_OBJECT,      /* TC_REF_PROPERTY_LIST      */
   VM_T_ARRAY,       /* TC_REF_ARRAY              */
   VM_T_ARRAY,       /* TC_REF_FIXED_LENGTH_ARRAY */
@@ -1660,6 +2326,61 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
 
   #define INSTRUCTION_RESERVED() VM_ASSERT(vm, false)
 
+  // The instruction switches (the primary opcode and each of the extended
+  // opcode groups) are written with DISPATCH and DISPATCH_CASE. Normally these
+  // are just MVM_SWITCH and MVM_CASE. With MVM_COMPUTED_GOTO, each case also
+  // gets a label named after its opcode, and DISPATCH jumps straight to the
+  // case through the given jump table (see "Jump Tables" below), so the switch
+  // itself is never entered from the top.
+  #if MVM_COMPUTED_GOTO
+    #define DISPATCH_CASE(op) LBL_##op: MVM_CASE(op)
+    #define DISPATCH(table, tag, upper) goto *table[tag]; MVM_SWITCH(tag, upper)
+  #else
+    #define DISPATCH_CASE(op) MVM_CASE(op)
+    #define DISPATCH(table, tag, upper) MVM_SWITCH(tag, upper)
+  #endif
+
+  // DISPATCH_NEXT ends each of the common tails (see TAILS below). With
+  // MVM_COMPUTED_GOTO it fetches the next instruction and jumps to its handler
+  // from the tail itself, so that each tail has its own indirect jump to
+  // predict rather than all of them sharing the one in SUB_DO_NEXT_INSTRUCTION.
+  // Anything that SUB_DO_NEXT_INSTRUCTION has to act on before the instruction
+  // (running out of instructions, a requested sample, breakpoints, a program
+  // counter out of range) sends it the long way round instead.
+  #if MVM_SAMPLING_PROFILER
+    #define DISPATCH_SAMPLE_REQUESTED() vm->sampleRequested
+  #else
+    #define DISPATCH_SAMPLE_REQUESTED() false
+  #endif
+  #if MVM_INCLUDE_DEBUG_CAPABILITY
+    #define DISPATCH_BREAKPOINTS_SET() (vm->pBreakpoints != NULL)
+  #else
+    #define DISPATCH_BREAKPOINTS_SET() false
+  #endif
+  #if MVM_DONT_TRUST_BYTECODE
+    #define DISPATCH_PC_OUT_OF_RANGE() ((lpProgramCounter < minProgramCounter) || (lpProgramCounter >= maxProgramCounter))
+  #else
+    #define DISPATCH_PC_OUT_OF_RANGE() false
+  #endif
+
+  #if MVM_COMPUTED_GOTO && !MVM_PROFILE
+    #define DISPATCH_NEXT() do { \
+      if ((vm->stopAfterNInstructions == 0) || DISPATCH_SAMPLE_REQUESTED() || \
+          DISPATCH_BREAKPOINTS_SET() || DISPATCH_PC_OUT_OF_RANGE()) { \
+        goto SUB_DO_NEXT_INSTRUCTION; \
+      } \
+      if (vm->stopAfterNInstructions > 0) vm->stopAfterNInstructions--; \
+      reg->lpProgramCounter = lpProgramCounter; \
+      READ_PGM_1(reg3); \
+      reg1 = reg3 & 0xF; \
+      reg3 = reg3 >> 4; \
+      if (reg3 >= VM_OP_DIVIDER_1) reg2 = POP(); \
+      goto *opcodeTable[reg3]; \
+    } while (false)
+  #else
+    #define DISPATCH_NEXT() goto SUB_DO_NEXT_INSTRUCTION
+  #endif
+
   // ------------------------------ Common Variables --------------------------
 
   VM_SAFE_CHECK_NOT_NULL(vm);
@@ -1703,10 +2424,113 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
   reg2 = 0;
   reg3 = 0;
 
+  // ------------------------------ Jump Tables -------------------------------
+
+  // Used by DISPATCH when MVM_COMPUTED_GOTO is enabled. There is one table for
+  // the primary opcode and one for each of the 4-bit extended opcode groups.
+  // These switches are indexed by a nibble, so every table has exactly 16
+  // entries and reserved opcodes go to SUB_OP_RESERVED. The ex-4 group and the
+  // number/bitwise operators are less frequent and are still dispatched with
+  // MVM_SWITCH.
+  #if MVM_COMPUTED_GOTO
+  static const void* const opcodeTable[VM_OP_END] = {
+    [VM_OP_LOAD_SMALL_LITERAL]      = &&LBL_VM_OP_LOAD_SMALL_LITERAL,
+    [VM_OP_LOAD_VAR_1]              = &&LBL_VM_OP_LOAD_VAR_1,
+    [VM_OP_LOAD_SCOPED_1]           = &&LBL_VM_OP_LOAD_SCOPED_1,
+    [VM_OP_LOAD_ARG_1]              = &&LBL_VM_OP_LOAD_ARG_1,
+    [VM_OP_CALL_1]                  = &&LBL_VM_OP_CALL_1,
+    [VM_OP_FIXED_ARRAY_NEW_1]       = &&LBL_VM_OP_FIXED_ARRAY_NEW_1,
+    [VM_OP_EXTENDED_1]              = &&LBL_VM_OP_EXTENDED_1,
+    [VM_OP_EXTENDED_2]              = &&LBL_VM_OP_EXTENDED_2,
+    [VM_OP_EXTENDED_3]              = &&LBL_VM_OP_EXTENDED_3,
+    [VM_OP_CALL_5]                  = &&LBL_VM_OP_CALL_5,
+    [VM_OP_STORE_VAR_1]             = &&LBL_VM_OP_STORE_VAR_1,
+    [VM_OP_STORE_SCOPED_1]          = &&LBL_VM_OP_STORE_SCOPED_1,
+    [VM_OP_ARRAY_GET_1]             = &&LBL_VM_OP_ARRAY_GET_1,
+    [VM_OP_ARRAY_SET_1]             = &&LBL_VM_OP_ARRAY_SET_1,
+    [VM_OP_NUM_OP]                  = &&LBL_VM_OP_NUM_OP,
+    [VM_OP_BIT_OP]                  = &&LBL_VM_OP_BIT_OP,
+  };
+
+  static const void* const opcodeEx1Table[VM_OP1_END] = {
+    [VM_OP1_RETURN]                 = &&LBL_VM_OP1_RETURN,
+    [VM_OP1_THROW]                  = &&LBL_VM_OP1_THROW,
+    [VM_OP1_CLOSURE_NEW]            = &&LBL_VM_OP1_CLOSURE_NEW,
+    [VM_OP1_NEW]                    = &&LBL_VM_OP1_NEW,
+    #if MVM_SUPERINSTRUCTIONS
+    [VM_OP1_FUSED_LOAD_VAR_2]       = &&LBL_VM_OP1_FUSED_LOAD_VAR_2,
+    #else
+    [VM_OP1_RESERVED_VIRTUAL_NEW]   = &&SUB_OP_RESERVED,
+    #endif
+    [VM_OP1_SCOPE_NEW]              = &&LBL_VM_OP1_SCOPE_NEW,
+    [VM_OP1_TYPE_CODE_OF]           = &&LBL_VM_OP1_TYPE_CODE_OF,
+    [VM_OP1_POP]                    = &&LBL_VM_OP1_POP,
+    [VM_OP1_TYPEOF]                 = &&LBL_VM_OP1_TYPEOF,
+    [VM_OP1_OBJECT_NEW]             = &&LBL_VM_OP1_OBJECT_NEW,
+    [VM_OP1_LOGICAL_NOT]            = &&LBL_VM_OP1_LOGICAL_NOT,
+    [VM_OP1_OBJECT_GET_1]           = &&LBL_VM_OP1_OBJECT_GET_1,
+    [VM_OP1_ADD]                    = &&LBL_VM_OP1_ADD,
+    [VM_OP1_EQUAL]                  = &&LBL_VM_OP1_EQUAL,
+    [VM_OP1_NOT_EQUAL]              = &&LBL_VM_OP1_NOT_EQUAL,
+    [VM_OP1_OBJECT_SET_1]           = &&LBL_VM_OP1_OBJECT_SET_1,
+  };
+
+  static const void* const opcodeEx2Table[VM_OP2_END] = {
+    [VM_OP2_BRANCH_1]               = &&LBL_VM_OP2_BRANCH_1,
+    [VM_OP2_STORE_ARG]              = &&LBL_VM_OP2_STORE_ARG,
+    [VM_OP2_STORE_SCOPED_2]         = &&LBL_VM_OP2_STORE_SCOPED_2,
+    [VM_OP2_STORE_VAR_2]            = &&LBL_VM_OP2_STORE_VAR_2,
+    #if MVM_SUPERINSTRUCTIONS
+    [VM_OP2_FUSED_STORE_LOAD_VAR]   = &&LBL_VM_OP2_FUSED_STORE_LOAD_VAR,
+    #else
+    [VM_OP2_ARRAY_GET_2_RESERVED]   = &&SUB_OP_RESERVED,
+    #endif
+    [VM_OP2_ARRAY_SET_2_RESERVED]   = &&SUB_OP_RESERVED,
+    [VM_OP2_JUMP_1]                 = &&LBL_VM_OP2_JUMP_1,
+    [VM_OP2_CALL_HOST]              = &&LBL_VM_OP2_CALL_HOST,
+    [VM_OP2_CALL_3]                 = &&LBL_VM_OP2_CALL_3,
+    [VM_OP2_CALL_6]                 = &&LBL_VM_OP2_CALL_6,
+    [VM_OP2_LOAD_SCOPED_2]          = &&LBL_VM_OP2_LOAD_SCOPED_2,
+    [VM_OP2_LOAD_VAR_2]             = &&LBL_VM_OP2_LOAD_VAR_2,
+    [VM_OP2_LOAD_ARG_2]             = &&LBL_VM_OP2_LOAD_ARG_2,
+    [VM_OP2_EXTENDED_4]             = &&LBL_VM_OP2_EXTENDED_4,
+    [VM_OP2_ARRAY_NEW]              = &&LBL_VM_OP2_ARRAY_NEW,
+    [VM_OP2_FIXED_ARRAY_NEW_2]      = &&LBL_VM_OP2_FIXED_ARRAY_NEW_2,
+  };
+
+  static const void* const opcodeEx3Table[VM_OP3_END] = {
+    [VM_OP3_POP_N]                  = &&LBL_VM_OP3_POP_N,
+    [VM_OP3_SCOPE_DISCARD]          = &&LBL_VM_OP3_SCOPE_DISCARD,
+    [VM_OP3_SCOPE_CLONE]            = &&LBL_VM_OP3_SCOPE_CLONE,
+    #if MVM_SUPERINSTRUCTIONS
+    [VM_OP3_FUSED_LOAD_VAR_NUM_OP]  = &&LBL_VM_OP3_FUSED_LOAD_VAR_NUM_OP,
+    [VM_OP3_FUSED_LOAD_LITERAL_GET] = &&LBL_VM_OP3_FUSED_LOAD_LITERAL_GET,
+    [VM_OP3_FUSED_LOAD_ARG_GET]     = &&LBL_VM_OP3_FUSED_LOAD_ARG_GET,
+    [VM_OP3_FUSED_LOAD_VAR_GET]     = &&LBL_VM_OP3_FUSED_LOAD_VAR_GET,
+    #else
+    [VM_OP3_AWAIT_RESERVED]         = &&SUB_OP_RESERVED,
+    [VM_OP3_AWAIT_CALL_RESERVED]    = &&SUB_OP_RESERVED,
+    [VM_OP3_ASYNC_RETURN_RESERVED]  = &&SUB_OP_RESERVED,
+    [VM_OP3_RESERVED_3]             = &&SUB_OP_RESERVED,
+    #endif
+    [VM_OP3_JUMP_2]                 = &&LBL_VM_OP3_JUMP_2,
+    [VM_OP3_LOAD_LITERAL]           = &&LBL_VM_OP3_LOAD_LITERAL,
+    [VM_OP3_LOAD_GLOBAL_3]          = &&LBL_VM_OP3_LOAD_GLOBAL_3,
+    [VM_OP3_LOAD_SCOPED_3]          = &&LBL_VM_OP3_LOAD_SCOPED_3,
+    [VM_OP3_BRANCH_2]               = &&LBL_VM_OP3_BRANCH_2,
+    [VM_OP3_STORE_GLOBAL_3]         = &&LBL_VM_OP3_STORE_GLOBAL_3,
+    [VM_OP3_STORE_SCOPED_3]         = &&LBL_VM_OP3_STORE_SCOPED_3,
+    [VM_OP3_OBJECT_GET_2]           = &&LBL_VM_OP3_OBJECT_GET_2,
+    [VM_OP3_OBJECT_SET_2]           = &&LBL_VM_OP3_OBJECT_SET_2,
+  };
+  #endif // MVM_COMPUTED_GOTO
+
   // ------------------------------ Initialization ---------------------------
 
   CODE_COVERAGE(4); // Hit
 
+  gc_completeIncremental(vm);
+
   // Create the call stack if it doesn't exist
   if (!vm->stack) {
     CODE_COVERAGE(230); // Hit
@@ -1714,6 +2538,10 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
     if (err != MVM_E_SUCCESS) {
       return err;
     }
+    #if MVM_SAMPLING_PROFILER
+    // Don't attribute time when the VM was idle to the first instruction
+    vm->sampleRequested = false;
+    #endif
   } else {
     CODE_COVERAGE_UNTESTED(232); // Not hit
   }
@@ -1723,6 +2551,41 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
 
   registerValuesAtEntry = *reg;
 
+  // Only the outermost call can yield, since the host frames of any calls
+  // below it can't be suspended
+  bool canYield = reg->pStackPointer == getBottomOfStack(vm->stack);
+
+  // A call made while another is suspended runs on top of it, and the
+  // suspended call can't be resumed until it returns (see below)
+  bool suspendedAtEntry = vm->suspended;
+
+  if (vm->resuming) {
+    CODE_COVERAGE_UNTESTED(842); // Not hit
+    VM_ASSERT(vm, suspendedAtEntry);
+    vm->resuming = false;
+    vm->suspended = false;
+    suspendedAtEntry = false;
+    // The suspended call was the outermost one, so the registers to restore on
+    // exit are those of an empty stack
+    vm_resetRegisters(vm, &registerValuesAtEntry);
+    canYield = true;
+    CACHE_REGISTERS();
+    if (vm->pendingHostCall) {
+      CODE_COVERAGE_UNTESTED(850); // Not hit
+      // Finish the host call with the result that mvm_completeHostCall put in
+      // its result slot (see SUB_CALL_HOST_COMMON)
+      reg3 = vm->pendingHostCall;
+      vm->pendingHostCall = 0;
+      reg1 = POP();
+      goto SUB_POP_ARGS;
+    } else {
+      CODE_COVERAGE_UNTESTED(851); // Not hit
+    }
+    goto SUB_DO_NEXT_INSTRUCTION;
+  } else {
+    CODE_COVERAGE(843); // Hit
+  }
+
   // Because we're coming from C-land, any exceptions that happen during
   // mvm_call should register as host errors
   reg->catchTarget = VM_VALUE_UNDEFINED;
@@ -1750,6 +2613,8 @@ TeError mvm_call(VM* vm, Value targetFunc, Value* out_result, Value* args, uint8
 
   // ---------------------------- Call target function ------------------------
 
+  vm->suspended = false;
+
   reg1 /* argCountAndFlags */ = (argCount + 1) | AF_CALLED_FROM_HOST; // +1 for the `this` value
   reg2 /* target */ = targetFunc;
   goto SUB_CALL;
@@ -1791,14 +2656,36 @@ SUB_DO_NEXT_INSTRUCTION:
     CODE_COVERAGE(650); // Hit
     if (vm->stopAfterNInstructions == 0) {
       CODE_COVERAGE(651); // Hit
-      err = MVM_E_INSTRUCTION_COUNT_REACHED;
-      goto SUB_EXIT;
+      if (!vm->yieldOnInstructionCount) {
+        CODE_COVERAGE(844); // Hit
+        err = MVM_E_INSTRUCTION_COUNT_REACHED;
+        goto SUB_EXIT;
+      } else if (canYield) {
+        CODE_COVERAGE_UNTESTED(845); // Not hit
+        err = MVM_E_YIELDED;
+        goto SUB_YIELD;
+      } else {
+        // A reentrant call runs to completion. The outer call yields at its
+        // next instruction.
+        CODE_COVERAGE_UNTESTED(846); // Not hit
+      }
     } else {
       CODE_COVERAGE(652); // Hit
       vm->stopAfterNInstructions--;
     }
   }
 
+  #if MVM_PROFILE
+  vm_profileInstruction(vm, lpProgramCounter);
+  #endif
+
+  #if MVM_SAMPLING_PROFILER
+  if (vm->sampleRequested) {
+    CODE_COVERAGE_UNTESTED(730); // Not hit
+    vm_takeSample(vm, lpProgramCounter, pFrameBase);
+  }
+  #endif
+
   // This is not required for execution but is intended for diagnostics,
   // required by mvm_getCurrentAddress.
   // TODO: If MVM_INCLUDE_DEBUG_CAPABILITY is not included, maybe this shouldn't be here, and `mvm_getCurrentAddress` should also not be available.
@@ -1843,7 +2730,7 @@ SUB_DO_NEXT_INSTRUCTION:
   }
 
   VM_ASSERT(vm, reg3 < VM_OP_END);
-  MVM_SWITCH(reg3, (VM_OP_END - 1)) {
+  DISPATCH(opcodeTable, reg3, (VM_OP_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
 /*                         VM_OP_LOAD_SMALL_LITERAL                          */
@@ -1851,7 +2738,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: small literal ID                                                */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE(VM_OP_LOAD_SMALL_LITERAL): {
+    DISPATCH_CASE(VM_OP_LOAD_SMALL_LITERAL): {
       CODE_COVERAGE(60); // Hit
       TABLE_COVERAGE(reg1, smallLiteralsSize, 448); // Hit 11/12
 
@@ -1871,7 +2758,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: variable index                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_LOAD_VAR_1):
+    DISPATCH_CASE (VM_OP_LOAD_VAR_1):
       CODE_COVERAGE(61); // Hit
     SUB_OP_LOAD_VAR:
       reg1 = pStackPointer[-reg1 - 1];
@@ -1887,7 +2774,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: variable index                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_LOAD_SCOPED_1):
+    DISPATCH_CASE (VM_OP_LOAD_SCOPED_1):
       CODE_COVERAGE(62); // Hit
       LongPtr lpVar;
     SUB_OP_LOAD_SCOPED:
@@ -1901,7 +2788,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: argument index                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_LOAD_ARG_1):
+    DISPATCH_CASE (VM_OP_LOAD_ARG_1):
       CODE_COVERAGE(63); // Hit
       goto SUB_OP_LOAD_ARG;
 
@@ -1911,7 +2798,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: index into short-call table                                     */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_CALL_1): {
+    DISPATCH_CASE (VM_OP_CALL_1): {
       CODE_COVERAGE_UNTESTED(66); // Not hit
       goto SUB_CALL_SHORT;
     }
@@ -1922,7 +2809,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: length of new fixed-length-array                                */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_FIXED_ARRAY_NEW_1): {
+    DISPATCH_CASE (VM_OP_FIXED_ARRAY_NEW_1): {
       CODE_COVERAGE_UNTESTED(134); // Not hit
       goto SUB_FIXED_ARRAY_NEW;
     }
@@ -1933,7 +2820,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: vm_TeOpcodeEx1                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_EXTENDED_1):
+    DISPATCH_CASE (VM_OP_EXTENDED_1):
       CODE_COVERAGE(69); // Hit
       goto SUB_OP_EXTENDED_1;
 
@@ -1943,7 +2830,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: vm_TeOpcodeEx2                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_EXTENDED_2):
+    DISPATCH_CASE (VM_OP_EXTENDED_2):
       CODE_COVERAGE(70); // Hit
       goto SUB_OP_EXTENDED_2;
 
@@ -1953,7 +2840,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: vm_TeOpcodeEx3                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_EXTENDED_3):
+    DISPATCH_CASE (VM_OP_EXTENDED_3):
       CODE_COVERAGE(71); // Hit
       goto SUB_OP_EXTENDED_3;
 
@@ -1963,7 +2850,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: argCount                                                        */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_CALL_5): {
+    DISPATCH_CASE (VM_OP_CALL_5): {
       CODE_COVERAGE_UNTESTED(72); // Not hit
       // Uses 16 bit literal for function offset
       READ_PGM_2(reg2);
@@ -1978,7 +2865,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_STORE_VAR_1): {
+    DISPATCH_CASE (VM_OP_STORE_VAR_1): {
       CODE_COVERAGE(73); // Hit
     SUB_OP_STORE_VAR:
       // Note: the value to store has already been popped off the stack at this
@@ -1995,7 +2882,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_STORE_SCOPED_1): {
+    DISPATCH_CASE (VM_OP_STORE_SCOPED_1): {
       CODE_COVERAGE(74); // Hit
       LongPtr lpVar;
     SUB_OP_STORE_SCOPED:
@@ -2004,6 +2891,7 @@ SUB_DO_NEXT_INSTRUCTION:
       // It would be an illegal operation to write to a closure variable stored in ROM
       VM_BYTECODE_ASSERT(vm, lpVar == LongPtr_new(pVar));
       *pVar = reg2;
+      gc_writeBarrier(vm, pVar, reg2);
       goto SUB_TAIL_POP_0_PUSH_0;
     }
 
@@ -2014,7 +2902,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg2: reference to array                                              */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_ARRAY_GET_1): {
+    DISPATCH_CASE (VM_OP_ARRAY_GET_1): {
       CODE_COVERAGE_UNTESTED(75); // Not hit
 
       // I think it makes sense for this instruction only to be an optimization for fixed-length arrays
@@ -2033,7 +2921,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg1: item index (4-bit)                                              */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_ARRAY_SET_1): {
+    DISPATCH_CASE (VM_OP_ARRAY_SET_1): {
       CODE_COVERAGE_UNTESTED(76); // Not hit
       reg2 = POP(); // array reference
       // I think it makes sense for this instruction only to be an optimization for fixed-length arrays
@@ -2043,6 +2931,7 @@ SUB_DO_NEXT_INSTRUCTION:
       // These indexes should be compiler-generated, so they should never be out of range
       VM_ASSERT(vm, reg1 < (vm_getAllocationSize(regP1) >> 1));
       regP1[reg1] = reg2;
+      gc_writeBarrier(vm, &regP1[reg1], reg2);
       goto SUB_TAIL_POP_0_PUSH_0;
     }
 
@@ -2053,7 +2942,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg2: first popped operand                                            */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_NUM_OP): {
+    DISPATCH_CASE (VM_OP_NUM_OP): {
       CODE_COVERAGE(77); // Hit
       goto SUB_OP_NUM_OP;
     } // End of case VM_OP_NUM_OP
@@ -2065,7 +2954,7 @@ SUB_DO_NEXT_INSTRUCTION:
 /*     reg2: first popped operand                                            */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP_BIT_OP): {
+    DISPATCH_CASE (VM_OP_BIT_OP): {
       CODE_COVERAGE(92); // Hit
       goto SUB_OP_BIT_OP;
     }
@@ -2245,7 +3134,7 @@ SUB_OP_EXTENDED_1: {
   reg3 = reg1;
 
   VM_ASSERT(vm, reg3 <= VM_OP1_END);
-  MVM_SWITCH (reg3, VM_OP1_END - 1) {
+  DISPATCH(opcodeEx1Table, reg3, VM_OP1_END - 1) {
 
 /* ------------------------------------------------------------------------- */
 /*                              VM_OP1_RETURN_x                              */
@@ -2253,13 +3142,13 @@ SUB_OP_EXTENDED_1: {
 /*     reg1: vm_TeOpcodeEx1                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_RETURN): {
+    DISPATCH_CASE (VM_OP1_RETURN): {
       CODE_COVERAGE(107); // Hit
       reg1 = POP();
       goto SUB_RETURN;
     }
 
-    MVM_CASE (VM_OP1_THROW): {
+    DISPATCH_CASE (VM_OP1_THROW): {
       CODE_COVERAGE(106); // Hit
 
       reg1 = POP(); // The exception value
@@ -2322,7 +3211,7 @@ SUB_OP_EXTENDED_1: {
 /*     reg3: vm_TeOpcodeEx1                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_CLOSURE_NEW): {
+    DISPATCH_CASE (VM_OP1_CLOSURE_NEW): {
       CODE_COVERAGE(599); // Hit
 
       FLUSH_REGISTER_CACHE();
@@ -2341,7 +3230,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_NEW): {
+    DISPATCH_CASE (VM_OP1_NEW): {
       CODE_COVERAGE(347); // Hit
       READ_PGM_1(reg1); // arg count
 
@@ -2379,13 +3268,13 @@ SUB_OP_EXTENDED_1: {
       FLUSH_REGISTER_CACHE();
       TsPropertyList* pObject = GC_ALLOCATE_TYPE(vm, TsPropertyList, TC_REF_PROPERTY_LIST);
       pObject->dpNext = VM_VALUE_NULL;
-      getProperty(vm, &regP1[1], &pStackPointer[-1], &pObject->dpProto);
+      getProperty(vm, &regP1[1], &pStackPointer[-1], &pObject->dpProto, 0);
       TeTypeCode tc = deepTypeOf(vm, pObject->dpProto);
       if ((tc != TC_REF_PROPERTY_LIST) && (tc != TC_REF_CLASS) && (tc != TC_REF_ARRAY)) {
         pObject->dpProto = VM_VALUE_NULL;
       }
       CACHE_REGISTERS();
-      POP(); // BIN_STR_PROTOTYPE
+      (void)POP(); // BIN_STR_PROTOTYPE
       if (err != MVM_E_SUCCESS) goto SUB_EXIT;
 
       // The first argument is the `this` value
@@ -2396,13 +3285,36 @@ SUB_OP_EXTENDED_1: {
       goto SUB_CALL;
     }
 
+#if MVM_SUPERINSTRUCTIONS
+/* ------------------------------------------------------------------------- */
+/*                          VM_OP1_FUSED_LOAD_VAR_2                          */
+/*   LOAD_VAR_1 followed by LOAD_VAR_1 (see vm_fuseFunction)                 */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP1_FUSED_LOAD_VAR_2): {
+      CODE_COVERAGE_UNTESTED(736); // Not hit
+      READ_PGM_1(reg2); // Both variable indexes
+      reg1 = pStackPointer[-(reg2 >> 4) - 1];
+      if (reg1 == VM_VALUE_DELETED) {
+        err = vm_newError(vm, MVM_E_TDZ_ERROR);
+        goto SUB_EXIT;
+      }
+      PUSH(reg1);
+      // The second index is relative to the new stack pointer
+      reg1 = reg2 & 0xF;
+      goto SUB_OP_LOAD_VAR;
+    }
+#endif // MVM_SUPERINSTRUCTIONS
+
 /* ------------------------------------------------------------------------- */
 /*                                 VM_OP1_SCOPE_NEW                          */
 /*   Expects:                                                                */
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_SCOPE_NEW): {
+    DISPATCH_CASE (VM_OP1_SCOPE_NEW): {
       CODE_COVERAGE(605); // Hit
       // A SCOPE_NEW is just like a SCOPE_PUSH without capturing the parent
       reg3 /*capture parent*/ = false;
@@ -2415,7 +3327,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_TYPE_CODE_OF): {
+    DISPATCH_CASE (VM_OP1_TYPE_CODE_OF): {
       CODE_COVERAGE_UNTESTED(607); // Not hit
       reg1 = POP();
       reg1 = mvm_typeOf(vm, reg1);
@@ -2428,7 +3340,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_POP): {
+    DISPATCH_CASE (VM_OP1_POP): {
       CODE_COVERAGE(138); // Hit
       pStackPointer--;
       goto SUB_TAIL_POP_0_PUSH_0;
@@ -2440,7 +3352,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_TYPEOF): {
+    DISPATCH_CASE (VM_OP1_TYPEOF): {
       CODE_COVERAGE(167); // Hit
       // TODO: This is should really be done using some kind of built-in helper
       // function, but we don't support those yet. The trouble with this
@@ -2464,7 +3376,7 @@ SUB_OP_EXTENDED_1: {
 /*     (nothing)                                                             */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_OBJECT_NEW): {
+    DISPATCH_CASE (VM_OP1_OBJECT_NEW): {
       CODE_COVERAGE(112); // Hit
       FLUSH_REGISTER_CACHE();
       TsPropertyList* pObject = GC_ALLOCATE_TYPE(vm, TsPropertyList, TC_REF_PROPERTY_LIST);
@@ -2481,7 +3393,7 @@ SUB_OP_EXTENDED_1: {
 /*     (nothing)                                                             */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_LOGICAL_NOT): {
+    DISPATCH_CASE (VM_OP1_LOGICAL_NOT): {
       CODE_COVERAGE(113); // Hit
       reg2 = POP(); // value to negate
       reg1 = mvm_toBool(vm, reg2) ? VM_VALUE_FALSE : VM_VALUE_TRUE;
@@ -2495,10 +3407,26 @@ SUB_OP_EXTENDED_1: {
 /*     reg2: propertyName                                                    */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_OBJECT_GET_1): {
+    DISPATCH_CASE (VM_OP1_OBJECT_GET_1): {
       CODE_COVERAGE(114); // Hit
+    #if MVM_SUPERINSTRUCTIONS
+    SUB_OP_OBJECT_GET_1:
+    #endif
+      // The read site for the inline property cache is identified by the
+      // bytecode offset of the next instruction
+      reg3 /* site */ = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode);
+      #if MVM_PROPERTY_CACHE_SIZE
+      regLP1 = vm_propertyCacheLookup(vm, reg3, pStackPointer[-2], pStackPointer[-1]);
+      if (regLP1) {
+        CODE_COVERAGE_UNTESTED(659); // Not hit
+        pStackPointer[-2] = LongPtr_read2_aligned(regLP1);
+        goto SUB_TAIL_POP_1_PUSH_0;
+      } else {
+        CODE_COVERAGE_UNTESTED(660); // Not hit
+      }
+      #endif // MVM_PROPERTY_CACHE_SIZE
       FLUSH_REGISTER_CACHE();
-      err = getProperty(vm, pStackPointer - 2, pStackPointer - 1, pStackPointer - 2);
+      err = getProperty(vm, pStackPointer - 2, pStackPointer - 1, pStackPointer - 2, reg3);
       CACHE_REGISTERS();
       if (err != MVM_E_SUCCESS) goto SUB_EXIT;
       goto SUB_TAIL_POP_1_PUSH_0;
@@ -2511,7 +3439,7 @@ SUB_OP_EXTENDED_1: {
 /*     reg2: right operand                                                   */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_ADD): {
+    DISPATCH_CASE (VM_OP1_ADD): {
       CODE_COVERAGE(115); // Hit
       reg1 = pStackPointer[-2];
       reg2 = pStackPointer[-1];
@@ -2540,7 +3468,7 @@ SUB_OP_EXTENDED_1: {
         CODE_COVERAGE(121); // Hit
         // Interpret like any of the other numeric operations
         // TODO: If VM_NUM_OP_ADD_NUM might cause a GC collection, then we shouldn't be popping here
-        POP();
+        (void)POP();
         reg1 = VM_NUM_OP_ADD_NUM;
         goto SUB_OP_NUM_OP;
       }
@@ -2553,7 +3481,7 @@ SUB_OP_EXTENDED_1: {
 /*     reg2: right operand                                                   */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_EQUAL): {
+    DISPATCH_CASE (VM_OP1_EQUAL): {
       CODE_COVERAGE(122); // Hit
       // TODO: This popping should be done on the egress rather than the ingress
       reg2 = POP();
@@ -2577,7 +3505,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_NOT_EQUAL): {
+    DISPATCH_CASE (VM_OP1_NOT_EQUAL): {
       reg1 = pStackPointer[-2];
       reg2 = pStackPointer[-1];
       // TODO: there seem to be so many places where we have to flush the
@@ -2605,7 +3533,7 @@ SUB_OP_EXTENDED_1: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP1_OBJECT_SET_1): {
+    DISPATCH_CASE (VM_OP1_OBJECT_SET_1): {
       CODE_COVERAGE(124); // Hit
       FLUSH_REGISTER_CACHE();
       err = setProperty(vm, pStackPointer - 3);
@@ -2698,6 +3626,15 @@ SUB_OP_NUM_OP: {
     CODE_COVERAGE(443); // Hit
   }
 
+  #if MVM_RECYCLE_NUMBER_BOXES
+  // A comparison can give back the box of an operand straight away. The other
+  // operations wait until they can no longer fall back to SUB_NUM_OP_FLOAT64,
+  // which reads the operands again.
+  if (reg3 <= VM_NUM_OP_GREATER_EQUAL) {
+    vm_recycleNumberBox(vm, lpProgramCounter, reg1, reg2);
+  }
+  #endif // MVM_RECYCLE_NUMBER_BOXES
+
   VM_ASSERT(vm, reg3 < VM_NUM_OP_END);
   MVM_SWITCH (reg3, (VM_NUM_OP_END - 1)) {
     MVM_CASE(VM_NUM_OP_LESS_THAN): {
@@ -2839,6 +3776,10 @@ SUB_OP_NUM_OP: {
     }
   } // End of switch vm_TeNumberOp for int32
 
+  #if MVM_RECYCLE_NUMBER_BOXES
+  vm_recycleNumberBox(vm, lpProgramCounter, reg1, reg2);
+  #endif
+
   // Convert the result from a 32-bit integer
   if ((reg1I >= VM_MIN_INT14) && (reg1I <= VM_MAX_INT14)) {
     CODE_COVERAGE(103); // Hit
@@ -2848,6 +3789,10 @@ SUB_OP_NUM_OP: {
     FLUSH_REGISTER_CACHE();
     reg1 = mvm_newInt32(vm, reg1I);
     CACHE_REGISTERS();
+    #if MVM_RECYCLE_NUMBER_BOXES
+    vm->numberBox = reg1;
+    vm->lpAfterNumberBox = lpProgramCounter;
+    #endif
   }
 
   goto SUB_TAIL_POP_0_PUSH_REG1;
@@ -2876,7 +3821,7 @@ SUB_OP_EXTENDED_2: {
   }
 
   VM_ASSERT(vm, reg3 < VM_OP2_END);
-  MVM_SWITCH (reg3, (VM_OP2_END - 1)) {
+  DISPATCH(opcodeEx2Table, reg3, (VM_OP2_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
 /*                             VM_OP2_BRANCH_1                               */
@@ -2885,7 +3830,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg2: condition to branch on                                          */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_BRANCH_1): {
+    DISPATCH_CASE (VM_OP2_BRANCH_1): {
       CODE_COVERAGE(130); // Hit
       SIGN_EXTEND_REG_1();
       goto SUB_BRANCH_COMMON;
@@ -2898,7 +3843,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_STORE_ARG): {
+    DISPATCH_CASE (VM_OP2_STORE_ARG): {
       CODE_COVERAGE_UNTESTED(131); // Not hit
       #if MVM_DONT_TRUST_BYTECODE
         // The ability to write to argument slots is intended as an optimization
@@ -2924,7 +3869,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_STORE_SCOPED_2): {
+    DISPATCH_CASE (VM_OP2_STORE_SCOPED_2): {
       CODE_COVERAGE(132); // Hit
       goto SUB_OP_STORE_SCOPED;
     }
@@ -2936,18 +3881,35 @@ SUB_OP_EXTENDED_2: {
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_STORE_VAR_2): {
+    DISPATCH_CASE (VM_OP2_STORE_VAR_2): {
       CODE_COVERAGE_UNTESTED(133); // Not hit
       goto SUB_OP_STORE_VAR;
     }
 
+#if MVM_SUPERINSTRUCTIONS
+/* ------------------------------------------------------------------------- */
+/*                        VM_OP2_FUSED_STORE_LOAD_VAR                        */
+/*   STORE_VAR_1 followed by LOAD_VAR_1 (see vm_fuseFunction)                */
+/*   Expects:                                                                */
+/*     reg1: index to store to (high nibble) and to load (low nibble)        */
+/*     reg2: value to store                                                  */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP2_FUSED_STORE_LOAD_VAR): {
+      CODE_COVERAGE_UNTESTED(737); // Not hit
+      pStackPointer[-(reg1 >> 4) - 1] = reg2;
+      reg1 &= 0xF;
+      goto SUB_OP_LOAD_VAR;
+    }
+#endif // MVM_SUPERINSTRUCTIONS
+
 /* ------------------------------------------------------------------------- */
 /*                             VM_OP2_JUMP_1                                 */
 /*   Expects:                                                                */
 /*     reg1: signed 8-bit offset to branch to, encoded in 16-bit unsigned    */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_JUMP_1): {
+    DISPATCH_CASE (VM_OP2_JUMP_1): {
       CODE_COVERAGE(136); // Hit
       SIGN_EXTEND_REG_1();
       goto SUB_JUMP_COMMON;
@@ -2959,7 +3921,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: arg count                                                       */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_CALL_HOST): {
+    DISPATCH_CASE (VM_OP2_CALL_HOST): {
       CODE_COVERAGE_UNTESTED(137); // Not hit
       // TODO: Unit tests for the host calling itself etc.
 
@@ -2977,7 +3939,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: arg count                                                       */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_CALL_3): {
+    DISPATCH_CASE (VM_OP2_CALL_3): {
       CODE_COVERAGE(142); // Hit
 
       reg1 /* argCountAndFlags */ |= AF_PUSHED_FUNCTION;
@@ -2993,7 +3955,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: index into short-call table                                      */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_CALL_6): {
+    DISPATCH_CASE (VM_OP2_CALL_6): {
       CODE_COVERAGE_UNTESTED(145); // Not hit
       goto SUB_CALL_SHORT;
     }
@@ -3004,7 +3966,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: unsigned closure scoped variable index                          */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_LOAD_SCOPED_2): {
+    DISPATCH_CASE (VM_OP2_LOAD_SCOPED_2): {
       CODE_COVERAGE(146); // Hit
       goto SUB_OP_LOAD_SCOPED;
     }
@@ -3015,7 +3977,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: unsigned variable index relative to stack pointer               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_LOAD_VAR_2): {
+    DISPATCH_CASE (VM_OP2_LOAD_VAR_2): {
       CODE_COVERAGE_UNTESTED(147); // Not hit
       goto SUB_OP_LOAD_VAR;
     }
@@ -3026,7 +3988,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: unsigned variable index relative to stack pointer               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_LOAD_ARG_2): {
+    DISPATCH_CASE (VM_OP2_LOAD_ARG_2): {
       CODE_COVERAGE_UNTESTED(148); // Not hit
       VM_NOT_IMPLEMENTED(vm);
       err = MVM_E_FATAL_ERROR_MUST_KILL_VM;
@@ -3039,7 +4001,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: The Ex-4 instruction opcode                                     */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_EXTENDED_4): {
+    DISPATCH_CASE (VM_OP2_EXTENDED_4): {
       CODE_COVERAGE(149); // Hit
       goto SUB_OP_EXTENDED_4;
     }
@@ -3049,7 +4011,7 @@ SUB_OP_EXTENDED_2: {
 /*   reg1: Array capacity                                                    */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_ARRAY_NEW): {
+    DISPATCH_CASE (VM_OP2_ARRAY_NEW): {
       CODE_COVERAGE(100); // Hit
 
       // Allocation size excluding header
@@ -3071,6 +4033,8 @@ SUB_OP_EXTENDED_2: {
         CACHE_REGISTERS();
         MVM_SET_LOCAL(arr, ShortPtr_decode(vm, pStackPointer[-1])); // arr may have moved during the collection
         MVM_GET_LOCAL(arr)->dpData = ShortPtr_encode(vm, pData);
+        // The array itself may have been promoted by the allocation
+        gc_writeBarrier(vm, &MVM_GET_LOCAL(arr)->dpData, MVM_GET_LOCAL(arr)->dpData);
         uint16_t* p = pData;
         uint16_t n = capacity;
         while (n--)
@@ -3086,7 +4050,7 @@ SUB_OP_EXTENDED_2: {
 /*     reg1: Fixed-array length (8-bit)                                      */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP2_FIXED_ARRAY_NEW_2): {
+    DISPATCH_CASE (VM_OP2_FIXED_ARRAY_NEW_2): {
       CODE_COVERAGE_UNTESTED(135); // Not hit
       goto SUB_FIXED_ARRAY_NEW;
     }
@@ -3145,7 +4109,7 @@ SUB_OP_EXTENDED_3: {
   }
 
   VM_ASSERT(vm, reg3 < VM_OP3_END);
-  MVM_SWITCH (reg3, (VM_OP3_END - 1)) {
+  DISPATCH(opcodeEx3Table, reg3, (VM_OP3_END - 1)) {
 
 /* ------------------------------------------------------------------------- */
 /*                             VM_OP3_POP_N                                  */
@@ -3153,7 +4117,7 @@ SUB_OP_EXTENDED_3: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_POP_N): {
+    DISPATCH_CASE (VM_OP3_POP_N): {
       CODE_COVERAGE(602); // Hit
       READ_PGM_1(reg1);
       while (reg1--)
@@ -3167,7 +4131,7 @@ SUB_OP_EXTENDED_3: {
 /*     Nothing                                                              */
 /* -------------------------------------------------------------------------*/
 
-    MVM_CASE (VM_OP3_SCOPE_DISCARD): {
+    DISPATCH_CASE (VM_OP3_SCOPE_DISCARD): {
       CODE_COVERAGE(634); // Hit
       reg->closure = VM_VALUE_UNDEFINED;
       goto SUB_TAIL_POP_0_PUSH_0;
@@ -3183,7 +4147,7 @@ SUB_OP_EXTENDED_3: {
 /*     Nothing                                                               */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_SCOPE_CLONE): {
+    DISPATCH_CASE (VM_OP3_SCOPE_CLONE): {
       CODE_COVERAGE(635); // Hit
 
       VM_ASSERT(vm, reg->closure != VM_VALUE_UNDEFINED);
@@ -3195,13 +4159,102 @@ SUB_OP_EXTENDED_3: {
       goto SUB_TAIL_POP_0_PUSH_0;
     }
 
+#if MVM_SUPERINSTRUCTIONS
+/* ------------------------------------------------------------------------- */
+/*                        VM_OP3_FUSED_LOAD_VAR_NUM_OP                       */
+/*   LOAD_VAR_1, LOAD_SMALL_LITERAL and NUM_OP (see vm_fuseFunction)         */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP3_FUSED_LOAD_VAR_NUM_OP): {
+      CODE_COVERAGE_UNTESTED(738); // Not hit
+      READ_PGM_1(reg1); // Variable index and small literal ID
+      reg2 = pStackPointer[-(reg1 >> 4) - 1];
+      if (reg2 == VM_VALUE_DELETED) {
+        err = vm_newError(vm, MVM_E_TDZ_ERROR);
+        goto SUB_EXIT;
+      }
+      PUSH(reg2); // Left operand
+      reg1 &= 0xF;
+      #if MVM_DONT_TRUST_BYTECODE
+      if (reg1 >= smallLiteralsSize) {
+        err = vm_newError(vm, MVM_E_INVALID_BYTECODE);
+        goto SUB_EXIT;
+      }
+      #endif
+      reg2 = smallLiterals[reg1]; // Right operand, as if popped
+      READ_PGM_1(reg1); // The original NUM_OP instruction
+      reg1 &= 0xF;
+      goto SUB_OP_NUM_OP;
+    }
+
+/* ------------------------------------------------------------------------- */
+/*                       VM_OP3_FUSED_LOAD_LITERAL_GET                       */
+/*   LOAD_LITERAL followed by OBJECT_GET_1 (see vm_fuseFunction)             */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP3_FUSED_LOAD_LITERAL_GET): {
+      CODE_COVERAGE_UNTESTED(739); // Not hit
+    SUB_OP_FUSED_OBJECT_GET:
+      READ_PGM_2(reg1); // Property key
+      PUSH(reg1);
+      // Skip the OBJECT_GET_1 byte, which is left in place, so that the
+      // property cache site is the same as for the unfused instructions
+      lpProgramCounter = LongPtr_add(lpProgramCounter, 1);
+      goto SUB_OP_OBJECT_GET_1;
+    }
+
+/* ------------------------------------------------------------------------- */
+/*                         VM_OP3_FUSED_LOAD_ARG_GET                         */
+/*   LOAD_ARG_1, LOAD_LITERAL and OBJECT_GET_1 (see vm_fuseFunction)         */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP3_FUSED_LOAD_ARG_GET): {
+      CODE_COVERAGE_UNTESTED(740); // Not hit
+      READ_PGM_1(reg1); // Argument index
+      if (reg1 < (uint8_t)reg->argCountAndFlags) {
+        CODE_COVERAGE_UNTESTED(741); // Not hit
+        reg1 = reg->pArgs[reg1];
+      } else {
+        CODE_COVERAGE_UNTESTED(742); // Not hit
+        reg1 = VM_VALUE_UNDEFINED;
+      }
+      PUSH(reg1); // Object
+      goto SUB_OP_FUSED_OBJECT_GET;
+    }
+
+/* ------------------------------------------------------------------------- */
+/*                         VM_OP3_FUSED_LOAD_VAR_GET                         */
+/*   LOAD_VAR_1, LOAD_LITERAL and OBJECT_GET_1 (see vm_fuseFunction)         */
+/*   Expects:                                                                */
+/*     Nothing                                                               */
+/* ------------------------------------------------------------------------- */
+
+    DISPATCH_CASE (VM_OP3_FUSED_LOAD_VAR_GET): {
+      CODE_COVERAGE_UNTESTED(743); // Not hit
+      READ_PGM_1(reg1); // Variable index
+      reg1 = pStackPointer[-reg1 - 1];
+      if (reg1 == VM_VALUE_DELETED) {
+        err = vm_newError(vm, MVM_E_TDZ_ERROR);
+        goto SUB_EXIT;
+      }
+      PUSH(reg1); // Object
+      goto SUB_OP_FUSED_OBJECT_GET;
+    }
+#endif // MVM_SUPERINSTRUCTIONS
+
 /* ------------------------------------------------------------------------- */
 /*                             VM_OP3_JUMP_2                                 */
 /*   Expects:                                                                */
 /*     reg1: signed offset                                                   */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_JUMP_2): {
+    DISPATCH_CASE (VM_OP3_JUMP_2): {
       CODE_COVERAGE(153); // Hit
       goto SUB_JUMP_COMMON;
     }
@@ -3212,7 +4265,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg1: literal value                                                   */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_LOAD_LITERAL): {
+    DISPATCH_CASE (VM_OP3_LOAD_LITERAL): {
       CODE_COVERAGE(154); // Hit
       goto SUB_TAIL_POP_0_PUSH_REG1;
     }
@@ -3223,7 +4276,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg1: global variable index                                           */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_LOAD_GLOBAL_3): {
+    DISPATCH_CASE (VM_OP3_LOAD_GLOBAL_3): {
       CODE_COVERAGE(155); // Hit
       reg1 = globals[reg1];
       goto SUB_TAIL_POP_0_PUSH_REG1;
@@ -3235,7 +4288,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg1: scoped variable index                                           */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_LOAD_SCOPED_3): {
+    DISPATCH_CASE (VM_OP3_LOAD_SCOPED_3): {
       CODE_COVERAGE_UNTESTED(600); // Not hit
       goto SUB_OP_LOAD_SCOPED;
     }
@@ -3247,7 +4300,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg2: condition                                                       */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_BRANCH_2): {
+    DISPATCH_CASE (VM_OP3_BRANCH_2): {
       CODE_COVERAGE(156); // Hit
       goto SUB_BRANCH_COMMON;
     }
@@ -3259,7 +4312,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_STORE_GLOBAL_3): {
+    DISPATCH_CASE (VM_OP3_STORE_GLOBAL_3): {
       CODE_COVERAGE(157); // Hit
       globals[reg1] = reg2;
       goto SUB_TAIL_POP_0_PUSH_0;
@@ -3272,7 +4325,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg2: value to store                                                  */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_STORE_SCOPED_3): {
+    DISPATCH_CASE (VM_OP3_STORE_SCOPED_3): {
       CODE_COVERAGE_UNTESTED(601); // Not hit
       goto SUB_OP_STORE_SCOPED;
     }
@@ -3284,11 +4337,29 @@ SUB_OP_EXTENDED_3: {
 /*     reg2: object value                                                    */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_OBJECT_GET_2): {
+    DISPATCH_CASE (VM_OP3_OBJECT_GET_2): {
       CODE_COVERAGE_UNTESTED(158); // Not hit
-      VM_NOT_IMPLEMENTED(vm);
-      err = MVM_E_FATAL_ERROR_MUST_KILL_VM;
-      goto SUB_EXIT;
+      // The object goes back into the stack slot it was popped from, so that
+      // it's anchored for the GC. The key is a literal from the bytecode, so
+      // it can't be a pointer into GC memory and doesn't need anchoring.
+      PUSH(reg2);
+      reg3 /* site */ = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode);
+      #if MVM_PROPERTY_CACHE_SIZE
+      regLP1 = vm_propertyCacheLookup(vm, reg3, reg2, reg1);
+      if (regLP1) {
+        CODE_COVERAGE_UNTESTED(661); // Not hit
+        pStackPointer[-1] = LongPtr_read2_aligned(regLP1);
+        goto SUB_TAIL_POP_0_PUSH_0;
+      } else {
+        CODE_COVERAGE_UNTESTED(662); // Not hit
+      }
+      #endif // MVM_PROPERTY_CACHE_SIZE
+      Value propertyName = reg1;
+      FLUSH_REGISTER_CACHE();
+      err = getProperty(vm, pStackPointer - 1, &propertyName, pStackPointer - 1, reg3);
+      CACHE_REGISTERS();
+      if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+      goto SUB_TAIL_POP_0_PUSH_0;
     }
 
 /* ------------------------------------------------------------------------- */
@@ -3298,7 +4369,7 @@ SUB_OP_EXTENDED_3: {
 /*     reg2: value                                                           */
 /* ------------------------------------------------------------------------- */
 
-    MVM_CASE (VM_OP3_OBJECT_SET_2): {
+    DISPATCH_CASE (VM_OP3_OBJECT_SET_2): {
       CODE_COVERAGE_UNTESTED(159); // Not hit
       VM_NOT_IMPLEMENTED(vm);
       err = MVM_E_FATAL_ERROR_MUST_KILL_VM;
@@ -3697,7 +4768,29 @@ SUB_CALL_HOST_COMMON: {
   // Call the host function
   err = hostFunction(vm, hostFunctionID, pResult, regP1, (uint8_t)reg3);
 
-  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  if (err != MVM_E_SUCCESS) {
+    CODE_COVERAGE_UNTESTED(852); // Not hit
+    #if (MVM_SAFE_MODE)
+      reg->usingCachedRegisters = true;
+      mvm_releaseHandle(vm, &hClosureCopy);
+    #endif
+    if (err == MVM_E_HOST_PENDING) {
+      CODE_COVERAGE_UNTESTED(853); // Not hit
+      // An async host function. The result slot stays on the stack for
+      // mvm_completeHostCall to fill.
+      if (canYield) {
+        CODE_COVERAGE_UNTESTED(854); // Not hit
+        vm->pendingHostCall = reg1;
+        goto SUB_YIELD;
+      } else {
+        CODE_COVERAGE_ERROR_PATH(855); // Not hit
+        err = MVM_E_CANNOT_SUSPEND;
+      }
+    } else {
+      CODE_COVERAGE_UNTESTED(856); // Not hit
+    }
+    goto SUB_EXIT;
+  }
 
   // The host function should not have left the stack unbalanced. A failure here
   // is not really a problem with the host since the Microvium C API doesn't
@@ -3740,7 +4833,7 @@ SUB_CALL_HOST_COMMON: {
   reg1 = *pResult;
 
   // Pop the result slot
-  POP();
+  (void)POP();
 
   goto SUB_POP_ARGS;
 }
@@ -3764,6 +4857,14 @@ SUB_CALL_BYTECODE_FUNC: {
   // Move PC to point to new function code
   lpProgramCounter = LongPtr_add(vm->lpBytecode, reg2);
 
+  #if MVM_PROFILE
+  vm_profileEnterFunction(vm, reg2);
+  #endif
+
+  #if MVM_SUPERINSTRUCTIONS
+  vm_fuseFunction(vm, reg2);
+  #endif
+
   // Check the stack space required (before we PUSH_REGISTERS)
   READ_PGM_1(reg2 /* requiredFrameSizeWords */);
   reg2 /* requiredFrameSizeWords */ += VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS;
@@ -3800,6 +4901,10 @@ SUB_NUM_OP_FLOAT64: {
   if (reg1) reg1F = mvm_toFloat64(vm, reg1);
   MVM_FLOAT64 reg2F = mvm_toFloat64(vm, reg2);
 
+  #if MVM_RECYCLE_NUMBER_BOXES
+  vm_recycleNumberBox(vm, lpProgramCounter, reg1, reg2);
+  #endif
+
   VM_ASSERT(vm, reg3 < VM_NUM_OP_END);
   MVM_SWITCH (reg3, (VM_NUM_OP_END - 1)) {
     MVM_CASE(VM_NUM_OP_LESS_THAN): {
@@ -3877,10 +4982,31 @@ SUB_NUM_OP_FLOAT64: {
   FLUSH_REGISTER_CACHE();
   reg1 = mvm_newNumber(vm, reg1F);
   CACHE_REGISTERS();
+  #if MVM_RECYCLE_NUMBER_BOXES
+  if (Value_isShortPtr(reg1)) {
+    CODE_COVERAGE(757); // Hit
+    vm->numberBox = reg1;
+    vm->lpAfterNumberBox = lpProgramCounter;
+  }
+  #endif
   goto SUB_TAIL_POP_0_PUSH_REG1;
 } // End of SUB_NUM_OP_FLOAT64
 #endif // MVM_SUPPORT_FLOAT
 
+#if MVM_COMPUTED_GOTO
+/* ------------------------------------------------------------------------- */
+/*                              SUB_OP_RESERVED                              */
+/*   Jump table target for reserved opcodes. With MVM_SWITCH, these fall     */
+/*   through the switch to VM_ASSERT_UNREACHABLE instead.                    */
+/* ------------------------------------------------------------------------- */
+SUB_OP_RESERVED: {
+  CODE_COVERAGE_UNTESTED(658); // Not hit
+  INSTRUCTION_RESERVED();
+  err = vm_newError(vm, MVM_E_INVALID_BYTECODE);
+  goto SUB_EXIT;
+}
+#endif // MVM_COMPUTED_GOTO
+
 /* --------------------------------------------------------------------------
                                      TAILS
 
@@ -3889,46 +5015,61 @@ general must keep their arguments on the stack right until the end, to prevent
 any pointer arguments from becoming dangling if the instruction triggers a GC
 collection. So popping the arguments is done at the end of the instruction, and
 the number of pops is common to many different instructions.
+
+Each tail finishes the instruction itself and ends with DISPATCH_NEXT, rather
+than falling through to a shared one.
  * -------------------------------------------------------------------------- */
 
 SUB_TAIL_PUSH_REG1_BOOL:
   CODE_COVERAGE(489); // Hit
   reg1 = reg1 ? VM_VALUE_TRUE : VM_VALUE_FALSE;
-  goto SUB_TAIL_POP_0_PUSH_REG1;
+  PUSH(reg1);
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_2_PUSH_REG1:
   CODE_COVERAGE(227); // Hit
   pStackPointer -= 1;
-  goto SUB_TAIL_POP_1_PUSH_REG1;
+  pStackPointer[-1] = reg1;
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_0_PUSH_REG1:
   CODE_COVERAGE(164); // Hit
   PUSH(reg1);
-  goto SUB_TAIL_POP_0_PUSH_0;
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_3_PUSH_0:
   CODE_COVERAGE(611); // Hit
   pStackPointer -= 3;
-  goto SUB_TAIL_POP_0_PUSH_0;
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_1_PUSH_0:
   CODE_COVERAGE(617); // Hit
   pStackPointer -= 1;
-  goto SUB_TAIL_POP_0_PUSH_0;
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_1_PUSH_REG1:
   CODE_COVERAGE(126); // Hit
   pStackPointer[-1] = reg1;
-  goto SUB_TAIL_POP_0_PUSH_0;
+  if (err != MVM_E_SUCCESS) goto SUB_EXIT;
+  DISPATCH_NEXT();
 
 SUB_TAIL_POP_0_PUSH_0:
   CODE_COVERAGE(125); // Hit
   if (err != MVM_E_SUCCESS) goto SUB_EXIT;
-  goto SUB_DO_NEXT_INSTRUCTION;
+  DISPATCH_NEXT();
 
 SUB_EXIT:
   CODE_COVERAGE(165); // Hit
 
+  #if MVM_PROFILE
+  vm_profileStop(vm);
+  #endif
+
   #if MVM_SAFE_MODE
   FLUSH_REGISTER_CACHE();
   VM_ASSERT(vm, registerValuesAtEntry.pStackPointer <= reg->pStackPointer);
@@ -3946,6 +5087,8 @@ SUB_EXIT:
   // stack.
   *reg = registerValuesAtEntry;
 
+  vm->suspended = suspendedAtEntry;
+
   // If the stack is empty, we can free it. It may not be empty if this is a
   // reentrant call, in which case there would be other frames below this one.
   if (reg->pStackPointer == getBottomOfStack(vm->stack)) {
@@ -3954,6 +5097,35 @@ SUB_EXIT:
     vm->stack = NULL;
   }
 
+  return err;
+
+/* ------------------------------------------------------------------------- */
+/*                                                                           */
+/*                                 SUB_YIELD                                 */
+/*                                                                           */
+/*   Suspend the outermost call until mvm_resume. Unlike SUB_EXIT, the stack */
+/*   and registers are kept as they are, at the start of an instruction or   */
+/*   after a pending host call.                                              */
+/*                                                                           */
+/*   Expects:                                                                */
+/*     err: MVM_E_YIELDED or MVM_E_HOST_PENDING                              */
+/* ------------------------------------------------------------------------- */
+SUB_YIELD:
+  CODE_COVERAGE_UNTESTED(847); // Not hit
+
+  #if MVM_PROFILE
+  vm_profileStop(vm);
+  #endif
+
+  FLUSH_REGISTER_CACHE();
+  vm->suspended = true;
+
+  #if MVM_RECYCLE_NUMBER_BOXES
+  // The host may call the VM before resuming, and the box may no longer be the
+  // last allocation or even live by then
+  vm->numberBox = 0;
+  #endif
+
   return err;
 } // End of mvm_call
 
@@ -4072,6 +5244,18 @@ static bool DynamicPtr_isRomPtr(VM* vm, DynamicPtr dp) {
 #endif // MVM_SAFE_MODE
 
 TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport) {
+  return vm_restore(result, lpBytecode, bytecodeSize_, context, resolveImport, lpBytecode);
+}
+
+/**
+ * Common implementation of mvm_restore and mvm_restoreHibernated.
+ *
+ * @param resolveImport Function to resolve the imports, or NULL for a warm
+ * restart (mvm_restoreHibernated). A warm restart copies the resolved import
+ * table from `lpSavedImports` and skips `loadPointers`, since the image was
+ * created by this same build of the firmware.
+ */
+static TeError vm_restore(mvm_VM** result, LongPtr lpBytecode, size_t bytecodeSize_, void* context, mvm_TfResolveImport resolveImport, LongPtr lpSavedImports) {
   // Note: these are declared here because some compilers give warnings when "goto" bypasses some variable declarations
   mvm_TfHostFunction* resolvedImports;
   uint16_t importTableOffset;
@@ -4117,8 +5301,11 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
     return MVM_E_INVALID_BYTECODE;
   }
 
+  // A warm restart doesn't recompute the CRC, which would take longer than the
+  // rest of the restore. mvm_restoreHibernated has checked it against the one
+  // saved with the build ID instead.
   uint16_t expectedCRC = header.crc;
-  if (!MVM_CHECK_CRC16_CCITT(LongPtr_add(lpBytecode, 8), (uint16_t)bytecodeSize - 8, expectedCRC)) {
+  if (resolveImport && !MVM_CHECK_CRC16_CCITT(LongPtr_add(lpBytecode, 8), (uint16_t)bytecodeSize - 8, expectedCRC)) {
     CODE_COVERAGE_ERROR_PATH(54); // Not hit
     return MVM_E_BYTECODE_CRC_FAIL;
   }
@@ -4170,6 +5357,17 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   vm->lpBytecode = lpBytecode;
   vm->globals = (void*)(resolvedImports + importCount);
   vm->stopAfterNInstructions = -1;
+  vm->gc_handleFreeList = HANDLE_NONE;
+  #if MVM_PROFILE
+  mvm_resetProfile(vm);
+  #endif
+  #if MVM_SUPERINSTRUCTIONS
+  err = vm_copyBytecode(vm);
+  if (err != MVM_E_SUCCESS) {
+    CODE_COVERAGE_ERROR_PATH(744); // Not hit
+    goto SUB_EXIT;
+  }
+  #endif
 
   importTableOffset = header.sectionOffsets[BCS_IMPORT_TABLE];
   lpImportTableStart = LongPtr_add(lpBytecode, importTableOffset);
@@ -4177,6 +5375,12 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   // Resolve imports (linking)
   resolvedImport = resolvedImports;
   lpImportTableEntry = lpImportTableStart;
+  if (!resolveImport) {
+    CODE_COVERAGE(718); // Hit
+    // Warm restart: the imports were resolved by this build before hibernating
+    memcpy_long(resolvedImports, lpSavedImports, sizeof(mvm_TfHostFunction) * importCount);
+    lpImportTableEntry = lpImportTableEnd;
+  }
   while (lpImportTableEntry < lpImportTableEnd) {
     CODE_COVERAGE(431); // Hit
     mvm_HostFunctionID hostFunctionID = READ_FIELD_2(lpImportTableEntry, vm_TsImportTableEntry, hostFunctionID);
@@ -4208,6 +5412,10 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
   initialHeapSize = bytecodeSize - initialHeapOffset;
   vm->heapSizeUsedAfterLastGC = initialHeapSize;
   vm->heapHighWaterMark = initialHeapSize;
+  #if MVM_GC_POLICY
+  vm->gc_policyBaseSize = initialHeapSize;
+  vm->gc_policyBaseTime = GC_CLOCK();
+  #endif
 
   if (initialHeapSize) {
     CODE_COVERAGE(435); // Hit
@@ -4224,16 +5432,36 @@ TeError mvm_restore(mvm_VM** result, MVM_LONG_PTR_TYPE lpBytecode, size_t byteco
     // represented as ShortPtr (and no others). We only need to call
     // `loadPointers` if there is an initial heap at all, otherwise there
     // will be no pointers to it.
+    #if MVM_NATIVE_POINTER_IS_16_BIT || MVM_USE_SINGLE_RAM_PAGE
     loadPointers(vm, (uint8_t*)heapStart);
+    #else
+    // When ShortPtr is an offset in the heap, it's the same as the serialized
+    // form, and `loadPointers` only serves to validate the pointers. A warm
+    // restart can skip this because the image was created by this build.
+    if (resolveImport) {
+      CODE_COVERAGE(719); // Hit
+      loadPointers(vm, (uint8_t*)heapStart);
+    } else {
+      CODE_COVERAGE(720); // Hit
+    }
+    #endif
   } else {
     CODE_COVERAGE(436); // Hit
   }
 
+  #if MVM_GENERATIONAL_GC
+  // The restored heap is the initial old generation
+  gc_sealOldGeneration(vm);
+  #endif
+
 SUB_EXIT:
   if (err != MVM_E_SUCCESS) {
     CODE_COVERAGE_ERROR_PATH(437); // Not hit
     *result = NULL;
     if (vm) {
+      #if MVM_SUPERINSTRUCTIONS
+      vm_free(vm, vm->pBytecodeCopy);
+      #endif
       vm_free(vm, vm);
       vm = NULL;
     } else {
@@ -4351,6 +5579,20 @@ void* mvm_getContext(VM* vm) {
 void mvm_free(VM* vm) {
   CODE_COVERAGE(166); // Hit
 
+  #if MVM_INCREMENTAL_GC
+  // Discard a collection in progress, including its tospace
+  if (vm->gc_pIncremental) {
+    CODE_COVERAGE(717); // Hit
+    TsBucket* bucket = vm->gc_pIncremental->gc.lastBucket;
+    while (bucket) {
+      TsBucket* prev = bucket->prev;
+      vm_free(vm, bucket);
+      bucket = prev;
+    }
+    vm_free(vm, vm->gc_pIncremental);
+  }
+  #endif // MVM_INCREMENTAL_GC
+
   gc_freeGCMemory(vm);
 
   // The stack may be allocated if `mvm_free` is called from the an error
@@ -4365,6 +5607,39 @@ void mvm_free(VM* vm) {
   // A compliant implementation of `free` will already check for null
   vm_free(vm, vm->stack);
 
+  uint16_t page;
+  for (page = 0; page < vm->gc_handlePageCount; page++) {
+    vm_free(vm, vm->gc_handlePages[page]);
+  }
+  vm_free(vm, vm->gc_handlePages);
+
+  #if MVM_INTERN_INDEX
+  vm_free(vm, vm->internIndex);
+  #endif
+
+  #if MVM_SAMPLING_PROFILER
+  vm_free(vm, vm->pSamples);
+  #endif
+
+  #if MVM_HEAP_PROFILE
+  vm_free(vm, vm->pHeapProfile);
+  #endif
+
+  #if MVM_SUPERINSTRUCTIONS
+  vm_free(vm, vm->pBytecodeCopy);
+  #endif
+
+  #if MVM_EXTERNAL_BUFFERS
+  // The host memory is no longer referenced by anything
+  uint16_t i;
+  for (i = 0; i < vm->externalBufferCapacity; i++) {
+    if (vm->pExternalBuffers[i].view != VM_VALUE_UNDEFINED) {
+      vm_releaseExternalBuffer(&vm->pExternalBuffers[i]);
+    }
+  }
+  vm_free(vm, vm->pExternalBuffers);
+  #endif // MVM_EXTERNAL_BUFFERS
+
   VM_EXEC_SAFE_MODE(memset(vm, 0, sizeof(*vm)));
   vm_free(vm, vm);
 }
@@ -4428,6 +5703,13 @@ RETRY:
   // Write header
   *p++ = vm_makeHeaderWord(vm, typeCode, sizeBytes);
 
+  #if MVM_HEAP_PROFILE
+  if (vm->pHeapProfile) {
+    CODE_COVERAGE_UNTESTED(872); // Not hit
+    vm_heapProfileAllocation(vm, pBucket, p, p[-1]);
+  }
+  #endif
+
   return p;
 
 GROW_HEAP_AND_RETRY:
@@ -4504,6 +5786,14 @@ static inline void* gc_allocateWithConstantHeader(VM* vm, uint16_t header, uint1
 
   pBucket->pEndOfUsedSpace = end;
   *p++ = header;
+
+  #if MVM_HEAP_PROFILE
+  if (vm->pHeapProfile) {
+    CODE_COVERAGE_UNTESTED(873); // Not hit
+    vm_heapProfileAllocation(vm, pBucket, p, header);
+  }
+  #endif
+
   return p;
 
 SLOW:
@@ -4514,10 +5804,26 @@ SLOW:
 // Looks for a variable in the closure scope chain based on its index. Scope
 // records can be stored in ROM in some optimized cases, so this returns a long
 // pointer.
+//
+// With MVM_SCOPE_CACHE_SIZE, a repeated access to the same variable from the
+// same closure is a single cache lookup, however deep the variable is in the
+// chain.
 static LongPtr vm_findScopedVariable(VM* vm, uint16_t varIndex) {
   // Slots are 2 bytes
   uint16_t offset = varIndex << 1;
   Value scope = vm->stack->reg.closure;
+
+  #if MVM_SCOPE_CACHE_SIZE
+  // Closures are 2-byte aligned, so the low bit of the pointer carries nothing
+  TsScopeCacheEntry* pEntry = &vm->scopeCache[(varIndex + (scope >> 1)) & (MVM_SCOPE_CACHE_SIZE - 1)];
+  if ((pEntry->closure == scope) && (pEntry->index == varIndex)) {
+    CODE_COVERAGE(860); // Hit
+    return pEntry->lpVar;
+  }
+  CODE_COVERAGE(861); // Hit
+  Value closure = scope;
+  #endif // MVM_SCOPE_CACHE_SIZE
+
   while (true)
   {
     // The bytecode is corrupt or the compiler has a bug if we hit the bottom of
@@ -4529,6 +5835,12 @@ static LongPtr vm_findScopedVariable(VM* vm, uint16_t varIndex) {
     VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(headerWord) == TC_REF_CLOSURE);
     uint16_t arraySize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
     if (offset < arraySize) {
+      #if MVM_SCOPE_CACHE_SIZE
+      // Entries are direct-mapped, so this evicts whatever was there before
+      pEntry->closure = closure;
+      pEntry->index = varIndex;
+      pEntry->lpVar = LongPtr_add(lpArr, offset);
+      #endif
       return LongPtr_add(lpArr, offset);
     } else {
       offset -= arraySize;
@@ -4562,6 +5874,7 @@ void mvm_getMemoryStats(VM* vm, mvm_TsMemoryStats* r) {
   VM_ASSERT(vm, r != NULL);
 
   memset(r, 0, sizeof *r);
+  gc_completeIncremental(vm);
 
   // Core size
   r->coreSize = sizeof(VM);
@@ -4601,9 +5914,52 @@ void mvm_getMemoryStats(VM* vm, mvm_TsMemoryStats* r) {
     r->virtualHeapUsed = getHeapSize(vm);
     if (r->virtualHeapUsed > r->virtualHeapHighWaterMark)
       r->virtualHeapHighWaterMark = r->virtualHeapUsed;
+    r->allocatedBytes = vm->gc_allocatedBytes + r->virtualHeapUsed - vm->heapSizeUsedAfterLastGC;
     r->virtualHeapAllocatedCapacity = pLastBucket->offsetStart + (uint16_t)(uintptr_t)vm->pLastBucketEndCapacity - (uint16_t)(uintptr_t)getBucketDataBegin(pLastBucket);
   }
 
+  r->gcMajorCollections = vm->gc_majorCount;
+  r->gcMajorPauseTotal = vm->gc_majorPauseTotal;
+  r->gcMajorPauseMax = vm->gc_majorPauseMax;
+  #if MVM_GENERATIONAL_GC
+  r->gcMinorCollections = vm->gc_minorCount;
+  r->gcMinorPauseTotal = vm->gc_minorPauseTotal;
+  r->gcMinorPauseMax = vm->gc_minorPauseMax;
+  #endif
+  #if MVM_INCREMENTAL_GC
+  r->gcIncrementalSteps = vm->gc_stepCount;
+  r->gcStepPauseTotal = vm->gc_stepPauseTotal;
+  r->gcStepPauseMax = vm->gc_stepPauseMax;
+  #endif
+  #if MVM_GC_POLICY
+  r->gcPolicyCollections = vm->gc_policyCount;
+  #endif
+
+  #if MVM_INTERN_INDEX
+  if (vm->internIndex) {
+    CODE_COVERAGE_UNTESTED(671); // Not hit
+    r->fragmentCount++;
+    r->internIndexSize = vm->internIndexCapacity * sizeof (ShortPtr);
+  }
+  #endif // MVM_INTERN_INDEX
+
+  #if MVM_SUPERINSTRUCTIONS
+  r->fragmentCount++;
+  r->bytecodeCopySize = getBytecodeSize(vm) + vm_fusedFunctionsSize(vm);
+  #endif // MVM_SUPERINSTRUCTIONS
+
+  if (vm->gc_handlePages) {
+    CODE_COVERAGE_UNTESTED(871); // Not hit
+    r->fragmentCount += 1 + vm->gc_handlePageCount;
+    r->handleTableSize =
+      vm->gc_handlePageCapacity * sizeof (TsHandlePage*) +
+      vm->gc_handlePageCount * sizeof (TsHandlePage);
+  }
+
+  #if MVM_RECYCLE_NUMBER_BOXES
+  r->numberBoxesRecycled = vm->numberBoxesRecycled;
+  #endif
+
   // Total size
   r->totalSize =
     r->coreSize +
@@ -4612,6 +5968,9 @@ void mvm_getMemoryStats(VM* vm, mvm_TsMemoryStats* r) {
     r->registersSize +
     r->stackAllocatedCapacity +
     r->virtualHeapAllocatedCapacity +
+    r->internIndexSize +
+    r->bytecodeCopySize +
+    r->handleTableSize +
     heapOverheadSize;
 }
 
@@ -4632,6 +5991,46 @@ static void gc_createNextBucket(VM* vm, uint16_t bucketSize, uint16_t minBucketS
 
   VM_ASSERT(vm, minBucketSize <= bucketSize);
 
+  #if MVM_INCREMENTAL_GC
+  // Allocation barrier (see mvm_gcStep). The caller retries the allocation
+  // once the collection is done.
+  if (vm->gc_pIncremental) {
+    CODE_COVERAGE(716); // Hit
+    gc_completeIncremental(vm);
+    return;
+  }
+  #endif // MVM_INCREMENTAL_GC
+
+  #if MVM_GENERATIONAL_GC
+  // If the nursery is full, collect it before growing the heap further
+  uint16_t youngSize = heapSize - vm->gc_nurseryStart;
+  if (youngSize && (youngSize + bucketSize > MVM_GC_NURSERY_SIZE)) {
+    if (vm->gc_pOldLastBucket) {
+      CODE_COVERAGE_UNTESTED(686); // Not hit
+      gc_runMinor(vm);
+    } else {
+      CODE_COVERAGE_UNTESTED(687); // Not hit
+      mvm_runGC(vm, false);
+    }
+    heapSize = getHeapSize(vm);
+  } else {
+    CODE_COVERAGE_UNTESTED(688); // Not hit
+  }
+  #endif // MVM_GENERATIONAL_GC
+
+  #if MVM_GC_POLICY
+  // After the nursery check, so that with generational collection the policy
+  // only decides what to do about what the minor collections leave behind
+  if (gc_policyWantsCollection(vm, heapSize, bucketSize)) {
+    CODE_COVERAGE_UNTESTED(882); // Not hit
+    vm->gc_policyCount++;
+    mvm_runGC(vm, false);
+    heapSize = getHeapSize(vm);
+  } else {
+    CODE_COVERAGE_UNTESTED(883); // Not hit
+  }
+  #endif // MVM_GC_POLICY
+
   // If this tips us over the top of the heap, then we run a collection
   if (heapSize + bucketSize > MVM_MAX_HEAP_SIZE) {
     CODE_COVERAGE(197); // Hit
@@ -5047,6 +6446,14 @@ static void gc_processShortPtrValue(gc_TsGCCollectionState* gc, Value* pValue) {
   const Value spSrc = *pValue;
   VM* const vm = gc->vm;
 
+  #if MVM_GENERATIONAL_GC
+  // A minor collection leaves the old generation where it is
+  if (spSrc < gc->nurseryStart) {
+    CODE_COVERAGE_UNTESTED(689); // Not hit
+    return;
+  }
+  #endif
+
   uint16_t* const pSrc = (uint16_t*)ShortPtr_decode(vm, spSrc);
   // ShortPtr is defined as not encoding null
   VM_ASSERT(vm, pSrc != NULL);
@@ -5061,6 +6468,20 @@ static void gc_processShortPtrValue(gc_TsGCCollectionState* gc, Value* pValue) {
   } else {
     CODE_COVERAGE(465); // Hit
   }
+
+  // References to a rope that has been flattened are replaced by references to
+  // the flat string, so that the rope and its leaves are not copied (see
+  // TsRope).
+  if ((vm_getTypeCodeFromHeaderWord(headerWord) == TC_REF_ROPE) && (((TsRope*)pSrc)->right == VM_VALUE_DELETED)) {
+    CODE_COVERAGE_UNTESTED(792); // Not hit
+    *pValue = ((TsRope*)pSrc)->left;
+    // The flat string is a TC_REF_STRING, so this doesn't recurse further
+    gc_processShortPtrValue(gc, pValue);
+    return;
+  } else {
+    CODE_COVERAGE(793); // Hit
+  }
+
   // Otherwise, we need to move the allocation
 
 SUB_MOVE_ALLOCATION:
@@ -5106,6 +6527,10 @@ SUB_MOVE_ALLOCATION:
     if (dpData != VM_VALUE_NULL) {
       CODE_COVERAGE(469); // Hit
       VM_ASSERT(vm, Value_isShortPtr(dpData));
+      #if MVM_GENERATIONAL_GC
+      // The data of a young array is always allocated after the array itself
+      VM_ASSERT(vm, dpData >= gc->nurseryStart);
+      #endif
 
       // Note: this decodes the pointer against fromspace
       TsFixedLengthArray* pData = ShortPtr_decode(vm, dpData);
@@ -5168,7 +6593,7 @@ SUB_MOVE_ALLOCATION:
         uint16_t childPropCount = (allocationSize - sizeof(TsPropertyList)) / 4;
         totalPropCount += childPropCount;
 
-        uint16_t* end = writePtr + childPropCount;
+        uint16_t* end = writePtr + childPropCount * 2; // 2 words per property
         // Check we have space for the new properties
         if (end > gc->lastBucketEndCapacity) {
           CODE_COVERAGE_UNTESTED(479); // Not hit
@@ -5215,6 +6640,13 @@ SUB_MOVE_ALLOCATION:
 
   ShortPtr spNew = ShortPtr_encodeInToSpace(gc, pNew);
 
+  #if MVM_HEAP_PROFILE
+  if (vm->pHeapProfile) {
+    CODE_COVERAGE_UNTESTED(874); // Not hit
+    vm_heapProfileMove(vm, spSrc, spNew, (uint16_t)((intptr_t)writePtr - (intptr_t)pNew) + 2);
+  }
+  #endif
+
   pOld[-1] = TOMBSTONE_HEADER;
   pOld[0] = spNew; // Forwarding pointer
 
@@ -5232,76 +6664,12 @@ static inline void gc_processValue(gc_TsGCCollectionState* gc, Value* pValue) {
   }
 }
 
-void mvm_runGC(VM* vm, bool squeeze) {
-  CODE_COVERAGE(593); // Hit
-
-  /*
-  This is a semispace collection model based on Cheney's algorithm
-  https://en.wikipedia.org/wiki/Cheney%27s_algorithm. It collects by moving
-  reachable allocations from the fromspace to the tospace and then releasing the
-  fromspace. It starts by moving allocations reachable by the roots, and then
-  iterates through moved allocations, checking the pointers therein, moving the
-  allocations they reference.
-
-  When an object is moved, the space it occupied is changed to a tombstone
-  (TC_REF_TOMBSTONE) which contains a forwarding pointer. When a pointer in
-  tospace is seen to point to an allocation in fromspace, if the fromspace
-  allocation is a tombstone then the pointer can be updated to the forwarding
-  pointer.
-
-  This algorithm relies on allocations in tospace each have a header. Some
-  allocations, such as property cells, don't have a header, but will only be
-  found in fromspace. When copying objects into tospace, the detached property
-  cells are merged into the object's head allocation.
-
-  Note: all pointer _values_ are only processed once each (since their
-  corresponding container is only processed once). This means that fromspace and
-  tospace can be treated as distinct spaces. An unprocessed pointer is
-  interpreted in terms of _fromspace_. Forwarding pointers and pointers in
-  processed allocations always reference _tospace_.
-  */
+// Moves the allocations referenced directly by the roots (globals, handles
+// and the stack)
+static void gc_processRoots(gc_TsGCCollectionState* gc) {
   uint16_t n;
   uint16_t* p;
-
-  uint16_t heapSize = getHeapSize(vm);
-  if (heapSize > vm->heapHighWaterMark)
-    vm->heapHighWaterMark = heapSize;
-
-  // A collection of variables shared by GC routines
-  gc_TsGCCollectionState gc;
-  memset(&gc, 0, sizeof gc);
-  gc.vm = vm;
-
-  // We don't know how big the heap needs to be, so we just allocate the same
-  // amount of space as used last time and then expand as-needed
-  uint16_t estimatedSize = vm->heapSizeUsedAfterLastGC;
-
-  #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
-    // Move the heap address space by 2 bytes on each cycle.
-    vm->gc_heap_shift += 2;
-    if (vm->gc_heap_shift == 0) {
-      // Minimum of 2 bytes just so we have consistency when it overflows
-      vm->gc_heap_shift = 2;
-    }
-    // We shift up the address space by `gc_heap_shift` amount by just
-    // allocating a bucket of that size at the beginning and marking it full.
-    gc_newBucket(&gc, vm->gc_heap_shift, 0);
-    // The heap must be parsable, so we need to have an allocation header to
-    // mark the space. In general, we do not allow allocations to be smaller
-    // than 4 bytes because a tombstone is 4 bytes. However, there can be no
-    // references to this "allocation" so no tombstone is required, so it can
-    // be as small as 2 bytes. I'm using a string here because it's a
-    // "non-container" type, so the GC will not interpret its contents.
-    VM_ASSERT(vm, vm->gc_heap_shift >= 2);
-    *gc.lastBucket->pEndOfUsedSpace = vm_makeHeaderWord(vm, TC_REF_STRING, vm->gc_heap_shift - 2);
-  #endif // MVM_VERY_EXPENSIVE_MEMORY_CHECKS
-
-  if (estimatedSize) {
-    CODE_COVERAGE(493); // Hit
-    gc_newBucket(&gc, estimatedSize, 0);
-  } else {
-    CODE_COVERAGE_UNTESTED(494); // Not hit
-  }
+  VM* vm = gc->vm;
 
   // Roots in global variables (including indirection handles)
   // Note: Interned strings are referenced from a handle and so will be GC'd here
@@ -5311,15 +6679,17 @@ void mvm_runGC(VM* vm, bool squeeze) {
   n = globalsSize / 2;
   TABLE_COVERAGE(n ? 1 : 0, 2, 495); // Hit 1/2
   while (n--)
-    gc_processValue(&gc, p++);
+    gc_processValue(gc, p++);
 
-  // Roots in gc_handles
-  mvm_Handle* handle = vm->gc_handles;
-  TABLE_COVERAGE(handle ? 1 : 0, 2, 496); // Hit 2/2
-  while (handle) {
-    gc_processValue(&gc, &handle->_value);
-    TABLE_COVERAGE(handle->_next ? 1 : 0, 2, 497); // Hit 2/2
-    handle = handle->_next;
+  // Roots in the handle table. Free slots hold `undefined`.
+  TsHandlePage** pPage = vm->gc_handlePages;
+  TsHandlePage** pEndPage = pPage + vm->gc_handlePageCount;
+  TABLE_COVERAGE(pPage != pEndPage ? 1 : 0, 2, 496); // Hit 2/2
+  while (pPage != pEndPage) {
+    p = (*pPage++)->values;
+    n = MVM_HANDLE_PAGE_SIZE;
+    while (n--)
+      gc_processValue(gc, p++);
   }
 
   // Roots on the stack or registers
@@ -5330,7 +6700,7 @@ void mvm_runGC(VM* vm, bool squeeze) {
     VM_ASSERT(vm, reg->usingCachedRegisters == false);
 
     // Roots in scope
-    gc_processValue(&gc, &reg->closure);
+    gc_processValue(gc, &reg->closure);
 
     // Roots on call stack
     uint16_t* beginningOfStack = getBottomOfStack(stack);
@@ -5344,8 +6714,8 @@ void mvm_runGC(VM* vm, bool squeeze) {
       p = beginningOfFrame;
       while (p != endOfFrame) {
         VM_ASSERT(vm, p < endOfFrame);
-        // TODO: It would be an interesting exercise to see if the GC can be written into a single function so that we don't need to pass around the &gc struct everywhere
-        gc_processValue(&gc, p++);
+        // TODO: It would be an interesting exercise to see if the GC can be written into a single function so that we don't need to pass around the gc struct everywhere
+        gc_processValue(gc, p++);
       }
 
       if (beginningOfFrame == beginningOfStack) {
@@ -5361,7 +6731,7 @@ void mvm_runGC(VM* vm, bool squeeze) {
 
       // The saved scope pointer
       Value* pScope = endOfFrame + 1;
-      gc_processValue(&gc, pScope);
+      gc_processValue(gc, pScope);
 
       // The first thing saved during a CALL is the size of the preceding frame
       beginningOfFrame = (uint16_t*)((uint8_t*)endOfFrame - *endOfFrame);
@@ -5371,72 +6741,134 @@ void mvm_runGC(VM* vm, bool squeeze) {
   } else {
     CODE_COVERAGE(500); // Hit
   }
+}
 
-  // Now we process moved allocations to make sure objects they point to are
-  // also moved, and to update pointers to reference the new space
+/**
+ * Process the pointers in the tospace allocation whose header is at `p`,
+ * returning a pointer to the header of the following allocation.
+ */
+static inline uint16_t* gc_processAllocation(gc_TsGCCollectionState* gc, uint16_t* p) {
+  uint16_t header = *p++;
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+  uint16_t words = (size + 1) >> 1;
+
+  // Note: we're comparing the header words here to compare the type code.
+  // The RHS here is constant
+  if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
+    CODE_COVERAGE(502); // Hit
+    return p + words;
+  } else {
+    // Else, container types
+    CODE_COVERAGE(505); // Hit
+  }
+
+  while (words--) { // Hot loop
+    if (Value_isShortPtr(*p))
+      gc_processValue(gc, p);
+    p++;
+  }
+  return p;
+}
 
-  TsBucket* bucket = gc.firstBucket;
+/**
+ * Process the pointers in allocations that have been moved into tospace,
+ * starting at `p` in `bucket`, moving the allocations that they reference in
+ * turn, until the scan catches up with the end of tospace.
+ */
+static void gc_processAllocations(gc_TsGCCollectionState* gc, TsBucket* bucket, uint16_t* p) {
   TABLE_COVERAGE(bucket ? 1 : 0, 2, 501); // Hit 1/2
   // Loop through buckets
   while (bucket) {
-    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
-
     // Loop through allocations in bucket. Note that this loop will hit exactly
     // the end of the bucket even when there are multiple buckets, because empty
     // space in a bucket is truncated when a new one is created (in
     // gc_processValue)
     while (p != bucket->pEndOfUsedSpace) { // Hot loop
-      VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
-      uint16_t header = *p++;
-      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-      uint16_t words = (size + 1) >> 1;
-
-      // Note: we're comparing the header words here to compare the type code.
-      // The RHS here is constant
-      if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
-        CODE_COVERAGE(502); // Hit
-        p += words;
-        continue;
-      } else {
-        // Else, container types
-        CODE_COVERAGE(505); // Hit
-      }
-
-      while (words--) { // Hot loop
-        if (Value_isShortPtr(*p))
-          gc_processValue(&gc, p);
-        p++;
-      }
+      VM_ASSERT(gc->vm, p < bucket->pEndOfUsedSpace);
+      p = gc_processAllocation(gc, p);
     }
 
     // Go to next bucket
     bucket = bucket->next;
     TABLE_COVERAGE(bucket ? 1 : 0, 2, 506); // Hit 2/2
+    if (bucket) {
+      p = (uint16_t*)getBucketDataBegin(bucket);
+    }
   }
+}
 
-  // Release old heap
-  TsBucket* oldBucket = vm->pLastBucket;
-  TABLE_COVERAGE(oldBucket ? 1 : 0, 2, 507); // Hit 1/2
-  while (oldBucket) {
-    TsBucket* prev = oldBucket->prev;
-    vm_free(vm, oldBucket);
-    oldBucket = prev;
-  }
+void mvm_runGC(VM* vm, bool squeeze) {
+  CODE_COVERAGE(593); // Hit
 
-  // Adopt new heap
-  vm->pLastBucket = gc.lastBucket;
-  vm->pLastBucketEndCapacity = gc.lastBucketEndCapacity;
+  /*
+  This is a semispace collection model based on Cheney's algorithm
+  https://en.wikipedia.org/wiki/Cheney%27s_algorithm. It collects by moving
+  reachable allocations from the fromspace to the tospace and then releasing the
+  fromspace. It starts by moving allocations reachable by the roots, and then
+  iterates through moved allocations, checking the pointers therein, moving the
+  allocations they reference.
 
-  uint16_t finalUsedSize = getHeapSize(vm);
-  vm->heapSizeUsedAfterLastGC = finalUsedSize;
+  When an object is moved, the space it occupied is changed to a tombstone
+  (TC_REF_TOMBSTONE) which contains a forwarding pointer. When a pointer in
+  tospace is seen to point to an allocation in fromspace, if the fromspace
+  allocation is a tombstone then the pointer can be updated to the forwarding
+  pointer.
 
-  if (squeeze && (finalUsedSize != estimatedSize)) {
-    CODE_COVERAGE(508); // Hit
-    /*
-    Note: The most efficient way to calculate the exact size needed for the heap
-    is actually to run a collection twice. The collection algorithm itself is
-    almost as efficient as any size-counting algorithm in terms of running time
-    since it needs to iterate the whole reachability graph and all the pointers
+  This algorithm relies on allocations in tospace each have a header. Some
+  allocations, such as property cells, don't have a header, but will only be
+  found in fromspace. When copying objects into tospace, the detached property
+  cells are merged into the object's head allocation.
+
+  Note: all pointer _values_ are only processed once each (since their
+  corresponding container is only processed once). This means that fromspace and
+  tospace can be treated as distinct spaces. An unprocessed pointer is
+  interpreted in terms of _fromspace_. Forwarding pointers and pointers in
+  processed allocations always reference _tospace_.
+
+  With MVM_GENERATIONAL_GC, this is the major collection. See gc_runMinor for
+  the minor collection, which only moves the young allocations.
+  */
+  uint32_t gcStart = GC_CLOCK();
+
+  #if MVM_INCREMENTAL_GC
+  // A collection already started by mvm_gcStep is finished rather than
+  // restarted
+  if (vm->gc_pIncremental) {
+    CODE_COVERAGE(703); // Hit
+    gc_finishIncremental(vm);
+    if (!squeeze) {
+      return;
+    }
+    gcStart = GC_CLOCK();
+  } else {
+    CODE_COVERAGE(704); // Hit
+  }
+  #endif // MVM_INCREMENTAL_GC
+
+  // A collection of variables shared by GC routines
+  gc_TsGCCollectionState gc;
+  uint16_t estimatedSize = gc_beginCollection(vm, &gc);
+
+  // Move the allocations referenced directly by the roots
+  gc_processRoots(&gc);
+
+  // Now we process moved allocations to make sure objects they point to are
+  // also moved, and to update pointers to reference the new space
+  gc_processAllocations(&gc, gc.firstBucket,
+    gc.firstBucket ? (uint16_t*)getBucketDataBegin(gc.firstBucket) : NULL);
+
+  gc_adoptToSpace(vm, &gc);
+  uint16_t finalUsedSize = vm->heapSizeUsedAfterLastGC;
+
+  gc_recordPause(&vm->gc_majorCount, &vm->gc_majorPauseTotal, &vm->gc_majorPauseMax, gcStart);
+
+  if (squeeze && (finalUsedSize != estimatedSize)) {
+    CODE_COVERAGE(508); // Hit
+    /*
+    Note: The most efficient way to calculate the exact size needed for the heap
+    is actually to run a collection twice. The collection algorithm itself is
+    almost as efficient as any size-counting algorithm in terms of running time
+    since it needs to iterate the whole reachability graph and all the pointers
     contained therein. But having a distinct size-counting algorithm is less
     efficient in terms of the amount of code-space (ROM) used, since it must
     duplicate much of the logic to parse the heap. It also needs to keep
@@ -5465,2565 +6897,5319 @@ void mvm_runGC(VM* vm, bool squeeze) {
     mvm_runGC(vm, false);
   } else {
     CODE_COVERAGE(509); // Hit
+    // Note: this is here rather than above so that after a squeeze it's only
+    // done once, in the nested collection.
+    gc_endCollection(vm);
   }
 }
 
 /**
- * Create the call VM call stack and registers
+ * Start a major collection: set up tospace, ready for the roots to be
+ * processed. Returns the estimated size of tospace.
  */
-TeError vm_createStackAndRegisters(VM* vm) {
-  CODE_COVERAGE(225); // Hit
-  // This is freed again at the end of mvm_call. Note: the allocated
-  // memory includes the registers, which are part of the vm_TsStack
-  // structure
-  vm_TsStack* stack = vm_malloc(vm, sizeof (vm_TsStack) + MVM_STACK_SIZE);
-  if (!stack) {
-    CODE_COVERAGE_ERROR_PATH(231); // Not hit
-    return vm_newError(vm, MVM_E_MALLOC_FAIL);
-  }
-  vm->stack = stack;
-  vm_TsRegisters* reg = &stack->reg;
-  memset(reg, 0, sizeof *reg);
-  // The stack grows upward. The bottom is the lowest address.
-  uint16_t* bottomOfStack = getBottomOfStack(stack);
-  reg->pFrameBase = bottomOfStack;
-  reg->pStackPointer = bottomOfStack;
-  reg->lpProgramCounter = vm->lpBytecode; // This is essentially treated as a null value
-  reg->argCountAndFlags = 0;
-  reg->closure = VM_VALUE_UNDEFINED;
-  reg->catchTarget = VM_VALUE_UNDEFINED;
-  VM_ASSERT(vm, reg->pArgs == 0);
+static uint16_t gc_beginCollection(VM* vm, gc_TsGCCollectionState* gc) {
+  uint16_t heapSize = getHeapSize(vm);
+  if (heapSize > vm->heapHighWaterMark)
+    vm->heapHighWaterMark = heapSize;
+  vm->gc_allocatedBytes += heapSize - vm->heapSizeUsedAfterLastGC;
 
-  return MVM_E_SUCCESS;
-}
+  memset(gc, 0, sizeof *gc);
+  gc->vm = vm;
 
-// Lowest address on stack
-static inline uint16_t* getBottomOfStack(vm_TsStack* stack) {
-  CODE_COVERAGE(510); // Hit
-  return (uint16_t*)(stack + 1);
-}
+  #if MVM_PROPERTY_CACHE_SIZE
+  // Everything in the cache is about to move
+  vm_propertyCacheInvalidate(vm);
+  #endif
 
-// Highest possible address on stack (+1) before overflow
-static inline uint16_t* getTopOfStackSpace(vm_TsStack* stack) {
-  CODE_COVERAGE(511); // Hit
-  return getBottomOfStack(stack) + MVM_STACK_SIZE / 2;
-}
+  #if MVM_SCOPE_CACHE_SIZE
+  vm_scopeCacheInvalidate(vm);
+  #endif
 
-#if MVM_DEBUG
-// Some utility functions, mainly to execute in the debugger (could also be copy-pasted as expressions in some cases)
-uint16_t dbgStackDepth(VM* vm) {
-  return (uint16_t)((uint16_t*)vm->stack->reg.pStackPointer - (uint16_t*)(vm->stack + 1));
-}
-uint16_t* dbgStack(VM* vm) {
-  return (uint16_t*)(vm->stack + 1);
-}
-uint16_t dbgPC(VM* vm) {
-  return (uint16_t)((intptr_t)vm->stack->reg.lpProgramCounter - (intptr_t)vm->lpBytecode);
-}
-#endif // MVM_DEBUG
+  #if MVM_RECYCLE_NUMBER_BOXES
+  vm->numberBox = 0;
+  #endif
 
-/**
- * Checks that we have enough stack space for the given size, and updates the
- * high water mark.
- */
-static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t sizeRequiredInWords) {
-  uint16_t* pStackHighWaterMark = pStackPointer + ((intptr_t)sizeRequiredInWords);
-  if (pStackHighWaterMark > getTopOfStackSpace(vm->stack)) {
-    CODE_COVERAGE_ERROR_PATH(233); // Not hit
+  #if MVM_HEAP_PROFILE
+  vm_heapProfileBeginCollection(vm, 0);
+  #endif
 
-    // TODO(low): Since we know the max stack depth for the function, we could
-    // actually grow the stack dynamically rather than allocate it fixed size.
-    // Actually, it seems likely that we could allocate the VM stack on the C
-    // stack, since it's a fixed-size structure anyway.
-    //
-    // (A way to do the allocation on the stack would be to perform a nested
-    // call to mvm_call, and the allocation can be at the beginning of
-    // mvm_call). Otherwise we could just malloc, which has the advantage of
-    // simplicity and we can grow the stack at any time.
-    //
-    // Rather than a segmented stack, it might also be simpler to just grow the
-    // stack size and copy across old data. This has the advantage of keeping
-    // the GC simple.
-    return vm_newError(vm, MVM_E_STACK_OVERFLOW);
-  }
+  // We don't know how big the heap needs to be, so we just allocate the same
+  // amount of space as used last time and then expand as-needed
+  uint16_t estimatedSize = vm->heapSizeUsedAfterLastGC;
 
-  // Stack high-water mark
-  uint16_t stackHighWaterMark = (uint16_t)((intptr_t)pStackHighWaterMark - (intptr_t)getBottomOfStack(vm->stack));
-  if (stackHighWaterMark > vm->stackHighWaterMark) {
-    vm->stackHighWaterMark = stackHighWaterMark;
+  #if MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+    // Move the heap address space by 2 bytes on each cycle.
+    vm->gc_heap_shift += 2;
+    if (vm->gc_heap_shift == 0) {
+      // Minimum of 2 bytes just so we have consistency when it overflows
+      vm->gc_heap_shift = 2;
+    }
+    // We shift up the address space by `gc_heap_shift` amount by just
+    // allocating a bucket of that size at the beginning and marking it full.
+    gc_newBucket(gc, vm->gc_heap_shift, 0);
+    // The heap must be parsable, so we need to have an allocation header to
+    // mark the space. In general, we do not allow allocations to be smaller
+    // than 4 bytes because a tombstone is 4 bytes. However, there can be no
+    // references to this "allocation" so no tombstone is required, so it can
+    // be as small as 2 bytes. I'm using a string here because it's a
+    // "non-container" type, so the GC will not interpret its contents.
+    VM_ASSERT(vm, vm->gc_heap_shift >= 2);
+    *gc->lastBucket->pEndOfUsedSpace = vm_makeHeaderWord(vm, TC_REF_STRING, vm->gc_heap_shift - 2);
+  #endif // MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+
+  if (estimatedSize) {
+    CODE_COVERAGE(493); // Hit
+    gc_newBucket(gc, estimatedSize, 0);
+  } else {
+    CODE_COVERAGE_UNTESTED(494); // Not hit
   }
 
-  return MVM_E_SUCCESS;
+  return estimatedSize;
 }
 
-TeError vm_resolveExport(VM* vm, mvm_VMExportID id, Value* result) {
-  CODE_COVERAGE(17); // Hit
-
-  LongPtr exportTableEnd;
-  LongPtr exportTable = getBytecodeSection(vm, BCS_EXPORT_TABLE, &exportTableEnd);
+// Replace the heap with tospace at the end of a major collection
+static void gc_adoptToSpace(VM* vm, gc_TsGCCollectionState* gc) {
+  #if MVM_EXTERNAL_BUFFERS
+  // Needs the tombstones in fromspace
+  gc_processExternalBuffers(gc);
+  #endif
 
-  // See vm_TsExportTableEntry
-  LongPtr exportTableEntry = exportTable;
-  while (exportTableEntry < exportTableEnd) {
-    CODE_COVERAGE(234); // Hit
-    mvm_VMExportID exportID = LongPtr_read2_aligned(exportTableEntry);
-    if (exportID == id) {
-      CODE_COVERAGE(235); // Hit
-      LongPtr pExportvalue = LongPtr_add(exportTableEntry, 2);
-      mvm_VMExportID exportValue = LongPtr_read2_aligned(pExportvalue);
-      *result = exportValue;
-      return MVM_E_SUCCESS;
-    } else {
-      CODE_COVERAGE(236); // Hit
-    }
-    exportTableEntry = LongPtr_add(exportTableEntry, sizeof (vm_TsExportTableEntry));
+  // Release old heap
+  TsBucket* oldBucket = vm->pLastBucket;
+  TABLE_COVERAGE(oldBucket ? 1 : 0, 2, 507); // Hit 1/2
+  while (oldBucket) {
+    TsBucket* prev = oldBucket->prev;
+    vm_free(vm, oldBucket);
+    oldBucket = prev;
   }
 
-  *result = VM_VALUE_UNDEFINED;
-  return vm_newError(vm, MVM_E_UNRESOLVED_EXPORT);
+  // Adopt new heap
+  vm->pLastBucket = gc->lastBucket;
+  vm->pLastBucketEndCapacity = gc->lastBucketEndCapacity;
+
+  vm->heapSizeUsedAfterLastGC = getHeapSize(vm);
+
+  #if MVM_GC_POLICY
+  vm->gc_policyBaseSize = vm->heapSizeUsedAfterLastGC;
+  vm->gc_policyBaseAllocated = vm->gc_allocatedBytes;
+  vm->gc_policyBaseTime = GC_CLOCK();
+  #endif
+
+  #if MVM_HEAP_PROFILE
+  vm_heapProfileEndCollection(vm, false);
+  #endif
 }
 
-TeError mvm_resolveExports(VM* vm, const mvm_VMExportID* idTable, Value* resultTable, uint8_t count) {
-  CODE_COVERAGE(18); // Hit
-  TeError err = MVM_E_SUCCESS;
-  while (count--) {
-    CODE_COVERAGE(237); // Hit
-    TeError tempErr = vm_resolveExport(vm, *idTable++, resultTable++);
-    if (tempErr != MVM_E_SUCCESS) {
-      CODE_COVERAGE_ERROR_PATH(238); // Not hit
-      err = tempErr;
-    } else {
-      CODE_COVERAGE(239); // Hit
-    }
+// Bookkeeping after each collection, once the heap is in its final place
+static void gc_endCollection(VM* vm) {
+  CODE_COVERAGE_UNTESTED(690); // Not hit
+
+  #if MVM_INTERN_INDEX
+  // The interned strings have all moved
+  if (vm->internIndex) {
+    CODE_COVERAGE_UNTESTED(669); // Not hit
+    vm_internIndexRebuild(vm);
+  } else {
+    CODE_COVERAGE_UNTESTED(670); // Not hit
   }
-  return err;
+  #endif // MVM_INTERN_INDEX
+
+  #if MVM_GENERATIONAL_GC
+  // Everything that survived is now old
+  gc_sealOldGeneration(vm);
+  #endif
 }
 
-#if MVM_SAFE_MODE
-static bool vm_isHandleInitialized(VM* vm, const mvm_Handle* handle) {
-  CODE_COVERAGE(22); // Hit
-  mvm_Handle* h = vm->gc_handles;
-  while (h) {
-    CODE_COVERAGE(243); // Hit
-    if (h == handle) {
-      CODE_COVERAGE_UNTESTED(244); // Not hit
-      return true;
+#if MVM_EXTERNAL_BUFFERS
+/**
+ * Update the weak references from the external buffer table to the external
+ * typed arrays, once all the reachable allocations have been moved, and
+ * release the buffers of the arrays that were not reached. The table is
+ * processed before fromspace is released, since the arrays that were moved
+ * have a tombstone there with their new address.
+ */
+static void gc_processExternalBuffers(gc_TsGCCollectionState* gc) {
+  CODE_COVERAGE(837); // Hit
+  VM* vm = gc->vm;
+  uint16_t i;
+  for (i = 0; i < vm->externalBufferCapacity; i++) {
+    TsExternalBuffer* pExternal = &vm->pExternalBuffers[i];
+    ShortPtr view = pExternal->view;
+    if (view == VM_VALUE_UNDEFINED) {
+      CODE_COVERAGE(838); // Hit
+      continue;
+    }
+
+    #if MVM_GENERATIONAL_GC
+    // A minor collection doesn't know whether old allocations are reachable
+    if (view < gc->nurseryStart) {
+      CODE_COVERAGE(839); // Hit
+      continue;
     }
-    else {
-      CODE_COVERAGE(245); // Hit
+    #endif
+
+    uint16_t* pView = ShortPtr_decode(vm, view);
+    if (pView[-1] == TOMBSTONE_HEADER) {
+      CODE_COVERAGE(840); // Hit
+      pExternal->view = pView[0];
+    } else {
+      CODE_COVERAGE(841); // Hit
+      vm_releaseExternalBuffer(pExternal);
     }
-    h = h->_next;
   }
-  return false;
 }
-#endif // MVM_SAFE_MODE
+#endif // MVM_EXTERNAL_BUFFERS
 
-void mvm_initializeHandle(VM* vm, mvm_Handle* handle) {
-  CODE_COVERAGE(19); // Hit
-  VM_ASSERT(vm, !vm_isHandleInitialized(vm, handle));
-  handle->_next = vm->gc_handles;
-  vm->gc_handles = handle;
-  handle->_value = VM_VALUE_UNDEFINED;
+static void gc_recordPause(uint32_t* pCount, uint32_t* pTotal, uint32_t* pMax, uint32_t start) {
+  CODE_COVERAGE_UNTESTED(691); // Not hit
+  uint32_t pause = GC_CLOCK() - start;
+  (*pCount)++;
+  *pTotal += pause;
+  if (pause > *pMax) {
+    *pMax = pause;
+  }
 }
 
-void vm_cloneHandle(VM* vm, mvm_Handle* target, const mvm_Handle* source) {
-  CODE_COVERAGE_UNTESTED(20); // Not hit
-  VM_ASSERT(vm, !vm_isHandleInitialized(vm, source));
-  mvm_initializeHandle(vm, target);
-  target->_value = source->_value;
+#if MVM_GENERATIONAL_GC
+/**
+ * Make everything currently in the heap part of the old generation, and start
+ * a new (empty) nursery.
+ *
+ * The last bucket is "sealed" by hiding its spare capacity from the allocator,
+ * so that young allocations always start in a new bucket. The spare capacity is
+ * used by the next minor collection to promote the survivors.
+ */
+static void gc_sealOldGeneration(VM* vm) {
+  CODE_COVERAGE_UNTESTED(692); // Not hit
+  TsBucket* pLastBucket = vm->pLastBucket;
+  vm->gc_pOldLastBucket = pLastBucket;
+  vm->gc_oldEndCapacity = vm->pLastBucketEndCapacity;
+  vm->gc_nurseryStart = getHeapSize(vm);
+  vm->gc_rememberedCount = 0;
+  vm->gc_rememberedSetOverflow = false;
+  if (pLastBucket) {
+    CODE_COVERAGE_UNTESTED(693); // Not hit
+    vm->pLastBucketEndCapacity = pLastBucket->pEndOfUsedSpace;
+  } else {
+    CODE_COVERAGE_UNTESTED(694); // Not hit
+  }
 }
 
-TeError mvm_releaseHandle(VM* vm, mvm_Handle* handle) {
-  // This function doesn't contain coverage markers because node hits this path
-  // non-deterministically.
-  mvm_Handle** h = &vm->gc_handles;
-  while (*h) {
-    if (*h == handle) {
-      *h = handle->_next;
-      handle->_value = VM_VALUE_UNDEFINED;
-      handle->_next = NULL;
-      return MVM_E_SUCCESS;
+/**
+ * Treat every pointer in the old generation as a root. This is the fallback
+ * for when the remembered set has overflowed. It's linear in the size of the
+ * old generation, but unlike a major collection nothing old is copied.
+ *
+ * @param pOldEnd The end of the old generation in its last bucket. The scan
+ * must stop here because the bucket is also the start of tospace.
+ */
+static void gc_processOldGeneration(gc_TsGCCollectionState* gc, TsBucket* pOldLastBucket, uint16_t* pOldEnd) {
+  CODE_COVERAGE_UNTESTED(702); // Not hit
+  TsBucket* bucket = pOldLastBucket;
+  while (bucket->prev) {
+    bucket = bucket->prev;
+  }
+
+  while (true) {
+    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
+    uint16_t* end = (bucket == pOldLastBucket) ? pOldEnd : bucket->pEndOfUsedSpace;
+    while (p != end) {
+      VM_ASSERT(gc->vm, p < end);
+      uint16_t header = *p++;
+      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+      uint16_t words = (size + 1) >> 1;
+      if (header < (uint16_t)(TC_REF_DIVIDER_CONTAINER_TYPES << 12)) { // Non-container types
+        p += words;
+        continue;
+      }
+      while (words--) {
+        if (Value_isShortPtr(*p))
+          gc_processValue(gc, p);
+        p++;
+      }
+    }
+    if (bucket == pOldLastBucket) {
+      break;
     }
-    h = &((*h)->_next);
+    bucket = bucket->next;
   }
-  handle->_value = VM_VALUE_UNDEFINED;
-  handle->_next = NULL;
-  return vm_newError(vm, MVM_E_INVALID_HANDLE);
 }
 
-#if MVM_SUPPORT_FLOAT
-static Value vm_float64ToStr(VM* vm, Value value) {
-  CODE_COVERAGE(619); // Hit
-
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm); // Because we allocate a new string
+/**
+ * Minor collection: moves the young allocations that are reachable from the
+ * roots or from the remembered set to the end of the old generation, and then
+ * releases the nursery buckets. Allocations in the old generation are neither
+ * moved nor scanned, so the cost is proportional to the number of survivors
+ * rather than the size of the heap.
+ *
+ * Survivors are promoted straight to the old generation. Garbage in the old
+ * generation (including old allocations that died while they were young) is
+ * only reclaimed by a major collection (mvm_runGC), which happens when the
+ * heap reaches MVM_MAX_HEAP_SIZE.
+ */
+static void gc_runMinor(VM* vm) {
+  CODE_COVERAGE_UNTESTED(695); // Not hit
+  uint32_t gcStart = GC_CLOCK();
 
-  // I don't think this is 100% compliant, but it's probably fine for most use
-  // cases, and most importantly it's small.
+  TsBucket* pOldLastBucket = vm->gc_pOldLastBucket;
+  VM_ASSERT(vm, pOldLastBucket != NULL);
 
-  double x = mvm_toFloat64(vm, value);
+  uint16_t heapSize = getHeapSize(vm);
+  if (heapSize > vm->heapHighWaterMark)
+    vm->heapHighWaterMark = heapSize;
+  vm->gc_allocatedBytes += heapSize - vm->heapSizeUsedAfterLastGC;
 
-  char buf[64];
-  char* p = buf;
+  gc_TsGCCollectionState gc;
+  memset(&gc, 0, sizeof gc);
+  gc.vm = vm;
+  gc.nurseryStart = vm->gc_nurseryStart;
 
-  // NaN should be represented as VM_VALUE_NAN not a float with NaN
-  VM_ASSERT(vm, !isnan(x));
+  #if MVM_PROPERTY_CACHE_SIZE
+  // Young objects in the cache are about to move
+  vm_propertyCacheInvalidate(vm);
+  #endif
 
-  if (isinf(x)) {
-    CODE_COVERAGE(621); // Hit
-    if (x < 0) {
-      CODE_COVERAGE(622); // Hit
-      *p++ = '-';
+  #if MVM_SCOPE_CACHE_SIZE
+  // Young closures in the cache are about to move
+  vm_scopeCacheInvalidate(vm);
+  #endif
+
+  #if MVM_RECYCLE_NUMBER_BOXES
+  vm->numberBox = 0;
+  #endif
+
+  #if MVM_HEAP_PROFILE
+  vm_heapProfileBeginCollection(vm, gc.nurseryStart);
+  #endif
+
+  // Tospace continues from the end of the old generation, first into the spare
+  // capacity of its last bucket and then into new buckets as needed. Tospace
+  // and the nursery overlap in heap offsets, which is fine for the same reason
+  // that it's fine in a major collection: unprocessed pointers are decoded
+  // against the existing bucket list (which is only searched backwards from the
+  // end of the nursery) and processed pointers are in terms of tospace.
+  uint16_t* pScanStart = pOldLastBucket->pEndOfUsedSpace;
+  pOldLastBucket->next = NULL;
+  gc.firstBucket = pOldLastBucket;
+  gc.lastBucket = pOldLastBucket;
+  gc.lastBucketEndCapacity = vm->gc_oldEndCapacity;
+
+  gc_processRoots(&gc);
+
+  // Old slots that may point into the nursery
+  if (!vm->gc_rememberedSetOverflow) {
+    CODE_COVERAGE_UNTESTED(700); // Not hit
+    uint8_t i;
+    for (i = 0; i < vm->gc_rememberedCount; i++) {
+      gc_processValue(&gc, (Value*)ShortPtr_decode(vm, vm->gc_rememberedSet[i]));
     }
-    memcpy(p, "Infinity", 9);
-    p += 8;
   } else {
-    CODE_COVERAGE(657); // Hit
-    p += MVM_SNPRINTF(p, sizeof buf, "%.15g", x);
-    VM_ASSERT(vm, p < buf + sizeof buf);
+    CODE_COVERAGE_UNTESTED(701); // Not hit
+    gc_processOldGeneration(&gc, pOldLastBucket, pScanStart);
   }
 
-  return mvm_newString(vm, buf, p - buf);
+  gc_processAllocations(&gc, pOldLastBucket, pScanStart);
+
+  #if MVM_EXTERNAL_BUFFERS
+  gc_processExternalBuffers(&gc);
+  #endif
+
+  // Release the nursery
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket != pOldLastBucket) {
+    TsBucket* prev = bucket->prev;
+    vm_free(vm, bucket);
+    bucket = prev;
+  }
+
+  vm->pLastBucket = gc.lastBucket;
+  vm->pLastBucketEndCapacity = gc.lastBucketEndCapacity;
+  vm->heapSizeUsedAfterLastGC = getHeapSize(vm);
+
+  #if MVM_HEAP_PROFILE
+  vm_heapProfileEndCollection(vm, true);
+  #endif
+
+  gc_recordPause(&vm->gc_minorCount, &vm->gc_minorPauseTotal, &vm->gc_minorPauseMax, gcStart);
+
+  gc_endCollection(vm);
 }
-#endif //  MVM_SUPPORT_FLOAT
+#endif // MVM_GENERATIONAL_GC
 
-static Value vm_intToStr(VM* vm, int32_t i) {
-  CODE_COVERAGE(618); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+#if MVM_INCREMENTAL_GC
+/*
+ * Incremental collection (mvm_gcStep) is the same Cheney collection as
+ * mvm_runGC, with the state kept in a gc_TsIncrementalState between calls so
+ * that the roots and then the scan of tospace can be processed a bit at a time.
+ *
+ * The VM itself doesn't run in between steps. A copying collector that lets
+ * the program run mid-collection needs a read barrier on every pointer that's
+ * loaded from the heap, which would slow down the whole interpreter. Instead,
+ * the collection is completed (in one go) by anything that would read or
+ * allocate in the heap while a collection is in progress:
+ *
+ *   - The public API functions that take values call gc_completeIncremental.
+ *   - Allocation: the capacity of the last fromspace bucket is hidden while
+ *     the collection is in progress, so every allocation goes through
+ *     gc_createNextBucket, which completes the collection first. This costs
+ *     nothing on the allocation fast path.
+ *   - The handle accessors (mvm_handleGet etc.), which aren't inline in this
+ *     configuration. Until all the roots are processed, some handles hold
+ *     pointers into fromspace and others into tospace, so a value copied from
+ *     one handle to another could otherwise be left pointing at the wrong
+ *     space.
+ *
+ * Property stores only happen in the interpreter, which is entered through
+ * mvm_call.
+ */
 
-  char buf[32];
-  size_t size;
+/**
+ * Process the roots from `inc->rootCursor` onwards, 2 bytes of `budget` each,
+ * returning what's left of the budget. The roots are numbered through the
+ * globals and then the slots of the handle table. The stack isn't one of them,
+ * since a collection isn't left in progress while the VM is running.
+ */
+static int32_t gc_processRootsIncremental(gc_TsIncrementalState* inc, int32_t budget) {
+  VM* vm = inc->gc.vm;
+  uint16_t globalCount = getSectionSize(vm, BCS_GLOBALS) / 2;
+  uint32_t rootCount = globalCount + (uint32_t)vm->gc_handlePageCount * MVM_HANDLE_PAGE_SIZE;
+  uint32_t i = inc->rootCursor;
+
+  VM_ASSERT(vm, !vm->stack);
+
+  while ((i < rootCount) && (budget > 0)) {
+    Value* pRoot;
+    if (i < globalCount) {
+      pRoot = &vm->globals[i];
+    } else {
+      uint32_t slot = i - globalCount;
+      pRoot = &vm->gc_handlePages[slot / MVM_HANDLE_PAGE_SIZE]->values[slot % MVM_HANDLE_PAGE_SIZE];
+    }
+    gc_processValue(&inc->gc, pRoot);
+    budget -= 2;
+    i++;
+  }
+  inc->rootCursor = i;
 
-  size = MVM_SNPRINTF(buf, sizeof buf, "%" PRId32, i);
-  VM_ASSERT(vm, size < sizeof buf);
+  // Tospace now holds everything the roots reference, ready to be scanned.
+  // (Pages added to the handle table after this only hold `undefined`, since
+  // setting a handle completes the collection.)
+  if ((i == rootCount) && !inc->rootsDone) {
+    CODE_COVERAGE(898); // Hit
+    inc->rootsDone = true;
+    inc->scanBucket = inc->gc.firstBucket;
+    inc->scanCursor = inc->gc.firstBucket ? (uint16_t*)getBucketDataBegin(inc->gc.firstBucket) : NULL;
+  }
 
-  return mvm_newString(vm, buf, size);
+  return budget;
 }
 
-static Value vm_convertToString(VM* vm, Value value) {
-  CODE_COVERAGE(23); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+bool mvm_gcStep(VM* vm, uint16_t budgetBytes) {
+  CODE_COVERAGE(705); // Hit
+  uint32_t stepStart = GC_CLOCK();
 
-  TeTypeCode type = deepTypeOf(vm, value);
-  const char* constStr;
+  // If called from a host function, the stack is a root and will change as
+  // soon as the VM resumes, so the collection can't be left in progress.
+  if (vm->stack) {
+    CODE_COVERAGE_UNTESTED(706); // Not hit
+    mvm_runGC(vm, false);
+    return true;
+  } else {
+    CODE_COVERAGE(707); // Hit
+  }
 
-  switch (type) {
-    case TC_VAL_INT14:
-    case TC_REF_INT32: {
-      CODE_COVERAGE(246); // Hit
-      int32_t i = vm_readInt32(vm, type, value);
-      return vm_intToStr(vm, i);
-    }
-    case TC_REF_FLOAT64: {
-      CODE_COVERAGE(248); // Hit
-      #if MVM_SUPPORT_FLOAT
-      return vm_float64ToStr(vm, value);
-      #else
-      constStr = "";
-      #endif
-      break;
-    }
-    case TC_REF_STRING: {
-      CODE_COVERAGE(249); // Hit
-      return value;
-    }
-    case TC_REF_INTERNED_STRING: {
-      CODE_COVERAGE(250); // Hit
-      return value;
-    }
-    case TC_REF_PROPERTY_LIST: {
-      CODE_COVERAGE_UNTESTED(251); // Not hit
-      constStr = "[Object]";
-      break;
-    }
-    case TC_REF_CLOSURE: {
-      CODE_COVERAGE_UNTESTED(365); // Not hit
-      constStr = "[Function]";
-      break;
-    }
-    case TC_REF_FIXED_LENGTH_ARRAY:
-    case TC_REF_ARRAY: {
-      CODE_COVERAGE_UNTESTED(252); // Not hit
-      constStr = "[Object]";
-      break;
-    }
-    case TC_REF_FUNCTION: {
-      CODE_COVERAGE_UNTESTED(254); // Not hit
-      constStr = "[Function]";
-      break;
-    }
-    case TC_REF_HOST_FUNC: {
-      CODE_COVERAGE_UNTESTED(255); // Not hit
-      constStr = "[Function]";
-      break;
-    }
-    case TC_REF_UINT8_ARRAY: {
-      CODE_COVERAGE_UNTESTED(256); // Not hit
-      constStr = "[Object]";
-      break;
-    }
-    case TC_REF_CLASS: {
-      CODE_COVERAGE_UNTESTED(596); // Not hit
-      constStr = "[Function]";
-      break;
-    }
-    case TC_REF_VIRTUAL: {
-      CODE_COVERAGE_UNTESTED(597); // Not hit
-      VM_NOT_IMPLEMENTED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
-    }
-    case TC_REF_SYMBOL: {
-      CODE_COVERAGE_UNTESTED(257); // Not hit
-      VM_NOT_IMPLEMENTED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
-    }
-    case TC_VAL_UNDEFINED: {
-      CODE_COVERAGE(258); // Hit
-      constStr = "undefined";
-      break;
-    }
-    case TC_VAL_NULL: {
-      CODE_COVERAGE(259); // Hit
-      constStr = "null";
-      break;
-    }
-    case TC_VAL_TRUE: {
-      CODE_COVERAGE(260); // Hit
-      constStr = "true";
-      break;
-    }
-    case TC_VAL_FALSE: {
-      CODE_COVERAGE(261); // Hit
-      constStr = "false";
-      break;
-    }
-    case TC_VAL_NAN: {
-      CODE_COVERAGE(262); // Hit
-      constStr = "NaN";
-      break;
-    }
-    case TC_VAL_NEG_ZERO: {
-      CODE_COVERAGE(263); // Hit
-      constStr = "0";
-      break;
+  gc_TsIncrementalState* inc = vm->gc_pIncremental;
+  if (!inc) {
+    CODE_COVERAGE(708); // Hit
+    inc = vm_malloc(vm, sizeof *inc);
+    if (!inc) {
+      CODE_COVERAGE_ERROR_PATH(709); // Not hit
+      // Not enough memory to keep the state between steps
+      mvm_runGC(vm, false);
+      return true;
     }
-    case TC_VAL_STR_LENGTH: {
-      CODE_COVERAGE(266); // Hit
-      return value;
+    gc_beginCollection(vm, &inc->gc);
+    inc->scanBucket = NULL;
+    inc->scanCursor = NULL;
+    inc->rootCursor = 0;
+    inc->rootsDone = false;
+    vm->gc_pIncremental = inc;
+
+    // Allocation barrier (see above)
+    if (vm->pLastBucket) {
+      CODE_COVERAGE(710); // Hit
+      vm->pLastBucketEndCapacity = vm->pLastBucket->pEndOfUsedSpace;
+    } else {
+      CODE_COVERAGE_UNTESTED(711); // Not hit
     }
-    case TC_VAL_STR_PROTO: {
-      CODE_COVERAGE_UNTESTED(267); // Not hit
-      return value;
+  } else {
+    CODE_COVERAGE(712); // Hit
+  }
+
+  // At least one root or allocation is processed, so that every step makes
+  // progress
+  int32_t budget = budgetBytes ? budgetBytes : 1;
+  if (!inc->rootsDone) {
+    budget = gc_processRootsIncremental(inc, budget);
+  }
+
+  TsBucket* bucket = inc->scanBucket;
+  uint16_t* p = inc->scanCursor;
+  while (bucket) {
+    while (p != bucket->pEndOfUsedSpace) {
+      VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
+      if (budget <= 0) {
+        CODE_COVERAGE(713); // Hit
+        inc->scanBucket = bucket;
+        inc->scanCursor = p;
+        gc_recordPause(&vm->gc_stepCount, &vm->gc_stepPauseTotal, &vm->gc_stepPauseMax, stepStart);
+        return false;
+      }
+      uint16_t* next = gc_processAllocation(&inc->gc, p);
+      budget -= (int32_t)((intptr_t)next - (intptr_t)p);
+      p = next;
     }
-    case TC_VAL_DELETED: {
-      return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+    bucket = bucket->next;
+    if (bucket) {
+      p = (uint16_t*)getBucketDataBegin(bucket);
     }
-    default: return VM_UNEXPECTED_INTERNAL_ERROR(vm);
   }
 
-  return vm_newStringFromCStrNT(vm, constStr);
+  // The budget ran out on the roots
+  if (!inc->rootsDone) {
+    CODE_COVERAGE(899); // Hit
+    gc_recordPause(&vm->gc_stepCount, &vm->gc_stepPauseTotal, &vm->gc_stepPauseMax, stepStart);
+    return false;
+  }
+
+  // The scan has caught up with the end of tospace
+  inc->scanBucket = NULL;
+  gc_finishIncremental(vm);
+  gc_recordPause(&vm->gc_stepCount, &vm->gc_stepPauseTotal, &vm->gc_stepPauseMax, stepStart);
+  return true;
 }
 
-static Value vm_concat(VM* vm, Value* left, Value* right) {
-  CODE_COVERAGE(553); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+// Finish the collection started by mvm_gcStep, without a budget
+static void gc_finishIncremental(VM* vm) {
+  CODE_COVERAGE(714); // Hit
+  gc_TsIncrementalState* inc = vm->gc_pIncremental;
+  VM_ASSERT(vm, inc != NULL);
 
-  uint16_t leftSize = vm_stringSizeUtf8(vm, *left);
-  uint16_t rightSize = vm_stringSizeUtf8(vm, *right);
+  if (!inc->rootsDone) {
+    CODE_COVERAGE(900); // Hit
+    gc_processRootsIncremental(inc, INT32_MAX);
+  } else {
+    CODE_COVERAGE(901); // Hit
+  }
+  gc_processAllocations(&inc->gc, inc->scanBucket, inc->scanCursor);
+  gc_adoptToSpace(vm, &inc->gc);
+  vm->gc_pIncremental = NULL;
+  vm_free(vm, inc);
 
-  uint8_t* data;
-  // Note: this allocation can cause a GC collection which could cause the
-  // strings to move in memory
-  Value value = vm_allocString(vm, leftSize + rightSize, (void**)&data);
+  vm->gc_majorCount++;
+  gc_endCollection(vm);
+}
 
-  LongPtr lpLeftStr = vm_getStringData(vm, *left);
-  LongPtr lpRightStr = vm_getStringData(vm, *right);
-  memcpy_long(data, lpLeftStr, leftSize);
-  memcpy_long(data + leftSize, lpRightStr, rightSize);
-  return value;
+/*
+ * The handle accessors complete a collection in progress before touching the
+ * slot (see above). A handle's page is found from its slot, and the VM from
+ * its page.
+ */
+static inline void gc_completeIncrementalForHandle(const mvm_Handle* handle) {
+  TsHandlePage* pPage = (TsHandlePage*)(handle->_slot - handle->_index % MVM_HANDLE_PAGE_SIZE);
+  gc_completeIncremental(pPage->vm);
 }
 
-/* Returns the deep type code of the value, looking through pointers and boxing */
-static TeTypeCode deepTypeOf(VM* vm, Value value) {
-  CODE_COVERAGE(27); // Hit
+mvm_Value mvm_handleGet(const mvm_Handle* handle) {
+  gc_completeIncrementalForHandle(handle);
+  return *handle->_slot;
+}
 
-  if (Value_isShortPtr(value)) {
-    CODE_COVERAGE(0); // Hit
-    void* p = ShortPtr_decode(vm, value);
-    uint16_t headerWord = readAllocationHeaderWord(p);
-    TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
-    return typeCode;
-  } else {
-    CODE_COVERAGE(515); // Hit
+mvm_Value* mvm_handleAt(mvm_Handle* handle) {
+  gc_completeIncrementalForHandle(handle);
+  return handle->_slot;
+}
+
+void mvm_handleSet(mvm_Handle* handle, mvm_Value value) {
+  gc_completeIncrementalForHandle(handle);
+  *handle->_slot = value;
+}
+#endif // MVM_INCREMENTAL_GC
+
+/**
+ * Must be called by public API functions before they read or allocate in the
+ * heap, in case mvm_gcStep has left a collection in progress.
+ */
+static inline void gc_completeIncremental(VM* vm) {
+  #if MVM_INCREMENTAL_GC
+  if (vm->gc_pIncremental) {
+    CODE_COVERAGE(715); // Hit
+    // This is the pause that the step budget was meant to avoid, so it's
+    // counted as a step
+    uint32_t start = GC_CLOCK();
+    gc_finishIncremental(vm);
+    gc_recordPause(&vm->gc_stepCount, &vm->gc_stepPauseTotal, &vm->gc_stepPauseMax, start);
   }
+  #endif // MVM_INCREMENTAL_GC
+}
 
-  if (Value_isVirtualInt14(value)) {
-    CODE_COVERAGE(295); // Hit
-    return TC_VAL_INT14;
-  } else {
-    CODE_COVERAGE(516); // Hit
+#if MVM_GC_POLICY
+/**
+ * Whether the GC policy calls for a major collection before the heap grows from
+ * `heapSize` by a new bucket of `bucketSize` bytes.
+ */
+static bool gc_policyWantsCollection(VM* vm, uint16_t heapSize, uint16_t bucketSize) {
+  const mvm_TsGCPolicy* policy = &vm->gc_policy;
+
+  // Nothing to collect yet (this also stops the policy from collecting again
+  // for the bucket that follows its own collection)
+  if (heapSize <= vm->gc_policyBaseSize) {
+    CODE_COVERAGE(884); // Hit
+    return false;
   }
 
-  VM_ASSERT(vm, Value_isBytecodeMappedPtrOrWellKnown(value));
+  if (policy->targetHeapSize || policy->growthPercent) {
+    CODE_COVERAGE(885); // Hit
+    uint32_t limit = policy->targetHeapSize;
+    uint32_t grownLimit = (uint32_t)vm->gc_policyBaseSize * policy->growthPercent / 100;
+    if (grownLimit > limit) {
+      limit = grownLimit;
+    }
+    if ((uint32_t)heapSize + bucketSize > limit) {
+      CODE_COVERAGE(886); // Hit
+      return true;
+    }
+  }
 
-  // Check for "well known" values such as TC_VAL_UNDEFINED
-  if (value < VM_VALUE_WELLKNOWN_END) {
-    CODE_COVERAGE(296); // Hit
-    return (TeTypeCode)((value >> 2) + 0x11);
-  } else {
-    CODE_COVERAGE(297); // Hit
+  if (policy->allocationRateBytes) {
+    CODE_COVERAGE_UNTESTED(887); // Not hit
+    uint32_t allocated = vm->gc_allocatedBytes + (heapSize - vm->heapSizeUsedAfterLastGC) - vm->gc_policyBaseAllocated;
+    uint32_t elapsed = GC_CLOCK() - vm->gc_policyBaseTime;
+    // allocated / elapsed >= allocationRateBytes / allocationRatePeriodUs
+    if ((allocated >= policy->allocationRateBytes) &&
+      ((uint64_t)allocated * policy->allocationRatePeriodUs >= (uint64_t)policy->allocationRateBytes * elapsed)) {
+      CODE_COVERAGE_UNTESTED(888); // Not hit
+      return true;
+    }
   }
 
-  LongPtr p = DynamicPtr_decode_long(vm, value);
-  uint16_t headerWord = readAllocationHeaderWord_long(p);
-  TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
+  return false;
+}
 
-  return typeCode;
+void mvm_setGCPolicy(VM* vm, const mvm_TsGCPolicy* policy) {
+  CODE_COVERAGE(889); // Hit
+  vm->gc_policy = *policy;
 }
 
-#if MVM_SUPPORT_FLOAT
-int32_t mvm_float64ToInt32(MVM_FLOAT64 value) {
-  CODE_COVERAGE(486); // Hit
-  if (MVM_FLOAT_IS_FINITE(value)) {
-    CODE_COVERAGE(487); // Hit
-    return (int32_t)value;
-  } else {
-    CODE_COVERAGE(488); // Hit
-    return 0;
-  }
+void mvm_getGCPolicy(VM* vm, mvm_TsGCPolicy* out_policy) {
+  CODE_COVERAGE_UNTESTED(890); // Not hit
+  *out_policy = vm->gc_policy;
 }
 
-Value mvm_newNumber(VM* vm, MVM_FLOAT64 value) {
-  CODE_COVERAGE(28); // Hit
-  if (MVM_FLOAT_IS_NAN(value)) {
-    CODE_COVERAGE(298); // Hit
-    return VM_VALUE_NAN;
-  } else {
-    CODE_COVERAGE(517); // Hit
-  }
+bool mvm_gcIdle(VM* vm) {
+  CODE_COVERAGE(891); // Hit
+  const mvm_TsGCPolicy* policy = &vm->gc_policy;
 
-  if (MVM_FLOAT_IS_NEG_ZERO(value)) {
-    CODE_COVERAGE(299); // Hit
-    return VM_VALUE_NEG_ZERO;
-  } else {
-    CODE_COVERAGE(518); // Hit
+  #if MVM_INCREMENTAL_GC
+  // Carry on with the collection started by an earlier call (or by the host)
+  if (vm->gc_pIncremental) {
+    if (policy->idleStepBytes) {
+      CODE_COVERAGE_UNTESTED(892); // Not hit
+      return mvm_gcStep(vm, policy->idleStepBytes);
+    } else {
+      CODE_COVERAGE_UNTESTED(895); // Not hit
+      gc_completeIncremental(vm);
+      return true;
+    }
   }
+  #endif // MVM_INCREMENTAL_GC
 
-  // Doubles are very expensive to compute, so at every opportunity, we'll check
-  // if we can coerce back to an integer
-  int32_t valueAsInt = mvm_float64ToInt32(value);
-  if (value == (MVM_FLOAT64)valueAsInt) {
-    CODE_COVERAGE(300); // Hit
-    return mvm_newInt32(vm, valueAsInt);
-  } else {
-    CODE_COVERAGE(301); // Hit
+  uint16_t heapSize = getHeapSize(vm);
+  if (!policy->idleCollectBytes ||
+    (heapSize <= vm->gc_policyBaseSize) ||
+    (heapSize - vm->gc_policyBaseSize < policy->idleCollectBytes)) {
+    CODE_COVERAGE_UNTESTED(893); // Not hit
+    return true;
   }
 
-  MVM_FLOAT64* pResult = GC_ALLOCATE_TYPE(vm, MVM_FLOAT64, TC_REF_FLOAT64);
-  *pResult = value;
-
-  return ShortPtr_encode(vm, pResult);
-}
-#endif // MVM_SUPPORT_FLOAT
-
-Value mvm_newInt32(VM* vm, int32_t value) {
-  CODE_COVERAGE(29); // Hit
-  if ((value >= VM_MIN_INT14) && (value <= VM_MAX_INT14)) {
-    CODE_COVERAGE(302); // Hit
-    return VirtualInt14_encode(vm, value);
-  } else {
-    CODE_COVERAGE(303); // Hit
+  vm->gc_policyCount++;
+  #if MVM_INCREMENTAL_GC
+  if (policy->idleStepBytes) {
+    CODE_COVERAGE(894); // Hit
+    return mvm_gcStep(vm, policy->idleStepBytes);
   }
-
-  // Int32
-
-  int32_t* pResult = GC_ALLOCATE_TYPE(vm, int32_t, TC_REF_INT32);
-  *pResult = value;
-
-  return ShortPtr_encode(vm, pResult);
+  #endif // MVM_INCREMENTAL_GC
+  mvm_runGC(vm, false);
+  return true;
 }
+#endif // MVM_GC_POLICY
 
-bool mvm_toBool(VM* vm, Value value) {
-  CODE_COVERAGE(30); // Hit
-
-  TeTypeCode type = deepTypeOf(vm, value);
-  switch (type) {
-    case TC_VAL_INT14: {
-      CODE_COVERAGE(304); // Hit
-      return value != VirtualInt14_encode(vm, 0);
-    }
-    case TC_REF_INT32: {
-      CODE_COVERAGE_UNTESTED(305); // Not hit
-      // Int32 can't be zero, otherwise it would be encoded as an int14
-      VM_ASSERT(vm, vm_readInt32(vm, type, value) != 0);
-      return false;
-    }
-    case TC_REF_FLOAT64: {
-      CODE_COVERAGE_UNTESTED(306); // Not hit
-      #if MVM_SUPPORT_FLOAT
-        // Double can't be zero, otherwise it would be encoded as an int14
-        VM_ASSERT(vm, mvm_toFloat64(vm, value) != 0);
-      #endif
-      return false;
-    }
-    case TC_REF_INTERNED_STRING:
-    case TC_REF_STRING: {
-      CODE_COVERAGE(307); // Hit
-      return vm_stringSizeUtf8(vm, value) != 0;
-    }
-    case TC_REF_PROPERTY_LIST: {
-      CODE_COVERAGE(308); // Hit
-      return true;
-    }
-    case TC_REF_CLOSURE: {
-      CODE_COVERAGE_UNTESTED(372); // Not hit
-      return true;
-    }
-    case TC_REF_ARRAY: {
-      CODE_COVERAGE(309); // Hit
-      return true;
-    }
-    case TC_REF_FUNCTION: {
-      CODE_COVERAGE_UNTESTED(311); // Not hit
-      return true;
-    }
-    case TC_REF_HOST_FUNC: {
-      CODE_COVERAGE_UNTESTED(312); // Not hit
-      return true;
-    }
-    case TC_REF_UINT8_ARRAY: {
-      CODE_COVERAGE_UNTESTED(313); // Not hit
-      return true;
-    }
-    case TC_REF_SYMBOL: {
-      CODE_COVERAGE_UNTESTED(314); // Not hit
-      return true;
-    }
-    case TC_REF_CLASS: {
-      CODE_COVERAGE(604); // Hit
-      return true;
-    }
-    case TC_REF_VIRTUAL: {
-      CODE_COVERAGE_UNTESTED(609); // Not hit
-      VM_RESERVED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
-
-    }
-    case TC_REF_RESERVED_1: {
-      CODE_COVERAGE_UNTESTED(610); // Not hit
-      VM_RESERVED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
+/**
+ * Must be called after writing `value` into `pSlot` if the slot is in a GC
+ * allocation that may be in the old generation (i.e. any allocation other than
+ * one that was just allocated), so that a minor collection can find pointers
+ * from old allocations to young ones. Writes to the stack, registers, globals
+ * and handles don't need this because those are roots.
+ */
+static inline void gc_writeBarrier(VM* vm, Value* pSlot, Value value) {
+  #if MVM_GENERATIONAL_GC
+  // Only pointers to young allocations need to be remembered
+  if (!Value_isShortPtr(value) || (value < vm->gc_nurseryStart)) {
+    return;
+  }
 
+  // Find the heap offset of the slot, if it's in the old generation
+  TsBucket* bucket = vm->gc_pOldLastBucket;
+  while (bucket) {
+    void* pBucketData = getBucketDataBegin(bucket);
+    if (((void*)pSlot >= pBucketData) && ((void*)pSlot < (void*)bucket->pEndOfUsedSpace)) {
+      CODE_COVERAGE_UNTESTED(696); // Not hit
+      uint16_t offset = bucket->offsetStart + (uint16_t)((intptr_t)pSlot - (intptr_t)pBucketData);
+      uint8_t i;
+      for (i = 0; i < vm->gc_rememberedCount; i++) {
+        if (vm->gc_rememberedSet[i] == offset) {
+          CODE_COVERAGE_UNTESTED(697); // Not hit
+          return;
+        }
+      }
+      if (vm->gc_rememberedCount < MVM_GC_REMEMBERED_SET_SIZE) {
+        CODE_COVERAGE_UNTESTED(698); // Not hit
+        vm->gc_rememberedSet[vm->gc_rememberedCount++] = offset;
+      } else {
+        CODE_COVERAGE_UNTESTED(699); // Not hit
+        vm->gc_rememberedSetOverflow = true;
+      }
+      return;
     }
-    case TC_VAL_UNDEFINED: {
-      CODE_COVERAGE(315); // Hit
-      return false;
-    }
-    case TC_VAL_NULL: {
-      CODE_COVERAGE(316); // Hit
-      return false;
-    }
-    case TC_VAL_TRUE: {
-      CODE_COVERAGE(317); // Hit
-      return true;
-    }
-    case TC_VAL_FALSE: {
-      CODE_COVERAGE(318); // Hit
-      return false;
-    }
-    case TC_VAL_NAN: {
-      CODE_COVERAGE_UNTESTED(319); // Not hit
-      return false;
-    }
-    case TC_VAL_NEG_ZERO: {
-      CODE_COVERAGE_UNTESTED(320); // Not hit
-      return false;
-    }
-    case TC_VAL_DELETED: {
-      CODE_COVERAGE_UNTESTED(321); // Not hit
-      return false;
-    }
-    case TC_VAL_STR_LENGTH: {
-      CODE_COVERAGE_UNTESTED(268); // Not hit
-      return true;
-    }
-    case TC_VAL_STR_PROTO: {
-      CODE_COVERAGE_UNTESTED(269); // Not hit
-      return true;
-    }
-    default: return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+    bucket = bucket->prev;
   }
+  #endif // MVM_GENERATIONAL_GC
 }
 
-static bool vm_isString(VM* vm, Value value) {
-  CODE_COVERAGE(31); // Hit
-  return mvm_typeOf(vm, value) == VM_T_STRING;
-}
-
-/** Reads a numeric value that is a subset of a 32-bit integer */
-static int32_t vm_readInt32(VM* vm, TeTypeCode type, Value value) {
-  CODE_COVERAGE(33); // Hit
-  if (type == TC_VAL_INT14) {
-    CODE_COVERAGE(330); // Hit
-    return VirtualInt14_decode(vm, value);
-  } else if (type == TC_REF_INT32) {
-    CODE_COVERAGE(331); // Hit
-    LongPtr target = DynamicPtr_decode_long(vm, value);
-    int32_t result = (int32_t)LongPtr_read4(target);
-    return result;
-  } else {
-    return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+/**
+ * Create the call VM call stack and registers
+ */
+TeError vm_createStackAndRegisters(VM* vm) {
+  CODE_COVERAGE(225); // Hit
+  // This is freed again at the end of mvm_call. Note: the allocated
+  // memory includes the registers, which are part of the vm_TsStack
+  // structure
+  vm_TsStack* stack = vm_malloc(vm, sizeof (vm_TsStack) + MVM_STACK_SIZE);
+  if (!stack) {
+    CODE_COVERAGE_ERROR_PATH(231); // Not hit
+    return vm_newError(vm, MVM_E_MALLOC_FAIL);
   }
-}
+  vm->stack = stack;
+  vm_resetRegisters(vm, &stack->reg);
 
-static inline uint16_t readAllocationHeaderWord_long(LongPtr pAllocation) {
-  CODE_COVERAGE(519); // Hit
-  return LongPtr_read2_aligned(LongPtr_add(pAllocation, -2));
+  return MVM_E_SUCCESS;
 }
 
-static inline uint16_t readAllocationHeaderWord(void* pAllocation) {
-  CODE_COVERAGE(520); // Hit
-  return ((uint16_t*)pAllocation)[-1];
+/**
+ * Set the registers to their state when the stack is empty
+ */
+static void vm_resetRegisters(VM* vm, vm_TsRegisters* reg) {
+  memset(reg, 0, sizeof *reg);
+  // The stack grows upward. The bottom is the lowest address.
+  uint16_t* bottomOfStack = getBottomOfStack(vm->stack);
+  reg->pFrameBase = bottomOfStack;
+  reg->pStackPointer = bottomOfStack;
+  reg->lpProgramCounter = vm->lpBytecode; // This is essentially treated as a null value
+  reg->argCountAndFlags = 0;
+  reg->closure = VM_VALUE_UNDEFINED;
+  reg->catchTarget = VM_VALUE_UNDEFINED;
+  VM_ASSERT(vm, reg->pArgs == 0);
 }
 
-static inline mvm_TfHostFunction* vm_getResolvedImports(VM* vm) {
-  CODE_COVERAGE(40); // Hit
-  return (mvm_TfHostFunction*)(vm + 1); // Starts right after the header
+// Lowest address on stack
+static inline uint16_t* getBottomOfStack(vm_TsStack* stack) {
+  CODE_COVERAGE(510); // Hit
+  return (uint16_t*)(stack + 1);
 }
 
-static inline mvm_HostFunctionID vm_getHostFunctionId(VM* vm, uint16_t hostFunctionIndex) {
-  LongPtr lpImportTable = getBytecodeSection(vm, BCS_IMPORT_TABLE, NULL);
-  LongPtr lpImportTableEntry = LongPtr_add(lpImportTable, hostFunctionIndex * sizeof (vm_TsImportTableEntry));
-  return LongPtr_read2_aligned(lpImportTableEntry);
+// Highest possible address on stack (+1) before overflow
+static inline uint16_t* getTopOfStackSpace(vm_TsStack* stack) {
+  CODE_COVERAGE(511); // Hit
+  return getBottomOfStack(stack) + MVM_STACK_SIZE / 2;
 }
 
-mvm_TeType mvm_typeOf(VM* vm, Value value) {
-  TeTypeCode tc = deepTypeOf(vm, value);
-  VM_ASSERT(vm, tc < sizeof typeByTC);
-  TABLE_COVERAGE(tc, TC_END, 42); // Hit 16/26
-  return (mvm_TeType)typeByTC[tc];
+#if MVM_DEBUG
+// Some utility functions, mainly to execute in the debugger (could also be copy-pasted as expressions in some cases)
+uint16_t dbgStackDepth(VM* vm) {
+  return (uint16_t)((uint16_t*)vm->stack->reg.pStackPointer - (uint16_t*)(vm->stack + 1));
 }
+uint16_t* dbgStack(VM* vm) {
+  return (uint16_t*)(vm->stack + 1);
+}
+uint16_t dbgPC(VM* vm) {
+  return (uint16_t)((intptr_t)vm->stack->reg.lpProgramCounter - (intptr_t)vm->lpBytecode);
+}
+#endif // MVM_DEBUG
 
-LongPtr vm_toStringUtf8_long(VM* vm, Value value, size_t* out_sizeBytes) {
-  CODE_COVERAGE(43); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-
-  value = vm_convertToString(vm, value);
-
-  TeTypeCode typeCode = deepTypeOf(vm, value);
-
-  if (typeCode == TC_VAL_STR_PROTO) {
-    CODE_COVERAGE_UNTESTED(521); // Not hit
-    *out_sizeBytes = sizeof PROTO_STR - 1;
-    return LongPtr_new((void*)&PROTO_STR);
-  } else {
-    CODE_COVERAGE(522); // Hit
+/**
+ * Checks that we have enough stack space for the given size, and updates the
+ * high water mark.
+ */
+static TeError vm_requireStackSpace(VM* vm, uint16_t* pStackPointer, uint16_t sizeRequiredInWords) {
+  uint16_t* pStackHighWaterMark = pStackPointer + ((intptr_t)sizeRequiredInWords);
+  if (pStackHighWaterMark > getTopOfStackSpace(vm->stack)) {
+    CODE_COVERAGE_ERROR_PATH(233); // Not hit
+
+    // TODO(low): Since we know the max stack depth for the function, we could
+    // actually grow the stack dynamically rather than allocate it fixed size.
+    // Actually, it seems likely that we could allocate the VM stack on the C
+    // stack, since it's a fixed-size structure anyway.
+    //
+    // (A way to do the allocation on the stack would be to perform a nested
+    // call to mvm_call, and the allocation can be at the beginning of
+    // mvm_call). Otherwise we could just malloc, which has the advantage of
+    // simplicity and we can grow the stack at any time.
+    //
+    // Rather than a segmented stack, it might also be simpler to just grow the
+    // stack size and copy across old data. This has the advantage of keeping
+    // the GC simple.
+    return vm_newError(vm, MVM_E_STACK_OVERFLOW);
   }
 
-  if (typeCode == TC_VAL_STR_LENGTH) {
-    CODE_COVERAGE_UNTESTED(523); // Not hit
-    *out_sizeBytes = sizeof LENGTH_STR - 1;
-    return LongPtr_new((void*)&LENGTH_STR);
-  } else {
-    CODE_COVERAGE(524); // Hit
+  // Stack high-water mark
+  uint16_t stackHighWaterMark = (uint16_t)((intptr_t)pStackHighWaterMark - (intptr_t)getBottomOfStack(vm->stack));
+  if (stackHighWaterMark > vm->stackHighWaterMark) {
+    vm->stackHighWaterMark = stackHighWaterMark;
   }
 
-  VM_ASSERT(vm, (typeCode == TC_REF_STRING) || (typeCode == TC_REF_INTERNED_STRING));
+  return MVM_E_SUCCESS;
+}
 
-  LongPtr lpTarget = DynamicPtr_decode_long(vm, value);
-  uint16_t headerWord = readAllocationHeaderWord_long(lpTarget);
-  uint16_t sourceSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+TeError vm_resolveExport(VM* vm, mvm_VMExportID id, Value* result) {
+  CODE_COVERAGE(17); // Hit
 
-  if (out_sizeBytes) {
-    CODE_COVERAGE(349); // Hit
-    *out_sizeBytes = sourceSize - 1; // Without the extra safety null-terminator
-  } else {
-    CODE_COVERAGE_UNTESTED(350); // Not hit
+  LongPtr exportTableEnd;
+  LongPtr exportTable = getBytecodeSection(vm, BCS_EXPORT_TABLE, &exportTableEnd);
+
+  // See vm_TsExportTableEntry
+  LongPtr exportTableEntry = exportTable;
+  while (exportTableEntry < exportTableEnd) {
+    CODE_COVERAGE(234); // Hit
+    mvm_VMExportID exportID = LongPtr_read2_aligned(exportTableEntry);
+    if (exportID == id) {
+      CODE_COVERAGE(235); // Hit
+      LongPtr pExportvalue = LongPtr_add(exportTableEntry, 2);
+      mvm_VMExportID exportValue = LongPtr_read2_aligned(pExportvalue);
+      *result = exportValue;
+      return MVM_E_SUCCESS;
+    } else {
+      CODE_COVERAGE(236); // Hit
+    }
+    exportTableEntry = LongPtr_add(exportTableEntry, sizeof (vm_TsExportTableEntry));
   }
 
-  return lpTarget;
+  *result = VM_VALUE_UNDEFINED;
+  return vm_newError(vm, MVM_E_UNRESOLVED_EXPORT);
 }
 
-/**
- * Gets a pointer to the string bytes of the string represented by `value`.
- *
- * `value` must be a string
- *
- * Warning: the result is a native pointer and becomes invalid if a GC
- * collection occurs.
- */
-LongPtr vm_getStringData(VM* vm, Value value) {
-  CODE_COVERAGE(228); // Hit
-  TeTypeCode typeCode = deepTypeOf(vm, value);
-  switch (typeCode) {
-    case TC_VAL_STR_PROTO:
-      CODE_COVERAGE_UNTESTED(229); // Not hit
-      return LongPtr_new((void*)&PROTO_STR);
-    case TC_VAL_STR_LENGTH:
-      CODE_COVERAGE(512); // Hit
-      return LongPtr_new((void*)&LENGTH_STR);
-    case TC_REF_STRING:
-    case TC_REF_INTERNED_STRING:
-      return DynamicPtr_decode_long(vm, value);
-    default:
-      VM_ASSERT_UNREACHABLE(vm);
-      return LongPtr_new(0);
+TeError mvm_resolveExports(VM* vm, const mvm_VMExportID* idTable, Value* resultTable, uint8_t count) {
+  CODE_COVERAGE(18); // Hit
+  TeError err = MVM_E_SUCCESS;
+  while (count--) {
+    CODE_COVERAGE(237); // Hit
+    TeError tempErr = vm_resolveExport(vm, *idTable++, resultTable++);
+    if (tempErr != MVM_E_SUCCESS) {
+      CODE_COVERAGE_ERROR_PATH(238); // Not hit
+      err = tempErr;
+    } else {
+      CODE_COVERAGE(239); // Hit
+    }
   }
+  return err;
 }
 
-const char* mvm_toStringUtf8(VM* vm, Value value, size_t* out_sizeBytes) {
-  CODE_COVERAGE(623); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-  /*
-   * Note: I previously had this function returning a long pointer, but this
-   * tripped someone up because they passed the result directly to printf, which
-   * on MSP430 apparently doesn't support arbitrary long pointers (data20
-   * pointers). Now I just copy it locally.
-   */
+// True if the handle refers to a slot of the handle table that is in use. The
+// handle may have been released already, which leaves its slot pointer null.
+static bool vm_isHandleInitialized(VM* vm, const mvm_Handle* handle) {
+  CODE_COVERAGE(22); // Hit
+  uint16_t index = handle->_index;
+  uint16_t page = index / MVM_HANDLE_PAGE_SIZE;
+  uint16_t slot = index % MVM_HANDLE_PAGE_SIZE;
+  if (page >= vm->gc_handlePageCount) {
+    CODE_COVERAGE(243); // Hit
+    return false;
+  }
+  TsHandlePage* pPage = vm->gc_handlePages[page];
+  if ((pPage->links[slot] == HANDLE_IN_USE) && (handle->_slot == &pPage->values[slot])) {
+    CODE_COVERAGE_UNTESTED(244); // Not hit
+    return true;
+  } else {
+    CODE_COVERAGE(245); // Hit
+    return false;
+  }
+}
 
-  size_t size; // Size excluding a null terminator
-  LongPtr lpTarget = vm_toStringUtf8_long(vm, value, &size);
-  if (out_sizeBytes)
-    *out_sizeBytes = size;
+// Adds a page of free slots to the handle table
+static void vm_growHandleTable(VM* vm) {
+  CODE_COVERAGE_UNTESTED(863); // Not hit
+  uint16_t pageCount = vm->gc_handlePageCount;
+  // Slot indexes must stay below HANDLE_IN_USE
+  if (pageCount >= HANDLE_IN_USE / MVM_HANDLE_PAGE_SIZE) {
+    CODE_COVERAGE_ERROR_PATH(864); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_OUT_OF_MEMORY);
+    return;
+  }
 
-  void* pTarget = LongPtr_truncate(lpTarget);
-  // Is the string in RAM? (i.e. the truncated pointer is the same as the full pointer)
-  if (LongPtr_new(pTarget) == lpTarget) {
-    CODE_COVERAGE(624); // Hit
-    return (const char*)pTarget;
+  if (pageCount == vm->gc_handlePageCapacity) {
+    CODE_COVERAGE_UNTESTED(865); // Not hit
+    // The table of pages is full, so it's doubled in size
+    uint16_t newCapacity = pageCount ? pageCount * 2 : 1;
+    TsHandlePage** pNewPages = vm_malloc(vm, newCapacity * sizeof (TsHandlePage*));
+    if (!pNewPages) {
+      CODE_COVERAGE_ERROR_PATH(866); // Not hit
+      MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+      return;
+    }
+    if (vm->gc_handlePages) {
+      memcpy(pNewPages, vm->gc_handlePages, pageCount * sizeof (TsHandlePage*));
+      vm_free(vm, vm->gc_handlePages);
+    }
+    vm->gc_handlePages = pNewPages;
+    vm->gc_handlePageCapacity = newCapacity;
   } else {
-    CODE_COVERAGE_UNTESTED(625); // Not hit
-    // Allocate a new string in local memory (with additional null terminator)
-    vm_allocString(vm, size, &pTarget);
-    memcpy_long(pTarget, lpTarget, size);
+    CODE_COVERAGE_UNTESTED(867); // Not hit
+  }
 
-    return (const char*)pTarget;
+  TsHandlePage* pPage = vm_malloc(vm, sizeof (TsHandlePage));
+  if (!pPage) {
+    CODE_COVERAGE_ERROR_PATH(868); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+    return;
   }
-}
 
-size_t mvm_stringSizeUtf8(mvm_VM* vm, mvm_Value value) {
-  CODE_COVERAGE_UNTESTED(620); // Not hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-  size_t size;
-  vm_toStringUtf8_long(vm, value, &size);
-  return size;
-}
+  // Chain the new slots onto the front of the free list, in order
+  uint16_t base = pageCount * MVM_HANDLE_PAGE_SIZE;
+  uint16_t i;
+  for (i = 0; i < MVM_HANDLE_PAGE_SIZE; i++) {
+    pPage->values[i] = VM_VALUE_UNDEFINED;
+    pPage->links[i] = base + i + 1;
+  }
+  pPage->links[MVM_HANDLE_PAGE_SIZE - 1] = vm->gc_handleFreeList;
+  vm->gc_handleFreeList = base;
+  #if MVM_INCREMENTAL_GC
+  pPage->vm = vm;
+  #endif
 
-Value mvm_newBoolean(bool source) {
-  CODE_COVERAGE_UNTESTED(44); // Not hit
-  return source ? VM_VALUE_TRUE : VM_VALUE_FALSE;
+  vm->gc_handlePages[pageCount] = pPage;
+  vm->gc_handlePageCount = pageCount + 1;
 }
 
-Value vm_allocString(VM* vm, size_t sizeBytes, void** out_pData) {
-  CODE_COVERAGE(45); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-  if (sizeBytes < 3) {
-    TABLE_COVERAGE(sizeBytes, 3, 525); // Hit 2/3
+void mvm_initializeHandle(VM* vm, mvm_Handle* handle) {
+  CODE_COVERAGE(19); // Hit
+  // The handle isn't checked: it's usually uninitialized memory, which can't
+  // be read, and that memory could equally pass for a handle in use
+  if (vm->gc_handleFreeList == HANDLE_NONE) {
+    CODE_COVERAGE(869); // Hit
+    vm_growHandleTable(vm);
+    // MVM_FATAL_ERROR may return, leaving the table as it was
+    if (vm->gc_handleFreeList == HANDLE_NONE) {
+      CODE_COVERAGE_ERROR_PATH(896); // Not hit
+      handle->_slot = NULL;
+      return;
+    }
+  } else {
+    CODE_COVERAGE(870); // Hit
   }
-
-  // Note: allocating 1 extra byte for the extra null terminator
-  char* pData = gc_allocateWithHeader(vm, (uint16_t)sizeBytes + 1, TC_REF_STRING);
-  *out_pData = pData;
-  // Null terminator
-  pData[sizeBytes] = '\0';
-  return ShortPtr_encode(vm, pData);
+  uint16_t index = vm->gc_handleFreeList;
+  TsHandlePage* pPage = vm->gc_handlePages[index / MVM_HANDLE_PAGE_SIZE];
+  uint16_t slot = index % MVM_HANDLE_PAGE_SIZE;
+  vm->gc_handleFreeList = pPage->links[slot];
+  pPage->links[slot] = HANDLE_IN_USE;
+  handle->_slot = &pPage->values[slot];
+  handle->_index = index;
 }
 
-// New string from null-terminated
-static Value vm_newStringFromCStrNT(VM* vm, const char* s) {
-  size_t len = strlen(s);
-  return mvm_newString(vm, s, len);
+void vm_cloneHandle(VM* vm, mvm_Handle* target, const mvm_Handle* source) {
+  CODE_COVERAGE_UNTESTED(20); // Not hit
+  VM_ASSERT(vm, vm_isHandleInitialized(vm, source));
+  gc_completeIncremental(vm);
+  mvm_initializeHandle(vm, target);
+  if (!target->_slot) {
+    CODE_COVERAGE_ERROR_PATH(897); // Not hit
+    return;
+  }
+  *target->_slot = *source->_slot;
 }
 
-Value mvm_newString(VM* vm, const char* sourceUtf8, size_t sizeBytes) {
-  CODE_COVERAGE(46); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-  void* data;
-  Value value = vm_allocString(vm, sizeBytes, &data);
-  memcpy(data, sourceUtf8, sizeBytes);
-  return value;
+TeError mvm_releaseHandle(VM* vm, mvm_Handle* handle) {
+  // This function doesn't contain coverage markers because node hits this path
+  // non-deterministically.
+  if (!vm_isHandleInitialized(vm, handle)) {
+    handle->_slot = NULL;
+    return vm_newError(vm, MVM_E_INVALID_HANDLE);
+  }
+  uint16_t index = handle->_index;
+  TsHandlePage* pPage = vm->gc_handlePages[index / MVM_HANDLE_PAGE_SIZE];
+  uint16_t slot = index % MVM_HANDLE_PAGE_SIZE;
+  pPage->values[slot] = VM_VALUE_UNDEFINED;
+  pPage->links[slot] = vm->gc_handleFreeList;
+  vm->gc_handleFreeList = index;
+  handle->_slot = NULL;
+  return MVM_E_SUCCESS;
 }
 
-static Value getBuiltin(VM* vm, mvm_TeBuiltins builtinID) {
-  CODE_COVERAGE(526); // Hit
-  LongPtr lpBuiltins = getBytecodeSection(vm, BCS_BUILTINS, NULL);
-  LongPtr lpBuiltin = LongPtr_add(lpBuiltins, (int16_t)(builtinID * sizeof (Value)));
-  Value value = LongPtr_read2_aligned(lpBuiltin);
+#if MVM_SUPPORT_FLOAT
+static Value vm_float64ToStr(VM* vm, Value value) {
+  CODE_COVERAGE(619); // Hit
 
-  // Check if the builtin accesses a RAM value via a handle
-  Value* target = getHandleTargetOrNull(vm, value);
-  if (target) {
-    CODE_COVERAGE(212); // Hit
-    return *target;
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm); // Because we allocate a new string
+
+  // I don't think this is 100% compliant, but it's probably fine for most use
+  // cases, and most importantly it's small.
+
+  double x = mvm_toFloat64(vm, value);
+
+  char buf[64];
+  char* p = buf;
+
+  // NaN should be represented as VM_VALUE_NAN not a float with NaN
+  VM_ASSERT(vm, !isnan(x));
+
+  if (isinf(x)) {
+    CODE_COVERAGE(621); // Hit
+    if (x < 0) {
+      CODE_COVERAGE(622); // Hit
+      *p++ = '-';
+    }
+    memcpy(p, "Infinity", 9);
+    p += 8;
   } else {
-    CODE_COVERAGE(213); // Hit
-    return value;
+    CODE_COVERAGE(657); // Hit
+    p += MVM_SNPRINTF(p, sizeof buf, "%.15g", x);
+    VM_ASSERT(vm, p < buf + sizeof buf);
   }
+
+  return mvm_newString(vm, buf, p - buf);
 }
+#endif //  MVM_SUPPORT_FLOAT
 
-/**
- * If the value is a handle, this returns a pointer to the global variable
- * referenced by the handle. Otherwise, this returns NULL.
- */
-static inline Value* getHandleTargetOrNull(VM* vm, Value value) {
-  CODE_COVERAGE(527); // Hit
-  if (!Value_isBytecodeMappedPtrOrWellKnown(value)) {
-    CODE_COVERAGE_UNTESTED(528); // Not hit
-    return NULL;
-  } else {
-    CODE_COVERAGE(529); // Hit
-  }
-  uint16_t globalsOffset = getSectionOffset(vm->lpBytecode, BCS_GLOBALS);
-  uint16_t globalsEndOffset = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_GLOBALS));
-  if ((value < globalsOffset) || (value >= globalsEndOffset)) {
-    CODE_COVERAGE(530); // Hit
-    return NULL;
+static Value vm_intToStr(VM* vm, int32_t i) {
+  CODE_COVERAGE(618); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  char buf[32];
+  size_t size;
+
+  size = MVM_SNPRINTF(buf, sizeof buf, "%" PRId32, i);
+  VM_ASSERT(vm, size < sizeof buf);
+
+  return mvm_newString(vm, buf, size);
+}
+
+static Value vm_convertToString(VM* vm, Value value) {
+  CODE_COVERAGE(23); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  TeTypeCode type = deepTypeOf(vm, value);
+  const char* constStr;
+
+  switch (type) {
+    case TC_VAL_INT14:
+    case TC_REF_INT32: {
+      CODE_COVERAGE(246); // Hit
+      int32_t i = vm_readInt32(vm, type, value);
+      return vm_intToStr(vm, i);
+    }
+    case TC_REF_FLOAT64: {
+      CODE_COVERAGE(248); // Hit
+      #if MVM_SUPPORT_FLOAT
+      return vm_float64ToStr(vm, value);
+      #else
+      constStr = "";
+      #endif
+      break;
+    }
+    case TC_REF_STRING: {
+      CODE_COVERAGE(249); // Hit
+      return value;
+    }
+    case TC_REF_INTERNED_STRING: {
+      CODE_COVERAGE(250); // Hit
+      return value;
+    }
+    case TC_REF_ROPE: {
+      CODE_COVERAGE(764); // Hit
+      return value;
+    }
+    case TC_REF_PROPERTY_LIST: {
+      CODE_COVERAGE_UNTESTED(251); // Not hit
+      constStr = "[Object]";
+      break;
+    }
+    case TC_REF_CLOSURE: {
+      CODE_COVERAGE_UNTESTED(365); // Not hit
+      constStr = "[Function]";
+      break;
+    }
+    case TC_REF_FIXED_LENGTH_ARRAY:
+    case TC_REF_ARRAY: {
+      CODE_COVERAGE_UNTESTED(252); // Not hit
+      constStr = "[Object]";
+      break;
+    }
+    case TC_REF_FUNCTION: {
+      CODE_COVERAGE_UNTESTED(254); // Not hit
+      constStr = "[Function]";
+      break;
+    }
+    case TC_REF_HOST_FUNC: {
+      CODE_COVERAGE_UNTESTED(255); // Not hit
+      constStr = "[Function]";
+      break;
+    }
+    case TC_REF_UINT8_ARRAY: {
+      CODE_COVERAGE_UNTESTED(256); // Not hit
+      constStr = "[Object]";
+      break;
+    }
+    case TC_REF_CLASS: {
+      CODE_COVERAGE_UNTESTED(596); // Not hit
+      constStr = "[Function]";
+      break;
+    }
+    case TC_REF_TYPED_ARRAY: {
+      CODE_COVERAGE_UNTESTED(597); // Not hit
+      constStr = "[Object]";
+      break;
+    }
+    case TC_REF_SYMBOL: {
+      CODE_COVERAGE_UNTESTED(257); // Not hit
+      VM_NOT_IMPLEMENTED(vm);
+      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
+    }
+    case TC_VAL_UNDEFINED: {
+      CODE_COVERAGE(258); // Hit
+      constStr = "undefined";
+      break;
+    }
+    case TC_VAL_NULL: {
+      CODE_COVERAGE(259); // Hit
+      constStr = "null";
+      break;
+    }
+    case TC_VAL_TRUE: {
+      CODE_COVERAGE(260); // Hit
+      constStr = "true";
+      break;
+    }
+    case TC_VAL_FALSE: {
+      CODE_COVERAGE(261); // Hit
+      constStr = "false";
+      break;
+    }
+    case TC_VAL_NAN: {
+      CODE_COVERAGE(262); // Hit
+      constStr = "NaN";
+      break;
+    }
+    case TC_VAL_NEG_ZERO: {
+      CODE_COVERAGE(263); // Hit
+      constStr = "0";
+      break;
+    }
+    case TC_VAL_STR_LENGTH: {
+      CODE_COVERAGE(266); // Hit
+      return value;
+    }
+    case TC_VAL_STR_PROTO: {
+      CODE_COVERAGE_UNTESTED(267); // Not hit
+      return value;
+    }
+    case TC_VAL_DELETED: {
+      return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+    }
+    default: return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+  }
+
+  return vm_newStringFromCStrNT(vm, constStr);
+}
+
+static Value vm_concat(VM* vm, Value* left, Value* right) {
+  CODE_COVERAGE(553); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  uint16_t leftSize = vm_stringSizeUtf8(vm, *left);
+  uint16_t rightSize = vm_stringSizeUtf8(vm, *right);
+
+  #if MVM_STRING_ROPES
+  // Short strings are cheaper to copy than to defer, so at least one side
+  // needs to be long. The result also needs to fit in a single allocation so
+  // that the rope can be flattened later (a longer one goes through the flat
+  // path, which reports the error).
+  uint16_t size = leftSize + rightSize;
+  if (leftSize && rightSize &&
+    ((leftSize >= MVM_ROPE_MIN_SIZE) || (rightSize >= MVM_ROPE_MIN_SIZE)) &&
+    (size < MAX_ALLOCATION_SIZE)
+  ) {
+    CODE_COVERAGE(765); // Hit
+    return vm_newRope(vm, left, right, size);
   } else {
-    CODE_COVERAGE(531); // Hit
+    CODE_COVERAGE(766); // Hit
+  }
+  #endif // MVM_STRING_ROPES
+
+  uint8_t* data;
+  // Note: this allocation can cause a GC collection which could cause the
+  // strings to move in memory
+  Value value = vm_allocString(vm, leftSize + rightSize, (void**)&data);
+
+  vm_stringCopy(vm, data, *left);
+  vm_stringCopy(vm, data + leftSize, *right);
+  return value;
+}
+
+#if MVM_STRING_ROPES
+/**
+ * Creates a rope for the concatenation of the strings in `*left` and
+ * `*right`, which must be GC roots. `size` is the combined size.
+ */
+static Value vm_newRope(VM* vm, Value* left, Value* right, uint16_t size) {
+  CODE_COVERAGE(767); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  // Appending a short piece to a rope that ends in a short leaf merges the two
+  // into a new leaf, so that building a string from many small pieces doesn't
+  // leave a rope node (and allocation header) for every piece.
+  mvm_Handle hLeaf;
+  mvm_initializeHandle(vm, &hLeaf);
+  TsRope* pLeft = (deepTypeOf(vm, *left) == TC_REF_ROPE) ? ShortPtr_decode(vm, *left) : NULL;
+  if (pLeft && (pLeft->right != VM_VALUE_DELETED)) {
+    CODE_COVERAGE(768); // Hit
+    uint16_t lastSize = vm_stringSizeUtf8(vm, pLeft->right);
+    uint16_t rightSize = size - VirtualInt14_decode(vm, pLeft->length);
+    if (lastSize + rightSize < MVM_ROPE_MIN_SIZE) {
+      CODE_COVERAGE(769); // Hit
+      uint8_t* data;
+      // Note: this allocation can cause a GC collection
+      mvm_handleSet(&hLeaf, vm_allocString(vm, lastSize + rightSize, (void**)&data));
+      pLeft = ShortPtr_decode(vm, *left);
+      vm_stringCopy(vm, data, pLeft->right);
+      vm_stringCopy(vm, data + lastSize, *right);
+    } else {
+      CODE_COVERAGE(770); // Hit
+    }
+  } else {
+    CODE_COVERAGE(771); // Hit
+  }
+
+  TsRope* pRope = gc_allocateWithHeader(vm, sizeof (TsRope), TC_REF_ROPE);
+  if (mvm_handleGet(&hLeaf) != VM_VALUE_UNDEFINED) {
+    CODE_COVERAGE(772); // Hit
+    pRope->left = ((TsRope*)ShortPtr_decode(vm, *left))->left;
+    pRope->right = mvm_handleGet(&hLeaf);
+  } else {
+    CODE_COVERAGE(773); // Hit
+    pRope->left = *left;
+    pRope->right = *right;
+  }
+  pRope->length = VirtualInt14_encode(vm, size);
+  mvm_releaseHandle(vm, &hLeaf);
+
+  return ShortPtr_encode(vm, pRope);
+}
+#endif // MVM_STRING_ROPES
+
+/* Returns the deep type code of the value, looking through pointers and boxing */
+static TeTypeCode deepTypeOf(VM* vm, Value value) {
+  CODE_COVERAGE(27); // Hit
+
+  if (Value_isShortPtr(value)) {
+    CODE_COVERAGE(0); // Hit
+    void* p = ShortPtr_decode(vm, value);
+    uint16_t headerWord = readAllocationHeaderWord(p);
+    TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
+    return typeCode;
+  } else {
+    CODE_COVERAGE(515); // Hit
+  }
+
+  if (Value_isVirtualInt14(value)) {
+    CODE_COVERAGE(295); // Hit
+    return TC_VAL_INT14;
+  } else {
+    CODE_COVERAGE(516); // Hit
+  }
+
+  VM_ASSERT(vm, Value_isBytecodeMappedPtrOrWellKnown(value));
+
+  // Check for "well known" values such as TC_VAL_UNDEFINED
+  if (value < VM_VALUE_WELLKNOWN_END) {
+    CODE_COVERAGE(296); // Hit
+    return (TeTypeCode)((value >> 2) + 0x11);
+  } else {
+    CODE_COVERAGE(297); // Hit
+  }
+
+  LongPtr p = DynamicPtr_decode_long(vm, value);
+  uint16_t headerWord = readAllocationHeaderWord_long(p);
+  TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
+
+  return typeCode;
+}
+
+#if MVM_SUPPORT_FLOAT
+int32_t mvm_float64ToInt32(MVM_FLOAT64 value) {
+  CODE_COVERAGE(486); // Hit
+  if (MVM_FLOAT_IS_FINITE(value)) {
+    CODE_COVERAGE(487); // Hit
+    return (int32_t)value;
+  } else {
+    CODE_COVERAGE(488); // Hit
+    return 0;
+  }
+}
+
+Value mvm_newNumber(VM* vm, MVM_FLOAT64 value) {
+  CODE_COVERAGE(28); // Hit
+  if (MVM_FLOAT_IS_NAN(value)) {
+    CODE_COVERAGE(298); // Hit
+    return VM_VALUE_NAN;
+  } else {
+    CODE_COVERAGE(517); // Hit
+  }
+
+  if (MVM_FLOAT_IS_NEG_ZERO(value)) {
+    CODE_COVERAGE(299); // Hit
+    return VM_VALUE_NEG_ZERO;
+  } else {
+    CODE_COVERAGE(518); // Hit
+  }
+
+  // Doubles are very expensive to compute, so at every opportunity, we'll check
+  // if we can coerce back to an integer
+  int32_t valueAsInt = mvm_float64ToInt32(value);
+  if (value == (MVM_FLOAT64)valueAsInt) {
+    CODE_COVERAGE(300); // Hit
+    return mvm_newInt32(vm, valueAsInt);
+  } else {
+    CODE_COVERAGE(301); // Hit
+  }
+
+  MVM_FLOAT64* pResult = GC_ALLOCATE_TYPE(vm, MVM_FLOAT64, TC_REF_FLOAT64);
+  *pResult = value;
+
+  return ShortPtr_encode(vm, pResult);
+}
+#endif // MVM_SUPPORT_FLOAT
+
+Value mvm_newInt32(VM* vm, int32_t value) {
+  CODE_COVERAGE(29); // Hit
+  if ((value >= VM_MIN_INT14) && (value <= VM_MAX_INT14)) {
+    CODE_COVERAGE(302); // Hit
+    return VirtualInt14_encode(vm, value);
+  } else {
+    CODE_COVERAGE(303); // Hit
+  }
+
+  // Int32
+
+  int32_t* pResult = GC_ALLOCATE_TYPE(vm, int32_t, TC_REF_INT32);
+  *pResult = value;
+
+  return ShortPtr_encode(vm, pResult);
+}
+
+#if MVM_RECYCLE_NUMBER_BOXES
+/**
+ * Called by SUB_OP_NUM_OP once it has read its operands. If one of them is the
+ * box that the arithmetic instruction just before allocated for its result,
+ * then nothing else can be referencing the box: it was pushed, and the only
+ * instructions run since are this one, which popped it, and at most one that
+ * pushed a constant on top of it. The box is also still the last allocation in
+ * the heap, so it's given back by moving the end of the heap back over it,
+ * and the result of this instruction (if it needs a box) takes its place.
+ */
+static void vm_recycleNumberBox(VM* vm, LongPtr lpProgramCounter, Value left, Value right) {
+  ShortPtr box = vm->numberBox;
+  if (!box) {
+    CODE_COVERAGE(758); // Hit
+    return;
+  }
+  vm->numberBox = 0;
+
+  // Size of the instructions from the one after the box was allocated, up to
+  // and including this one (a 1-byte NUM_OP)
+  int16_t distance = LongPtr_sub(lpProgramCounter, vm->lpAfterNumberBox);
+  if (right == box) {
+    CODE_COVERAGE_UNTESTED(759); // Not hit
+    if (distance != 1) return;
+  } else if (left == box) {
+    CODE_COVERAGE(760); // Hit
+    uint8_t op = LongPtr_read1(vm->lpAfterNumberBox);
+    if (((op >> 4) == VM_OP_LOAD_SMALL_LITERAL) || ((op >> 4) == VM_OP_LOAD_ARG_1)) {
+      if (distance != 2) return;
+    } else if ((op == ((VM_OP_EXTENDED_3 << 4) | VM_OP3_LOAD_LITERAL)) ||
+               (op == ((VM_OP_EXTENDED_3 << 4) | VM_OP3_LOAD_GLOBAL_3))) {
+      if (distance != 4) return;
+    } else {
+      return;
+    }
+  } else {
+    CODE_COVERAGE(761); // Hit
+    return;
+  }
+
+  uint16_t* pHeader = (uint16_t*)ShortPtr_decode(vm, box) - 1;
+  VM_ASSERT(vm, (vm_getTypeCodeFromHeaderWord(*pHeader) == TC_REF_INT32) ||
+    (vm_getTypeCodeFromHeaderWord(*pHeader) == TC_REF_FLOAT64));
+  uint16_t sizeIncludingHeader = (vm_getAllocationSizeExcludingHeaderFromHeaderWord(*pHeader) + 3) & 0xFFFE;
+  TsBucket* pBucket = vm->pLastBucket;
+  if ((uint16_t*)((intptr_t)pHeader + sizeIncludingHeader) != pBucket->pEndOfUsedSpace) {
+    CODE_COVERAGE_UNTESTED(762); // Not hit
+    return;
+  }
+
+  CODE_COVERAGE(763); // Hit
+  #if MVM_HEAP_PROFILE
+  if (vm->pHeapProfile) {
+    CODE_COVERAGE_UNTESTED(875); // Not hit
+    vm_heapProfileFree(vm, box, sizeIncludingHeader);
+  }
+  #endif
+  pBucket->pEndOfUsedSpace = pHeader;
+  vm->numberBoxesRecycled++;
+}
+#endif // MVM_RECYCLE_NUMBER_BOXES
+
+bool mvm_toBool(VM* vm, Value value) {
+  CODE_COVERAGE(30); // Hit
+  gc_completeIncremental(vm);
+
+  TeTypeCode type = deepTypeOf(vm, value);
+  switch (type) {
+    case TC_VAL_INT14: {
+      CODE_COVERAGE(304); // Hit
+      return value != VirtualInt14_encode(vm, 0);
+    }
+    case TC_REF_INT32: {
+      CODE_COVERAGE_UNTESTED(305); // Not hit
+      // Int32 can't be zero, otherwise it would be encoded as an int14
+      VM_ASSERT(vm, vm_readInt32(vm, type, value) != 0);
+      return false;
+    }
+    case TC_REF_FLOAT64: {
+      CODE_COVERAGE_UNTESTED(306); // Not hit
+      #if MVM_SUPPORT_FLOAT
+        // Double can't be zero, otherwise it would be encoded as an int14
+        VM_ASSERT(vm, mvm_toFloat64(vm, value) != 0);
+      #endif
+      return false;
+    }
+    case TC_REF_INTERNED_STRING:
+    case TC_REF_STRING: {
+      CODE_COVERAGE(307); // Hit
+      return vm_stringSizeUtf8(vm, value) != 0;
+    }
+    case TC_REF_PROPERTY_LIST: {
+      CODE_COVERAGE(308); // Hit
+      return true;
+    }
+    case TC_REF_CLOSURE: {
+      CODE_COVERAGE_UNTESTED(372); // Not hit
+      return true;
+    }
+    case TC_REF_ARRAY: {
+      CODE_COVERAGE(309); // Hit
+      return true;
+    }
+    case TC_REF_FUNCTION: {
+      CODE_COVERAGE_UNTESTED(311); // Not hit
+      return true;
+    }
+    case TC_REF_HOST_FUNC: {
+      CODE_COVERAGE_UNTESTED(312); // Not hit
+      return true;
+    }
+    case TC_REF_UINT8_ARRAY: {
+      CODE_COVERAGE_UNTESTED(313); // Not hit
+      return true;
+    }
+    case TC_REF_SYMBOL: {
+      CODE_COVERAGE_UNTESTED(314); // Not hit
+      return true;
+    }
+    case TC_REF_CLASS: {
+      CODE_COVERAGE(604); // Hit
+      return true;
+    }
+    case TC_REF_TYPED_ARRAY: {
+      CODE_COVERAGE_UNTESTED(609); // Not hit
+      return true;
+    }
+    case TC_REF_ROPE: {
+      CODE_COVERAGE_UNTESTED(610); // Not hit
+      return vm_stringSizeUtf8(vm, value) != 0;
+    }
+    case TC_VAL_UNDEFINED: {
+      CODE_COVERAGE(315); // Hit
+      return false;
+    }
+    case TC_VAL_NULL: {
+      CODE_COVERAGE(316); // Hit
+      return false;
+    }
+    case TC_VAL_TRUE: {
+      CODE_COVERAGE(317); // Hit
+      return true;
+    }
+    case TC_VAL_FALSE: {
+      CODE_COVERAGE(318); // Hit
+      return false;
+    }
+    case TC_VAL_NAN: {
+      CODE_COVERAGE_UNTESTED(319); // Not hit
+      return false;
+    }
+    case TC_VAL_NEG_ZERO: {
+      CODE_COVERAGE_UNTESTED(320); // Not hit
+      return false;
+    }
+    case TC_VAL_DELETED: {
+      CODE_COVERAGE_UNTESTED(321); // Not hit
+      return false;
+    }
+    case TC_VAL_STR_LENGTH: {
+      CODE_COVERAGE_UNTESTED(268); // Not hit
+      return true;
+    }
+    case TC_VAL_STR_PROTO: {
+      CODE_COVERAGE_UNTESTED(269); // Not hit
+      return true;
+    }
+    default: return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+  }
+}
+
+static bool vm_isString(VM* vm, Value value) {
+  CODE_COVERAGE(31); // Hit
+  return mvm_typeOf(vm, value) == VM_T_STRING;
+}
+
+/** Reads a numeric value that is a subset of a 32-bit integer */
+static int32_t vm_readInt32(VM* vm, TeTypeCode type, Value value) {
+  CODE_COVERAGE(33); // Hit
+  if (type == TC_VAL_INT14) {
+    CODE_COVERAGE(330); // Hit
+    return VirtualInt14_decode(vm, value);
+  } else if (type == TC_REF_INT32) {
+    CODE_COVERAGE(331); // Hit
+    LongPtr target = DynamicPtr_decode_long(vm, value);
+    int32_t result = (int32_t)LongPtr_read4(target);
+    return result;
+  } else {
+    return VM_UNEXPECTED_INTERNAL_ERROR(vm);
+  }
+}
+
+static inline uint16_t readAllocationHeaderWord_long(LongPtr pAllocation) {
+  CODE_COVERAGE(519); // Hit
+  return LongPtr_read2_aligned(LongPtr_add(pAllocation, -2));
+}
+
+static inline uint16_t readAllocationHeaderWord(void* pAllocation) {
+  CODE_COVERAGE(520); // Hit
+  return ((uint16_t*)pAllocation)[-1];
+}
+
+static inline mvm_TfHostFunction* vm_getResolvedImports(VM* vm) {
+  CODE_COVERAGE(40); // Hit
+  return (mvm_TfHostFunction*)(vm + 1); // Starts right after the header
+}
+
+static inline mvm_HostFunctionID vm_getHostFunctionId(VM* vm, uint16_t hostFunctionIndex) {
+  LongPtr lpImportTable = getBytecodeSection(vm, BCS_IMPORT_TABLE, NULL);
+  LongPtr lpImportTableEntry = LongPtr_add(lpImportTable, hostFunctionIndex * sizeof (vm_TsImportTableEntry));
+  return LongPtr_read2_aligned(lpImportTableEntry);
+}
+
+mvm_TeType mvm_typeOf(VM* vm, Value value) {
+  gc_completeIncremental(vm);
+  TeTypeCode tc = deepTypeOf(vm, value);
+  VM_ASSERT(vm, tc < sizeof typeByTC);
+  TABLE_COVERAGE(tc, TC_END, 42); // Hit 16/26
+  return (mvm_TeType)typeByTC[tc];
+}
+
+LongPtr vm_toStringUtf8_long(VM* vm, Value value, size_t* out_sizeBytes) {
+  CODE_COVERAGE(43); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  value = vm_convertToString(vm, value);
+
+  TeTypeCode typeCode = deepTypeOf(vm, value);
+
+  if (typeCode == TC_VAL_STR_PROTO) {
+    CODE_COVERAGE_UNTESTED(521); // Not hit
+    *out_sizeBytes = sizeof PROTO_STR - 1;
+    return LongPtr_new((void*)&PROTO_STR);
+  } else {
+    CODE_COVERAGE(522); // Hit
+  }
+
+  if (typeCode == TC_VAL_STR_LENGTH) {
+    CODE_COVERAGE_UNTESTED(523); // Not hit
+    *out_sizeBytes = sizeof LENGTH_STR - 1;
+    return LongPtr_new((void*)&LENGTH_STR);
+  } else {
+    CODE_COVERAGE(524); // Hit
+  }
+
+  // The caller needs the bytes in one piece
+  if (typeCode == TC_REF_ROPE) {
+    CODE_COVERAGE(774); // Hit
+    value = vm_flattenRope(vm, value);
+    typeCode = TC_REF_STRING;
+  } else {
+    CODE_COVERAGE_UNTESTED(775); // Not hit
+  }
+
+  VM_ASSERT(vm, (typeCode == TC_REF_STRING) || (typeCode == TC_REF_INTERNED_STRING));
+
+  LongPtr lpTarget = DynamicPtr_decode_long(vm, value);
+  uint16_t headerWord = readAllocationHeaderWord_long(lpTarget);
+  uint16_t sourceSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+
+  if (out_sizeBytes) {
+    CODE_COVERAGE(349); // Hit
+    *out_sizeBytes = sourceSize - 1; // Without the extra safety null-terminator
+  } else {
+    CODE_COVERAGE_UNTESTED(350); // Not hit
+  }
+
+  return lpTarget;
+}
+
+/**
+ * Gets a pointer to the string bytes of the string represented by `value`.
+ *
+ * `value` must be a string
+ *
+ * Warning: the result is a native pointer and becomes invalid if a GC
+ * collection occurs.
+ */
+LongPtr vm_getStringData(VM* vm, Value value) {
+  CODE_COVERAGE(228); // Hit
+  TeTypeCode typeCode = deepTypeOf(vm, value);
+  switch (typeCode) {
+    case TC_VAL_STR_PROTO:
+      CODE_COVERAGE_UNTESTED(229); // Not hit
+      return LongPtr_new((void*)&PROTO_STR);
+    case TC_VAL_STR_LENGTH:
+      CODE_COVERAGE(512); // Hit
+      return LongPtr_new((void*)&LENGTH_STR);
+    case TC_REF_STRING:
+    case TC_REF_INTERNED_STRING:
+      return DynamicPtr_decode_long(vm, value);
+    case TC_REF_ROPE: {
+      CODE_COVERAGE_UNTESTED(776); // Not hit
+      // Only a rope that has already been flattened has contiguous data (see
+      // vm_flattenRope)
+      TsRope* pRope = ShortPtr_decode(vm, value);
+      VM_ASSERT(vm, pRope->right == VM_VALUE_DELETED);
+      return vm_getStringData(vm, pRope->left);
+    }
+    default:
+      VM_ASSERT_UNREACHABLE(vm);
+      return LongPtr_new(0);
+  }
+}
+
+const char* mvm_toStringUtf8(VM* vm, Value value, size_t* out_sizeBytes) {
+  CODE_COVERAGE(623); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  gc_completeIncremental(vm);
+  /*
+   * Note: I previously had this function returning a long pointer, but this
+   * tripped someone up because they passed the result directly to printf, which
+   * on MSP430 apparently doesn't support arbitrary long pointers (data20
+   * pointers). Now I just copy it locally.
+   */
+
+  size_t size; // Size excluding a null terminator
+  LongPtr lpTarget = vm_toStringUtf8_long(vm, value, &size);
+  if (out_sizeBytes)
+    *out_sizeBytes = size;
+
+  void* pTarget = LongPtr_truncate(lpTarget);
+  // Is the string in RAM? (i.e. the truncated pointer is the same as the full pointer)
+  if (LongPtr_new(pTarget) == lpTarget) {
+    CODE_COVERAGE(624); // Hit
+    return (const char*)pTarget;
+  } else {
+    CODE_COVERAGE_UNTESTED(625); // Not hit
+    // Allocate a new string in local memory (with additional null terminator)
+    vm_allocString(vm, size, &pTarget);
+    memcpy_long(pTarget, lpTarget, size);
+
+    return (const char*)pTarget;
+  }
+}
+
+size_t mvm_stringSizeUtf8(mvm_VM* vm, mvm_Value value) {
+  CODE_COVERAGE_UNTESTED(620); // Not hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  gc_completeIncremental(vm);
+  size_t size;
+  vm_toStringUtf8_long(vm, value, &size);
+  return size;
+}
+
+Value mvm_newBoolean(bool source) {
+  CODE_COVERAGE_UNTESTED(44); // Not hit
+  return source ? VM_VALUE_TRUE : VM_VALUE_FALSE;
+}
+
+Value vm_allocString(VM* vm, size_t sizeBytes, void** out_pData) {
+  CODE_COVERAGE(45); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  if (sizeBytes < 3) {
+    TABLE_COVERAGE(sizeBytes, 3, 525); // Hit 2/3
+  }
+
+  // Note: allocating 1 extra byte for the extra null terminator
+  char* pData = gc_allocateWithHeader(vm, (uint16_t)sizeBytes + 1, TC_REF_STRING);
+  *out_pData = pData;
+  // Null terminator
+  pData[sizeBytes] = '\0';
+  return ShortPtr_encode(vm, pData);
+}
+
+// New string from null-terminated
+static Value vm_newStringFromCStrNT(VM* vm, const char* s) {
+  size_t len = strlen(s);
+  return mvm_newString(vm, s, len);
+}
+
+Value mvm_newString(VM* vm, const char* sourceUtf8, size_t sizeBytes) {
+  CODE_COVERAGE(46); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  void* data;
+  Value value = vm_allocString(vm, sizeBytes, &data);
+  memcpy(data, sourceUtf8, sizeBytes);
+  return value;
+}
+
+static Value getBuiltin(VM* vm, mvm_TeBuiltins builtinID) {
+  CODE_COVERAGE(526); // Hit
+  LongPtr lpBuiltins = getBytecodeSection(vm, BCS_BUILTINS, NULL);
+  LongPtr lpBuiltin = LongPtr_add(lpBuiltins, (int16_t)(builtinID * sizeof (Value)));
+  Value value = LongPtr_read2_aligned(lpBuiltin);
+
+  // Check if the builtin accesses a RAM value via a handle
+  Value* target = getHandleTargetOrNull(vm, value);
+  if (target) {
+    CODE_COVERAGE(212); // Hit
+    return *target;
+  } else {
+    CODE_COVERAGE(213); // Hit
+    return value;
+  }
+}
+
+/**
+ * If the value is a handle, this returns a pointer to the global variable
+ * referenced by the handle. Otherwise, this returns NULL.
+ */
+static inline Value* getHandleTargetOrNull(VM* vm, Value value) {
+  CODE_COVERAGE(527); // Hit
+  if (!Value_isBytecodeMappedPtrOrWellKnown(value)) {
+    CODE_COVERAGE_UNTESTED(528); // Not hit
+    return NULL;
+  } else {
+    CODE_COVERAGE(529); // Hit
+  }
+  uint16_t globalsOffset = getSectionOffset(vm->lpBytecode, BCS_GLOBALS);
+  uint16_t globalsEndOffset = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_GLOBALS));
+  if ((value < globalsOffset) || (value >= globalsEndOffset)) {
+    CODE_COVERAGE(530); // Hit
+    return NULL;
+  } else {
+    CODE_COVERAGE(531); // Hit
+  }
+  uint16_t globalIndex = (value - globalsOffset) / 2;
+  return &vm->globals[globalIndex];
+}
+
+
+/**
+ * Assigns to the slot pointed to by lpTarget
+ *
+ * If lpTarget points to a handle, then the corresponding global variable is
+ * mutated. Otherwise, the target is directly mutated.
+ *
+ * This is used to synthesize mutation of slots in ROM, such as exports,
+ * builtins, and properties of ROM objects. Such logically-mutable slots *must*
+ * hold a value that is a BytecodeMappedPtr to a global variable that holds the
+ * mutable reference.
+ *
+ * The function works transparently on RAM or ROM slots.
+ */
+// TODO: probably SetProperty should use this, so it works on ROM-allocated
+// objects/arrays. Probably a good candidate for TDD.
+static void setSlot_long(VM* vm, LongPtr lpSlot, Value value) {
+  CODE_COVERAGE(532); // Hit
+  Value slotContents = LongPtr_read2_aligned(lpSlot);
+  // Work out if the target slot is actually a handle.
+  Value* handleTarget = getHandleTargetOrNull(vm, slotContents);
+  if (handleTarget) {
+    CODE_COVERAGE(533); // Hit
+    // Set the corresponding global variable
+    *handleTarget = value;
+    return;
+  } else {
+    CODE_COVERAGE_UNTESTED(534); // Not hit
+  }
+  // Otherwise, for the mutation must be valid, the slot must be in RAM.
+
+  // We never mutate through a long pointer, because anything mutable must be in
+  // RAM and anything in RAM must be addressable by a short pointer
+  Value* pSlot = LongPtr_truncate(lpSlot);
+
+  // Check the truncation hasn't lost anything. If this fails, the slot could be
+  // in ROM. If this passes, the slot
+  VM_ASSERT(vm, LongPtr_new(pSlot) == lpSlot);
+
+  // The compiler must never produce bytecode that is able to attempt to write
+  // to the bytecode image itself, but just to catch mistakes, here's an
+  // assertion to make sure it doesn't write to bytecode. In a properly working
+  // system (compiler + engine), this assertion isn't needed
+  VM_ASSERT(vm, (lpSlot < vm->lpBytecode) ||
+    (lpSlot >= LongPtr_add(vm->lpBytecode, getBytecodeSize(vm))));
+
+  *pSlot = value;
+  gc_writeBarrier(vm, pSlot, value);
+}
+
+static void setBuiltin(VM* vm, mvm_TeBuiltins builtinID, Value value) {
+  CODE_COVERAGE(535); // Hit
+  LongPtr lpBuiltins = getBytecodeSection(vm, BCS_BUILTINS, NULL);
+  LongPtr lpBuiltin = LongPtr_add(lpBuiltins, (int16_t)(builtinID * sizeof (Value)));
+  setSlot_long(vm, lpBuiltin, value);
+}
+
+#if MVM_PROPERTY_CACHE_SIZE
+/**
+ * Returns a pointer to the value slot recorded in the inline property cache for
+ * reading `key` from `object` at bytecode offset `site`, or 0 on a cache miss.
+ */
+static inline LongPtr vm_propertyCacheLookup(VM* vm, uint16_t site, Value object, Value key) {
+  TsPropertyCacheEntry* pEntry = &vm->propertyCache[site & (MVM_PROPERTY_CACHE_SIZE - 1)];
+  if ((pEntry->site == site) && (pEntry->object == object) && (pEntry->key == key)) {
+    CODE_COVERAGE_UNTESTED(663); // Not hit
+    return pEntry->lpValue;
+  } else {
+    CODE_COVERAGE_UNTESTED(664); // Not hit
+    return LongPtr_new(0);
+  }
+}
+
+static void vm_propertyCacheFill(VM* vm, uint16_t site, Value object, Value key, LongPtr lpValue) {
+  CODE_COVERAGE_UNTESTED(665); // Not hit
+  // Entries are direct-mapped, so this evicts whatever site was there before
+  TsPropertyCacheEntry* pEntry = &vm->propertyCache[site & (MVM_PROPERTY_CACHE_SIZE - 1)];
+  pEntry->site = site;
+  pEntry->object = object;
+  pEntry->key = key;
+  pEntry->lpValue = lpValue;
+}
+
+static void vm_propertyCacheInvalidate(VM* vm) {
+  CODE_COVERAGE_UNTESTED(666); // Not hit
+  memset(vm->propertyCache, 0, sizeof vm->propertyCache);
+}
+#endif // MVM_PROPERTY_CACHE_SIZE
+
+#if MVM_SCOPE_CACHE_SIZE
+static void vm_scopeCacheInvalidate(VM* vm) {
+  CODE_COVERAGE(862); // Hit
+  memset(vm->scopeCache, 0, sizeof vm->scopeCache);
+}
+#endif // MVM_SCOPE_CACHE_SIZE
+
+// Warning: this function trashes the word at pObjectValue.
+// Note: out_propertyValue may point to the same address as pObjectValue
+//
+// `cacheSite` is the bytecode offset that identifies the instruction doing the
+// read, for the inline property cache, or 0 if the read should not be cached.
+static TeError getProperty(VM* vm, Value* pObjectValue, Value* pPropertyName, Value* out_propertyValue, uint16_t cacheSite) {
+  CODE_COVERAGE(48); // Hit
+
+  mvm_TeError err;
+  LongPtr lpArr;
+  LongPtr lpClass;
+  uint16_t length;
+  TeTypeCode type;
+  Value objectValue;
+  Value propertyName;
+
+  // This function may trigger a GC cycle because it may add a cell to the string intern table
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  // Note: toPropertyName can trigger a GC cycle
+  err = toPropertyName(vm, pPropertyName);
+  if (err != MVM_E_SUCCESS) return err;
+
+  #if MVM_PROPERTY_CACHE_SIZE
+  // The object that the read was performed on. A hit is cached whether the
+  // property is the receiver's own or is inherited from its prototype chain,
+  // since the property list walk below follows the chain without changing
+  // `objectValue`. Reads that are delegated to a different object (a class's
+  // static properties, or the array prototype for an array) restart with that
+  // object as `objectValue` and are not cached.
+  Value receiver = *pObjectValue;
+  #endif
+
+SUB_GET_PROPERTY:
+
+  propertyName = *pPropertyName;
+  objectValue = *pObjectValue;
+  type = deepTypeOf(vm, objectValue);
+  switch (type) {
+    case TC_REF_UINT8_ARRAY: {
+      CODE_COVERAGE(339); // Hit
+      lpArr = DynamicPtr_decode_long(vm, objectValue);
+      uint16_t header = readAllocationHeaderWord_long(lpArr);
+      length = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+      if (propertyName == VM_VALUE_STR_LENGTH) {
+        CODE_COVERAGE(340); // Hit
+        VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+        *out_propertyValue = VirtualInt14_encode(vm, length);
+        return MVM_E_SUCCESS;
+      } else {
+        CODE_COVERAGE(341); // Hit
+      }
+
+      if (!Value_isVirtualInt14(propertyName)) {
+        CODE_COVERAGE_ERROR_PATH(342); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+      int16_t index = VirtualInt14_decode(vm, propertyName);
+
+      if ((index < 0) || (index >= length)) {
+        CODE_COVERAGE_ERROR_PATH(343); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+
+      uint8_t byteValue = LongPtr_read1(LongPtr_add(lpArr, (uint16_t)index));
+      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+      *out_propertyValue = VirtualInt14_encode(vm, byteValue);
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_TYPED_ARRAY: {
+      CODE_COVERAGE_UNTESTED(794); // Not hit
+      mvm_TeTypedArrayKind kind;
+      uint8_t* pElements = vm_typedArrayElements(vm, objectValue, &kind, &length);
+      uint8_t elementSize = typedArrayElementSize[kind];
+      if (propertyName == VM_VALUE_STR_LENGTH) {
+        CODE_COVERAGE_UNTESTED(795); // Not hit
+        VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+        *out_propertyValue = VirtualInt14_encode(vm, length);
+        return MVM_E_SUCCESS;
+      } else {
+        CODE_COVERAGE_UNTESTED(796); // Not hit
+      }
+
+      if (!Value_isVirtualInt14(propertyName)) {
+        CODE_COVERAGE_ERROR_PATH(797); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+      int16_t index = VirtualInt14_decode(vm, propertyName);
+
+      if ((index < 0) || (index >= length)) {
+        CODE_COVERAGE_ERROR_PATH(798); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+
+      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+      // Note: this can allocate a box for the number
+      *out_propertyValue = vm_typedArrayRead(vm, kind, pElements + index * elementSize);
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_PROPERTY_LIST: {
+      CODE_COVERAGE(359); // Hit
+
+      LongPtr lpPropertyList = DynamicPtr_decode_long(vm, objectValue);
+      DynamicPtr dpProto = READ_FIELD_2(lpPropertyList, TsPropertyList, dpProto);
+
+      if (propertyName == VM_VALUE_STR_PROTO) {
+        CODE_COVERAGE_UNIMPLEMENTED(326); // Hit
+        *out_propertyValue = dpProto;
+        return MVM_E_SUCCESS;
+      }
+
+      while (lpPropertyList) {
+        uint16_t headerWord = readAllocationHeaderWord_long(lpPropertyList);
+        uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+        uint16_t propCount = (size - sizeof (TsPropertyList)) / 4;
+
+        LongPtr p = LongPtr_add(lpPropertyList, sizeof (TsPropertyList));
+        while (propCount--) {
+          Value key = LongPtr_read2_aligned(p);
+          p = LongPtr_add(p, 2);
+          Value value = LongPtr_read2_aligned(p);
+          p = LongPtr_add(p, 2);
+
+          if (key == propertyName) {
+            CODE_COVERAGE(361); // Hit
+            #if MVM_PROPERTY_CACHE_SIZE
+            if (cacheSite && (objectValue == receiver)) {
+              CODE_COVERAGE_UNTESTED(667); // Not hit
+              vm_propertyCacheFill(vm, cacheSite, receiver, propertyName, LongPtr_add(p, -2));
+            } else {
+              CODE_COVERAGE_UNTESTED(668); // Not hit
+            }
+            #endif // MVM_PROPERTY_CACHE_SIZE
+            VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+            *out_propertyValue = value;
+            return MVM_E_SUCCESS;
+          } else {
+            CODE_COVERAGE(362); // Hit
+          }
+        }
+
+        DynamicPtr dpNext = READ_FIELD_2(lpPropertyList, TsPropertyList, dpNext);
+         // Move to next group, if there is one
+        if (dpNext != VM_VALUE_NULL) {
+          CODE_COVERAGE(536); // Hit
+          lpPropertyList = DynamicPtr_decode_long(vm, dpNext);
+        } else { // Otherwise try read from the prototype
+          CODE_COVERAGE(537); // Hit
+          lpPropertyList = DynamicPtr_decode_long(vm, dpProto);
+          if (lpPropertyList) {
+            CODE_COVERAGE(538); // Hit
+            dpProto = READ_FIELD_2(lpPropertyList, TsPropertyList, dpProto);
+          } else {
+            CODE_COVERAGE(539); // Hit
+          }
+        }
+      }
+
+      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+      *out_propertyValue = VM_VALUE_UNDEFINED;
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_ARRAY: {
+      CODE_COVERAGE(363); // Hit
+
+      lpArr = DynamicPtr_decode_long(vm, objectValue);
+      Value viLength = READ_FIELD_2(lpArr, TsArray, viLength);
+      length = VirtualInt14_decode(vm, viLength);
+
+      // Drill in to fixed-length array inside the array
+      DynamicPtr dpData = READ_FIELD_2(lpArr, TsArray, dpData);
+      lpArr = DynamicPtr_decode_long(vm, dpData);
+
+      goto SUB_GET_PROP_FIXED_LENGTH_ARRAY;
+    }
+
+    case TC_REF_FIXED_LENGTH_ARRAY: {
+      CODE_COVERAGE(286); // Hit
+
+      lpArr = DynamicPtr_decode_long(vm, objectValue);
+
+      uint16_t header = readAllocationHeaderWord_long(lpArr);
+      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+      length = size >> 1;
+
+      goto SUB_GET_PROP_FIXED_LENGTH_ARRAY;
+    }
+
+    case TC_REF_CLASS: {
+      CODE_COVERAGE(615); // Hit
+      lpClass = DynamicPtr_decode_long(vm, objectValue);
+      // Delegate to the `staticProps` of the class
+      *pObjectValue = READ_FIELD_2(lpClass, TsClass, staticProps);
+      goto SUB_GET_PROPERTY;
+    }
+
+    default: return vm_newError(vm, MVM_E_TYPE_ERROR);
+  }
+
+SUB_GET_PROP_FIXED_LENGTH_ARRAY:
+  CODE_COVERAGE(323); // Hit
+
+  if (propertyName == VM_VALUE_STR_LENGTH) {
+    CODE_COVERAGE(274); // Hit
+    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+    *out_propertyValue = VirtualInt14_encode(vm, length);
+    return MVM_E_SUCCESS;
+  } else if (propertyName == VM_VALUE_STR_PROTO) {
+    CODE_COVERAGE(275); // Hit
+    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+    *out_propertyValue = getBuiltin(vm, BIN_ARRAY_PROTO);
+    return MVM_E_SUCCESS;
+  } else {
+    CODE_COVERAGE(276); // Hit
+  }
+
+  // Array index
+  if (Value_isVirtualInt14(propertyName)) {
+    CODE_COVERAGE(277); // Hit
+    int16_t index = VirtualInt14_decode(vm, propertyName);
+    if (index < 0) {
+      CODE_COVERAGE_ERROR_PATH(144); // Not hit
+      return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
+    }
+
+    if ((uint16_t)index >= length) {
+      CODE_COVERAGE(283); // Hit
+      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+      *out_propertyValue = VM_VALUE_UNDEFINED;
+      return MVM_E_SUCCESS;
+    } else {
+      CODE_COVERAGE(328); // Hit
+    }
+    // We've already checked if the value exceeds the length, so lpData
+    // cannot be null and the capacity must be at least as large as the
+    // length of the array.
+    VM_ASSERT(vm, lpArr);
+    VM_ASSERT(vm, length * 2 <= vm_getAllocationSizeExcludingHeaderFromHeaderWord(readAllocationHeaderWord_long(lpArr)));
+    Value value = LongPtr_read2_aligned(LongPtr_add(lpArr, (uint16_t)index * 2));
+    if (value == VM_VALUE_DELETED) {
+      CODE_COVERAGE(329); // Hit
+      value = VM_VALUE_UNDEFINED;
+    } else {
+      CODE_COVERAGE(364); // Hit
+    }
+    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+    *out_propertyValue = value;
+    return MVM_E_SUCCESS;
+  }
+  CODE_COVERAGE(278); // Hit
+
+  *pObjectValue = getBuiltin(vm, BIN_ARRAY_PROTO);
+  if (*pObjectValue != VM_VALUE_NULL) {
+    CODE_COVERAGE(396); // Hit
+    goto SUB_GET_PROPERTY;
+  } else {
+    CODE_COVERAGE_UNTESTED(397); // Not hit
+    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
+    *out_propertyValue = VM_VALUE_UNDEFINED;
+    return MVM_E_SUCCESS;
+  }
+}
+
+static void growArray(VM* vm, Value* pvArr, uint16_t newLength, uint16_t newCapacity) {
+  CODE_COVERAGE(293); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  VM_ASSERT(vm, newCapacity >= newLength);
+  if (newCapacity > MAX_ALLOCATION_SIZE / 2) {
+    CODE_COVERAGE_ERROR_PATH(540); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_ARRAY_TOO_LONG);
+  }
+  VM_ASSERT(vm, newCapacity != 0);
+
+  uint16_t* pNewData = gc_allocateWithHeader(vm, newCapacity * 2, TC_REF_FIXED_LENGTH_ARRAY);
+  // Copy values from the old array. Note that the above allocation can trigger
+  // a GC collection which moves the array, so we need to decode the value again
+  TsArray* arr = DynamicPtr_decode_native(vm, *pvArr);
+  DynamicPtr dpOldData = arr->dpData;
+  uint16_t oldCapacity = 0;
+  if (dpOldData != VM_VALUE_NULL) {
+    CODE_COVERAGE(294); // Hit
+    LongPtr lpOldData = DynamicPtr_decode_long(vm, dpOldData);
+
+    uint16_t oldDataHeader = readAllocationHeaderWord_long(lpOldData);
+    uint16_t oldSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(oldDataHeader);
+    VM_ASSERT(vm, (oldSize & 1) == 0);
+    oldCapacity = oldSize / 2;
+
+    memcpy_long(pNewData, lpOldData, oldSize);
+  } else {
+    CODE_COVERAGE(310); // Hit
+  }
+  CODE_COVERAGE(325); // Hit
+  VM_ASSERT(vm, newCapacity >= oldCapacity);
+  // Fill in the rest of the memory as holes
+  uint16_t* p = &pNewData[oldCapacity];
+  uint16_t* end = &pNewData[newCapacity];
+  while (p != end) {
+    *p++ = VM_VALUE_DELETED;
+  }
+  arr->dpData = ShortPtr_encode(vm, pNewData);
+  gc_writeBarrier(vm, &arr->dpData, arr->dpData);
+  arr->viLength = VirtualInt14_encode(vm, newLength);
+}
+
+static TeError vm_objectKeys(VM* vm, Value* inout_slot) {
+  CODE_COVERAGE(636); // Hit
+  Value obj;
+  LongPtr lpClass;
+
+SUB_OBJECT_KEYS:
+  obj = *inout_slot;
+
+  TeTypeCode tc = deepTypeOf(vm, obj);
+  if (tc == TC_REF_CLASS) {
+    CODE_COVERAGE_UNTESTED(637); // Not hit
+    lpClass = DynamicPtr_decode_long(vm, obj);
+    // Delegate to the `staticProps` of the class
+    *inout_slot = READ_FIELD_2(lpClass, TsClass, staticProps);
+    goto SUB_OBJECT_KEYS;
+  }
+  CODE_COVERAGE(638); // Hit
+
+  if (tc != TC_REF_PROPERTY_LIST) {
+    CODE_COVERAGE_ERROR_PATH(639); // Not hit
+    return MVM_E_OBJECT_KEYS_ON_NON_OBJECT;
+  }
+
+  // Count the number of properties (first add up the sizes)
+
+  uint16_t propsSize = 0;
+  Value propList = obj;
+  // Note: the GC packs an object into a single allocation, so this should
+  // frequently be O(1) and only loop once
+  do {
+    LongPtr lpPropList = DynamicPtr_decode_long(vm, propList);
+    propsSize += vm_getAllocationSize_long(lpPropList) - sizeof(TsPropertyList);
+    propList = LongPtr_read2_aligned(lpPropList) /* dpNext */;
+    TABLE_COVERAGE(propList != VM_VALUE_NULL ? 1 : 0, 2, 640); // Hit 2/2
+  } while (propList != VM_VALUE_NULL);
+
+  // Each prop is 4 bytes, and each entry in the array is 2 bytes
+  uint16_t arrSize = propsSize >> 1;
+
+  // If the array is empty, an empty allocation is illegal. A 1-byte allocation
+  // will be rounded down when asking the size, but rounded up in the allocation
+  // unit.
+  if (!arrSize) {
+    CODE_COVERAGE(641); // Hit
+    arrSize = 1;
+  }
+
+  // Allocate the new array.
+  uint16_t* p = gc_allocateWithHeader(vm, arrSize, TC_REF_FIXED_LENGTH_ARRAY);
+  obj = *inout_slot; // Invalidated by potential GC collection
+
+  // Populate the array
+
+  propList = obj;
+  *inout_slot = ShortPtr_encode(vm, p);
+  do {
+    LongPtr lpPropList = DynamicPtr_decode_long(vm, propList);
+    propList = LongPtr_read2_aligned(lpPropList) /* dpNext */;
+
+    uint16_t propsSize = vm_getAllocationSize_long(lpPropList) - sizeof(TsPropertyList);
+    LongPtr lpProp = LongPtr_add(lpPropList, sizeof(TsPropertyList));
+    TABLE_COVERAGE(propsSize != 0 ? 1 : 0, 2, 642); // Hit 2/2
+    while (propsSize) {
+      *p = LongPtr_read2_aligned(lpProp);
+      p++; // Move to next entry in array
+      // Each property cell is 4 bytes
+      lpProp /* prop */ = LongPtr_add(lpProp /* prop */, 4);
+      propsSize -= 4;
+    }
+    TABLE_COVERAGE(propList != VM_VALUE_NULL ? 1 : 0, 2, 643); // Hit 2/2
+  } while (propList != VM_VALUE_NULL);
+
+  return MVM_E_SUCCESS;
+}
+
+/**
+ * Note: the operands are passed by pointer to make sure they're anchored in the
+ * stack and that if the GC moves their targets, we will be using the latest
+ * values. The operands are:
+ *
+ *   - pOperands[0]: object
+ *   - pOperands[1]: propertyName
+ *   - pOperands[2]: propertyValue
+ */
+static TeError setProperty(VM* vm, Value* pOperands) {
+  CODE_COVERAGE(49); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+
+  mvm_TeError err;
+  LongPtr lpClass;
+  TeTypeCode type;
+
+  // This function may trigger a GC cycle because it may add a cell to the string intern table
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  err = toPropertyName(vm, &pOperands[1]);
+  if (err != MVM_E_SUCCESS) return err;
+
+  MVM_LOCAL(Value, vObjectValue, 0);
+  MVM_LOCAL(Value, vPropertyName, pOperands[1]);
+  MVM_LOCAL(Value, vPropertyValue, pOperands[2]);
+
+SUB_SET_PROPERTY:
+
+  MVM_SET_LOCAL(vObjectValue, pOperands[0]);
+  type = deepTypeOf(vm, MVM_GET_LOCAL(vObjectValue));
+  switch (type) {
+    case TC_REF_UINT8_ARRAY: {
+      CODE_COVERAGE(594); // Hit
+      // It's not valid for the optimizer to move a buffer into ROM if it's
+      // ever written to, so it must be in RAM.
+      VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(vObjectValue)));
+      uint8_t* p = ShortPtr_decode(vm, MVM_GET_LOCAL(vObjectValue));
+      uint16_t header = readAllocationHeaderWord(p);
+      uint16_t length = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+
+      if (!Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyName))) {
+        CODE_COVERAGE_ERROR_PATH(595); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+      int16_t index = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyName));
+      if ((index < 0) || (index >= length)) {
+        CODE_COVERAGE_ERROR_PATH(612); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+
+      Value byteValue = MVM_GET_LOCAL(vPropertyValue);
+      if (!Value_isVirtualUInt8(byteValue)) {
+        // For performance reasons, Microvium does not automatically coerce
+        // values to bytes.
+        CODE_COVERAGE_ERROR_PATH(613); // Not hit
+        return MVM_E_CAN_ONLY_ASSIGN_BYTES_TO_UINT8_ARRAY;
+      }
+
+      p[index] = (uint8_t)VirtualInt14_decode(vm, byteValue);
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_TYPED_ARRAY: {
+      CODE_COVERAGE_UNTESTED(799); // Not hit
+      mvm_TeTypedArrayKind kind;
+      uint16_t length;
+      uint8_t* pElements = vm_typedArrayElements(vm, MVM_GET_LOCAL(vObjectValue), &kind, &length);
+      uint8_t elementSize = typedArrayElementSize[kind];
+
+      if (!Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyName))) {
+        CODE_COVERAGE_ERROR_PATH(800); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+      int16_t index = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyName));
+      if ((index < 0) || (index >= length)) {
+        CODE_COVERAGE_ERROR_PATH(801); // Not hit
+        return MVM_E_INVALID_ARRAY_INDEX;
+      }
+
+      vm_typedArrayWrite(vm, kind, pElements + index * elementSize, MVM_GET_LOCAL(vPropertyValue));
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_PROPERTY_LIST: {
+      CODE_COVERAGE(366); // Hit
+      if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_PROTO) {
+        CODE_COVERAGE_UNIMPLEMENTED(327); // Not hit
+        VM_NOT_IMPLEMENTED(vm);
+        return MVM_E_FATAL_ERROR_MUST_KILL_VM;
+      } else {
+        CODE_COVERAGE(541); // Hit
+      }
+
+      // Note: while objects in general can be in ROM, objects which are
+      // writable must always be in RAM.
+
+      MVM_LOCAL(TsPropertyList*, pPropertyList, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue)));
+
+      while (true) {
+        CODE_COVERAGE(367); // Hit
+        uint16_t headerWord = readAllocationHeaderWord(MVM_GET_LOCAL(pPropertyList));
+        uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+        uint16_t propCount = (size - sizeof (TsPropertyList)) / 4;
+
+        uint16_t* p = (uint16_t*)(MVM_GET_LOCAL(pPropertyList) + 1);
+        while (propCount--) {
+          Value key = *p++;
+
+          // We can do direct comparison because the strings have been interned,
+          // and numbers are represented in a normalized way.
+          if (key == MVM_GET_LOCAL(vPropertyName)) {
+            CODE_COVERAGE(368); // Hit
+            *p = MVM_GET_LOCAL(vPropertyValue);
+            gc_writeBarrier(vm, p, MVM_GET_LOCAL(vPropertyValue));
+            return MVM_E_SUCCESS;
+          } else {
+            // Skip to next property
+            p++;
+            CODE_COVERAGE(369); // Hit
+          }
+        }
+
+        DynamicPtr dpNext = MVM_GET_LOCAL(pPropertyList)->dpNext;
+        // Move to next group, if there is one
+        if (dpNext != VM_VALUE_NULL) {
+          CODE_COVERAGE(542); // Hit
+          MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, dpNext));
+        } else {
+          CODE_COVERAGE(543); // Hit
+          break;
+        }
+      }
+
+      // If we reach the end, then this is a new property. We add new properties
+      // by just appending a new TsPropertyList onto the linked list. The GC
+      // will compact these into the head later.
+
+      TsPropertyCell* pNewCell = GC_ALLOCATE_TYPE(vm, TsPropertyCell, TC_REF_PROPERTY_LIST);
+
+      // GC collection invalidates the following values so we need to refresh
+      // them from the stack slots.
+      MVM_SET_LOCAL(vPropertyName, pOperands[1]);
+      MVM_SET_LOCAL(vPropertyValue, pOperands[2]);
+      MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, pOperands[0]));
+
+      /*
+      Note: This is a bit of a pain. When we allocate the new cell, it may or
+      may not trigger a GC collection cycle. If it does, then the object may be
+      moved AND COMPACTED, so the linked list chain of properties is different
+      to before (or may not be different, if there was no GC cycle), so we need
+      to re-iterate the linked list to find the last node, where we append the
+      property.
+      */
+      while (true) {
+        DynamicPtr dpNext = MVM_GET_LOCAL(pPropertyList)->dpNext;
+        if (dpNext != VM_VALUE_NULL) {
+          MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, dpNext));
+        } else {
+          break;
+        }
+      }
+
+      ShortPtr spNewCell = ShortPtr_encode(vm, pNewCell);
+      pNewCell->base.dpNext = VM_VALUE_NULL;
+      pNewCell->base.dpProto = VM_VALUE_NULL; // Not used because this is a child cell, but still needs a value because the GC sees it.
+      pNewCell->key = MVM_GET_LOCAL(vPropertyName);
+      pNewCell->value = MVM_GET_LOCAL(vPropertyValue);
+
+      // Attach to linked list. This needs to be a long-pointer write because we
+      // don't know if the original property list was in data memory.
+      //
+      // Note: `pPropertyList` currently points to the last property list in
+      // the chain.
+      MVM_GET_LOCAL(pPropertyList)->dpNext = spNewCell;
+      gc_writeBarrier(vm, &MVM_GET_LOCAL(pPropertyList)->dpNext, spNewCell);
+
+      #if MVM_PROPERTY_CACHE_SIZE
+      // The new property may shadow one that a cached read found on a
+      // prototype
+      vm_propertyCacheInvalidate(vm);
+      #endif
+
+      return MVM_E_SUCCESS;
+    }
+    case TC_REF_ARRAY: {
+      CODE_COVERAGE(370); // Hit
+
+      // Note: while objects in general can be in ROM, objects which are
+      // writable must always be in RAM.
+
+      MVM_LOCAL(TsArray*, arr, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue)));
+      VirtualInt14 viLength = MVM_GET_LOCAL(arr)->viLength;
+      VM_ASSERT(vm, Value_isVirtualInt14(viLength));
+      uint16_t oldLength = VirtualInt14_decode(vm, viLength);
+      MVM_LOCAL(DynamicPtr, dpData, MVM_GET_LOCAL(arr)->dpData);
+      MVM_LOCAL(uint16_t*, pData, NULL);
+      uint16_t oldCapacity = 0;
+      if (MVM_GET_LOCAL(dpData) != VM_VALUE_NULL) {
+        CODE_COVERAGE(544); // Hit
+        VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(dpData)));
+        MVM_SET_LOCAL(pData, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(dpData)));
+        uint16_t dataSize = vm_getAllocationSize(MVM_GET_LOCAL(pData));
+        oldCapacity = dataSize / 2;
+      } else {
+        CODE_COVERAGE(545); // Hit
+      }
+
+      // If the property name is "length" then we'll be changing the length
+      if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_LENGTH) {
+        CODE_COVERAGE(282); // Hit
+
+        if (!Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyValue)))
+          MVM_FATAL_ERROR(vm, MVM_E_TYPE_ERROR);
+        uint16_t newLength = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyValue));
+
+        if (newLength < oldLength) { // Making array smaller
+          CODE_COVERAGE(176); // Hit
+          // pData will not be null because oldLength must be more than 1 for it to get here
+          VM_ASSERT(vm, MVM_GET_LOCAL(pData));
+          // Wipe array items that aren't reachable
+          uint16_t count = oldLength - newLength;
+          uint16_t* p = &MVM_GET_LOCAL(pData)[newLength];
+          while (count--)
+            *p++ = VM_VALUE_DELETED;
+
+          MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
+          return MVM_E_SUCCESS;
+        } else if (newLength == oldLength) {
+          CODE_COVERAGE_UNTESTED(546); // Not hit
+          /* Do nothing */
+        } else if (newLength <= oldCapacity) { // Array is getting bigger, but still less than capacity
+          CODE_COVERAGE(287); // Hit
+
+          // We can just overwrite the length field. Note that the newly
+          // uncovered memory is already filled with VM_VALUE_DELETED
+          MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
+          return MVM_E_SUCCESS;
+        } else { // Make array bigger
+          CODE_COVERAGE(288); // Hit
+          // I'll assume that direct assignments to the length mean that people
+          // know exactly how big the array should be, so we don't add any
+          // extra capacity
+          uint16_t newCapacity = newLength;
+          growArray(vm, &pOperands[0], newLength, newCapacity);
+          return MVM_E_SUCCESS;
+        }
+      } else if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_PROTO) { // Writing to the __proto__ property
+        CODE_COVERAGE_UNTESTED(289); // Not hit
+        // We could make this read/write in future
+        return vm_newError(vm, MVM_E_PROTO_IS_READONLY);
+      } else if (Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyName))) { // Array index
+        CODE_COVERAGE(285); // Hit
+        int16_t index = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyName) );
+        if (index < 0) {
+          CODE_COVERAGE_ERROR_PATH(24); // Not hit
+          return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
+        }
+
+        // Need to expand the array?
+        if ((uint16_t)index >= oldLength) {
+          CODE_COVERAGE(290); // Hit
+          uint16_t newLength = (uint16_t)index + 1;
+          if ((uint16_t)index < oldCapacity) {
+            CODE_COVERAGE(291); // Hit
+            // The length changes to include the value. The extra slots are
+            // already filled in with holes from the original allocation.
+            MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
+          } else {
+            CODE_COVERAGE(292); // Hit
+            // We expand the capacity more aggressively here because this is the
+            // path used when we push into arrays or just assign values to an
+            // array in a loop.
+            uint16_t newCapacity = oldCapacity * 2;
+            if (newCapacity < 4) newCapacity = 4;
+            if (newCapacity < newLength) newCapacity = newLength;
+            growArray(vm, &pOperands[0], newLength, newCapacity);
+            MVM_SET_LOCAL(vPropertyValue, pOperands[2]); // Value could have changed due to GC collection
+            MVM_SET_LOCAL(vObjectValue, pOperands[0]); // Value could have changed due to GC collection
+            MVM_SET_LOCAL(arr, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue))); // Value could have changed due to GC collection
+          }
+        } // End of array expansion
+
+        // By this point, the array should have expanded as necessary
+        MVM_SET_LOCAL(dpData, MVM_GET_LOCAL(arr)->dpData);
+        VM_ASSERT(vm, MVM_GET_LOCAL(dpData) != VM_VALUE_NULL);
+        VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(dpData)));
+        MVM_SET_LOCAL(pData, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(dpData)));
+        VM_ASSERT(vm, !!MVM_GET_LOCAL(pData));
+
+        // Write the item to memory
+        MVM_GET_LOCAL(pData)[(uint16_t)index] = MVM_GET_LOCAL(vPropertyValue);
+        gc_writeBarrier(vm, &MVM_GET_LOCAL(pData)[(uint16_t)index], MVM_GET_LOCAL(vPropertyValue));
+
+        return MVM_E_SUCCESS;
+      }
+
+      // Else not a valid array index
+      CODE_COVERAGE_ERROR_PATH(140); // Not hit
+      return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
+    }
+
+    case TC_REF_CLASS: {
+      CODE_COVERAGE(630); // Hit
+      lpClass = DynamicPtr_decode_long(vm, MVM_GET_LOCAL(vObjectValue));
+      // Delegate to the `staticProps` of the class
+      pOperands[0] = READ_FIELD_2(lpClass, TsClass, staticProps);
+      goto SUB_SET_PROPERTY;
+    }
+
+    default: return vm_newError(vm, MVM_E_TYPE_ERROR);
+  }
+}
+
+/** Converts the argument to either an TC_VAL_INT14 or a TC_REF_INTERNED_STRING, or gives an error */
+static TeError toPropertyName(VM* vm, Value* value) {
+  CODE_COVERAGE(50); // Hit
+
+  // This function may trigger a GC cycle because it may add a cell to the string intern table
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  // Property names in microvium are either integer indexes or non-integer interned strings
+  TeTypeCode type = deepTypeOf(vm, *value);
+  switch (type) {
+    // These are already valid property names
+    case TC_VAL_INT14: {
+      CODE_COVERAGE(279); // Hit
+      if (VirtualInt14_decode(vm, *value) < 0) {
+        CODE_COVERAGE_UNTESTED(280); // Not hit
+        return vm_newError(vm, MVM_E_RANGE_ERROR);
+      }
+      CODE_COVERAGE(281); // Hit
+      return MVM_E_SUCCESS;
+    }
+    case TC_REF_INTERNED_STRING: {
+      CODE_COVERAGE(373); // Hit
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_REF_INT32: {
+      CODE_COVERAGE_ERROR_PATH(374); // Not hit
+      // 32-bit numbers are out of the range of supported array indexes
+      return vm_newError(vm, MVM_E_RANGE_ERROR);
+    }
+
+    case TC_REF_ROPE: {
+      CODE_COVERAGE_UNTESTED(791); // Not hit
+      // Interning needs the bytes in one piece. Note that the flat string may
+      // itself have been interned already, if the rope was used as a property
+      // name before.
+      *value = vm_flattenRope(vm, *value);
+      return toPropertyName(vm, value);
+    }
+    case TC_REF_STRING: {
+      CODE_COVERAGE(375); // Hit
+
+      // Note: In Microvium at the moment, it's illegal to use an integer-valued
+      // string as a property name. If the string is in bytecode, it will only
+      // have the type TC_REF_STRING if it's a number and is illegal.
+      if (!Value_isShortPtr(*value)) {
+        return vm_newError(vm, MVM_E_TYPE_ERROR);
+      }
+
+      if (vm_ramStringIsNonNegativeInteger(vm, *value)) {
+        CODE_COVERAGE_ERROR_PATH(378); // Not hit
+        return vm_newError(vm, MVM_E_TYPE_ERROR);
+      } else {
+        CODE_COVERAGE(379); // Hit
+      }
+
+      // Strings need to be converted to interned strings in order to be valid
+      // property names. This is because properties are searched by reference
+      // equality.
+      toInternedString(vm, value);
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_VAL_STR_LENGTH: {
+      CODE_COVERAGE(272); // Hit
+      return MVM_E_SUCCESS;
+    }
+
+    case TC_VAL_STR_PROTO: {
+      CODE_COVERAGE(273); // Hit
+      return MVM_E_SUCCESS;
+    }
+    default: {
+      CODE_COVERAGE_ERROR_PATH(380); // Not hit
+      return vm_newError(vm, MVM_E_TYPE_ERROR);
+    }
   }
-  uint16_t globalIndex = (value - globalsOffset) / 2;
-  return &vm->globals[globalIndex];
 }
 
+// Converts a TC_REF_STRING to a TC_REF_INTERNED_STRING
+// TODO: Test cases for this function
+static void toInternedString(VM* vm, Value* pValue) {
+  CODE_COVERAGE(51); // Hit
+  Value value = *pValue;
+  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_STRING);
 
-/**
- * Assigns to the slot pointed to by lpTarget
- *
- * If lpTarget points to a handle, then the corresponding global variable is
- * mutated. Otherwise, the target is directly mutated.
- *
- * This is used to synthesize mutation of slots in ROM, such as exports,
- * builtins, and properties of ROM objects. Such logically-mutable slots *must*
- * hold a value that is a BytecodeMappedPtr to a global variable that holds the
- * mutable reference.
- *
- * The function works transparently on RAM or ROM slots.
- */
-// TODO: probably SetProperty should use this, so it works on ROM-allocated
-// objects/arrays. Probably a good candidate for TDD.
-static void setSlot_long(VM* vm, LongPtr lpSlot, Value value) {
-  CODE_COVERAGE(532); // Hit
-  Value slotContents = LongPtr_read2_aligned(lpSlot);
-  // Work out if the target slot is actually a handle.
-  Value* handleTarget = getHandleTargetOrNull(vm, slotContents);
-  if (handleTarget) {
-    CODE_COVERAGE(533); // Hit
-    // Set the corresponding global variable
-    *handleTarget = value;
+  // This function may trigger a GC cycle because it may add a cell to the intern table
+  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+
+  // TC_REF_STRING values are always in GC memory. If they were in flash, they'd
+  // already be TC_REF_INTERNED_STRING.
+  char* pStr1 = DynamicPtr_decode_native(vm, value);
+  uint16_t str1Size = vm_getAllocationSize(pStr1);
+
+  LongPtr lpStr1 = LongPtr_new(pStr1);
+  // Note: the sizes here include the null terminator
+  if ((str1Size == sizeof PROTO_STR) && (memcmp_long(lpStr1, LongPtr_new((void*)&PROTO_STR), sizeof PROTO_STR) == 0)) {
+    CODE_COVERAGE_UNTESTED(547); // Not hit
+    *pValue = VM_VALUE_STR_PROTO;
+    return;
+  } else if ((str1Size == sizeof LENGTH_STR) && (memcmp_long(lpStr1, LongPtr_new((void*)&LENGTH_STR), sizeof LENGTH_STR) == 0)) {
+    CODE_COVERAGE(548); // Hit
+    *pValue = VM_VALUE_STR_LENGTH;
     return;
   } else {
-    CODE_COVERAGE_UNTESTED(534); // Not hit
+    CODE_COVERAGE(549); // Hit
   }
-  // Otherwise, for the mutation must be valid, the slot must be in RAM.
 
-  // We never mutate through a long pointer, because anything mutable must be in
-  // RAM and anything in RAM must be addressable by a short pointer
-  Value* pSlot = LongPtr_truncate(lpSlot);
+  LongPtr lpBytecode = vm->lpBytecode;
 
-  // Check the truncation hasn't lost anything. If this fails, the slot could be
-  // in ROM. If this passes, the slot
-  VM_ASSERT(vm, LongPtr_new(pSlot) == lpSlot);
+  // We start by searching the string table for interned strings that are baked
+  // into the ROM. These are stored alphabetically, so we can perform a binary
+  // search.
 
-  // The compiler must never produce bytecode that is able to attempt to write
-  // to the bytecode image itself, but just to catch mistakes, here's an
-  // assertion to make sure it doesn't write to bytecode. In a properly working
-  // system (compiler + engine), this assertion isn't needed
-  VM_ASSERT(vm, (lpSlot < vm->lpBytecode) ||
-    (lpSlot >= LongPtr_add(vm->lpBytecode, getBytecodeSize(vm))));
+  uint16_t stringTableOffset = getSectionOffset(vm->lpBytecode, BCS_STRING_TABLE);
+  uint16_t stringTableSize = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_STRING_TABLE)) - stringTableOffset;
+  int strCount = stringTableSize / sizeof (Value);
 
-  *pSlot = value;
-}
+  int first = 0;
+  int last = strCount - 1;
 
-static void setBuiltin(VM* vm, mvm_TeBuiltins builtinID, Value value) {
-  CODE_COVERAGE(535); // Hit
-  LongPtr lpBuiltins = getBytecodeSection(vm, BCS_BUILTINS, NULL);
-  LongPtr lpBuiltin = LongPtr_add(lpBuiltins, (int16_t)(builtinID * sizeof (Value)));
-  setSlot_long(vm, lpBuiltin, value);
-}
+  while (first <= last) {
+    CODE_COVERAGE(381); // Hit
+    int middle = (first + last) / 2;
+    uint16_t str2Offset = stringTableOffset + middle * 2;
+    Value vStr2 = LongPtr_read2_aligned(LongPtr_add(lpBytecode, str2Offset));
+    LongPtr lpStr2 = DynamicPtr_decode_long(vm, vStr2);
+    uint16_t header = readAllocationHeaderWord_long(lpStr2);
+    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(header) == TC_REF_INTERNED_STRING);
+    uint16_t str2Size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+    int compareSize = str1Size < str2Size ? str1Size : str2Size;
+    int c = memcmp_long(lpStr1, lpStr2, compareSize);
 
-// Warning: this function trashes the word at pObjectValue.
-// Note: out_propertyValue may point to the same address as pObjectValue
-static TeError getProperty(VM* vm, Value* pObjectValue, Value* pPropertyName, Value* out_propertyValue) {
-  CODE_COVERAGE(48); // Hit
+    // If they compare equal for the range that they have in common, we check the length
+    if (c == 0) {
+      CODE_COVERAGE(382); // Hit
+      if (str1Size < str2Size) {
+        CODE_COVERAGE_UNTESTED(383); // Not hit
+        c = -1;
+      } else if (str1Size > str2Size) {
+        CODE_COVERAGE_UNTESTED(384); // Not hit
+        c = 1;
+      } else {
+        CODE_COVERAGE(385); // Hit
+        // Exact match
+        *pValue = vStr2;
+        return;
+      }
+    }
 
-  mvm_TeError err;
-  LongPtr lpArr;
-  LongPtr lpClass;
-  uint16_t length;
-  TeTypeCode type;
-  Value objectValue;
-  Value propertyName;
+    // c is > 0 if the string we're searching for comes after the middle point
+    if (c > 0) {
+      CODE_COVERAGE(386); // Hit
+      first = middle + 1;
+    } else {
+      CODE_COVERAGE(387); // Hit
+      last = middle - 1;
+    }
+  }
 
-  // This function may trigger a GC cycle because it may add a cell to the string intern table
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+  // At this point, we haven't found the interned string in the bytecode. We
+  // need to check in RAM. Now we're comparing an in-RAM string against other
+  // in-RAM strings. We're looking for an exact match, not performing a binary
+  // search with inequality comparison, since the linked list of interned
+  // strings in RAM is not sorted.
+  Value vInternedStrings = getBuiltin(vm, BIN_INTERNED_STRINGS);
 
-  // Note: toPropertyName can trigger a GC cycle
-  err = toPropertyName(vm, pPropertyName);
-  if (err != MVM_E_SUCCESS) return err;
+  #if MVM_INTERN_INDEX
+  // The index is built lazily, which also covers the case of a VM restored
+  // from a snapshot that already has strings in the RAM intern list.
+  if (!vm->internIndex) {
+    CODE_COVERAGE_UNTESTED(672); // Not hit
+    vm_internIndexRebuild(vm);
+  } else {
+    CODE_COVERAGE_UNTESTED(673); // Not hit
+  }
+
+  if (vm->internIndex) {
+    CODE_COVERAGE_UNTESTED(674); // Not hit
+    uint16_t mask = vm->internIndexCapacity - 1;
+    uint16_t i = vm_internIndexHash(pStr1, str1Size) & mask;
+    ShortPtr spStr2;
+    // Linear probing. The index is never more than half full, so there is
+    // always an empty slot to stop at.
+    while ((spStr2 = vm->internIndex[i]) != 0) {
+      CODE_COVERAGE_UNTESTED(675); // Not hit
+      char* pStr2 = ShortPtr_decode(vm, spStr2);
+      if ((vm_getAllocationSize(pStr2) == str1Size) && (memcmp(pStr1, pStr2, str1Size) == 0)) {
+        CODE_COVERAGE_UNTESTED(676); // Not hit
+        *pValue = spStr2;
+        return;
+      }
+      i = (i + 1) & mask;
+    }
+    goto SUB_NOT_FOUND;
+  } else {
+    // Could not allocate the index. Fall back to searching the list.
+    CODE_COVERAGE_UNTESTED(677); // Not hit
+  }
+  #endif // MVM_INTERN_INDEX
 
-SUB_GET_PROPERTY:
+  Value spCell = vInternedStrings;
+  while (spCell != VM_VALUE_UNDEFINED) {
+    CODE_COVERAGE(388); // Hit
+    VM_ASSERT(vm, Value_isShortPtr(spCell));
+    TsInternedStringCell* pCell = ShortPtr_decode(vm, spCell);
+    Value vStr2 = pCell->str;
+    char* pStr2 = ShortPtr_decode(vm, vStr2);
+    uint16_t str2Header = readAllocationHeaderWord(pStr2);
+    uint16_t str2Size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(str2Header);
 
-  propertyName = *pPropertyName;
-  objectValue = *pObjectValue;
-  type = deepTypeOf(vm, objectValue);
-  switch (type) {
-    case TC_REF_UINT8_ARRAY: {
-      CODE_COVERAGE(339); // Hit
-      lpArr = DynamicPtr_decode_long(vm, objectValue);
-      uint16_t header = readAllocationHeaderWord_long(lpArr);
-      length = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-      if (propertyName == VM_VALUE_STR_LENGTH) {
-        CODE_COVERAGE(340); // Hit
-        VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-        *out_propertyValue = VirtualInt14_encode(vm, length);
-        return MVM_E_SUCCESS;
+    // The sizes have to match for the strings to be equal
+    if (str2Size == str1Size) {
+      CODE_COVERAGE(389); // Hit
+      // Note: we use memcmp instead of strcmp because strings are allowed to
+      // have embedded null terminators.
+      int c = memcmp(pStr1, pStr2, str1Size);
+      // Equal?
+      if (c == 0) {
+        CODE_COVERAGE(390); // Hit
+        *pValue = vStr2;
+        return;
       } else {
-        CODE_COVERAGE(341); // Hit
+        CODE_COVERAGE(391); // Hit
       }
+    } else {
+      CODE_COVERAGE(550); // Hit
+    }
+    spCell = pCell->spNext;
+    TABLE_COVERAGE(spCell ? 1 : 0, 2, 551); // Hit 1/2
+  }
 
-      if (!Value_isVirtualInt14(propertyName)) {
-        CODE_COVERAGE_ERROR_PATH(342); // Not hit
-        return MVM_E_INVALID_ARRAY_INDEX;
-      }
-      int16_t index = VirtualInt14_decode(vm, propertyName);
+  CODE_COVERAGE(616); // Hit
 
-      if ((index < 0) || (index >= length)) {
-        CODE_COVERAGE_ERROR_PATH(343); // Not hit
-        return MVM_E_INVALID_ARRAY_INDEX;
-      }
+  #if MVM_INTERN_INDEX
+SUB_NOT_FOUND:
+  #endif
+
+  // If we get here, it means there was no matching interned string already
+  // existing in ROM or RAM. We upgrade the current string to a
+  // TC_REF_INTERNED_STRING, since we now know it doesn't conflict with any existing
+  // existing interned strings.
+  setHeaderWord(vm, pStr1, TC_REF_INTERNED_STRING, str1Size);
+
+  // Add the string to the linked list of interned strings
+  TsInternedStringCell* pCell = GC_ALLOCATE_TYPE(vm, TsInternedStringCell, TC_REF_FIXED_LENGTH_ARRAY);
+  value = *pValue; // Invalidated by potential GC collection
+  vInternedStrings = getBuiltin(vm, BIN_INTERNED_STRINGS); // Likewise
+  // Push onto linked list2
+  pCell->spNext = vInternedStrings;
+  pCell->str = value;
+  setBuiltin(vm, BIN_INTERNED_STRINGS, ShortPtr_encode(vm, pCell));
+
+  #if MVM_INTERN_INDEX
+  vm_internIndexInsert(vm, value);
+  #endif
+}
+
+#if MVM_INTERN_INDEX
+// FNV-1a, folded to 16 bits
+static uint16_t vm_internIndexHash(const void* pStr, uint16_t size) {
+  CODE_COVERAGE_UNTESTED(678); // Not hit
+  const uint8_t* p = (const uint8_t*)pStr;
+  uint32_t h = 2166136261u;
+  while (size--) {
+    h ^= *p++;
+    h *= 16777619u;
+  }
+  return (uint16_t)(h ^ (h >> 16));
+}
+
+static void vm_internIndexPut(VM* vm, ShortPtr spStr) {
+  CODE_COVERAGE_UNTESTED(679); // Not hit
+  char* pStr = ShortPtr_decode(vm, spStr);
+  uint16_t mask = vm->internIndexCapacity - 1;
+  uint16_t i = vm_internIndexHash(pStr, vm_getAllocationSize(pStr)) & mask;
+  while (vm->internIndex[i] != 0) {
+    i = (i + 1) & mask;
+  }
+  vm->internIndex[i] = spStr;
+  vm->internIndexCount++;
+}
+
+/**
+ * (Re)build the intern index from the BIN_INTERNED_STRINGS list. The capacity
+ * is chosen from the current number of interned strings in RAM so that the
+ * index starts off at most a quarter full.
+ *
+ * The index is only an accelerator, so if the host can't provide the memory
+ * then `vm->internIndex` is left NULL and toInternedString falls back to
+ * searching the list.
+ */
+static void vm_internIndexRebuild(VM* vm) {
+  CODE_COVERAGE_UNTESTED(680); // Not hit
+  Value vInternedStrings = getBuiltin(vm, BIN_INTERNED_STRINGS);
 
-      uint8_t byteValue = LongPtr_read1(LongPtr_add(lpArr, (uint16_t)index));
-      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-      *out_propertyValue = VirtualInt14_encode(vm, byteValue);
-      return MVM_E_SUCCESS;
-    }
+  uint16_t count = 0;
+  Value spCell = vInternedStrings;
+  while (spCell != VM_VALUE_UNDEFINED) {
+    TsInternedStringCell* pCell = ShortPtr_decode(vm, spCell);
+    count++;
+    spCell = pCell->spNext;
+  }
 
-    case TC_REF_PROPERTY_LIST: {
-      CODE_COVERAGE(359); // Hit
+  uint16_t capacity = 8;
+  while ((capacity < count * 4) && (capacity < 0x8000)) {
+    capacity *= 2;
+  }
 
-      LongPtr lpPropertyList = DynamicPtr_decode_long(vm, objectValue);
-      DynamicPtr dpProto = READ_FIELD_2(lpPropertyList, TsPropertyList, dpProto);
+  vm_free(vm, vm->internIndex);
+  vm->internIndexCount = 0;
+  vm->internIndexCapacity = capacity;
+  vm->internIndex = vm_malloc(vm, capacity * sizeof (ShortPtr));
+  if (!vm->internIndex) {
+    CODE_COVERAGE_ERROR_PATH(681); // Not hit
+    vm->internIndexCapacity = 0;
+    return;
+  }
+  memset(vm->internIndex, 0, capacity * sizeof (ShortPtr));
 
-      if (propertyName == VM_VALUE_STR_PROTO) {
-        CODE_COVERAGE_UNIMPLEMENTED(326); // Hit
-        *out_propertyValue = dpProto;
-        return MVM_E_SUCCESS;
-      }
+  spCell = vInternedStrings;
+  while (spCell != VM_VALUE_UNDEFINED) {
+    TsInternedStringCell* pCell = ShortPtr_decode(vm, spCell);
+    vm_internIndexPut(vm, pCell->str);
+    spCell = pCell->spNext;
+  }
+}
 
-      while (lpPropertyList) {
-        uint16_t headerWord = readAllocationHeaderWord_long(lpPropertyList);
-        uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-        uint16_t propCount = (size - sizeof (TsPropertyList)) / 4;
+// Add a string that has just been pushed onto the BIN_INTERNED_STRINGS list
+static void vm_internIndexInsert(VM* vm, Value str) {
+  CODE_COVERAGE_UNTESTED(682); // Not hit
+  if (!vm->internIndex) {
+    CODE_COVERAGE_UNTESTED(683); // Not hit
+    return;
+  }
+  // Keep the load factor at or below 1/2. The rebuild picks up the new string
+  // from the list.
+  if ((vm->internIndexCount + 1) * 2 > vm->internIndexCapacity) {
+    CODE_COVERAGE_UNTESTED(684); // Not hit
+    vm_internIndexRebuild(vm);
+  } else {
+    CODE_COVERAGE_UNTESTED(685); // Not hit
+    vm_internIndexPut(vm, str);
+  }
+}
+#endif // MVM_INTERN_INDEX
 
-        LongPtr p = LongPtr_add(lpPropertyList, sizeof (TsPropertyList));
-        while (propCount--) {
-          Value key = LongPtr_read2_aligned(p);
-          p = LongPtr_add(p, 2);
-          Value value = LongPtr_read2_aligned(p);
-          p = LongPtr_add(p, 2);
+static int memcmp_long(LongPtr p1, LongPtr p2, size_t size) {
+  CODE_COVERAGE(471); // Hit
+  return MVM_LONG_MEM_CMP(p1, p2, size);
+}
 
-          if (key == propertyName) {
-            CODE_COVERAGE(361); // Hit
-            VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-            *out_propertyValue = value;
-            return MVM_E_SUCCESS;
-          } else {
-            CODE_COVERAGE(362); // Hit
-          }
-        }
+static void memcpy_long(void* target, LongPtr source, size_t size) {
+  CODE_COVERAGE(9); // Hit
+  MVM_LONG_MEM_CPY(target, source, size);
+}
 
-        DynamicPtr dpNext = READ_FIELD_2(lpPropertyList, TsPropertyList, dpNext);
-         // Move to next group, if there is one
-        if (dpNext != VM_VALUE_NULL) {
-          CODE_COVERAGE(536); // Hit
-          lpPropertyList = DynamicPtr_decode_long(vm, dpNext);
-        } else { // Otherwise try read from the prototype
-          CODE_COVERAGE(537); // Hit
-          lpPropertyList = DynamicPtr_decode_long(vm, dpProto);
-          if (lpPropertyList) {
-            CODE_COVERAGE(538); // Hit
-            dpProto = READ_FIELD_2(lpPropertyList, TsPropertyList, dpProto);
-          } else {
-            CODE_COVERAGE(539); // Hit
-          }
-        }
-      }
+/** Size of string excluding bonus null terminator */
+static uint16_t vm_stringSizeUtf8(VM* vm, Value value) {
+  CODE_COVERAGE(53); // Hit
+  TeTypeCode typeCode = deepTypeOf(vm, value);
+  switch (typeCode) {
+    case TC_REF_STRING:
+    case TC_REF_INTERNED_STRING: {
+      LongPtr lpStr = DynamicPtr_decode_long(vm, value);
+      uint16_t headerWord = readAllocationHeaderWord_long(lpStr);
+      // Less 1 because of the bonus null terminator
+      return vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord) - 1;
+    }
+    case TC_VAL_STR_PROTO: {
+      CODE_COVERAGE_UNTESTED(552); // Not hit
+      return sizeof PROTO_STR - 1;
+    }
+    case TC_VAL_STR_LENGTH: {
+      CODE_COVERAGE(608); // Hit
+      return sizeof LENGTH_STR - 1;
+    }
+    case TC_REF_ROPE: {
+      CODE_COVERAGE(777); // Hit
+      TsRope* pRope = ShortPtr_decode(vm, value);
+      return VirtualInt14_decode(vm, pRope->length);
+    }
+    default:
+      VM_ASSERT_UNREACHABLE(vm);
+      return 0;
+  }
+}
 
-      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-      *out_propertyValue = VM_VALUE_UNDEFINED;
-      return MVM_E_SUCCESS;
+/**
+ * Gets the bytes of the string `str` starting at byte `offset`, without
+ * allocating. The result is the longest contiguous run of bytes available,
+ * which is the rest of the string unless `str` is a rope, and its size is
+ * written to `out_size`.
+ *
+ * Warning: the result is a native pointer and becomes invalid if a GC
+ * collection occurs.
+ */
+static LongPtr vm_stringSegment(VM* vm, Value str, uint16_t offset, uint16_t* out_size) {
+  CODE_COVERAGE_UNTESTED(778); // Not hit
+  // Find the leaf that contains the offset
+  while (deepTypeOf(vm, str) == TC_REF_ROPE) {
+    CODE_COVERAGE_UNTESTED(779); // Not hit
+    TsRope* pRope = ShortPtr_decode(vm, str);
+    if (pRope->right == VM_VALUE_DELETED) {
+      CODE_COVERAGE_UNTESTED(780); // Not hit
+      str = pRope->left;
+      break;
+    }
+    uint16_t leftSize = vm_stringSizeUtf8(vm, pRope->left);
+    if (offset < leftSize) {
+      CODE_COVERAGE_UNTESTED(781); // Not hit
+      str = pRope->left;
+    } else {
+      CODE_COVERAGE_UNTESTED(782); // Not hit
+      offset -= leftSize;
+      str = pRope->right;
     }
+  }
 
-    case TC_REF_ARRAY: {
-      CODE_COVERAGE(363); // Hit
+  uint16_t size = vm_stringSizeUtf8(vm, str);
+  VM_ASSERT(vm, offset <= size);
+  *out_size = size - offset;
+  return LongPtr_add(vm_getStringData(vm, str), offset);
+}
 
-      lpArr = DynamicPtr_decode_long(vm, objectValue);
-      Value viLength = READ_FIELD_2(lpArr, TsArray, viLength);
-      length = VirtualInt14_decode(vm, viLength);
+/**
+ * Copies the bytes of the string `str` to `target`, which must have space for
+ * vm_stringSizeUtf8(str) bytes. Does not allocate.
+ */
+static void vm_stringCopy(VM* vm, uint8_t* target, Value str) {
+  CODE_COVERAGE(783); // Hit
+  while (deepTypeOf(vm, str) == TC_REF_ROPE) {
+    CODE_COVERAGE(784); // Hit
+    TsRope* pRope = ShortPtr_decode(vm, str);
+    if (pRope->right == VM_VALUE_DELETED) {
+      CODE_COVERAGE_UNTESTED(785); // Not hit
+      str = pRope->left;
+      break;
+    }
+    // Recursing into the smaller side and looping on the larger side keeps the
+    // recursion depth logarithmic in the size of the string, however
+    // unbalanced the rope is.
+    uint16_t leftSize = vm_stringSizeUtf8(vm, pRope->left);
+    uint16_t rightSize = vm_stringSizeUtf8(vm, pRope->right);
+    if (leftSize <= rightSize) {
+      CODE_COVERAGE_UNTESTED(786); // Not hit
+      vm_stringCopy(vm, target, pRope->left);
+      target += leftSize;
+      str = pRope->right;
+    } else {
+      CODE_COVERAGE(787); // Hit
+      vm_stringCopy(vm, target + leftSize, pRope->right);
+      str = pRope->left;
+    }
+  }
 
-      // Drill in to fixed-length array inside the array
-      DynamicPtr dpData = READ_FIELD_2(lpArr, TsArray, dpData);
-      lpArr = DynamicPtr_decode_long(vm, dpData);
+  memcpy_long(target, vm_getStringData(vm, str), vm_stringSizeUtf8(vm, str));
+}
 
-      goto SUB_GET_PROP_FIXED_LENGTH_ARRAY;
-    }
+/**
+ * Flattens the rope `rope` into a TC_REF_STRING and returns it. The rope
+ * remembers the result, so flattening it again is free.
+ *
+ * Note: this allocates, which can cause a GC collection.
+ */
+static Value vm_flattenRope(VM* vm, Value rope) {
+  CODE_COVERAGE(788); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  VM_ASSERT(vm, deepTypeOf(vm, rope) == TC_REF_ROPE);
 
-    case TC_REF_FIXED_LENGTH_ARRAY: {
-      CODE_COVERAGE(286); // Hit
+  TsRope* pRope = ShortPtr_decode(vm, rope);
+  if (pRope->right == VM_VALUE_DELETED) {
+    CODE_COVERAGE_UNTESTED(789); // Not hit
+    return pRope->left;
+  } else {
+    CODE_COVERAGE(790); // Hit
+  }
 
-      lpArr = DynamicPtr_decode_long(vm, objectValue);
+  mvm_Handle hRope;
+  mvm_initializeHandle(vm, &hRope);
+  mvm_handleSet(&hRope, rope);
 
-      uint16_t header = readAllocationHeaderWord_long(lpArr);
-      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-      length = size >> 1;
+  uint8_t* data;
+  // Note: this allocation can cause a GC collection which could cause the rope
+  // to move in memory
+  Value flat = vm_allocString(vm, VirtualInt14_decode(vm, pRope->length), (void**)&data);
+  rope = mvm_handleGet(&hRope);
+  mvm_releaseHandle(vm, &hRope);
 
-      goto SUB_GET_PROP_FIXED_LENGTH_ARRAY;
-    }
+  vm_stringCopy(vm, data, rope);
 
-    case TC_REF_CLASS: {
-      CODE_COVERAGE(615); // Hit
-      lpClass = DynamicPtr_decode_long(vm, objectValue);
-      // Delegate to the `staticProps` of the class
-      *pObjectValue = READ_FIELD_2(lpClass, TsClass, staticProps);
-      goto SUB_GET_PROPERTY;
-    }
+  pRope = ShortPtr_decode(vm, rope);
+  pRope->left = flat;
+  gc_writeBarrier(vm, &pRope->left, flat);
+  pRope->right = VM_VALUE_DELETED;
 
-    default: return vm_newError(vm, MVM_E_TYPE_ERROR);
-  }
+  return flat;
+}
 
-SUB_GET_PROP_FIXED_LENGTH_ARRAY:
-  CODE_COVERAGE(323); // Hit
+/**
+ * Checks if a string contains only decimal digits (and is not empty). May only
+ * be called on TC_REF_STRING and only those in GC memory.
+ */
+static bool vm_ramStringIsNonNegativeInteger(VM* vm, Value str) {
+  CODE_COVERAGE(55); // Hit
+  VM_ASSERT(vm, deepTypeOf(vm, str) == TC_REF_STRING);
 
-  if (propertyName == VM_VALUE_STR_LENGTH) {
-    CODE_COVERAGE(274); // Hit
-    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-    *out_propertyValue = VirtualInt14_encode(vm, length);
-    return MVM_E_SUCCESS;
-  } else if (propertyName == VM_VALUE_STR_PROTO) {
-    CODE_COVERAGE(275); // Hit
-    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-    *out_propertyValue = getBuiltin(vm, BIN_ARRAY_PROTO);
-    return MVM_E_SUCCESS;
+  char* pStr = ShortPtr_decode(vm, str);
+
+  // Length excluding bonus null terminator
+  uint16_t len = vm_getAllocationSize(pStr) - 1;
+  char* p = pStr;
+  if (!len) {
+    CODE_COVERAGE_UNTESTED(554); // Not hit
+    return false;
   } else {
-    CODE_COVERAGE(276); // Hit
+    CODE_COVERAGE(555); // Hit
   }
-
-  // Array index
-  if (Value_isVirtualInt14(propertyName)) {
-    CODE_COVERAGE(277); // Hit
-    int16_t index = VirtualInt14_decode(vm, propertyName);
-    if (index < 0) {
-      CODE_COVERAGE_ERROR_PATH(144); // Not hit
-      return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
-    }
-
-    if ((uint16_t)index >= length) {
-      CODE_COVERAGE(283); // Hit
-      VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-      *out_propertyValue = VM_VALUE_UNDEFINED;
-      return MVM_E_SUCCESS;
-    } else {
-      CODE_COVERAGE(328); // Hit
-    }
-    // We've already checked if the value exceeds the length, so lpData
-    // cannot be null and the capacity must be at least as large as the
-    // length of the array.
-    VM_ASSERT(vm, lpArr);
-    VM_ASSERT(vm, length * 2 <= vm_getAllocationSizeExcludingHeaderFromHeaderWord(readAllocationHeaderWord_long(lpArr)));
-    Value value = LongPtr_read2_aligned(LongPtr_add(lpArr, (uint16_t)index * 2));
-    if (value == VM_VALUE_DELETED) {
-      CODE_COVERAGE(329); // Hit
-      value = VM_VALUE_UNDEFINED;
+  while (len--) {
+    CODE_COVERAGE(398); // Hit
+    if (!isdigit(*p++)) {
+      CODE_COVERAGE(399); // Hit
+      return false;
     } else {
-      CODE_COVERAGE(364); // Hit
+      CODE_COVERAGE_UNTESTED(400); // Not hit
     }
-    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-    *out_propertyValue = value;
-    return MVM_E_SUCCESS;
   }
-  CODE_COVERAGE(278); // Hit
+  return true;
+}
 
-  *pObjectValue = getBuiltin(vm, BIN_ARRAY_PROTO);
-  if (*pObjectValue != VM_VALUE_NULL) {
-    CODE_COVERAGE(396); // Hit
-    goto SUB_GET_PROPERTY;
-  } else {
-    CODE_COVERAGE_UNTESTED(397); // Not hit
-    VM_EXEC_SAFE_MODE(*pObjectValue = VM_VALUE_NULL);
-    *out_propertyValue = VM_VALUE_UNDEFINED;
-    return MVM_E_SUCCESS;
+/**
+ * Reads a string a byte at a time without allocating, following the leaves if
+ * the string is a rope. Reads 0 past the end of the string, like the null
+ * terminator of a flat string.
+ */
+typedef struct vm_TsStringReader {
+  Value str;
+  uint16_t offset; // Offset of `lp` in the string
+  uint16_t available; // Bytes from `lp` to the end of the current segment
+  LongPtr lp;
+} vm_TsStringReader;
+
+static void vm_stringReaderInit(VM* vm, vm_TsStringReader* reader, Value str) {
+  reader->str = str;
+  reader->offset = 0;
+  reader->lp = vm_stringSegment(vm, str, 0, &reader->available);
+}
+
+static inline uint8_t vm_stringReaderPeek(vm_TsStringReader* reader) {
+  return reader->available ? LongPtr_read1(reader->lp) : 0;
+}
+
+static void vm_stringReaderNext(VM* vm, vm_TsStringReader* reader) {
+  VM_ASSERT(vm, reader->available);
+  reader->offset++;
+  reader->lp = LongPtr_add(reader->lp, 1);
+  if (!--reader->available) {
+    reader->lp = vm_stringSegment(vm, reader->str, reader->offset, &reader->available);
   }
 }
 
-static void growArray(VM* vm, Value* pvArr, uint16_t newLength, uint16_t newCapacity) {
-  CODE_COVERAGE(293); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+// Convert a string to an integer
+TeError strToInt32(mvm_VM* vm, mvm_Value value, int32_t* out_result) {
+  CODE_COVERAGE(404); // Hit
+
+  #if MVM_SAFE_MODE
+    TeTypeCode type = deepTypeOf(vm, value);
+    VM_ASSERT(vm, type == TC_REF_STRING || type == TC_REF_INTERNED_STRING || type == TC_REF_ROPE);
+  #endif
+
+  bool isFloat = false;
+
+  // Note: this function is implemented to use long pointers to access ROM
+  // memory. This is because the string may be in ROM and we don't want to copy
+  // the string to RAM. Copying to RAM involves allocating the available memory,
+  // which requires that the VM register cache be in a flushed state, which they
+  // aren't necessarily at this point in the code. For the same reason, a rope
+  // is read leaf by leaf rather than flattened.
+
+  vm_TsStringReader s;
+  vm_stringReaderInit(vm, &s, value);
+  uint16_t len = vm_stringSizeUtf8(vm, value);
 
-  VM_ASSERT(vm, newCapacity >= newLength);
-  if (newCapacity > MAX_ALLOCATION_SIZE / 2) {
-    CODE_COVERAGE_ERROR_PATH(540); // Not hit
-    MVM_FATAL_ERROR(vm, MVM_E_ARRAY_TOO_LONG);
+  // Skip leading whitespace
+  while (isspace(vm_stringReaderPeek(&s))) {
+    vm_stringReaderNext(vm, &s);
   }
-  VM_ASSERT(vm, newCapacity != 0);
-
-  uint16_t* pNewData = gc_allocateWithHeader(vm, newCapacity * 2, TC_REF_FIXED_LENGTH_ARRAY);
-  // Copy values from the old array. Note that the above allocation can trigger
-  // a GC collection which moves the array, so we need to decode the value again
-  TsArray* arr = DynamicPtr_decode_native(vm, *pvArr);
-  DynamicPtr dpOldData = arr->dpData;
-  uint16_t oldCapacity = 0;
-  if (dpOldData != VM_VALUE_NULL) {
-    CODE_COVERAGE(294); // Hit
-    LongPtr lpOldData = DynamicPtr_decode_long(vm, dpOldData);
 
-    uint16_t oldDataHeader = readAllocationHeaderWord_long(lpOldData);
-    uint16_t oldSize = vm_getAllocationSizeExcludingHeaderFromHeaderWord(oldDataHeader);
-    VM_ASSERT(vm, (oldSize & 1) == 0);
-    oldCapacity = oldSize / 2;
+  int sign = (vm_stringReaderPeek(&s) == '-') ? -1 : 1;
+  if (vm_stringReaderPeek(&s) == '+' || vm_stringReaderPeek(&s) == '-') {
+    vm_stringReaderNext(vm, &s);
+  }
 
-    memcpy_long(pNewData, lpOldData, oldSize);
-  } else {
-    CODE_COVERAGE(310); // Hit
+  // Find end of digits
+  int32_t n = 0;
+  while (isdigit(vm_stringReaderPeek(&s))) {
+    int32_t n2 = n * 10 + (vm_stringReaderPeek(&s) - '0');
+    vm_stringReaderNext(vm, &s);
+    // Overflow Int32
+    if (n2 < n) isFloat = true;
+    n = n2;
   }
-  CODE_COVERAGE(325); // Hit
-  VM_ASSERT(vm, newCapacity >= oldCapacity);
-  // Fill in the rest of the memory as holes
-  uint16_t* p = &pNewData[oldCapacity];
-  uint16_t* end = &pNewData[newCapacity];
-  while (p != end) {
-    *p++ = VM_VALUE_DELETED;
+
+  // Decimal point
+  if ((vm_stringReaderPeek(&s) == ',') || (vm_stringReaderPeek(&s) == '.')) {
+    CODE_COVERAGE(653); // Hit
+    isFloat = true;
+    vm_stringReaderNext(vm, &s);
   }
-  arr->dpData = ShortPtr_encode(vm, pNewData);
-  arr->viLength = VirtualInt14_encode(vm, newLength);
-}
 
-static TeError vm_objectKeys(VM* vm, Value* inout_slot) {
-  CODE_COVERAGE(636); // Hit
-  Value obj;
-  LongPtr lpClass;
+  // Digits after decimal point
+  while (isdigit(vm_stringReaderPeek(&s))) vm_stringReaderNext(vm, &s);
 
-SUB_OBJECT_KEYS:
-  obj = *inout_slot;
+  // Skip trailing whitespace
+  while (isspace(vm_stringReaderPeek(&s))) vm_stringReaderNext(vm, &s);
 
-  TeTypeCode tc = deepTypeOf(vm, obj);
-  if (tc == TC_REF_CLASS) {
-    CODE_COVERAGE_UNTESTED(637); // Not hit
-    lpClass = DynamicPtr_decode_long(vm, obj);
-    // Delegate to the `staticProps` of the class
-    *inout_slot = READ_FIELD_2(lpClass, TsClass, staticProps);
-    goto SUB_OBJECT_KEYS;
+  // Check if we reached the end of the string. If we haven't reached the end of
+  // the string then there is a non-digit character in the string.
+  if (s.offset != len) {
+    CODE_COVERAGE(654); // Hit
+    return MVM_E_NAN;
   }
-  CODE_COVERAGE(638); // Hit
 
-  if (tc != TC_REF_PROPERTY_LIST) {
-    CODE_COVERAGE_ERROR_PATH(639); // Not hit
-    return MVM_E_OBJECT_KEYS_ON_NON_OBJECT;
+  // This function cannot handle floating point numbers
+  if (isFloat) {
+    CODE_COVERAGE_UNTESTED(655); // Not hit
+    return MVM_E_FLOAT64;
   }
 
-  // Count the number of properties (first add up the sizes)
+  CODE_COVERAGE(656); // Hit
 
-  uint16_t propsSize = 0;
-  Value propList = obj;
-  // Note: the GC packs an object into a single allocation, so this should
-  // frequently be O(1) and only loop once
-  do {
-    LongPtr lpPropList = DynamicPtr_decode_long(vm, propList);
-    propsSize += vm_getAllocationSize_long(lpPropList) - sizeof(TsPropertyList);
-    propList = LongPtr_read2_aligned(lpPropList) /* dpNext */;
-    TABLE_COVERAGE(propList != VM_VALUE_NULL ? 1 : 0, 2, 640); // Hit 2/2
-  } while (propList != VM_VALUE_NULL);
+  *out_result = sign * n;
 
-  // Each prop is 4 bytes, and each entry in the array is 2 bytes
-  uint16_t arrSize = propsSize >> 1;
+  return MVM_E_SUCCESS;
+}
 
-  // If the array is empty, an empty allocation is illegal. A 1-byte allocation
-  // will be rounded down when asking the size, but rounded up in the allocation
-  // unit.
-  if (!arrSize) {
-    CODE_COVERAGE(641); // Hit
-    arrSize = 1;
+TeError toInt32Internal(mvm_VM* vm, mvm_Value value, int32_t* out_result) {
+  CODE_COVERAGE(56); // Hit
+  // TODO: when the type codes are more stable, we should convert these to a table.
+  *out_result = 0;
+  TeTypeCode type = deepTypeOf(vm, value);
+  MVM_SWITCH(type, TC_END - 1) {
+    MVM_CASE(TC_VAL_INT14):
+    MVM_CASE(TC_REF_INT32): {
+      CODE_COVERAGE(401); // Hit
+      *out_result = vm_readInt32(vm, type, value);
+      return MVM_E_SUCCESS;
+    }
+    MVM_CASE(TC_REF_FLOAT64): {
+      CODE_COVERAGE(402); // Hit
+      return MVM_E_FLOAT64;
+    }
+    MVM_CASE(TC_REF_STRING):
+    MVM_CASE(TC_REF_INTERNED_STRING):
+    MVM_CASE(TC_REF_ROPE): {
+      CODE_COVERAGE(403); // Hit
+      return strToInt32(vm, value, out_result);
+    }
+    MVM_CASE(TC_VAL_STR_LENGTH): {
+      CODE_COVERAGE(270); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_VAL_STR_PROTO): {
+      CODE_COVERAGE(271); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_PROPERTY_LIST): {
+      CODE_COVERAGE(405); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_ARRAY): {
+      CODE_COVERAGE_UNTESTED(406); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_FUNCTION): {
+      CODE_COVERAGE(408); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_HOST_FUNC): {
+      CODE_COVERAGE_UNTESTED(409); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_CLOSURE): {
+      CODE_COVERAGE_UNTESTED(410); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_UINT8_ARRAY): {
+      CODE_COVERAGE_UNTESTED(411); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_TYPED_ARRAY): {
+      CODE_COVERAGE_UNTESTED(632); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_CLASS): {
+      CODE_COVERAGE(633); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_REF_SYMBOL): {
+      CODE_COVERAGE_UNTESTED(412); // Not hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_VAL_UNDEFINED): {
+      CODE_COVERAGE(413); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_VAL_NULL): {
+      CODE_COVERAGE(414); // Hit
+      break;
+    }
+    MVM_CASE(TC_VAL_TRUE): {
+      CODE_COVERAGE_UNTESTED(415); // Not hit
+      *out_result = 1; break;
+    }
+    MVM_CASE(TC_VAL_FALSE): {
+      CODE_COVERAGE_UNTESTED(416); // Not hit
+      break;
+    }
+    MVM_CASE(TC_VAL_NAN): {
+      CODE_COVERAGE(417); // Hit
+      return MVM_E_NAN;
+    }
+    MVM_CASE(TC_VAL_NEG_ZERO): {
+      CODE_COVERAGE(418); // Hit
+      return MVM_E_NEG_ZERO;
+    }
+    MVM_CASE(TC_VAL_DELETED): {
+      CODE_COVERAGE_UNTESTED(419); // Not hit
+      return MVM_E_NAN;
+    }
+    default:
+      VM_ASSERT_UNREACHABLE(vm);
   }
+  return MVM_E_SUCCESS;
+}
 
-  // Allocate the new array.
-  uint16_t* p = gc_allocateWithHeader(vm, arrSize, TC_REF_FIXED_LENGTH_ARRAY);
-  obj = *inout_slot; // Invalidated by potential GC collection
-
-  // Populate the array
+int32_t mvm_toInt32(mvm_VM* vm, mvm_Value value) {
+  CODE_COVERAGE(57); // Hit
+  gc_completeIncremental(vm);
+  int32_t result;
+  TeError err = toInt32Internal(vm, value, &result);
+  if (err == MVM_E_SUCCESS) {
+    CODE_COVERAGE(420); // Hit
+    return result;
+  } else if (err == MVM_E_NAN) {
+    CODE_COVERAGE(421); // Hit
+    return 0;
+  } else if (err == MVM_E_NEG_ZERO) {
+    CODE_COVERAGE_UNTESTED(422); // Not hit
+    return 0;
+  } else {
+    CODE_COVERAGE_UNTESTED(423); // Not hit
+  }
 
-  propList = obj;
-  *inout_slot = ShortPtr_encode(vm, p);
-  do {
-    LongPtr lpPropList = DynamicPtr_decode_long(vm, propList);
-    propList = LongPtr_read2_aligned(lpPropList) /* dpNext */;
+  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_FLOAT64);
+  #if MVM_SUPPORT_FLOAT
+    return (int32_t)mvm_toFloat64(vm, value);
+  #else // !MVM_SUPPORT_FLOAT
+    // If things were compiled correctly, there shouldn't be any floats in the
+    // system at all
+    return 0;
+  #endif
+}
 
-    uint16_t propsSize = vm_getAllocationSize_long(lpPropList) - sizeof(TsPropertyList);
-    LongPtr lpProp = LongPtr_add(lpPropList, sizeof(TsPropertyList));
-    TABLE_COVERAGE(propsSize != 0 ? 1 : 0, 2, 642); // Hit 2/2
-    while (propsSize) {
-      *p = LongPtr_read2_aligned(lpProp);
-      p++; // Move to next entry in array
-      // Each property cell is 4 bytes
-      lpProp /* prop */ = LongPtr_add(lpProp /* prop */, 4);
-      propsSize -= 4;
-    }
-    TABLE_COVERAGE(propList != VM_VALUE_NULL ? 1 : 0, 2, 643); // Hit 2/2
-  } while (propList != VM_VALUE_NULL);
+#if MVM_SUPPORT_FLOAT
+MVM_FLOAT64 mvm_toFloat64(mvm_VM* vm, mvm_Value value) {
+  CODE_COVERAGE(58); // Hit
+  gc_completeIncremental(vm);
+  int32_t result;
+  TeError err = toInt32Internal(vm, value, &result);
+  if (err == MVM_E_SUCCESS) {
+    CODE_COVERAGE(424); // Hit
+    return result;
+  } else if (err == MVM_E_NAN) {
+    CODE_COVERAGE(425); // Hit
+    return MVM_FLOAT64_NAN;
+  } else if (err == MVM_E_NEG_ZERO) {
+    CODE_COVERAGE(426); // Hit
+    return MVM_FLOAT_NEG_ZERO;
+  } else {
+    CODE_COVERAGE(427); // Hit
+  }
 
-  return MVM_E_SUCCESS;
+  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_FLOAT64);
+  LongPtr lpFloat = DynamicPtr_decode_long(vm, value);
+  MVM_FLOAT64 f;
+  memcpy_long(&f, lpFloat, sizeof f);
+  return f;
 }
+#endif // MVM_SUPPORT_FLOAT
 
-/**
- * Note: the operands are passed by pointer to make sure they're anchored in the
- * stack and that if the GC moves their targets, we will be using the latest
- * values. The operands are:
- *
- *   - pOperands[0]: object
- *   - pOperands[1]: propertyName
- *   - pOperands[2]: propertyValue
- */
-static TeError setProperty(VM* vm, Value* pOperands) {
-  CODE_COVERAGE(49); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
-
-  mvm_TeError err;
-  LongPtr lpClass;
-  TeTypeCode type;
+// See implementation of mvm_equal for the meaning of each
+typedef enum TeEqualityAlgorithm {
+  EA_NONE,
+  EA_COMPARE_PTR_VALUE_AND_TYPE,
+  EA_COMPARE_NON_PTR_TYPE,
+  EA_COMPARE_REFERENCE,
+  EA_NOT_EQUAL,
+  EA_COMPARE_STRING,
+} TeEqualityAlgorithm;
 
-  // This function may trigger a GC cycle because it may add a cell to the string intern table
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+static const TeEqualityAlgorithm equalityAlgorithmByTypeCode[TC_END] = {
+  EA_NONE,                       // TC_REF_TOMBSTONE          = 0x0
+  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_INT32              = 0x1
+  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_FLOAT64            = 0x2
+  EA_COMPARE_STRING,             // TC_REF_STRING             = 0x3
+  EA_COMPARE_STRING,             // TC_REF_INTERNED_STRING    = 0x4
+  EA_COMPARE_REFERENCE,          // TC_REF_FUNCTION           = 0x5
+  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_HOST_FUNC          = 0x6
+  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_BIG_INT            = 0x7
+  EA_COMPARE_REFERENCE,          // TC_REF_SYMBOL             = 0x8
+  EA_NONE,                       // TC_REF_CLASS              = 0x9
+  EA_COMPARE_REFERENCE,          // TC_REF_TYPED_ARRAY        = 0xA
+  EA_COMPARE_STRING,             // TC_REF_ROPE               = 0xB
+  EA_COMPARE_REFERENCE,          // TC_REF_PROPERTY_LIST      = 0xC
+  EA_COMPARE_REFERENCE,          // TC_REF_ARRAY              = 0xD
+  EA_COMPARE_REFERENCE,          // TC_REF_FIXED_LENGTH_ARRAY = 0xE
+  EA_COMPARE_REFERENCE,          // TC_REF_CLOSURE            = 0xF
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_INT14              = 0x10
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_UNDEFINED          = 0x11
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_NULL               = 0x12
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_TRUE               = 0x13
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_FALSE              = 0x14
+  EA_NOT_EQUAL,                  // TC_VAL_NAN                = 0x15
+  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_NEG_ZERO           = 0x16
+  EA_NONE,                       // TC_VAL_DELETED            = 0x17
+  EA_COMPARE_STRING,             // TC_VAL_STR_LENGTH         = 0x18
+  EA_COMPARE_STRING,             // TC_VAL_STR_PROTO          = 0x19
+};
 
-  err = toPropertyName(vm, &pOperands[1]);
-  if (err != MVM_E_SUCCESS) return err;
+bool mvm_equal(mvm_VM* vm, mvm_Value a, mvm_Value b) {
+  CODE_COVERAGE(462); // Hit
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  gc_completeIncremental(vm);
 
-  MVM_LOCAL(Value, vObjectValue, 0);
-  MVM_LOCAL(Value, vPropertyName, pOperands[1]);
-  MVM_LOCAL(Value, vPropertyValue, pOperands[2]);
+  TeTypeCode aType = deepTypeOf(vm, a);
+  TeTypeCode bType = deepTypeOf(vm, b);
+  TeEqualityAlgorithm algorithmA = equalityAlgorithmByTypeCode[aType];
+  TeEqualityAlgorithm algorithmB = equalityAlgorithmByTypeCode[bType];
 
-SUB_SET_PROPERTY:
+  TABLE_COVERAGE(algorithmA, 6, 556); // Hit 4/6
+  TABLE_COVERAGE(algorithmB, 6, 557); // Hit 4/6
+  TABLE_COVERAGE(aType, TC_END, 558); // Hit 6/26
+  TABLE_COVERAGE(bType, TC_END, 559); // Hit 8/26
 
-  MVM_SET_LOCAL(vObjectValue, pOperands[0]);
-  type = deepTypeOf(vm, MVM_GET_LOCAL(vObjectValue));
-  switch (type) {
-    case TC_REF_UINT8_ARRAY: {
-      CODE_COVERAGE(594); // Hit
-      // It's not valid for the optimizer to move a buffer into ROM if it's
-      // ever written to, so it must be in RAM.
-      VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(vObjectValue)));
-      uint8_t* p = ShortPtr_decode(vm, MVM_GET_LOCAL(vObjectValue));
-      uint16_t header = readAllocationHeaderWord(p);
-      uint16_t length = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+  // If the values aren't even in the same class of comparison, they're not
+  // equal. In particular, strings will not be equal to non-strings.
+  if (algorithmA != algorithmB) {
+    CODE_COVERAGE(560); // Hit
+    return false;
+  } else {
+    CODE_COVERAGE(561); // Hit
+  }
 
-      if (!Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyName))) {
-        CODE_COVERAGE_ERROR_PATH(595); // Not hit
-        return MVM_E_INVALID_ARRAY_INDEX;
-      }
-      int16_t index = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyName));
-      if ((index < 0) || (index >= length)) {
-        CODE_COVERAGE_ERROR_PATH(612); // Not hit
-        return MVM_E_INVALID_ARRAY_INDEX;
-      }
+  if (algorithmA == EA_NOT_EQUAL) {
+    CODE_COVERAGE(562); // Hit
+    return false; // E.g. comparing NaN
+  } else {
+    CODE_COVERAGE(563); // Hit
+  }
 
-      Value byteValue = MVM_GET_LOCAL(vPropertyValue);
-      if (!Value_isVirtualUInt8(byteValue)) {
-        // For performance reasons, Microvium does not automatically coerce
-        // values to bytes.
-        CODE_COVERAGE_ERROR_PATH(613); // Not hit
-        return MVM_E_CAN_ONLY_ASSIGN_BYTES_TO_UINT8_ARRAY;
-      }
+  if (a == b) {
+    CODE_COVERAGE(564); // Hit
+    return true;
+  } else {
+    CODE_COVERAGE(565); // Hit
+  }
 
-      p[index] = (uint8_t)VirtualInt14_decode(vm, byteValue);
-      return MVM_E_SUCCESS;
+  switch (algorithmA) {
+    case EA_COMPARE_REFERENCE: {
+      // Reference equality comparison assumes that two values with different
+      // locations in memory must be different values, since their identity is
+      // their address. Since we've already checked `a == b`, this must be false.
+      return false;
+    }
+    case EA_COMPARE_NON_PTR_TYPE: {
+      // Non-pointer types are those like Int14 and the well-known values
+      // (except NaN). These can just be compared with `a == b`, which we've
+      // already done.
+      return false;
     }
 
-    case TC_REF_PROPERTY_LIST: {
-      CODE_COVERAGE(366); // Hit
-      if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_PROTO) {
-        CODE_COVERAGE_UNIMPLEMENTED(327); // Not hit
-        VM_NOT_IMPLEMENTED(vm);
-        return MVM_E_FATAL_ERROR_MUST_KILL_VM;
+    case EA_COMPARE_STRING: {
+      // Strings are a pain to compare because there are edge cases like the
+      // fact that the string "length" _may_ be represented by
+      // VM_VALUE_STR_LENGTH rather than a pointer to a string (or it may be a
+      // TC_REF_STRING). To keep the code concise, I'm fetching a pointer to the
+      // string data itself and then comparing that. This is the only equality
+      // algorithm that doesn't check the type. It makes use of the check for
+      // `algorithmA != algorithmB` from earlier and the fact that only strings
+      // compare with this algorithm, which means we won't get to this point
+      // unless both `a` and `b` are strings.
+      if (a == b) {
+        CODE_COVERAGE_UNTESTED(566); // Not hit
+        return true;
       } else {
-        CODE_COVERAGE(541); // Hit
+        CODE_COVERAGE(567); // Hit
       }
 
-      // Note: while objects in general can be in ROM, objects which are
-      // writable must always be in RAM.
-
-      MVM_LOCAL(TsPropertyList*, pPropertyList, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue)));
-
-      while (true) {
-        CODE_COVERAGE(367); // Hit
-        uint16_t headerWord = readAllocationHeaderWord(MVM_GET_LOCAL(pPropertyList));
-        uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-        uint16_t propCount = (size - sizeof (TsPropertyList)) / 4;
+      // Either string may be a rope, so they're compared a segment at a time
+      // (the common case of two flat strings is a single segment).
+      uint16_t size = vm_stringSizeUtf8(vm, a);
+      bool result = size == vm_stringSizeUtf8(vm, b);
+      uint16_t offset = 0;
+      while (result && (offset < size)) {
+        uint16_t segmentSizeA;
+        uint16_t segmentSizeB;
+        LongPtr lpStrA = vm_stringSegment(vm, a, offset, &segmentSizeA);
+        LongPtr lpStrB = vm_stringSegment(vm, b, offset, &segmentSizeB);
+        uint16_t n = segmentSizeA < segmentSizeB ? segmentSizeA : segmentSizeB;
+        result = memcmp_long(lpStrA, lpStrB, n) == 0;
+        offset += n;
+      }
+      TABLE_COVERAGE(result ? 1 : 0, 2, 568); // Hit 2/2
+      return result;
+    }
 
-        uint16_t* p = (uint16_t*)(MVM_GET_LOCAL(pPropertyList) + 1);
-        while (propCount--) {
-          Value key = *p++;
+    /*
+    Compares two values that are both pointer values that point to non-reference
+    types (e.g. int32). These will be equal if the value pointed to has the same
+    type, the same size, and the raw data pointed to is the same.
+    */
+    case EA_COMPARE_PTR_VALUE_AND_TYPE: {
+      CODE_COVERAGE_UNTESTED(475); // Not hit
 
-          // We can do direct comparison because the strings have been interned,
-          // and numbers are represented in a normalized way.
-          if (key == MVM_GET_LOCAL(vPropertyName)) {
-            CODE_COVERAGE(368); // Hit
-            *p = MVM_GET_LOCAL(vPropertyValue);
-            return MVM_E_SUCCESS;
-          } else {
-            // Skip to next property
-            p++;
-            CODE_COVERAGE(369); // Hit
-          }
+      if (a == b) {
+        CODE_COVERAGE_UNTESTED(569); // Not hit
+        return true;
+      } else {
+        CODE_COVERAGE_UNTESTED(570); // Not hit
+      }
+      if (aType != bType) {
+        CODE_COVERAGE_UNTESTED(571); // Not hit
+        return false;
+      } else {
+        CODE_COVERAGE_UNTESTED(572); // Not hit
         }
 
-        DynamicPtr dpNext = MVM_GET_LOCAL(pPropertyList)->dpNext;
-        // Move to next group, if there is one
-        if (dpNext != VM_VALUE_NULL) {
-          CODE_COVERAGE(542); // Hit
-          MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, dpNext));
-        } else {
-          CODE_COVERAGE(543); // Hit
-          break;
-        }
+      LongPtr lpA = DynamicPtr_decode_long(vm, a);
+      LongPtr lpB = DynamicPtr_decode_long(vm, b);
+      uint16_t aHeaderWord = readAllocationHeaderWord_long(lpA);
+      uint16_t bHeaderWord = readAllocationHeaderWord_long(lpB);
+      // If the header words are different, the sizes or types are different
+      if (aHeaderWord != bHeaderWord) {
+        CODE_COVERAGE_UNTESTED(476); // Not hit
+        return false;
+      } else {
+        CODE_COVERAGE_UNTESTED(477); // Not hit
       }
-
-      // If we reach the end, then this is a new property. We add new properties
-      // by just appending a new TsPropertyList onto the linked list. The GC
-      // will compact these into the head later.
-
-      TsPropertyCell* pNewCell = GC_ALLOCATE_TYPE(vm, TsPropertyCell, TC_REF_PROPERTY_LIST);
-
-      // GC collection invalidates the following values so we need to refresh
-      // them from the stack slots.
-      MVM_SET_LOCAL(vPropertyName, pOperands[1]);
-      MVM_SET_LOCAL(vPropertyValue, pOperands[2]);
-      MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, pOperands[0]));
-
-      /*
-      Note: This is a bit of a pain. When we allocate the new cell, it may or
-      may not trigger a GC collection cycle. If it does, then the object may be
-      moved AND COMPACTED, so the linked list chain of properties is different
-      to before (or may not be different, if there was no GC cycle), so we need
-      to re-iterate the linked list to find the last node, where we append the
-      property.
-      */
-      while (true) {
-        DynamicPtr dpNext = MVM_GET_LOCAL(pPropertyList)->dpNext;
-        if (dpNext != VM_VALUE_NULL) {
-          MVM_SET_LOCAL(pPropertyList, DynamicPtr_decode_native(vm, dpNext));
-        } else {
-          break;
-        }
+      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(aHeaderWord);
+      if (memcmp_long(lpA, lpB, size) == 0) {
+        CODE_COVERAGE_UNTESTED(481); // Not hit
+        return true;
+      } else {
+        CODE_COVERAGE_UNTESTED(482); // Not hit
+        return false;
       }
+    }
 
-      ShortPtr spNewCell = ShortPtr_encode(vm, pNewCell);
-      pNewCell->base.dpNext = VM_VALUE_NULL;
-      pNewCell->base.dpProto = VM_VALUE_NULL; // Not used because this is a child cell, but still needs a value because the GC sees it.
-      pNewCell->key = MVM_GET_LOCAL(vPropertyName);
-      pNewCell->value = MVM_GET_LOCAL(vPropertyValue);
-
-      // Attach to linked list. This needs to be a long-pointer write because we
-      // don't know if the original property list was in data memory.
-      //
-      // Note: `pPropertyList` currently points to the last property list in
-      // the chain.
-      MVM_GET_LOCAL(pPropertyList)->dpNext = spNewCell;
-
-      return MVM_E_SUCCESS;
+    default: {
+      VM_ASSERT_UNREACHABLE(vm);
+      return false;
     }
-    case TC_REF_ARRAY: {
-      CODE_COVERAGE(370); // Hit
+  }
+}
 
-      // Note: while objects in general can be in ROM, objects which are
-      // writable must always be in RAM.
+bool mvm_isNaN(mvm_Value value) {
+  CODE_COVERAGE_UNTESTED(573); // Not hit
+  return value == VM_VALUE_NAN;
+}
 
-      MVM_LOCAL(TsArray*, arr, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue)));
-      VirtualInt14 viLength = MVM_GET_LOCAL(arr)->viLength;
-      VM_ASSERT(vm, Value_isVirtualInt14(viLength));
-      uint16_t oldLength = VirtualInt14_decode(vm, viLength);
-      MVM_LOCAL(DynamicPtr, dpData, MVM_GET_LOCAL(arr)->dpData);
-      MVM_LOCAL(uint16_t*, pData, NULL);
-      uint16_t oldCapacity = 0;
-      if (MVM_GET_LOCAL(dpData) != VM_VALUE_NULL) {
-        CODE_COVERAGE(544); // Hit
-        VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(dpData)));
-        MVM_SET_LOCAL(pData, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(dpData)));
-        uint16_t dataSize = vm_getAllocationSize(MVM_GET_LOCAL(pData));
-        oldCapacity = dataSize / 2;
-      } else {
-        CODE_COVERAGE(545); // Hit
-      }
+#if MVM_INCLUDE_SNAPSHOT_CAPABILITY
 
-      // If the property name is "length" then we'll be changing the length
-      if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_LENGTH) {
-        CODE_COVERAGE(282); // Hit
+// Called during snapshotting to convert native pointers to their position-independent form
+static void serializePtr(VM* vm, Value* pv) {
+  CODE_COVERAGE(576); // Hit
+  Value v = *pv;
+  if (!Value_isShortPtr(v)) {
+    CODE_COVERAGE(577); // Hit
+    return;
+  } else {
+    CODE_COVERAGE(578); // Hit
+  }
+  void* p = ShortPtr_decode(vm, v);
 
-        if (!Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyValue)))
-          MVM_FATAL_ERROR(vm, MVM_E_TYPE_ERROR);
-        uint16_t newLength = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyValue));
+  // Pointers are encoded as an offset in the heap
+  uint16_t offsetInHeap = pointerOffsetInHeap(vm, vm->pLastBucket, p);
 
-        if (newLength < oldLength) { // Making array smaller
-          CODE_COVERAGE(176); // Hit
-          // pData will not be null because oldLength must be more than 1 for it to get here
-          VM_ASSERT(vm, MVM_GET_LOCAL(pData));
-          // Wipe array items that aren't reachable
-          uint16_t count = oldLength - newLength;
-          uint16_t* p = &MVM_GET_LOCAL(pData)[newLength];
-          while (count--)
-            *p++ = VM_VALUE_DELETED;
+  // The lowest bit must be zero so that this is tagged as a "ShortPtr".
+  VM_ASSERT(vm, (offsetInHeap & 1) == 0);
 
-          MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
-          return MVM_E_SUCCESS;
-        } else if (newLength == oldLength) {
-          CODE_COVERAGE_UNTESTED(546); // Not hit
-          /* Do nothing */
-        } else if (newLength <= oldCapacity) { // Array is getting bigger, but still less than capacity
-          CODE_COVERAGE(287); // Hit
+  *pv = offsetInHeap;
+}
 
-          // We can just overwrite the length field. Note that the newly
-          // uncovered memory is already filled with VM_VALUE_DELETED
-          MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
-          return MVM_E_SUCCESS;
-        } else { // Make array bigger
-          CODE_COVERAGE(288); // Hit
-          // I'll assume that direct assignments to the length mean that people
-          // know exactly how big the array should be, so we don't add any
-          // extra capacity
-          uint16_t newCapacity = newLength;
-          growArray(vm, &pOperands[0], newLength, newCapacity);
-          return MVM_E_SUCCESS;
-        }
-      } else if (MVM_GET_LOCAL(vPropertyName) == VM_VALUE_STR_PROTO) { // Writing to the __proto__ property
-        CODE_COVERAGE_UNTESTED(289); // Not hit
-        // We could make this read/write in future
-        return vm_newError(vm, MVM_E_PROTO_IS_READONLY);
-      } else if (Value_isVirtualInt14(MVM_GET_LOCAL(vPropertyName))) { // Array index
-        CODE_COVERAGE(285); // Hit
-        int16_t index = VirtualInt14_decode(vm, MVM_GET_LOCAL(vPropertyName) );
-        if (index < 0) {
-          CODE_COVERAGE_ERROR_PATH(24); // Not hit
-          return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
-        }
+// The opposite of `loadPointers`
+static void serializePointers(VM* vm, mvm_TsBytecodeHeader* bc) {
+  CODE_COVERAGE(579); // Hit
+  // CAREFUL! This function mutates `bc`, not `vm`.
 
-        // Need to expand the array?
-        if ((uint16_t)index >= oldLength) {
-          CODE_COVERAGE(290); // Hit
-          uint16_t newLength = (uint16_t)index + 1;
-          if ((uint16_t)index < oldCapacity) {
-            CODE_COVERAGE(291); // Hit
-            // The length changes to include the value. The extra slots are
-            // already filled in with holes from the original allocation.
-            MVM_GET_LOCAL(arr)->viLength = VirtualInt14_encode(vm, newLength);
-          } else {
-            CODE_COVERAGE(292); // Hit
-            // We expand the capacity more aggressively here because this is the
-            // path used when we push into arrays or just assign values to an
-            // array in a loop.
-            uint16_t newCapacity = oldCapacity * 2;
-            if (newCapacity < 4) newCapacity = 4;
-            if (newCapacity < newLength) newCapacity = newLength;
-            growArray(vm, &pOperands[0], newLength, newCapacity);
-            MVM_SET_LOCAL(vPropertyValue, pOperands[2]); // Value could have changed due to GC collection
-            MVM_SET_LOCAL(vObjectValue, pOperands[0]); // Value could have changed due to GC collection
-            MVM_SET_LOCAL(arr, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(vObjectValue))); // Value could have changed due to GC collection
-          }
-        } // End of array expansion
+  uint16_t n;
+  uint16_t* p;
 
-        // By this point, the array should have expanded as necessary
-        MVM_SET_LOCAL(dpData, MVM_GET_LOCAL(arr)->dpData);
-        VM_ASSERT(vm, MVM_GET_LOCAL(dpData) != VM_VALUE_NULL);
-        VM_ASSERT(vm, Value_isShortPtr(MVM_GET_LOCAL(dpData)));
-        MVM_SET_LOCAL(pData, DynamicPtr_decode_native(vm, MVM_GET_LOCAL(dpData)));
-        VM_ASSERT(vm, !!MVM_GET_LOCAL(pData));
+  uint16_t heapOffset = bc->sectionOffsets[BCS_HEAP];
+  uint16_t heapSize = bc->bytecodeSize - heapOffset;
 
-        // Write the item to memory
-        MVM_GET_LOCAL(pData)[(uint16_t)index] = MVM_GET_LOCAL(vPropertyValue);
+  uint16_t* pGlobals = (uint16_t*)((uint8_t*)bc + bc->sectionOffsets[BCS_GLOBALS]);
+  uint16_t* heapMemory = (uint16_t*)((uint8_t*)bc + heapOffset);
 
-        return MVM_E_SUCCESS;
-      }
+  // Roots in global variables
+  uint16_t globalsSize = bc->sectionOffsets[BCS_GLOBALS + 1] - bc->sectionOffsets[BCS_GLOBALS];
+  p = pGlobals;
+  n = globalsSize / 2;
+  TABLE_COVERAGE(n ? 1 : 0, 2, 580); // Hit 1/2
+  while (n--) {
+    serializePtr(vm, p++);
+  }
 
-      // Else not a valid array index
-      CODE_COVERAGE_ERROR_PATH(140); // Not hit
-      return vm_newError(vm, MVM_E_INVALID_ARRAY_INDEX);
-    }
+  // Pointers in heap memory
+  p = heapMemory;
+  uint16_t* heapEnd = (uint16_t*)((uint8_t*)heapMemory + heapSize);
+  while (p < heapEnd) {
+    CODE_COVERAGE(581); // Hit
+    uint16_t header = *p++;
+    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
+    uint16_t words = (size + 1) / 2;
+    TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
 
-    case TC_REF_CLASS: {
-      CODE_COVERAGE(630); // Hit
-      lpClass = DynamicPtr_decode_long(vm, MVM_GET_LOCAL(vObjectValue));
-      // Delegate to the `staticProps` of the class
-      pOperands[0] = READ_FIELD_2(lpClass, TsClass, staticProps);
-      goto SUB_SET_PROPERTY;
+    if (tc < TC_REF_DIVIDER_CONTAINER_TYPES) { // Non-container types
+      CODE_COVERAGE(582); // Hit
+      p += words;
+      continue;
+    } else {
+      // Else, container types
+      CODE_COVERAGE(583); // Hit
     }
 
-    default: return vm_newError(vm, MVM_E_TYPE_ERROR);
+    while (words--) {
+      if (Value_isShortPtr(*p))
+        serializePtr(vm, p);
+      p++;
+    }
   }
 }
 
-/** Converts the argument to either an TC_VAL_INT14 or a TC_REF_INTERNED_STRING, or gives an error */
-static TeError toPropertyName(VM* vm, Value* value) {
-  CODE_COVERAGE(50); // Hit
+void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size) {
+  CODE_COVERAGE(503); // Hit
+  return vm_createSnapshot(vm, 0, out_size);
+}
 
-  // This function may trigger a GC cycle because it may add a cell to the string intern table
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+/**
+ * Implementation of mvm_createSnapshot, allowing space for `prefixSize` bytes
+ * before the bytecode image in the malloc'd result. `out_size` receives the
+ * size of the bytecode image (not including the prefix).
+ */
+static void* vm_createSnapshot(mvm_VM* vm, uint16_t prefixSize, size_t* out_size) {
+  gc_completeIncremental(vm);
+  if (out_size)
+    *out_size = 0;
 
-  // Property names in microvium are either integer indexes or non-integer interned strings
-  TeTypeCode type = deepTypeOf(vm, *value);
-  switch (type) {
-    // These are already valid property names
-    case TC_VAL_INT14: {
-      CODE_COVERAGE(279); // Hit
-      if (VirtualInt14_decode(vm, *value) < 0) {
-        CODE_COVERAGE_UNTESTED(280); // Not hit
-        return vm_newError(vm, MVM_E_RANGE_ERROR);
-      }
-      CODE_COVERAGE(281); // Hit
-      return MVM_E_SUCCESS;
-    }
-    case TC_REF_INTERNED_STRING: {
-      CODE_COVERAGE(373); // Hit
-      return MVM_E_SUCCESS;
-    }
+  uint16_t heapOffset = getSectionOffset(vm->lpBytecode, BCS_HEAP);
+  uint16_t heapSize = getHeapSize(vm);
 
-    case TC_REF_INT32: {
-      CODE_COVERAGE_ERROR_PATH(374); // Not hit
-      // 32-bit numbers are out of the range of supported array indexes
-      return vm_newError(vm, MVM_E_RANGE_ERROR);
-    }
+  // This assumes that the heap is the last section in the bytecode. Since the
+  // heap is the only part of the bytecode image that changes size, we can just
+  // calculate the new bytecode size as follows
+  VM_ASSERT(vm, BCS_HEAP == BCS_SECTION_COUNT - 1);
+  uint32_t bytecodeSize = (uint32_t)heapOffset + heapSize;
 
-    case TC_REF_STRING: {
-      CODE_COVERAGE(375); // Hit
+  if (bytecodeSize > 0xFFFF) {
+    CODE_COVERAGE_ERROR_PATH(584); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_SNAPSHOT_TOO_LARGE);
+  } else {
+    CODE_COVERAGE(585); // Hit
+  }
 
-      // Note: In Microvium at the moment, it's illegal to use an integer-valued
-      // string as a property name. If the string is in bytecode, it will only
-      // have the type TC_REF_STRING if it's a number and is illegal.
-      if (!Value_isShortPtr(*value)) {
-        return vm_newError(vm, MVM_E_TYPE_ERROR);
-      }
+  uint8_t* pResult = vm_malloc(vm, prefixSize + bytecodeSize);
+  if (!pResult) return NULL;
+  mvm_TsBytecodeHeader* pNewBytecode = (mvm_TsBytecodeHeader*)(pResult + prefixSize);
+
+  // The globals and heap are the last parts of the image because they're the
+  // only mutable sections
+  VM_ASSERT(vm, BCS_GLOBALS == BCS_SECTION_COUNT - 2);
+  uint16_t sizeOfConstantPart = getSectionOffset(vm->lpBytecode, BCS_GLOBALS);
+
+  // The first part of the snapshot doesn't change between executions (except
+  // some header fields, which we'll update later).
+  #if MVM_SUPERINSTRUCTIONS
+  // From the original image, since functions in the copy may have been fused
+  memcpy_long(pNewBytecode, vm->lpOriginalBytecode, sizeOfConstantPart);
+  #else
+  memcpy_long(pNewBytecode, vm->lpBytecode, sizeOfConstantPart);
+  #endif
 
-      if (vm_ramStringIsNonNegativeInteger(vm, *value)) {
-        CODE_COVERAGE_ERROR_PATH(378); // Not hit
-        return vm_newError(vm, MVM_E_TYPE_ERROR);
-      } else {
-        CODE_COVERAGE(379); // Hit
-      }
+  // Snapshot the globals memory
+  uint16_t sizeOfGlobals = getSectionSize(vm, BCS_GLOBALS);
+  memcpy((uint8_t*)pNewBytecode + pNewBytecode->sectionOffsets[BCS_GLOBALS], vm->globals, sizeOfGlobals);
 
-      // Strings need to be converted to interned strings in order to be valid
-      // property names. This is because properties are searched by reference
-      // equality.
-      toInternedString(vm, value);
-      return MVM_E_SUCCESS;
-    }
+  // Snapshot heap memory
 
-    case TC_VAL_STR_LENGTH: {
-      CODE_COVERAGE(272); // Hit
-      return MVM_E_SUCCESS;
-    }
+  TsBucket* pBucket = vm->pLastBucket;
+  // Start at the end of the heap and work backwards, because buckets are linked
+  // in reverse order. (Edit: actually, they're also linked forwards now, but I
+  // might retract that at some point so I'll leave this with the backwards
+  // iteration).
+  uint8_t* pHeapStart = (uint8_t*)pNewBytecode + pNewBytecode->sectionOffsets[BCS_HEAP];
+  uint8_t* pTarget = pHeapStart + heapSize;
+  uint16_t cursor = heapSize;
+  TABLE_COVERAGE(pBucket ? 1 : 0, 2, 586); // Hit 1/2
+  while (pBucket) {
+    CODE_COVERAGE(504); // Hit
+    uint16_t offsetStart = pBucket->offsetStart;
+    uint16_t bucketSize = cursor - offsetStart;
+    uint8_t* pBucketData = getBucketDataBegin(pBucket);
 
-    case TC_VAL_STR_PROTO: {
-      CODE_COVERAGE(273); // Hit
-      return MVM_E_SUCCESS;
-    }
-    default: {
-      CODE_COVERAGE_ERROR_PATH(380); // Not hit
-      return vm_newError(vm, MVM_E_TYPE_ERROR);
-    }
+    pTarget -= bucketSize;
+    memcpy(pTarget, pBucketData, bucketSize);
+
+    cursor = offsetStart;
+    pBucket = pBucket->prev;
   }
-}
 
-// Converts a TC_REF_STRING to a TC_REF_INTERNED_STRING
-// TODO: Test cases for this function
-static void toInternedString(VM* vm, Value* pValue) {
-  CODE_COVERAGE(51); // Hit
-  Value value = *pValue;
-  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_STRING);
+  // Update header fields
+  pNewBytecode->bytecodeSize = bytecodeSize;
 
-  // This function may trigger a GC cycle because it may add a cell to the intern table
-  VM_ASSERT(vm, !vm->stack || !vm->stack->reg.usingCachedRegisters);
+  // Convert pointers-to-RAM into their corresponding serialized form
+  serializePointers(vm, pNewBytecode);
 
-  // TC_REF_STRING values are always in GC memory. If they were in flash, they'd
-  // already be TC_REF_INTERNED_STRING.
-  char* pStr1 = DynamicPtr_decode_native(vm, value);
-  uint16_t str1Size = vm_getAllocationSize(pStr1);
+  uint16_t crcStartOffset = OFFSETOF(mvm_TsBytecodeHeader, crc) + sizeof pNewBytecode->crc;
+  uint16_t crcSize = bytecodeSize - crcStartOffset;
+  void* pCrcStart = (uint8_t*)pNewBytecode + crcStartOffset;
+  pNewBytecode->crc = MVM_CALC_CRC16_CCITT(pCrcStart, crcSize);
 
-  LongPtr lpStr1 = LongPtr_new(pStr1);
-  // Note: the sizes here include the null terminator
-  if ((str1Size == sizeof PROTO_STR) && (memcmp_long(lpStr1, LongPtr_new((void*)&PROTO_STR), sizeof PROTO_STR) == 0)) {
-    CODE_COVERAGE_UNTESTED(547); // Not hit
-    *pValue = VM_VALUE_STR_PROTO;
-  } else if ((str1Size == sizeof LENGTH_STR) && (memcmp_long(lpStr1, LongPtr_new((void*)&LENGTH_STR), sizeof LENGTH_STR) == 0)) {
-    CODE_COVERAGE(548); // Hit
-    *pValue = VM_VALUE_STR_LENGTH;
-  } else {
-    CODE_COVERAGE(549); // Hit
+  if (out_size) {
+    CODE_COVERAGE(587); // Hit
+    *out_size = bytecodeSize;
   }
+  return (void*)pResult;
+}
 
-  LongPtr lpBytecode = vm->lpBytecode;
+void* mvm_hibernate(mvm_VM* vm, uint32_t buildId, size_t* out_size) {
+  CODE_COVERAGE(721); // Hit
+  if (out_size)
+    *out_size = 0;
 
-  // We start by searching the string table for interned strings that are baked
-  // into the ROM. These are stored alphabetically, so we can perform a binary
-  // search.
+  uint16_t importCount = getSectionSize(vm, BCS_IMPORT_TABLE) / sizeof (vm_TsImportTableEntry);
+  uint16_t importsSize = importCount * sizeof (mvm_TfHostFunction);
+  uint16_t prefixSize = sizeof (mvm_TsHibernationHeader) + importsSize;
 
-  uint16_t stringTableOffset = getSectionOffset(vm->lpBytecode, BCS_STRING_TABLE);
-  uint16_t stringTableSize = getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_STRING_TABLE)) - stringTableOffset;
-  int strCount = stringTableSize / sizeof (Value);
+  size_t bytecodeSize;
+  uint8_t* pImage = vm_createSnapshot(vm, prefixSize, &bytecodeSize);
+  if (!pImage) return NULL;
 
-  int first = 0;
-  int last = strCount - 1;
+  mvm_TsHibernationHeader* pHeader = (mvm_TsHibernationHeader*)pImage;
+  uint8_t* pImports = pImage + sizeof (mvm_TsHibernationHeader);
+  memcpy(pImports, vm_getResolvedImports(vm), importsSize);
+  pHeader->magic = MVM_HIBERNATION_MAGIC;
+  pHeader->buildId = buildId;
+  pHeader->importCount = importCount;
+  pHeader->bytecodeSize = (uint16_t)bytecodeSize;
+  pHeader->crc = importsSize ? MVM_CALC_CRC16_CCITT(pImports, importsSize) : 0;
+  pHeader->bytecodeCrc = ((mvm_TsBytecodeHeader*)(pImage + prefixSize))->crc;
 
-  while (first <= last) {
-    CODE_COVERAGE(381); // Hit
-    int middle = (first + last) / 2;
-    uint16_t str2Offset = stringTableOffset + middle * 2;
-    Value vStr2 = LongPtr_read2_aligned(LongPtr_add(lpBytecode, str2Offset));
-    LongPtr lpStr2 = DynamicPtr_decode_long(vm, vStr2);
-    uint16_t header = readAllocationHeaderWord_long(lpStr2);
-    VM_ASSERT(vm, vm_getTypeCodeFromHeaderWord(header) == TC_REF_INTERNED_STRING);
-    uint16_t str2Size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-    int compareSize = str1Size < str2Size ? str1Size : str2Size;
-    int c = memcmp_long(lpStr1, lpStr2, compareSize);
+  if (out_size) {
+    CODE_COVERAGE(722); // Hit
+    *out_size = prefixSize + bytecodeSize;
+  }
+  return pImage;
+}
 
-    // If they compare equal for the range that they have in common, we check the length
-    if (c == 0) {
-      CODE_COVERAGE(382); // Hit
-      if (str1Size < str2Size) {
-        CODE_COVERAGE_UNTESTED(383); // Not hit
-        c = -1;
-      } else if (str1Size > str2Size) {
-        CODE_COVERAGE_UNTESTED(384); // Not hit
-        c = 1;
-      } else {
-        CODE_COVERAGE(385); // Hit
-        // Exact match
-        *pValue = vStr2;
-        return;
-      }
-    }
+TeError mvm_restoreHibernated(mvm_VM** result, MVM_LONG_PTR_TYPE lpImage, size_t imageSize, uint32_t buildId, void* context) {
+  CODE_COVERAGE(723); // Hit
+  *result = NULL;
 
-    // c is > 0 if the string we're searching for comes after the middle point
-    if (c > 0) {
-      CODE_COVERAGE(386); // Hit
-      first = middle + 1;
-    } else {
-      CODE_COVERAGE(387); // Hit
-      last = middle - 1;
-    }
+  if (imageSize < sizeof (mvm_TsHibernationHeader)) {
+    CODE_COVERAGE_ERROR_PATH(724); // Not hit
+    return MVM_E_INVALID_HIBERNATION_IMAGE;
   }
+  mvm_TsHibernationHeader header;
+  memcpy_long(&header, lpImage, sizeof header);
 
-  // At this point, we haven't found the interned string in the bytecode. We
-  // need to check in RAM. Now we're comparing an in-RAM string against other
-  // in-RAM strings. We're looking for an exact match, not performing a binary
-  // search with inequality comparison, since the linked list of interned
-  // strings in RAM is not sorted.
-  Value vInternedStrings = getBuiltin(vm, BIN_INTERNED_STRINGS);
-  Value spCell = vInternedStrings;
-  while (spCell != VM_VALUE_UNDEFINED) {
-    CODE_COVERAGE(388); // Hit
-    VM_ASSERT(vm, Value_isShortPtr(spCell));
-    TsInternedStringCell* pCell = ShortPtr_decode(vm, spCell);
-    Value vStr2 = pCell->str;
-    char* pStr2 = ShortPtr_decode(vm, vStr2);
-    uint16_t str2Header = readAllocationHeaderWord(pStr2);
-    uint16_t str2Size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(str2Header);
-
-    // The sizes have to match for the strings to be equal
-    if (str2Size == str1Size) {
-      CODE_COVERAGE(389); // Hit
-      // Note: we use memcmp instead of strcmp because strings are allowed to
-      // have embedded null terminators.
-      int c = memcmp(pStr1, pStr2, str1Size);
-      // Equal?
-      if (c == 0) {
-        CODE_COVERAGE(390); // Hit
-        *pValue = vStr2;
-        return;
-      } else {
-        CODE_COVERAGE(391); // Hit
-      }
-    } else {
-      CODE_COVERAGE(550); // Hit
-    }
-    spCell = pCell->spNext;
-    TABLE_COVERAGE(spCell ? 1 : 0, 2, 551); // Hit 1/2
+  // A different build may have a different set of host functions at
+  // different addresses, so the image must come from this exact build
+  uint16_t importsSize = header.importCount * sizeof (mvm_TfHostFunction);
+  if ((header.magic != MVM_HIBERNATION_MAGIC) ||
+    (header.buildId != buildId) ||
+    (header.bytecodeSize < sizeof (mvm_TsBytecodeHeader)) ||
+    (sizeof (mvm_TsHibernationHeader) + importsSize + header.bytecodeSize > imageSize)
+  ) {
+    CODE_COVERAGE_ERROR_PATH(725); // Not hit
+    return MVM_E_INVALID_HIBERNATION_IMAGE;
   }
 
-  CODE_COVERAGE(616); // Hit
+  LongPtr lpImports = LongPtr_add(lpImage, sizeof (mvm_TsHibernationHeader));
+  if (importsSize && !MVM_CHECK_CRC16_CCITT(lpImports, importsSize, header.crc)) {
+    CODE_COVERAGE_ERROR_PATH(726); // Not hit
+    return MVM_E_INVALID_HIBERNATION_IMAGE;
+  }
 
-  // If we get here, it means there was no matching interned string already
-  // existing in ROM or RAM. We upgrade the current string to a
-  // TC_REF_INTERNED_STRING, since we now know it doesn't conflict with any existing
-  // existing interned strings.
-  setHeaderWord(vm, pStr1, TC_REF_INTERNED_STRING, str1Size);
+  LongPtr lpBytecode = LongPtr_add(lpImports, importsSize);
 
-  // Add the string to the linked list of interned strings
-  TsInternedStringCell* pCell = GC_ALLOCATE_TYPE(vm, TsInternedStringCell, TC_REF_FIXED_LENGTH_ARRAY);
-  value = *pValue; // Invalidated by potential GC collection
-  // Push onto linked list2
-  pCell->spNext = vInternedStrings;
-  pCell->str = value;
-  setBuiltin(vm, BIN_INTERNED_STRINGS, ShortPtr_encode(vm, pCell));
-}
+  // The snapshot must be the one that was hibernated with this header. Its CRC
+  // is not recomputed (see vm_restore).
+  if (READ_FIELD_2(lpBytecode, mvm_TsBytecodeHeader, crc) != header.bytecodeCrc) {
+    CODE_COVERAGE_ERROR_PATH(902); // Not hit
+    return MVM_E_INVALID_HIBERNATION_IMAGE;
+  }
 
-static int memcmp_long(LongPtr p1, LongPtr p2, size_t size) {
-  CODE_COVERAGE(471); // Hit
-  return MVM_LONG_MEM_CMP(p1, p2, size);
-}
+  // The import count in the bytecode must match the saved table
+  uint16_t importTableSize = getSectionOffset(lpBytecode, (mvm_TeBytecodeSection)(BCS_IMPORT_TABLE + 1)) - getSectionOffset(lpBytecode, BCS_IMPORT_TABLE);
+  if (importTableSize / sizeof (vm_TsImportTableEntry) != header.importCount) {
+    CODE_COVERAGE_ERROR_PATH(727); // Not hit
+    return MVM_E_INVALID_HIBERNATION_IMAGE;
+  }
 
-static void memcpy_long(void* target, LongPtr source, size_t size) {
-  CODE_COVERAGE(9); // Hit
-  MVM_LONG_MEM_CPY(target, source, size);
+  return vm_restore(result, lpBytecode, header.bytecodeSize, context, NULL, lpImports);
 }
+#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
 
-/** Size of string excluding bonus null terminator */
-static uint16_t vm_stringSizeUtf8(VM* vm, Value value) {
-  CODE_COVERAGE(53); // Hit
-  TeTypeCode typeCode = deepTypeOf(vm, value);
-  switch (typeCode) {
-    case TC_REF_STRING:
-    case TC_REF_INTERNED_STRING: {
-      LongPtr lpStr = DynamicPtr_decode_long(vm, value);
-      uint16_t headerWord = readAllocationHeaderWord_long(lpStr);
-      // Less 1 because of the bonus null terminator
-      return vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord) - 1;
-    }
-    case TC_VAL_STR_PROTO: {
-      CODE_COVERAGE_UNTESTED(552); // Not hit
-      return sizeof PROTO_STR - 1;
-    }
-    case TC_VAL_STR_LENGTH: {
-      CODE_COVERAGE(608); // Hit
-      return sizeof LENGTH_STR - 1;
-    }
-    default:
-      VM_ASSERT_UNREACHABLE(vm);
-      return 0;
-  }
-}
+#if MVM_INCLUDE_DEBUG_CAPABILITY
 
-/**
- * Checks if a string contains only decimal digits (and is not empty). May only
- * be called on TC_REF_STRING and only those in GC memory.
- */
-static bool vm_ramStringIsNonNegativeInteger(VM* vm, Value str) {
-  CODE_COVERAGE(55); // Hit
-  VM_ASSERT(vm, deepTypeOf(vm, str) == TC_REF_STRING);
+void mvm_dbg_setBreakpoint(VM* vm, uint16_t bytecodeAddress) {
+  CODE_COVERAGE_UNTESTED(588); // Not hit
 
-  char* pStr = ShortPtr_decode(vm, str);
+  // These checks on the bytecode address are assertions rather than user faults
+  // because the address is probably not manually computed by a user, it's
+  // derived from some kind of debug symbol file. In a production environment,
+  // setting a breakpoint on an address that's never executed (e.g. because it's
+  // not executable) is not a VM failure.
+  VM_ASSERT(vm, bytecodeAddress >= getSectionOffset(vm->lpBytecode, BCS_ROM));
+  VM_ASSERT(vm, bytecodeAddress < getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_ROM)));
 
-  // Length excluding bonus null terminator
-  uint16_t len = vm_getAllocationSize(pStr) - 1;
-  char* p = pStr;
-  if (!len) {
-    CODE_COVERAGE_UNTESTED(554); // Not hit
-    return false;
-  } else {
-    CODE_COVERAGE(555); // Hit
-  }
-  while (len--) {
-    CODE_COVERAGE(398); // Hit
-    if (!isdigit(*p++)) {
-      CODE_COVERAGE(399); // Hit
-      return false;
+  mvm_dbg_removeBreakpoint(vm, bytecodeAddress);
+  TsBreakpoint* breakpoint = vm_malloc(vm, sizeof (TsBreakpoint));
+  if (!breakpoint) {
+    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+    return;
+  }
+  breakpoint->bytecodeAddress = bytecodeAddress;
+  // Add to linked-list
+  breakpoint->next = vm->pBreakpoints;
+  vm->pBreakpoints = breakpoint;
+}
+
+void mvm_dbg_removeBreakpoint(VM* vm, uint16_t bytecodeAddress) {
+  CODE_COVERAGE_UNTESTED(589); // Not hit
+
+  TsBreakpoint** ppBreakpoint = &vm->pBreakpoints;
+  TsBreakpoint* pBreakpoint = *ppBreakpoint;
+  while (pBreakpoint) {
+    if (pBreakpoint->bytecodeAddress == bytecodeAddress) {
+      CODE_COVERAGE_UNTESTED(590); // Not hit
+      // Remove from linked list
+      *ppBreakpoint = pBreakpoint->next;
+      vm_free(vm, pBreakpoint);
+      pBreakpoint = *ppBreakpoint;
     } else {
-      CODE_COVERAGE_UNTESTED(400); // Not hit
+      CODE_COVERAGE_UNTESTED(591); // Not hit
+      ppBreakpoint = &pBreakpoint->next;
+      pBreakpoint = *ppBreakpoint;
     }
   }
-  return true;
 }
 
-// Convert a string to an integer
-TeError strToInt32(mvm_VM* vm, mvm_Value value, int32_t* out_result) {
-  CODE_COVERAGE(404); // Hit
-
-  TeTypeCode type = deepTypeOf(vm, value);
-  VM_ASSERT(vm, type == TC_REF_STRING || type == TC_REF_INTERNED_STRING);
+void mvm_dbg_setBreakpointCallback(mvm_VM* vm, mvm_TfBreakpointCallback cb) {
+  CODE_COVERAGE_UNTESTED(592); // Not hit
+  // It doesn't strictly need to be null, but is probably a mistake if it's not.
+  VM_ASSERT(vm, vm->breakpointCallback == NULL);
+  vm->breakpointCallback = cb;
+}
 
-  bool isFloat = false;
+#endif // MVM_INCLUDE_DEBUG_CAPABILITY
 
-  // Note: this function is implemented to use long pointers to access ROM
-  // memory. This is because the string may be in ROM and we don't want to copy
-  // the string to RAM. Copying to RAM involves allocating the available memory,
-  // which requires that the VM register cache be in a flushed state, which they
-  // aren't necessarily at this point in the code.
+/**
+ * Test out the LONG_PTR macros provided in the port file. lpBytecode should
+ * point to actual bytecode, whereas pHeader should point to a local copy that's
+ * been validated.
+ */
+static TeError vm_validatePortFileMacros(MVM_LONG_PTR_TYPE lpBytecode, mvm_TsBytecodeHeader* pHeader, void* context) {
+  uint32_t x1 = 0x12345678;
+  uint32_t x2 = 0x12345678;
+  uint32_t x3 = 0x87654321;
+  uint32_t x4 = 0x99999999;
+  uint32_t* px1 = &x1;
+  uint32_t* px2 = &x2;
+  uint32_t* px3 = &x3;
+  uint32_t* px4 = &x4;
+  MVM_LONG_PTR_TYPE lpx1 = MVM_LONG_PTR_NEW(px1);
+  MVM_LONG_PTR_TYPE lpx2 = MVM_LONG_PTR_NEW(px2);
+  MVM_LONG_PTR_TYPE lpx3 = MVM_LONG_PTR_NEW(px3);
+  MVM_LONG_PTR_TYPE lpx4 = MVM_LONG_PTR_NEW(px4);
 
-  LongPtr start = DynamicPtr_decode_long(vm, value);
-  LongPtr s = start;
-  uint16_t size = vm_getAllocationSize_long(s);
-  uint16_t len = size - 1; // Excluding null terminator
+  if (!((MVM_LONG_PTR_TRUNCATE(lpx1)) == px1)) goto SUB_FAIL;
+  if (!((MVM_READ_LONG_PTR_1(lpx1)) == 0x78)) goto SUB_FAIL;
+  if (!((MVM_READ_LONG_PTR_2(lpx1)) == 0x5678)) goto SUB_FAIL;
+  if (!((MVM_READ_LONG_PTR_1((MVM_LONG_PTR_ADD(lpx1, 1)))) == 0x56)) goto SUB_FAIL;
+  if (!((MVM_LONG_PTR_SUB((MVM_LONG_PTR_ADD(lpx1, 3)), lpx1)) == 3)) goto SUB_FAIL;
+  if (!((MVM_LONG_PTR_SUB(lpx1, (MVM_LONG_PTR_ADD(lpx1, 3)))) == -3)) goto SUB_FAIL;
+  if (!((MVM_LONG_MEM_CMP(lpx1, lpx2, 4)) == 0)) goto SUB_FAIL;
+  if (!((MVM_LONG_MEM_CMP(lpx1, lpx3, 4)) > 0)) goto SUB_FAIL;
+  if (!((MVM_LONG_MEM_CMP(lpx1, lpx4, 4)) < 0)) goto SUB_FAIL;
 
-  // Skip leading whitespace
-  while (isspace(LongPtr_read1(s))) {
-    s = LongPtr_add(s, 1);
-  }
+  MVM_LONG_MEM_CPY(px4, lpx3, 4);
+  if (!(x4 == 0x87654321)) goto SUB_FAIL;
+  x4 = 0x99999999;
 
-  int sign = (LongPtr_read1(s) == '-') ? -1 : 1;
-  if (LongPtr_read1(s) == '+' || LongPtr_read1(s) == '-') {
-    s = LongPtr_add(s, 1);
-  }
+  // The above tests were testing the case of using a long pointer to point to
+  // local RAM. We need to also test that everything works when point to the
+  // actual bytecode. lpBytecode and pHeader should point to data of the same
+  // value but in different address spaces (ROM and RAM respectively).
 
-  // Find end of digits
-  int32_t n = 0;
-  while (isdigit(LongPtr_read1(s))) {
-    int32_t n2 = n * 10 + (LongPtr_read1(s) - '0');
-    s = LongPtr_add(s, 1);
-    // Overflow Int32
-    if (n2 < n) isFloat = true;
-    n = n2;
-  }
+  if (!((MVM_READ_LONG_PTR_1(lpBytecode)) == pHeader->bytecodeVersion)) goto SUB_FAIL;
+  if (!((MVM_READ_LONG_PTR_2(lpBytecode)) == *((uint16_t*)pHeader))) goto SUB_FAIL;
+  if (!((MVM_READ_LONG_PTR_1((MVM_LONG_PTR_ADD(lpBytecode, 2)))) == pHeader->requiredEngineVersion)) goto SUB_FAIL;
+  if (!((MVM_LONG_PTR_SUB((MVM_LONG_PTR_ADD(lpBytecode, 3)), lpBytecode)) == 3)) goto SUB_FAIL;
+  if (!((MVM_LONG_PTR_SUB(lpBytecode, (MVM_LONG_PTR_ADD(lpBytecode, 3)))) == -3)) goto SUB_FAIL;
+  if (!((MVM_LONG_MEM_CMP(lpBytecode, (MVM_LONG_PTR_NEW(pHeader)), 8)) == 0)) goto SUB_FAIL;
 
-  // Decimal point
-  if ((LongPtr_read1(s) == ',') || (LongPtr_read1(s) == '.')) {
-    CODE_COVERAGE(653); // Hit
-    isFloat = true;
-    s = LongPtr_add(s, 1);
-  }
+  if (MVM_NATIVE_POINTER_IS_16_BIT && (sizeof(void*) != 2)) return MVM_E_EXPECTED_POINTER_SIZE_TO_BE_16_BIT;
+  if ((!MVM_NATIVE_POINTER_IS_16_BIT) && (sizeof(void*) == 2)) return MVM_E_EXPECTED_POINTER_SIZE_NOT_TO_BE_16_BIT;
 
-  // Digits after decimal point
-  while (isdigit(LongPtr_read1(s))) s = LongPtr_add(s, 1);
+  #if MVM_USE_SINGLE_RAM_PAGE
+    void* ptr = MVM_CONTEXTUAL_MALLOC(2, context);
+    MVM_CONTEXTUAL_FREE(ptr, context);
+    if ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR > 0xffff) return MVM_E_MALLOC_NOT_WITHIN_RAM_PAGE;
+  #endif // MVM_USE_SINGLE_RAM_PAGE
 
-  // Skip trailing whitespace
-  while (isspace(LongPtr_read1(s))) s = LongPtr_add(s, 1);
+  return MVM_E_SUCCESS;
 
-  // Check if we reached the end of the string. If we haven't reached the end of
-  // the string then there is a non-digit character in the string.
-  if (LongPtr_sub(s, start) != len) {
-    CODE_COVERAGE(654); // Hit
-    return MVM_E_NAN;
-  }
+SUB_FAIL:
+  return MVM_E_PORT_FILE_MACRO_TEST_FAILURE;
+}
 
-  // This function cannot handle floating point numbers
-  if (isFloat) {
-    CODE_COVERAGE_UNTESTED(655); // Not hit
-    return MVM_E_FLOAT64;
-  }
+uint16_t mvm_getCurrentAddress(VM* vm) {
+  vm_TsStack* stack = vm->stack;
+  if (!stack) return 0; // Not currently running
+  LongPtr lpProgramCounter = stack->reg.lpProgramCounter;
+  LongPtr lpBytecode = vm->lpBytecode;
+  uint16_t address = (uint16_t)MVM_LONG_PTR_SUB(lpProgramCounter, lpBytecode);
+  return address;
+}
 
-  CODE_COVERAGE(656); // Hit
+// Clone a fixed length array or other container type
+static Value vm_cloneContainer(VM* vm, Value* pArr) {
+  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
 
-  *out_result = sign * n;
+  LongPtr* lpSource = DynamicPtr_decode_long(vm, *pArr);
+  uint16_t headerWord = readAllocationHeaderWord_long(lpSource);
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+  uint16_t* newArray = gc_allocateWithHeader(vm, size, vm_getTypeCodeFromHeaderWord(headerWord));
 
-  return MVM_E_SUCCESS;
-}
+  // May have moved during allocation
+  lpSource = DynamicPtr_decode_long(vm, *pArr);
 
-TeError toInt32Internal(mvm_VM* vm, mvm_Value value, int32_t* out_result) {
-  CODE_COVERAGE(56); // Hit
-  // TODO: when the type codes are more stable, we should convert these to a table.
-  *out_result = 0;
-  TeTypeCode type = deepTypeOf(vm, value);
-  MVM_SWITCH(type, TC_END - 1) {
-    MVM_CASE(TC_VAL_INT14):
-    MVM_CASE(TC_REF_INT32): {
-      CODE_COVERAGE(401); // Hit
-      *out_result = vm_readInt32(vm, type, value);
-      return MVM_E_SUCCESS;
-    }
-    MVM_CASE(TC_REF_FLOAT64): {
-      CODE_COVERAGE(402); // Hit
-      return MVM_E_FLOAT64;
-    }
-    MVM_CASE(TC_REF_STRING):
-    MVM_CASE(TC_REF_INTERNED_STRING): {
-      CODE_COVERAGE(403); // Hit
-      return strToInt32(vm, value, out_result);
-    }
-    MVM_CASE(TC_VAL_STR_LENGTH): {
-      CODE_COVERAGE(270); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_VAL_STR_PROTO): {
-      CODE_COVERAGE(271); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_PROPERTY_LIST): {
-      CODE_COVERAGE(405); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_ARRAY): {
-      CODE_COVERAGE_UNTESTED(406); // Not hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_FUNCTION): {
-      CODE_COVERAGE(408); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_HOST_FUNC): {
-      CODE_COVERAGE_UNTESTED(409); // Not hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_CLOSURE): {
-      CODE_COVERAGE_UNTESTED(410); // Not hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_UINT8_ARRAY): {
-      CODE_COVERAGE_UNTESTED(411); // Not hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_VIRTUAL): {
-      CODE_COVERAGE_UNTESTED(632); // Not hit
-      VM_RESERVED(vm);
-      return MVM_E_FATAL_ERROR_MUST_KILL_VM;
-    }
-    MVM_CASE(TC_REF_CLASS): {
-      CODE_COVERAGE(633); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_REF_SYMBOL): {
-      CODE_COVERAGE_UNTESTED(412); // Not hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_VAL_UNDEFINED): {
-      CODE_COVERAGE(413); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_VAL_NULL): {
-      CODE_COVERAGE(414); // Hit
-      break;
-    }
-    MVM_CASE(TC_VAL_TRUE): {
-      CODE_COVERAGE_UNTESTED(415); // Not hit
-      *out_result = 1; break;
-    }
-    MVM_CASE(TC_VAL_FALSE): {
-      CODE_COVERAGE_UNTESTED(416); // Not hit
-      break;
-    }
-    MVM_CASE(TC_VAL_NAN): {
-      CODE_COVERAGE(417); // Hit
-      return MVM_E_NAN;
-    }
-    MVM_CASE(TC_VAL_NEG_ZERO): {
-      CODE_COVERAGE(418); // Hit
-      return MVM_E_NEG_ZERO;
-    }
-    MVM_CASE(TC_VAL_DELETED): {
-      CODE_COVERAGE_UNTESTED(419); // Not hit
-      return MVM_E_NAN;
-    }
-    default:
-      VM_ASSERT_UNREACHABLE(vm);
+  uint16_t* pTarget = newArray;
+  while (size) {
+    *pTarget++ = LongPtr_read2_aligned(lpSource);
+    lpSource = LongPtr_add(lpSource, 2);
+    size -= 2;
   }
-  return MVM_E_SUCCESS;
-}
 
-int32_t mvm_toInt32(mvm_VM* vm, mvm_Value value) {
-  CODE_COVERAGE(57); // Hit
-  int32_t result;
-  TeError err = toInt32Internal(vm, value, &result);
-  if (err == MVM_E_SUCCESS) {
-    CODE_COVERAGE(420); // Hit
-    return result;
-  } else if (err == MVM_E_NAN) {
-    CODE_COVERAGE(421); // Hit
-    return 0;
-  } else if (err == MVM_E_NEG_ZERO) {
-    CODE_COVERAGE_UNTESTED(422); // Not hit
-    return 0;
-  } else {
-    CODE_COVERAGE_UNTESTED(423); // Not hit
+  return ShortPtr_encode(vm, newArray);
+}
+
+#if MVM_SAFE_MODE
+static Value vm_safePop(VM* vm, Value* pStackPointerAfterDecr) {
+  // This is only called in the run-loop, so the registers should be cached
+  VM_ASSERT(vm, vm->stack->reg.usingCachedRegisters);
+  if (pStackPointerAfterDecr < getBottomOfStack(vm->stack)) {
+    MVM_FATAL_ERROR(vm, MVM_E_ASSERTION_FAILED);
   }
+  return *pStackPointerAfterDecr;
+}
+#endif // MVM_SAFE_MODE
 
-  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_FLOAT64);
-  #if MVM_SUPPORT_FLOAT
-    return (int32_t)mvm_toFloat64(vm, value);
-  #else // !MVM_SUPPORT_FLOAT
-    // If things were compiled correctly, there shouldn't be any floats in the
-    // system at all
-    return 0;
+static inline void vm_checkValueAccess(VM* vm, uint8_t potentialCycleNumber) {
+  VM_ASSERT(vm, vm->gc_potentialCycleNumber == potentialCycleNumber);
+}
+
+static TeError vm_newError(VM* vm, TeError err) {
+  #if MVM_ALL_ERRORS_FATAL
+  MVM_FATAL_ERROR(vm, err);
   #endif
+  return err;
 }
 
-#if MVM_SUPPORT_FLOAT
-MVM_FLOAT64 mvm_toFloat64(mvm_VM* vm, mvm_Value value) {
-  CODE_COVERAGE(58); // Hit
-  int32_t result;
-  TeError err = toInt32Internal(vm, value, &result);
-  if (err == MVM_E_SUCCESS) {
-    CODE_COVERAGE(424); // Hit
-    return result;
-  } else if (err == MVM_E_NAN) {
-    CODE_COVERAGE(425); // Hit
-    return MVM_FLOAT64_NAN;
-  } else if (err == MVM_E_NEG_ZERO) {
-    CODE_COVERAGE(426); // Hit
-    return MVM_FLOAT_NEG_ZERO;
-  } else {
-    CODE_COVERAGE(427); // Hit
-  }
+static void* vm_malloc(VM* vm, size_t size) {
+  void* result = MVM_CONTEXTUAL_MALLOC(size, vm->context);
 
-  VM_ASSERT(vm, deepTypeOf(vm, value) == TC_REF_FLOAT64);
-  LongPtr lpFloat = DynamicPtr_decode_long(vm, value);
-  MVM_FLOAT64 f;
-  memcpy_long(&f, lpFloat, sizeof f);
-  return f;
+  #if MVM_SAFE_MODE && MVM_USE_SINGLE_RAM_PAGE
+    // See comment on MVM_RAM_PAGE_ADDR in microvium_port_example.h
+    VM_ASSERT(vm, (intptr_t)result - (intptr_t)MVM_RAM_PAGE_ADDR <= 0xFFFF);
+  #endif
+  return result;
 }
-#endif // MVM_SUPPORT_FLOAT
-
-// See implementation of mvm_equal for the meaning of each
-typedef enum TeEqualityAlgorithm {
-  EA_NONE,
-  EA_COMPARE_PTR_VALUE_AND_TYPE,
-  EA_COMPARE_NON_PTR_TYPE,
-  EA_COMPARE_REFERENCE,
-  EA_NOT_EQUAL,
-  EA_COMPARE_STRING,
-} TeEqualityAlgorithm;
 
-static const TeEqualityAlgorithm equalityAlgorithmByTypeCode[TC_END] = {
-  EA_NONE,                       // TC_REF_TOMBSTONE          = 0x0
-  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_INT32              = 0x1
-  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_FLOAT64            = 0x2
-  EA_COMPARE_STRING,             // TC_REF_STRING             = 0x3
-  EA_COMPARE_STRING,             // TC_REF_INTERNED_STRING    = 0x4
-  EA_COMPARE_REFERENCE,          // TC_REF_FUNCTION           = 0x5
-  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_HOST_FUNC          = 0x6
-  EA_COMPARE_PTR_VALUE_AND_TYPE, // TC_REF_BIG_INT            = 0x7
-  EA_COMPARE_REFERENCE,          // TC_REF_SYMBOL             = 0x8
-  EA_NONE,                       // TC_REF_CLASS              = 0x9
-  EA_NONE,                       // TC_REF_VIRTUAL            = 0xA
-  EA_NONE,                       // TC_REF_RESERVED_1         = 0xB
-  EA_COMPARE_REFERENCE,          // TC_REF_PROPERTY_LIST      = 0xC
-  EA_COMPARE_REFERENCE,          // TC_REF_ARRAY              = 0xD
-  EA_COMPARE_REFERENCE,          // TC_REF_FIXED_LENGTH_ARRAY = 0xE
-  EA_COMPARE_REFERENCE,          // TC_REF_CLOSURE            = 0xF
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_INT14              = 0x10
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_UNDEFINED          = 0x11
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_NULL               = 0x12
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_TRUE               = 0x13
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_FALSE              = 0x14
-  EA_NOT_EQUAL,                  // TC_VAL_NAN                = 0x15
-  EA_COMPARE_NON_PTR_TYPE,       // TC_VAL_NEG_ZERO           = 0x16
-  EA_NONE,                       // TC_VAL_DELETED            = 0x17
-  EA_COMPARE_STRING,             // TC_VAL_STR_LENGTH         = 0x18
-  EA_COMPARE_STRING,             // TC_VAL_STR_PROTO          = 0x19
-};
+// Note: mvm_free frees the VM, while vm_free is the counterpart to vm_malloc
+static void vm_free(VM* vm, void* ptr) {
+  // Capture the context before freeing the ptr, since the pointer could be the vm
+  void* context = vm->context;
+  (void)context; // Unused if the port ignores it
 
-bool mvm_equal(mvm_VM* vm, mvm_Value a, mvm_Value b) {
-  CODE_COVERAGE(462); // Hit
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+  #if MVM_SAFE_MODE && MVM_USE_SINGLE_RAM_PAGE
+    // See comment on MVM_RAM_PAGE_ADDR in microvium_port_example.h
+    VM_ASSERT(vm, !ptr || ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR <= 0xFFFF));
+  #endif
 
-  TeTypeCode aType = deepTypeOf(vm, a);
-  TeTypeCode bType = deepTypeOf(vm, b);
-  TeEqualityAlgorithm algorithmA = equalityAlgorithmByTypeCode[aType];
-  TeEqualityAlgorithm algorithmB = equalityAlgorithmByTypeCode[bType];
+  MVM_CONTEXTUAL_FREE(ptr, context);
+}
 
-  TABLE_COVERAGE(algorithmA, 6, 556); // Hit 4/6
-  TABLE_COVERAGE(algorithmB, 6, 557); // Hit 4/6
-  TABLE_COVERAGE(aType, TC_END, 558); // Hit 6/26
-  TABLE_COVERAGE(bType, TC_END, 559); // Hit 8/26
+static mvm_TeError vm_uint8ArrayNew(VM* vm, Value* slot) {
+  CODE_COVERAGE(344); // Hit
 
-  // If the values aren't even in the same class of comparison, they're not
-  // equal. In particular, strings will not be equal to non-strings.
-  if (algorithmA != algorithmB) {
-    CODE_COVERAGE(560); // Hit
-    return false;
-  } else {
-    CODE_COVERAGE(561); // Hit
+  uint16_t size = *slot;
+  if (!Value_isVirtualUInt12(size)) {
+    CODE_COVERAGE_ERROR_PATH(345); // Not hit
+    return MVM_E_INVALID_UINT8_ARRAY_LENGTH;
   }
+  size = VirtualInt14_decode(vm, size);
 
-  if (algorithmA == EA_NOT_EQUAL) {
-    CODE_COVERAGE(562); // Hit
-    return false; // E.g. comparing NaN
-  } else {
-    CODE_COVERAGE(563); // Hit
-  }
+  uint8_t* p = gc_allocateWithHeader(vm, size, TC_REF_UINT8_ARRAY);
+  *slot = ShortPtr_encode(vm, p);
+  memset(p, 0, size);
 
-  if (a == b) {
-    CODE_COVERAGE(564); // Hit
-    return true;
-  } else {
-    CODE_COVERAGE(565); // Hit
+  return MVM_E_SUCCESS;
+}
+
+mvm_Value mvm_uint8ArrayFromBytes(mvm_VM* vm, const uint8_t* data, size_t sizeBytes) {
+  CODE_COVERAGE(346); // Hit
+  if (sizeBytes >= (MAX_ALLOCATION_SIZE + 1)) {
+    MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
+    return VM_VALUE_UNDEFINED;
   }
+  // Note: gc_allocateWithHeader will also check the size
+  uint8_t* p = gc_allocateWithHeader(vm, (uint16_t)sizeBytes, TC_REF_UINT8_ARRAY);
+  Value result = ShortPtr_encode(vm, p);
+  memcpy(p, data, sizeBytes);
+  return result;
+}
 
-  switch (algorithmA) {
-    case EA_COMPARE_REFERENCE: {
-      // Reference equality comparison assumes that two values with different
-      // locations in memory must be different values, since their identity is
-      // their address. Since we've already checked `a == b`, this must be false.
-      return false;
-    }
-    case EA_COMPARE_NON_PTR_TYPE: {
-      // Non-pointer types are those like Int14 and the well-known values
-      // (except NaN). These can just be compared with `a == b`, which we've
-      // already done.
-      return false;
-    }
+mvm_TeError mvm_uint8ArrayToBytes(mvm_VM* vm, mvm_Value uint8ArrayValue, uint8_t** out_data, size_t* out_size) {
+  CODE_COVERAGE(348); // Hit
+  gc_completeIncremental(vm);
 
-    case EA_COMPARE_STRING: {
-      // Strings are a pain to compare because there are edge cases like the
-      // fact that the string "length" _may_ be represented by
-      // VM_VALUE_STR_LENGTH rather than a pointer to a string (or it may be a
-      // TC_REF_STRING). To keep the code concise, I'm fetching a pointer to the
-      // string data itself and then comparing that. This is the only equality
-      // algorithm that doesn't check the type. It makes use of the check for
-      // `algorithmA != algorithmB` from earlier and the fact that only strings
-      // compare with this algorithm, which means we won't get to this point
-      // unless both `a` and `b` are strings.
-      if (a == b) {
-        CODE_COVERAGE_UNTESTED(566); // Not hit
-        return true;
-      } else {
-        CODE_COVERAGE(567); // Hit
-      }
-      size_t sizeA;
-      size_t sizeB;
-      LongPtr lpStrA = vm_toStringUtf8_long(vm, a, &sizeA);
-      LongPtr lpStrB = vm_toStringUtf8_long(vm, b, &sizeB);
-      bool result = (sizeA == sizeB) && (memcmp_long(lpStrA, lpStrB, (uint16_t)sizeA) == 0);
-      TABLE_COVERAGE(result ? 1 : 0, 2, 568); // Hit 2/2
-      return result;
-    }
+  // Note: while it makes sense to allow Uint8Arrays in general to live in ROM,
+  // I think we can require that those that hit the FFI boundary are never
+  // optimized into ROM. For efficiency and because I imagine that it's a very
+  // limited use case to have constant data accessed through this API.
 
-    /*
-    Compares two values that are both pointer values that point to non-reference
-    types (e.g. int32). These will be equal if the value pointed to has the same
-    type, the same size, and the raw data pointed to is the same.
-    */
-    case EA_COMPARE_PTR_VALUE_AND_TYPE: {
-      CODE_COVERAGE_UNTESTED(475); // Not hit
+  if (!Value_isShortPtr(uint8ArrayValue)) {
+    CODE_COVERAGE_ERROR_PATH(574); // Not hit
+    return MVM_E_TYPE_ERROR;
+  }
 
-      if (a == b) {
-        CODE_COVERAGE_UNTESTED(569); // Not hit
-        return true;
-      } else {
-        CODE_COVERAGE_UNTESTED(570); // Not hit
-      }
-      if (aType != bType) {
-        CODE_COVERAGE_UNTESTED(571); // Not hit
-        return false;
-      } else {
-        CODE_COVERAGE_UNTESTED(572); // Not hit
-        }
+  void* p = ShortPtr_decode(vm, uint8ArrayValue);
+  uint16_t headerWord = readAllocationHeaderWord(p);
+  TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
+  if (typeCode != TC_REF_UINT8_ARRAY) {
+    CODE_COVERAGE_ERROR_PATH(575); // Not hit
+    return MVM_E_TYPE_ERROR;
+  }
 
-      LongPtr lpA = DynamicPtr_decode_long(vm, a);
-      LongPtr lpB = DynamicPtr_decode_long(vm, b);
-      uint16_t aHeaderWord = readAllocationHeaderWord_long(lpA);
-      uint16_t bHeaderWord = readAllocationHeaderWord_long(lpB);
-      // If the header words are different, the sizes or types are different
-      if (aHeaderWord != bHeaderWord) {
-        CODE_COVERAGE_UNTESTED(476); // Not hit
-        return false;
-      } else {
-        CODE_COVERAGE_UNTESTED(477); // Not hit
-      }
-      uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(aHeaderWord);
-      if (memcmp_long(lpA, lpB, size) == 0) {
-        CODE_COVERAGE_UNTESTED(481); // Not hit
-        return true;
-      } else {
-        CODE_COVERAGE_UNTESTED(482); // Not hit
-        return false;
-      }
-    }
+  *out_size = (size_t)vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+  *out_data = p;
+  return MVM_E_SUCCESS;
+}
 
-    default: {
-      VM_ASSERT_UNREACHABLE(vm);
-      return false;
+/**
+ * Finds the elements of a typed array, in the heap or (for an external array)
+ * in host memory. An external array whose memory is no longer in the table
+ * (e.g. in a VM restored from a snapshot) has no elements.
+ */
+static uint8_t* vm_typedArrayElements(VM* vm, Value typedArray, mvm_TeTypedArrayKind* out_kind, uint16_t* out_length) {
+  CODE_COVERAGE(820); // Hit
+  // Typed arrays are created by the host, so they're always in RAM
+  VM_ASSERT(vm, Value_isShortPtr(typedArray));
+  TsTypedArray* pTypedArray = ShortPtr_decode(vm, typedArray);
+  mvm_TeTypedArrayKind kind = (mvm_TeTypedArrayKind)VirtualInt14_decode(vm, pTypedArray->kind);
+  *out_kind = kind;
+
+  #if MVM_EXTERNAL_BUFFERS
+  if (Value_isVirtualInt14(pTypedArray->buffer)) {
+    CODE_COVERAGE(821); // Hit
+    uint16_t index = VirtualInt14_decode(vm, pTypedArray->buffer);
+    if ((index < vm->externalBufferCapacity) && (vm->pExternalBuffers[index].view == typedArray)) {
+      CODE_COVERAGE(822); // Hit
+      TsExternalBuffer* pExternal = &vm->pExternalBuffers[index];
+      *out_length = pExternal->length;
+      return pExternal->data;
+    } else {
+      CODE_COVERAGE_UNTESTED(823); // Not hit
+      *out_length = 0;
+      return NULL;
+    }
+  } else {
+    CODE_COVERAGE_UNTESTED(824); // Not hit
+  }
+  #endif // MVM_EXTERNAL_BUFFERS
+
+  uint8_t* pElements = ShortPtr_decode(vm, pTypedArray->buffer);
+  *out_length = vm_getAllocationSize(pElements) / typedArrayElementSize[kind];
+  return pElements;
+}
+
+// Reads an element of a typed array. Note: this can allocate a box for the
+// number.
+static Value vm_typedArrayRead(VM* vm, mvm_TeTypedArrayKind kind, const uint8_t* pElement) {
+  CODE_COVERAGE_UNTESTED(802); // Not hit
+  switch (kind) {
+    case MVM_TA_INT16: {
+      CODE_COVERAGE_UNTESTED(803); // Not hit
+      int16_t element;
+      memcpy(&element, pElement, sizeof element);
+      return mvm_newInt32(vm, element);
+    }
+    case MVM_TA_UINT16: {
+      CODE_COVERAGE_UNTESTED(804); // Not hit
+      uint16_t element;
+      memcpy(&element, pElement, sizeof element);
+      return mvm_newInt32(vm, element);
+    }
+    case MVM_TA_INT32: {
+      CODE_COVERAGE_UNTESTED(805); // Not hit
+      int32_t element;
+      memcpy(&element, pElement, sizeof element);
+      return mvm_newInt32(vm, element);
+    }
+    #if MVM_SUPPORT_FLOAT
+    case MVM_TA_FLOAT32: {
+      CODE_COVERAGE_UNTESTED(806); // Not hit
+      float element;
+      memcpy(&element, pElement, sizeof element);
+      return mvm_newNumber(vm, element);
     }
+    #endif // MVM_SUPPORT_FLOAT
+    case MVM_TA_UINT8: {
+      CODE_COVERAGE(825); // Hit
+      return VirtualInt14_encode(vm, *pElement);
+    }
+    default:
+      return VM_UNEXPECTED_INTERNAL_ERROR(vm);
   }
 }
 
-bool mvm_isNaN(mvm_Value value) {
-  CODE_COVERAGE_UNTESTED(573); // Not hit
-  return value == VM_VALUE_NAN;
+// Writes an element of a typed array. This doesn't allocate.
+static void vm_typedArrayWrite(VM* vm, mvm_TeTypedArrayKind kind, uint8_t* pElement, Value value) {
+  CODE_COVERAGE_UNTESTED(807); // Not hit
+  #if MVM_SUPPORT_FLOAT
+  if (kind == MVM_TA_FLOAT32) {
+    CODE_COVERAGE_UNTESTED(808); // Not hit
+    float element = (float)mvm_toFloat64(vm, value);
+    memcpy(pElement, &element, sizeof element);
+    return;
+  } else {
+    CODE_COVERAGE_UNTESTED(809); // Not hit
+  }
+  #endif // MVM_SUPPORT_FLOAT
+
+  // Integer arrays wrap around like they do in JavaScript (e.g. 40000 written
+  // to an Int16Array reads back as -25536)
+  int32_t element = Value_isVirtualInt14(value)
+    ? VirtualInt14_decode(vm, value)
+    : mvm_toInt32(vm, value);
+  if (typedArrayElementSize[kind] == 2) {
+    CODE_COVERAGE_UNTESTED(810); // Not hit
+    uint16_t element16 = (uint16_t)element;
+    memcpy(pElement, &element16, sizeof element16);
+  } else if (typedArrayElementSize[kind] == 4) {
+    CODE_COVERAGE_UNTESTED(811); // Not hit
+    memcpy(pElement, &element, sizeof element);
+  } else {
+    CODE_COVERAGE(826); // Hit
+    *pElement = (uint8_t)element;
+  }
 }
 
-#if MVM_INCLUDE_SNAPSHOT_CAPABILITY
+mvm_Value mvm_typedArrayFromElements(mvm_VM* vm, mvm_TeTypedArrayKind kind, const void* data, size_t length) {
+  CODE_COVERAGE_UNTESTED(812); // Not hit
+  if (((unsigned)kind >= MVM_TA_END) || !length) {
+    CODE_COVERAGE_ERROR_PATH(813); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_INVALID_ARGUMENTS);
+    return VM_VALUE_UNDEFINED;
+  }
+  #if !MVM_SUPPORT_FLOAT
+  if (kind == MVM_TA_FLOAT32) {
+    CODE_COVERAGE_ERROR_PATH(814); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_OPERATION_REQUIRES_FLOAT_SUPPORT);
+    return VM_VALUE_UNDEFINED;
+  }
+  #endif // !MVM_SUPPORT_FLOAT
+  if (length > MAX_ALLOCATION_SIZE / typedArrayElementSize[kind]) {
+    CODE_COVERAGE_ERROR_PATH(815); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
+    return VM_VALUE_UNDEFINED;
+  }
+  uint16_t sizeBytes = (uint16_t)length * typedArrayElementSize[kind];
 
-// Called during snapshotting to convert native pointers to their position-independent form
-static void serializePtr(VM* vm, Value* pv) {
-  CODE_COVERAGE(576); // Hit
-  Value v = *pv;
-  if (!Value_isShortPtr(v)) {
-    CODE_COVERAGE(577); // Hit
-    return;
+  uint8_t* pElements = gc_allocateWithHeader(vm, sizeBytes, TC_REF_UINT8_ARRAY);
+  if (data) {
+    CODE_COVERAGE_UNTESTED(816); // Not hit
+    memcpy(pElements, data, sizeBytes);
   } else {
-    CODE_COVERAGE(578); // Hit
+    CODE_COVERAGE_UNTESTED(817); // Not hit
+    memset(pElements, 0, sizeBytes);
   }
-  void* p = ShortPtr_decode(vm, v);
-
-  // Pointers are encoded as an offset in the heap
-  uint16_t offsetInHeap = pointerOffsetInHeap(vm, vm->pLastBucket, p);
 
-  // The lowest bit must be zero so that this is tagged as a "ShortPtr".
-  VM_ASSERT(vm, (offsetInHeap & 1) == 0);
+  // Note: this allocation can cause a GC collection which could cause the
+  // buffer to move in memory
+  mvm_Handle hBuffer;
+  mvm_initializeHandle(vm, &hBuffer);
+  mvm_handleSet(&hBuffer, ShortPtr_encode(vm, pElements));
+  TsTypedArray* pTypedArray = GC_ALLOCATE_TYPE(vm, TsTypedArray, TC_REF_TYPED_ARRAY);
+  pTypedArray->buffer = mvm_handleGet(&hBuffer);
+  pTypedArray->kind = VirtualInt14_encode(vm, kind);
+  mvm_releaseHandle(vm, &hBuffer);
 
-  *pv = offsetInHeap;
+  return ShortPtr_encode(vm, pTypedArray);
 }
 
-// The opposite of `loadPointers`
-static void serializePointers(VM* vm, mvm_TsBytecodeHeader* bc) {
-  CODE_COVERAGE(579); // Hit
-  // CAREFUL! This function mutates `bc`, not `vm`.
+mvm_TeError mvm_typedArrayToElements(mvm_VM* vm, mvm_Value typedArrayValue, mvm_TeTypedArrayKind* out_kind, void** out_data, size_t* out_length) {
+  CODE_COVERAGE_UNTESTED(818); // Not hit
+  gc_completeIncremental(vm);
 
-  uint16_t n;
-  uint16_t* p;
+  if (!Value_isShortPtr(typedArrayValue) || (deepTypeOf(vm, typedArrayValue) != TC_REF_TYPED_ARRAY)) {
+    CODE_COVERAGE_ERROR_PATH(819); // Not hit
+    return MVM_E_TYPE_ERROR;
+  }
 
-  uint16_t heapOffset = bc->sectionOffsets[BCS_HEAP];
-  uint16_t heapSize = bc->bytecodeSize - heapOffset;
+  uint16_t length;
+  *out_data = vm_typedArrayElements(vm, typedArrayValue, out_kind, &length);
+  *out_length = length;
+  return MVM_E_SUCCESS;
+}
 
-  uint16_t* pGlobals = (uint16_t*)((uint8_t*)bc + bc->sectionOffsets[BCS_GLOBALS]);
-  uint16_t* heapMemory = (uint16_t*)((uint8_t*)bc + heapOffset);
+#if MVM_EXTERNAL_BUFFERS
+mvm_Value mvm_typedArrayFromExternal(mvm_VM* vm, mvm_TeTypedArrayKind kind, void* data, size_t length, mvm_TfReleaseExternal release, void* context) {
+  CODE_COVERAGE(827); // Hit
+  gc_completeIncremental(vm);
 
-  // Roots in global variables
-  uint16_t globalsSize = bc->sectionOffsets[BCS_GLOBALS + 1] - bc->sectionOffsets[BCS_GLOBALS];
-  p = pGlobals;
-  n = globalsSize / 2;
-  TABLE_COVERAGE(n ? 1 : 0, 2, 580); // Hit 1/2
-  while (n--) {
-    serializePtr(vm, p++);
+  if (((unsigned)kind >= MVM_TA_END) || !data || !length || (length > VM_MAX_INT14)) {
+    CODE_COVERAGE_ERROR_PATH(828); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_INVALID_ARGUMENTS);
+    return VM_VALUE_UNDEFINED;
+  }
+  #if !MVM_SUPPORT_FLOAT
+  if (kind == MVM_TA_FLOAT32) {
+    CODE_COVERAGE_ERROR_PATH(829); // Not hit
+    MVM_FATAL_ERROR(vm, MVM_E_OPERATION_REQUIRES_FLOAT_SUPPORT);
+    return VM_VALUE_UNDEFINED;
   }
+  #endif // !MVM_SUPPORT_FLOAT
 
-  // Pointers in heap memory
-  p = heapMemory;
-  uint16_t* heapEnd = (uint16_t*)((uint8_t*)heapMemory + heapSize);
-  while (p < heapEnd) {
-    CODE_COVERAGE(581); // Hit
-    uint16_t header = *p++;
-    uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(header);
-    uint16_t words = (size + 1) / 2;
-    TeTypeCode tc = vm_getTypeCodeFromHeaderWord(header);
+  // The array is allocated first, since the allocation can cause a collection
+  // which releases entries in the table
+  TsTypedArray* pTypedArray = GC_ALLOCATE_TYPE(vm, TsTypedArray, TC_REF_TYPED_ARRAY);
+  Value result = ShortPtr_encode(vm, pTypedArray);
 
-    if (tc < TC_REF_DIVIDER_CONTAINER_TYPES) { // Non-container types
-      CODE_COVERAGE(582); // Hit
-      p += words;
-      continue;
-    } else {
-      // Else, container types
-      CODE_COVERAGE(583); // Hit
-    }
+  // Find a free entry in the table
+  uint16_t index = 0;
+  while ((index < vm->externalBufferCapacity) && (vm->pExternalBuffers[index].view != VM_VALUE_UNDEFINED)) {
+    index++;
+  }
 
-    while (words--) {
-      if (Value_isShortPtr(*p))
-        serializePtr(vm, p);
-      p++;
+  if (index == vm->externalBufferCapacity) {
+    CODE_COVERAGE(830); // Hit
+    // The table is full, so it's doubled in size
+    uint16_t newCapacity = vm->externalBufferCapacity ? vm->externalBufferCapacity * 2 : 4;
+    if (newCapacity > VM_MAX_INT14 + 1) {
+      newCapacity = VM_MAX_INT14 + 1;
+    }
+    if (index == newCapacity) {
+      CODE_COVERAGE_ERROR_PATH(831); // Not hit
+      MVM_FATAL_ERROR(vm, MVM_E_OUT_OF_MEMORY);
+      return VM_VALUE_UNDEFINED;
     }
+    TsExternalBuffer* pNewTable = vm_malloc(vm, newCapacity * sizeof (TsExternalBuffer));
+    if (!pNewTable) {
+      CODE_COVERAGE_ERROR_PATH(832); // Not hit
+      MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+      return VM_VALUE_UNDEFINED;
+    }
+    if (vm->pExternalBuffers) {
+      memcpy(pNewTable, vm->pExternalBuffers, vm->externalBufferCapacity * sizeof (TsExternalBuffer));
+      vm_free(vm, vm->pExternalBuffers);
+    }
+    uint16_t i;
+    for (i = vm->externalBufferCapacity; i < newCapacity; i++) {
+      pNewTable[i].view = VM_VALUE_UNDEFINED;
+    }
+    vm->pExternalBuffers = pNewTable;
+    vm->externalBufferCapacity = newCapacity;
+  } else {
+    CODE_COVERAGE(833); // Hit
   }
-}
 
-void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size) {
-  CODE_COVERAGE(503); // Hit
-  if (out_size)
-    *out_size = 0;
+  TsExternalBuffer* pExternal = &vm->pExternalBuffers[index];
+  pExternal->view = result;
+  pExternal->length = (uint16_t)length;
+  pExternal->data = data;
+  pExternal->release = release;
+  pExternal->context = context;
 
-  uint16_t heapOffset = getSectionOffset(vm->lpBytecode, BCS_HEAP);
-  uint16_t heapSize = getHeapSize(vm);
+  pTypedArray->buffer = VirtualInt14_encode(vm, index);
+  pTypedArray->kind = VirtualInt14_encode(vm, kind);
 
-  // This assumes that the heap is the last section in the bytecode. Since the
-  // heap is the only part of the bytecode image that changes size, we can just
-  // calculate the new bytecode size as follows
-  VM_ASSERT(vm, BCS_HEAP == BCS_SECTION_COUNT - 1);
-  uint32_t bytecodeSize = (uint32_t)heapOffset + heapSize;
+  return result;
+}
 
-  if (bytecodeSize > 0xFFFF) {
-    CODE_COVERAGE_ERROR_PATH(584); // Not hit
-    MVM_FATAL_ERROR(vm, MVM_E_SNAPSHOT_TOO_LARGE);
+// Calls the release callback of an entry in the external buffer table and frees
+// the entry
+static void vm_releaseExternalBuffer(TsExternalBuffer* pExternal) {
+  CODE_COVERAGE(834); // Hit
+  pExternal->view = VM_VALUE_UNDEFINED;
+  if (pExternal->release) {
+    CODE_COVERAGE(835); // Hit
+    pExternal->release(pExternal->data, pExternal->context);
   } else {
-    CODE_COVERAGE(585); // Hit
+    CODE_COVERAGE_UNTESTED(836); // Not hit
   }
+}
+#endif // MVM_EXTERNAL_BUFFERS
 
-  mvm_TsBytecodeHeader* pNewBytecode = vm_malloc(vm, bytecodeSize);
-  if (!pNewBytecode) return NULL;
+#ifdef MVM_GAS_COUNTER
+void mvm_stopAfterNInstructions(mvm_VM* vm, int32_t n) {
+  vm->stopAfterNInstructions = n;
+  vm->yieldOnInstructionCount = false;
+}
 
-  // The globals and heap are the last parts of the image because they're the
-  // only mutable sections
-  VM_ASSERT(vm, BCS_GLOBALS == BCS_SECTION_COUNT - 2);
-  uint16_t sizeOfConstantPart = getSectionOffset(vm->lpBytecode, BCS_GLOBALS);
+int32_t mvm_getInstructionCountRemaining(mvm_VM* vm) {
+  return vm->stopAfterNInstructions;
+}
 
-  // The first part of the snapshot doesn't change between executions (except
-  // some header fields, which we'll update later).
-  memcpy_long(pNewBytecode, vm->lpBytecode, sizeOfConstantPart);
+void mvm_yieldAfterNInstructions(mvm_VM* vm, int32_t n) {
+  vm->stopAfterNInstructions = n;
+  vm->yieldOnInstructionCount = true;
+}
+#endif // MVM_GAS_COUNTER
 
-  // Snapshot the globals memory
-  uint16_t sizeOfGlobals = getSectionSize(vm, BCS_GLOBALS);
-  memcpy((uint8_t*)pNewBytecode + pNewBytecode->sectionOffsets[BCS_GLOBALS], vm->globals, sizeOfGlobals);
+TeError mvm_resume(mvm_VM* vm, mvm_Value* out_result) {
+  CODE_COVERAGE_UNTESTED(848); // Not hit
+  if (!vm->suspended) {
+    CODE_COVERAGE_ERROR_PATH(849); // Not hit
+    return MVM_E_NOT_SUSPENDED;
+  }
+  if (vm->pendingHostCall) {
+    CODE_COVERAGE_ERROR_PATH(857); // Not hit
+    // Still waiting for mvm_completeHostCall
+    return MVM_E_HOST_PENDING;
+  }
+  vm->resuming = true;
+  return mvm_call(vm, VM_VALUE_UNDEFINED, out_result, NULL, 0);
+}
+
+TeError mvm_completeHostCall(mvm_VM* vm, mvm_Value result, mvm_Value* out_result) {
+  CODE_COVERAGE_UNTESTED(858); // Not hit
+  if (!vm->suspended || !vm->pendingHostCall) {
+    CODE_COVERAGE_ERROR_PATH(859); // Not hit
+    return MVM_E_NOT_SUSPENDED;
+  }
+  // The result slot of the host call
+  vm->stack->reg.pStackPointer[-1] = result;
+  vm->resuming = true;
+  return mvm_call(vm, VM_VALUE_UNDEFINED, out_result, NULL, 0);
+}
+
+bool mvm_isSuspended(mvm_VM* vm) {
+  return vm->suspended;
+}
+
+#if MVM_PROFILE
+
+#define PROFILE_NAME(slot, op) [slot + op] = #op
+
+static const char* const profileOpNames[PROFILE_SLOT_END] = {
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_LOAD_SMALL_LITERAL),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_LOAD_VAR_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_LOAD_SCOPED_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_LOAD_ARG_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_CALL_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_FIXED_ARRAY_NEW_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_EXTENDED_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_EXTENDED_2),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_EXTENDED_3),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_CALL_5),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_STORE_VAR_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_STORE_SCOPED_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_ARRAY_GET_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_ARRAY_SET_1),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_NUM_OP),
+  PROFILE_NAME(PROFILE_SLOT_OP, VM_OP_BIT_OP),
+
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_RETURN),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_THROW),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_CLOSURE_NEW),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_NEW),
+  #if MVM_SUPERINSTRUCTIONS
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_FUSED_LOAD_VAR_2),
+  #else
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_RESERVED_VIRTUAL_NEW),
+  #endif
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_SCOPE_NEW),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_TYPE_CODE_OF),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_POP),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_TYPEOF),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_OBJECT_NEW),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_LOGICAL_NOT),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_OBJECT_GET_1),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_ADD),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_EQUAL),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_NOT_EQUAL),
+  PROFILE_NAME(PROFILE_SLOT_OP1, VM_OP1_OBJECT_SET_1),
+
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_BRANCH_1),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_STORE_ARG),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_STORE_SCOPED_2),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_STORE_VAR_2),
+  #if MVM_SUPERINSTRUCTIONS
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_FUSED_STORE_LOAD_VAR),
+  #else
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_ARRAY_GET_2_RESERVED),
+  #endif
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_ARRAY_SET_2_RESERVED),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_JUMP_1),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_CALL_HOST),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_CALL_3),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_CALL_6),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_LOAD_SCOPED_2),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_LOAD_VAR_2),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_LOAD_ARG_2),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_EXTENDED_4),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_ARRAY_NEW),
+  PROFILE_NAME(PROFILE_SLOT_OP2, VM_OP2_FIXED_ARRAY_NEW_2),
+
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_POP_N),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_SCOPE_DISCARD),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_SCOPE_CLONE),
+  #if MVM_SUPERINSTRUCTIONS
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_FUSED_LOAD_VAR_NUM_OP),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_FUSED_LOAD_LITERAL_GET),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_FUSED_LOAD_ARG_GET),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_FUSED_LOAD_VAR_GET),
+  #else
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_AWAIT_RESERVED),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_AWAIT_CALL_RESERVED),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_ASYNC_RETURN_RESERVED),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_RESERVED_3),
+  #endif
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_JUMP_2),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_LOAD_LITERAL),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_LOAD_GLOBAL_3),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_LOAD_SCOPED_3),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_BRANCH_2),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_STORE_GLOBAL_3),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_STORE_SCOPED_3),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_OBJECT_GET_2),
+  PROFILE_NAME(PROFILE_SLOT_OP3, VM_OP3_OBJECT_SET_2),
+
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_START_TRY),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_END_TRY),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_OBJECT_KEYS),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_UINT8_ARRAY_NEW),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_CLASS_CREATE),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_TYPE_CODE_OF),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_LOAD_REG_CLOSURE),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_SCOPE_PUSH),
+  PROFILE_NAME(PROFILE_SLOT_OP4, VM_OP4_SCOPE_POP),
+
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_LESS_THAN),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_GREATER_THAN),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_LESS_EQUAL),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_GREATER_EQUAL),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_ADD_NUM),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_SUBTRACT),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_MULTIPLY),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_DIVIDE),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_DIVIDE_AND_TRUNC),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_REMAINDER),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_POWER),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_NEGATE),
+  PROFILE_NAME(PROFILE_SLOT_NUM, VM_NUM_OP_UNARY_PLUS),
+
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_SHR_ARITHMETIC),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_SHR_LOGICAL),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_SHL),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_OR),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_AND),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_XOR),
+  PROFILE_NAME(PROFILE_SLOT_BIT, VM_BIT_OP_NOT),
+};
 
-  // Snapshot heap memory
+/**
+ * Index of the last function in the table starting at or before the given
+ * bytecode address, or 0 if there isn't one.
+ */
+static uint8_t vm_profileFindFunction(vm_TsProfile* p, uint16_t address) {
+  uint8_t lo = 1;
+  uint8_t hi = p->functionCount;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (p->functionAddresses[mid] <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo - 1;
+}
 
-  TsBucket* pBucket = vm->pLastBucket;
-  // Start at the end of the heap and work backwards, because buckets are linked
-  // in reverse order. (Edit: actually, they're also linked forwards now, but I
-  // might retract that at some point so I'll leave this with the backwards
-  // iteration).
-  uint8_t* pHeapStart = (uint8_t*)pNewBytecode + pNewBytecode->sectionOffsets[BCS_HEAP];
-  uint8_t* pTarget = pHeapStart + heapSize;
-  uint16_t cursor = heapSize;
-  TABLE_COVERAGE(pBucket ? 1 : 0, 2, 586); // Hit 1/2
-  while (pBucket) {
-    CODE_COVERAGE(504); // Hit
-    uint16_t offsetStart = pBucket->offsetStart;
-    uint16_t bucketSize = cursor - offsetStart;
-    uint8_t* pBucketData = getBucketDataBegin(pBucket);
+static inline bool vm_profileInFunction(vm_TsProfile* p, uint8_t f, uint16_t address) {
+  return f && (address >= p->functionAddresses[f]) && (address < p->functionEnds[f]);
+}
 
-    pTarget -= bucketSize;
-    memcpy(pTarget, pBucketData, bucketSize);
+/**
+ * Charge the time since the last instruction started to that instruction and
+ * its function.
+ */
+static void vm_profileStop(VM* vm) {
+  vm_TsProfile* p = &vm->profile;
+  if (p->currentSlot != PROFILE_SLOT_NONE) {
+    uint32_t elapsed = PROFILE_CLOCK() - p->lastClock;
+    p->ops[p->currentSlot].cycles += elapsed;
+    p->functions[p->currentFunction].cycles += elapsed;
+    p->currentSlot = PROFILE_SLOT_NONE;
+  }
+}
 
-    cursor = offsetStart;
-    pBucket = pBucket->prev;
+static inline void vm_profileSuperinstruction(vm_TsProfile* p, uint8_t superinstruction) {
+  if (!superinstruction)
+    return;
+  uint8_t i = 0;
+  while (!(superinstruction & (1 << i)))
+    i++;
+  p->superinstructionCounts[i]++;
+}
+
+static void vm_profileInstruction(VM* vm, LongPtr lpProgramCounter) {
+  vm_TsProfile* p = &vm->profile;
+  vm_profileStop(vm);
+
+  uint8_t instruction = LongPtr_read1(lpProgramCounter);
+  uint8_t op = instruction >> 4;
+  uint8_t subOp = instruction & 0xF;
+  uint8_t slot;
+  switch (op) {
+    case VM_OP_EXTENDED_1: slot = PROFILE_SLOT_OP1 + subOp; break;
+    case VM_OP_EXTENDED_3: slot = PROFILE_SLOT_OP3 + subOp; break;
+    case VM_OP_EXTENDED_2:
+      slot = PROFILE_SLOT_OP2 + subOp;
+      if (subOp == VM_OP2_EXTENDED_4) {
+        uint8_t op4 = LongPtr_read1(LongPtr_add(lpProgramCounter, 1));
+        if (op4 < VM_OP4_END)
+          slot = PROFILE_SLOT_OP4 + op4;
+      }
+      break;
+    case VM_OP_NUM_OP:
+      slot = subOp < VM_NUM_OP_END ? PROFILE_SLOT_NUM + subOp : PROFILE_SLOT_OP + op;
+      break;
+    case VM_OP_BIT_OP:
+      slot = subOp < VM_BIT_OP_END ? PROFILE_SLOT_BIT + subOp : PROFILE_SLOT_OP + op;
+      break;
+    default: slot = PROFILE_SLOT_OP + op; break;
+  }
+  p->ops[slot].count++;
+
+  uint16_t address = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode);
+
+  // Count the candidate superinstructions that end with this instruction
+  if (address != p->nextAddress)
+    p->historyLength = 0;
+  if (p->historyLength >= 1)
+    vm_profileSuperinstruction(p, vm_superinstruction2(p->history[0], instruction));
+  if (p->historyLength >= 2)
+    vm_profileSuperinstruction(p, vm_superinstruction3(p->history[1], p->history[0], instruction));
+  p->history[1] = p->history[0];
+  p->history[0] = instruction;
+  if (p->historyLength < 2)
+    p->historyLength++;
+  uint8_t size = vm_instructionSize(lpProgramCounter);
+  p->nextAddress = size ? address + size : 0;
+
+  // Usually still in the same function as the last instruction
+  uint8_t f = p->currentFunction;
+  if (!vm_profileInFunction(p, f, address)) {
+    f = vm_profileFindFunction(p, address);
+    if (!vm_profileInFunction(p, f, address))
+      f = 0;
+  }
+
+  p->currentSlot = slot;
+  p->currentFunction = f;
+  p->lastClock = PROFILE_CLOCK();
+}
+
+static void vm_profileEnterFunction(VM* vm, uint16_t functionAddress) {
+  vm_TsProfile* p = &vm->profile;
+  uint8_t f = vm_profileFindFunction(p, functionAddress);
+  if (f && p->functionAddresses[f] == functionAddress) {
+    p->functions[f].count++;
+    return;
   }
 
-  // Update header fields
-  pNewBytecode->bytecodeSize = bytecodeSize;
+  if (p->functionCount > MVM_PROFILE_MAX_FUNCTIONS) {
+    CODE_COVERAGE_UNTESTED(728); // Not hit
+    // The table is full, so the function is counted under index 0
+    p->functions[0].count++;
+    return;
+  }
 
-  // Convert pointers-to-RAM into their corresponding serialized form
-  serializePointers(vm, pNewBytecode);
+  // Insert after `f` to keep the table sorted
+  f++;
+  uint8_t n = p->functionCount - f;
+  memmove(&p->functions[f + 1], &p->functions[f], n * sizeof p->functions[0]);
+  memmove(&p->functionAddresses[f + 1], &p->functionAddresses[f], n * sizeof p->functionAddresses[0]);
+  memmove(&p->functionEnds[f + 1], &p->functionEnds[f], n * sizeof p->functionEnds[0]);
+  uint16_t headerWord = LongPtr_read2_aligned(LongPtr_add(vm->lpBytecode, functionAddress - 2));
+  p->functions[f].count = 1;
+  p->functions[f].cycles = 0;
+  p->functionAddresses[f] = functionAddress;
+  p->functionEnds[f] = functionAddress + vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+  p->functionCount++;
+  if (p->currentFunction >= f)
+    p->currentFunction++;
+}
+
+void mvm_getProfile(mvm_VM* vm, mvm_TfProfileCallback callback, void* context) {
+  CODE_COVERAGE_UNTESTED(729); // Not hit
+  vm_TsProfile* p = &vm->profile;
+  mvm_TsProfileEntry entry;
+
+  for (uint8_t slot = 0; slot < PROFILE_SLOT_END; slot++) {
+    if (!p->ops[slot].count)
+      continue;
+    entry.name = profileOpNames[slot];
+    entry.functionAddress = 0;
+    entry.count = p->ops[slot].count;
+    entry.cycles = p->ops[slot].cycles;
+    callback(context, &entry);
+  }
 
-  uint16_t crcStartOffset = OFFSETOF(mvm_TsBytecodeHeader, crc) + sizeof pNewBytecode->crc;
-  uint16_t crcSize = bytecodeSize - crcStartOffset;
-  void* pCrcStart = (uint8_t*)pNewBytecode + crcStartOffset;
-  pNewBytecode->crc = MVM_CALC_CRC16_CCITT(pCrcStart, crcSize);
+  for (uint8_t f = 0; f < p->functionCount; f++) {
+    if (!p->functions[f].count && !p->functions[f].cycles)
+      continue;
+    entry.name = NULL;
+    entry.functionAddress = p->functionAddresses[f];
+    entry.count = p->functions[f].count;
+    entry.cycles = p->functions[f].cycles;
+    callback(context, &entry);
+  }
+}
 
-  if (out_size) {
-    CODE_COVERAGE(587); // Hit
-    *out_size = bytecodeSize;
+void mvm_resetProfile(mvm_VM* vm) {
+  vm_TsProfile* p = &vm->profile;
+  memset(p, 0, sizeof *p);
+  p->functionCount = 1;
+  p->currentSlot = PROFILE_SLOT_NONE;
+}
+
+uint8_t mvm_suggestSuperinstructions(mvm_VM* vm, uint8_t minPercent) {
+  CODE_COVERAGE_UNTESTED(745); // Not hit
+  // Number of instructions replaced by each superinstruction
+  static const uint8_t lengths[MVM_SUPERINSTRUCTION_COUNT] = { 3, 2, 3, 3, 2, 2 };
+  vm_TsProfile* p = &vm->profile;
+
+  uint64_t total = 0;
+  for (uint8_t slot = 0; slot < PROFILE_SLOT_END; slot++)
+    total += p->ops[slot].count;
+
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < MVM_SUPERINSTRUCTION_COUNT; i++) {
+    uint64_t count = p->superinstructionCounts[i];
+    if (count && (count * lengths[i] * 100 >= total * minPercent))
+      mask |= 1 << i;
   }
-  return (void*)pNewBytecode;
+  return mask;
 }
-#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
+#endif // MVM_PROFILE
 
-#if MVM_INCLUDE_DEBUG_CAPABILITY
+#if MVM_SAMPLING_PROFILER
+/**
+ * Records the call stack into the sample ring. This runs at an instruction
+ * boundary, so the frames are consistent: each frame boundary saved by
+ * PUSH_REGISTERS holds the caller's return address and activation flags, and
+ * the distance back to the caller's frame base.
+ */
+static void vm_takeSample(VM* vm, LongPtr lpProgramCounter, uint16_t* pFrameBase) {
+  vm->sampleRequested = false;
 
-void mvm_dbg_setBreakpoint(VM* vm, uint16_t bytecodeAddress) {
-  CODE_COVERAGE_UNTESTED(588); // Not hit
+  vm_TsSampleRing* ring = vm->pSamples;
+  if (!ring) {
+    CODE_COVERAGE_UNTESTED(731); // Not hit
+    return;
+  }
+  if (ring->count == MVM_SAMPLE_RING_SIZE) {
+    CODE_COVERAGE_UNTESTED(732); // Not hit
+    ring->dropped++;
+    return;
+  }
 
-  // These checks on the bytecode address are assertions rather than user faults
-  // because the address is probably not manually computed by a user, it's
-  // derived from some kind of debug symbol file. In a production environment,
-  // setting a breakpoint on an address that's never executed (e.g. because it's
-  // not executable) is not a VM failure.
-  VM_ASSERT(vm, bytecodeAddress >= getSectionOffset(vm->lpBytecode, BCS_ROM));
-  VM_ASSERT(vm, bytecodeAddress < getSectionOffset(vm->lpBytecode, vm_sectionAfter(vm, BCS_ROM)));
+  vm_TsSample* sample = &ring->samples[(ring->head + ring->count) % MVM_SAMPLE_RING_SIZE];
+  ring->count++;
 
-  mvm_dbg_removeBreakpoint(vm, bytecodeAddress);
-  TsBreakpoint* breakpoint = vm_malloc(vm, sizeof (TsBreakpoint));
-  if (!breakpoint) {
-    MVM_FATAL_ERROR(vm, MVM_E_MALLOC_FAIL);
+  uint8_t depth = 0;
+  sample->truncated = false;
+  sample->addresses[depth++] = (uint16_t)LongPtr_sub(lpProgramCounter, vm->lpBytecode);
+  uint16_t argCountAndFlags = vm->stack->reg.argCountAndFlags;
+  while (!(argCountAndFlags & AF_CALLED_FROM_HOST)) {
+    if (depth == MVM_SAMPLE_MAX_DEPTH) {
+      sample->truncated = true;
+      break;
+    }
+    sample->addresses[depth++] = pFrameBase[-1];
+    argCountAndFlags = pFrameBase[-2];
+    pFrameBase = (uint16_t*)((uint8_t*)(pFrameBase - VM_FRAME_BOUNDARY_SAVE_SIZE_WORDS) - pFrameBase[-4]);
+  }
+  sample->depth = depth;
+}
+
+TeError mvm_startSampling(VM* vm) {
+  CODE_COVERAGE_UNTESTED(733); // Not hit
+  if (vm->pSamples)
+    return MVM_E_SUCCESS;
+  vm_TsSampleRing* ring = vm_malloc(vm, sizeof *ring);
+  if (!ring) {
+    CODE_COVERAGE_ERROR_PATH(734); // Not hit
+    return MVM_E_MALLOC_FAIL;
+  }
+  memset(ring, 0, sizeof *ring);
+  vm->pSamples = ring;
+  return MVM_E_SUCCESS;
+}
+
+void mvm_stopSampling(VM* vm) {
+  vm_free(vm, vm->pSamples);
+  vm->pSamples = NULL;
+}
+
+void mvm_requestSample(VM* vm) {
+  vm->sampleRequested = true;
+}
+
+uint32_t mvm_drainFoldedStacks(VM* vm, mvm_TfFoldedStackCallback callback, void* context) {
+  CODE_COVERAGE_UNTESTED(735); // Not hit
+  vm_TsSampleRing* ring = vm->pSamples;
+  if (!ring)
+    return 0;
+
+  // "[truncated];" + "0x1234;" per frame + " 1"
+  char line[13 + MVM_SAMPLE_MAX_DEPTH * 7 + 2];
+  while (ring->count) {
+    vm_TsSample* sample = &ring->samples[ring->head];
+    char* p = line;
+    if (sample->truncated) {
+      memcpy(p, "[truncated];", 12);
+      p += 12;
+    }
+    // Folded stacks are written outermost frame first
+    for (int i = sample->depth - 1; i >= 0; i--) {
+      static const char hex[] = "0123456789abcdef";
+      uint16_t address = sample->addresses[i];
+      *p++ = '0';
+      *p++ = 'x';
+      *p++ = hex[(address >> 12) & 0xF];
+      *p++ = hex[(address >> 8) & 0xF];
+      *p++ = hex[(address >> 4) & 0xF];
+      *p++ = hex[address & 0xF];
+      *p++ = i ? ';' : ' ';
+    }
+    *p++ = '1';
+    *p = '\0';
+    callback(context, line);
+
+    ring->head = (ring->head + 1) % MVM_SAMPLE_RING_SIZE;
+    ring->count--;
+  }
+
+  uint32_t dropped = ring->dropped;
+  ring->dropped = 0;
+  return dropped;
+}
+#endif // MVM_SAMPLING_PROFILER
+
+#if MVM_HEAP_PROFILE
+static const char* const heapProfileTypeNames[16] = {
+  "TC_REF_TOMBSTONE",
+  "TC_REF_INT32",
+  "TC_REF_FLOAT64",
+  "TC_REF_STRING",
+  "TC_REF_INTERNED_STRING",
+  "TC_REF_FUNCTION",
+  "TC_REF_HOST_FUNC",
+  "TC_REF_UINT8_ARRAY",
+  "TC_REF_SYMBOL",
+  "TC_REF_CLASS",
+  "TC_REF_TYPED_ARRAY",
+  "TC_REF_ROPE",
+  "TC_REF_PROPERTY_LIST",
+  "TC_REF_ARRAY",
+  "TC_REF_FIXED_LENGTH_ARRAY",
+  "TC_REF_CLOSURE",
+};
+
+// Site of an allocation made at `address`, adding it to the table if there's
+// room, or site 0 otherwise
+static uint8_t vm_heapProfileSite(vm_TsHeapProfile* profile, uint16_t address, uint8_t typeCode) {
+  vm_TsHeapProfileSite* site = &profile->sites[profile->lastSite];
+  if ((site->address == address) && (site->typeCode == typeCode) && profile->lastSite) {
+    return profile->lastSite;
+  }
+  uint8_t i;
+  for (i = 1; i < profile->siteCount; i++) {
+    site = &profile->sites[i];
+    if ((site->address == address) && (site->typeCode == typeCode)) {
+      profile->lastSite = i;
+      return i;
+    }
+  }
+  if (profile->siteCount == MVM_HEAP_PROFILE_MAX_SITES + 1) {
+    return 0;
+  }
+  site = &profile->sites[i];
+  site->address = address;
+  site->typeCode = typeCode;
+  profile->siteCount++;
+  profile->lastSite = i;
+  return i;
+}
+
+// `p` points to the body of the new allocation (after its header) in the last
+// bucket
+static void vm_heapProfileAllocation(VM* vm, TsBucket* pBucket, uint16_t* p, uint16_t header) {
+  vm_TsHeapProfile* profile = vm->pHeapProfile;
+  uint16_t offset = pBucket->offsetStart + (uint16_t)((intptr_t)p - (intptr_t)getBucketDataBegin(pBucket));
+  uint16_t size = (vm_getAllocationSizeExcludingHeaderFromHeaderWord(header) + 3) & 0xFFFE;
+  uint8_t index = vm_heapProfileSite(profile, mvm_getCurrentAddress(vm), vm_getTypeCodeFromHeaderWord(header));
+  vm_TsHeapProfileSite* site = &profile->sites[index];
+  profile->tags[offset >> 1] = index;
+  site->allocationCount++;
+  site->allocatedBytes += size;
+  site->youngCount++;
+  site->youngBytes += size;
+}
+
+// The allocation was given back without a collection (see vm_recycleNumberBox)
+static void vm_heapProfileFree(VM* vm, ShortPtr sp, uint16_t sizeIncludingHeader) {
+  vm_TsHeapProfileSite* site = &vm->pHeapProfile->sites[vm->pHeapProfile->tags[sp >> 1]];
+  if (site->youngCount) {
+    site->youngCount--;
+    site->youngBytes -= sizeIncludingHeader;
+    site->reclaimedBytes += sizeIncludingHeader;
+  }
+}
+
+// `nurseryStart` is the start of the nursery for a minor collection, or 0 for
+// a major collection. Only the allocations after it will move.
+static void vm_heapProfileBeginCollection(VM* vm, uint16_t nurseryStart) {
+  vm_TsHeapProfile* profile = vm->pHeapProfile;
+  if (!profile) {
     return;
   }
-  breakpoint->bytecodeAddress = bytecodeAddress;
-  // Add to linked-list
-  breakpoint->next = vm->pBreakpoints;
-  vm->pBreakpoints = breakpoint;
+  memcpy(profile->toTags, profile->tags, nurseryStart >> 1);
+  memset(profile->toTags + (nurseryStart >> 1), 0, (MVM_MAX_HEAP_SIZE - nurseryStart) >> 1);
+  uint8_t i;
+  for (i = 0; i < profile->siteCount; i++) {
+    profile->sites[i].movedCount = 0;
+    profile->sites[i].movedBytes = 0;
+  }
 }
 
-void mvm_dbg_removeBreakpoint(VM* vm, uint16_t bytecodeAddress) {
-  CODE_COVERAGE_UNTESTED(589); // Not hit
+static inline void vm_heapProfileMove(VM* vm, ShortPtr spOld, ShortPtr spNew, uint16_t sizeIncludingHeader) {
+  vm_TsHeapProfile* profile = vm->pHeapProfile;
+  uint8_t index = profile->tags[spOld >> 1];
+  profile->toTags[spNew >> 1] = index;
+  profile->sites[index].movedCount++;
+  profile->sites[index].movedBytes += sizeIncludingHeader;
+}
 
-  TsBreakpoint** ppBreakpoint = &vm->pBreakpoints;
-  TsBreakpoint* pBreakpoint = *ppBreakpoint;
-  while (pBreakpoint) {
-    if (pBreakpoint->bytecodeAddress == bytecodeAddress) {
-      CODE_COVERAGE_UNTESTED(590); // Not hit
-      // Remove from linked list
-      *ppBreakpoint = pBreakpoint->next;
-      vm_free(vm, pBreakpoint);
-      pBreakpoint = *ppBreakpoint;
+/**
+ * The allocations that a collection moved survived it, and the rest of the
+ * ones it considered were reclaimed: the young ones for a minor collection,
+ * and all of them for a major collection.
+ *
+ * Note: a property list absorbs its extensions when it moves, so the bytes of
+ * the extensions survive under the site of the object rather than their own.
+ */
+static void vm_heapProfileEndCollection(VM* vm, bool minor) {
+  vm_TsHeapProfile* profile = vm->pHeapProfile;
+  if (!profile) {
+    return;
+  }
+  uint8_t* tags = profile->tags;
+  profile->tags = profile->toTags;
+  profile->toTags = tags;
+
+  uint8_t i;
+  for (i = 0; i < profile->siteCount; i++) {
+    vm_TsHeapProfileSite* site = &profile->sites[i];
+    uint32_t consideredBytes = site->youngBytes;
+    if (minor) {
+      site->liveCount += site->movedCount;
+      site->liveBytes += site->movedBytes;
     } else {
-      CODE_COVERAGE_UNTESTED(591); // Not hit
-      ppBreakpoint = &pBreakpoint->next;
-      pBreakpoint = *ppBreakpoint;
+      consideredBytes += site->liveBytes;
+      site->liveCount = site->movedCount;
+      site->liveBytes = site->movedBytes;
+    }
+    site->survivedBytes += site->movedBytes;
+    if (consideredBytes > site->movedBytes) {
+      site->reclaimedBytes += consideredBytes - site->movedBytes;
     }
+    site->youngCount = 0;
+    site->youngBytes = 0;
   }
 }
 
-void mvm_dbg_setBreakpointCallback(mvm_VM* vm, mvm_TfBreakpointCallback cb) {
-  CODE_COVERAGE_UNTESTED(592); // Not hit
-  // It doesn't strictly need to be null, but is probably a mistake if it's not.
-  VM_ASSERT(vm, vm->breakpointCallback == NULL);
-  vm->breakpointCallback = cb;
+TeError mvm_startHeapProfile(VM* vm) {
+  CODE_COVERAGE_UNTESTED(876); // Not hit
+  if (vm->pHeapProfile)
+    return MVM_E_SUCCESS;
+  gc_completeIncremental(vm);
+  vm_TsHeapProfile* profile = vm_malloc(vm, sizeof *profile);
+  if (!profile) {
+    CODE_COVERAGE_ERROR_PATH(877); // Not hit
+    return MVM_E_MALLOC_FAIL;
+  }
+  memset(profile, 0, sizeof *profile);
+  profile->tags = profile->tagSpace[0];
+  profile->toTags = profile->tagSpace[1];
+  profile->siteCount = 1;
+
+  // The allocations already in the heap are untracked (site 0). They were
+  // all young as far as the profiler knows.
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket) {
+    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
+    while (p != bucket->pEndOfUsedSpace) {
+      VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
+      uint16_t size = (vm_getAllocationSizeExcludingHeaderFromHeaderWord(*p) + 3) & 0xFFFE;
+      profile->sites[0].youngCount++;
+      profile->sites[0].youngBytes += size;
+      p = (uint16_t*)((intptr_t)p + size);
+    }
+    bucket = bucket->prev;
+  }
+
+  vm->pHeapProfile = profile;
+  return MVM_E_SUCCESS;
 }
 
-#endif // MVM_INCLUDE_DEBUG_CAPABILITY
+void mvm_stopHeapProfile(VM* vm) {
+  vm_free(vm, vm->pHeapProfile);
+  vm->pHeapProfile = NULL;
+}
+
+void mvm_getHeapProfile(VM* vm, mvm_TfHeapProfileCallback callback, void* context) {
+  CODE_COVERAGE_UNTESTED(878); // Not hit
+  vm_TsHeapProfile* profile = vm->pHeapProfile;
+  if (!profile)
+    return;
+  uint8_t i;
+  for (i = 0; i < profile->siteCount; i++) {
+    vm_TsHeapProfileSite* site = &profile->sites[i];
+    if (!site->allocationCount && !site->liveCount && !site->youngCount) {
+      continue;
+    }
+    mvm_TsHeapProfileSite entry;
+    entry.typeName = i ? heapProfileTypeNames[site->typeCode] : NULL;
+    entry.bytecodeAddress = site->address;
+    entry.allocationCount = site->allocationCount;
+    entry.allocatedBytes = site->allocatedBytes;
+    entry.liveCount = site->liveCount + site->youngCount;
+    entry.liveBytes = site->liveBytes + site->youngBytes;
+    entry.survivedBytes = site->survivedBytes;
+    entry.reclaimedBytes = site->reclaimedBytes;
+    callback(context, &entry);
+  }
+}
+#endif // MVM_HEAP_PROFILE
 
+#if MVM_HEAP_DUMP
 /**
- * Test out the LONG_PTR macros provided in the port file. lpBytecode should
- * point to actual bytecode, whereas pHeader should point to a local copy that's
- * been validated.
+ * Small buffer in front of the host's write callback, so that the dump isn't
+ * written a few bytes at a time. Values are written little-endian.
  */
-static TeError vm_validatePortFileMacros(MVM_LONG_PTR_TYPE lpBytecode, mvm_TsBytecodeHeader* pHeader, void* context) {
-  uint32_t x1 = 0x12345678;
-  uint32_t x2 = 0x12345678;
-  uint32_t x3 = 0x87654321;
-  uint32_t x4 = 0x99999999;
-  uint32_t* px1 = &x1;
-  uint32_t* px2 = &x2;
-  uint32_t* px3 = &x3;
-  uint32_t* px4 = &x4;
-  MVM_LONG_PTR_TYPE lpx1 = MVM_LONG_PTR_NEW(px1);
-  MVM_LONG_PTR_TYPE lpx2 = MVM_LONG_PTR_NEW(px2);
-  MVM_LONG_PTR_TYPE lpx3 = MVM_LONG_PTR_NEW(px3);
-  MVM_LONG_PTR_TYPE lpx4 = MVM_LONG_PTR_NEW(px4);
-
-  if (!((MVM_LONG_PTR_TRUNCATE(lpx1)) == px1)) goto SUB_FAIL;
-  if (!((MVM_READ_LONG_PTR_1(lpx1)) == 0x78)) goto SUB_FAIL;
-  if (!((MVM_READ_LONG_PTR_2(lpx1)) == 0x5678)) goto SUB_FAIL;
-  if (!((MVM_READ_LONG_PTR_1((MVM_LONG_PTR_ADD(lpx1, 1)))) == 0x56)) goto SUB_FAIL;
-  if (!((MVM_LONG_PTR_SUB((MVM_LONG_PTR_ADD(lpx1, 3)), lpx1)) == 3)) goto SUB_FAIL;
-  if (!((MVM_LONG_PTR_SUB(lpx1, (MVM_LONG_PTR_ADD(lpx1, 3)))) == -3)) goto SUB_FAIL;
-  if (!((MVM_LONG_MEM_CMP(lpx1, lpx2, 4)) == 0)) goto SUB_FAIL;
-  if (!((MVM_LONG_MEM_CMP(lpx1, lpx3, 4)) > 0)) goto SUB_FAIL;
-  if (!((MVM_LONG_MEM_CMP(lpx1, lpx4, 4)) < 0)) goto SUB_FAIL;
-
-  MVM_LONG_MEM_CPY(px4, lpx3, 4);
-  if (!(x4 == 0x87654321)) goto SUB_FAIL;
-  x4 = 0x99999999;
+typedef struct vm_TsHeapDumpWriter {
+  mvm_TfHeapDumpWrite write;
+  void* context;
+  uint8_t used;
+  uint8_t buffer[64];
+} vm_TsHeapDumpWriter;
 
-  // The above tests were testing the case of using a long pointer to point to
-  // local RAM. We need to also test that everything works when point to the
-  // actual bytecode. lpBytecode and pHeader should point to data of the same
-  // value but in different address spaces (ROM and RAM respectively).
+static void vm_heapDumpFlush(vm_TsHeapDumpWriter* writer) {
+  if (writer->used) {
+    writer->write(writer->context, writer->buffer, writer->used);
+    writer->used = 0;
+  }
+}
 
-  if (!((MVM_READ_LONG_PTR_1(lpBytecode)) == pHeader->bytecodeVersion)) goto SUB_FAIL;
-  if (!((MVM_READ_LONG_PTR_2(lpBytecode)) == *((uint16_t*)pHeader))) goto SUB_FAIL;
-  if (!((MVM_READ_LONG_PTR_1((MVM_LONG_PTR_ADD(lpBytecode, 2)))) == pHeader->requiredEngineVersion)) goto SUB_FAIL;
-  if (!((MVM_LONG_PTR_SUB((MVM_LONG_PTR_ADD(lpBytecode, 3)), lpBytecode)) == 3)) goto SUB_FAIL;
-  if (!((MVM_LONG_PTR_SUB(lpBytecode, (MVM_LONG_PTR_ADD(lpBytecode, 3)))) == -3)) goto SUB_FAIL;
-  if (!((MVM_LONG_MEM_CMP(lpBytecode, (MVM_LONG_PTR_NEW(pHeader)), 8)) == 0)) goto SUB_FAIL;
+static void vm_heapDumpWrite(vm_TsHeapDumpWriter* writer, uint16_t value, uint8_t size) {
+  if (writer->used + size > sizeof writer->buffer) {
+    vm_heapDumpFlush(writer);
+  }
+  writer->buffer[writer->used++] = (uint8_t)value;
+  if (size == 2) {
+    writer->buffer[writer->used++] = (uint8_t)(value >> 8);
+  }
+}
 
-  if (MVM_NATIVE_POINTER_IS_16_BIT && (sizeof(void*) != 2)) return MVM_E_EXPECTED_POINTER_SIZE_TO_BE_16_BIT;
-  if ((!MVM_NATIVE_POINTER_IS_16_BIT) && (sizeof(void*) == 2)) return MVM_E_EXPECTED_POINTER_SIZE_NOT_TO_BE_16_BIT;
+// Writes the root entry for `value` if it points into the heap, returning
+// whether it did
+static bool vm_heapDumpRoot(VM* vm, vm_TsHeapDumpWriter* writer, uint8_t kind, uint16_t index, Value value) {
+  if (!Value_isShortPtr(value)) {
+    return false;
+  }
+  if (writer) {
+    vm_heapDumpWrite(writer, kind, 1);
+    vm_heapDumpWrite(writer, index, 2);
+    vm_heapDumpWrite(writer, pointerOffsetInHeap(vm, vm->pLastBucket, ShortPtr_decode(vm, value)), 2);
+  }
+  return true;
+}
 
-  #if MVM_USE_SINGLE_RAM_PAGE
-    void* ptr = MVM_CONTEXTUAL_MALLOC(2, context);
-    MVM_CONTEXTUAL_FREE(ptr, context);
-    if ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR > 0xffff) return MVM_E_MALLOC_NOT_WITHIN_RAM_PAGE;
-  #endif // MVM_USE_SINGLE_RAM_PAGE
+// Writes the root entries, or just counts them if `writer` is NULL
+static uint16_t vm_heapDumpRoots(VM* vm, vm_TsHeapDumpWriter* writer) {
+  uint16_t count = 0;
+  uint16_t i;
 
-  return MVM_E_SUCCESS;
+  uint16_t globalCount = getSectionSize(vm, BCS_GLOBALS) / 2;
+  for (i = 0; i < globalCount; i++) {
+    count += vm_heapDumpRoot(vm, writer, MVM_HEAP_DUMP_ROOT_GLOBAL, i, vm->globals[i]);
+  }
 
-SUB_FAIL:
-  return MVM_E_PORT_FILE_MACRO_TEST_FAILURE;
-}
+  uint16_t handleCount = vm->gc_handlePageCount * MVM_HANDLE_PAGE_SIZE;
+  for (i = 0; i < handleCount; i++) {
+    Value value = vm->gc_handlePages[i / MVM_HANDLE_PAGE_SIZE]->values[i % MVM_HANDLE_PAGE_SIZE];
+    count += vm_heapDumpRoot(vm, writer, MVM_HEAP_DUMP_ROOT_HANDLE, i, value);
+  }
 
-uint16_t mvm_getCurrentAddress(VM* vm) {
-  vm_TsStack* stack = vm->stack;
-  if (!stack) return 0; // Not currently running
-  LongPtr lpProgramCounter = stack->reg.lpProgramCounter;
-  LongPtr lpBytecode = vm->lpBytecode;
-  uint16_t address = (uint16_t)MVM_LONG_PTR_SUB(lpProgramCounter, lpBytecode);
-  return address;
+  return count;
 }
 
-// Clone a fixed length array or other container type
-static Value vm_cloneContainer(VM* vm, Value* pArr) {
-  VM_ASSERT_NOT_USING_CACHED_REGISTERS(vm);
+void mvm_dumpHeap(VM* vm, mvm_TfHeapDumpWrite write, void* context) {
+  CODE_COVERAGE_UNTESTED(879); // Not hit
+  vm_TsHeapDumpWriter writer;
+  writer.write = write;
+  writer.context = context;
+  writer.used = 0;
 
-  LongPtr* lpSource = DynamicPtr_decode_long(vm, *pArr);
-  uint16_t headerWord = readAllocationHeaderWord_long(lpSource);
-  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-  uint16_t* newArray = gc_allocateWithHeader(vm, size, vm_getTypeCodeFromHeaderWord(headerWord));
+  // The collection leaves only reachable allocations, each with a header and
+  // with the property lists compacted, so the buckets can be parsed from
+  // start to end
+  mvm_runGC(vm, false);
 
-  // May have moved during allocation
-  lpSource = DynamicPtr_decode_long(vm, *pArr);
+  vm_heapDumpWrite(&writer, 'M' | ('V' << 8), 2);
+  vm_heapDumpWrite(&writer, 'H' | ('D' << 8), 2);
+  vm_heapDumpWrite(&writer, MVM_HEAP_DUMP_VERSION, 2);
+  vm_heapDumpWrite(&writer, getHeapSize(vm), 2);
+  vm_heapDumpWrite(&writer, vm_heapDumpRoots(vm, NULL), 2);
+  vm_heapDumpRoots(vm, &writer);
 
-  uint16_t* pTarget = newArray;
-  while (size) {
-    *pTarget++ = LongPtr_read2_aligned(lpSource);
-    lpSource = LongPtr_add(lpSource, 2);
-    size -= 2;
+  TsBucket* bucket = vm->pLastBucket;
+  while (bucket && bucket->prev) {
+    bucket = bucket->prev;
   }
+  while (bucket) {
+    uint16_t* p = (uint16_t*)getBucketDataBegin(bucket);
+    while (p != bucket->pEndOfUsedSpace) {
+      VM_ASSERT(vm, p < bucket->pEndOfUsedSpace);
+      uint16_t header = *p++;
+      uint16_t words = (vm_getAllocationSizeExcludingHeaderFromHeaderWord(header) + 1) >> 1;
+      vm_heapDumpWrite(&writer, header, 2);
 
-  return ShortPtr_encode(vm, newArray);
-}
+      if (vm_getTypeCodeFromHeaderWord(header) < TC_REF_DIVIDER_CONTAINER_TYPES) {
+        CODE_COVERAGE_UNTESTED(880); // Not hit
+        p += words;
+        continue;
+      } else {
+        CODE_COVERAGE_UNTESTED(881); // Not hit
+      }
 
-static Value vm_safePop(VM* vm, Value* pStackPointerAfterDecr) {
-  // This is only called in the run-loop, so the registers should be cached
-  VM_ASSERT(vm, vm->stack->reg.usingCachedRegisters);
-  if (pStackPointerAfterDecr < getBottomOfStack(vm->stack)) {
-    MVM_FATAL_ERROR(vm, MVM_E_ASSERTION_FAILED);
+      uint16_t refCount = 0;
+      uint16_t i;
+      for (i = 0; i < words; i++) {
+        if (Value_isShortPtr(p[i])) {
+          refCount++;
+        }
+      }
+      vm_heapDumpWrite(&writer, refCount, 2);
+      for (i = 0; i < words; i++) {
+        if (Value_isShortPtr(p[i])) {
+          vm_heapDumpWrite(&writer, i, 2);
+          vm_heapDumpWrite(&writer, pointerOffsetInHeap(vm, vm->pLastBucket, ShortPtr_decode(vm, p[i])), 2);
+        }
+      }
+      p += words;
+    }
+    bucket = bucket->next;
   }
-  return *pStackPointerAfterDecr;
-}
 
-static inline void vm_checkValueAccess(VM* vm, uint8_t potentialCycleNumber) {
-  VM_ASSERT(vm, vm->gc_potentialCycleNumber == potentialCycleNumber);
+  vm_heapDumpFlush(&writer);
 }
+#endif // MVM_HEAP_DUMP
 
-static TeError vm_newError(VM* vm, TeError err) {
-  #if MVM_ALL_ERRORS_FATAL
-  MVM_FATAL_ERROR(vm, err);
-  #endif
-  return err;
+#if MVM_PROFILE || MVM_SUPERINSTRUCTIONS
+/**
+ * Size in bytes of the instruction at the given address, including its
+ * operands, or 0 if it uses a reserved opcode (which includes the
+ * superinstructions).
+ */
+static uint8_t vm_instructionSize(LongPtr lpInstruction) {
+  uint8_t instruction = LongPtr_read1(lpInstruction);
+  uint8_t subOp = instruction & 0xF;
+  switch (instruction >> 4) {
+    case VM_OP_EXTENDED_1:
+      if (subOp == VM_OP1_RESERVED_VIRTUAL_NEW)
+        return 0;
+      return ((subOp == VM_OP1_NEW) || (subOp == VM_OP1_SCOPE_NEW)) ? 2 : 1;
+    case VM_OP_EXTENDED_2:
+      if ((subOp == VM_OP2_ARRAY_GET_2_RESERVED) || (subOp == VM_OP2_ARRAY_SET_2_RESERVED))
+        return 0;
+      if (subOp == VM_OP2_CALL_HOST)
+        return 3;
+      if (subOp == VM_OP2_EXTENDED_4) {
+        uint8_t op4 = LongPtr_read1(LongPtr_add(lpInstruction, 1));
+        if (op4 == VM_OP4_START_TRY)
+          return 4;
+        if (op4 == VM_OP4_SCOPE_PUSH)
+          return 3;
+        if (op4 >= VM_OP4_END)
+          return 0;
+      }
+      return 2;
+    case VM_OP_EXTENDED_3:
+      if (subOp >= VM_OP3_DIVIDER_1)
+        return 3;
+      if (subOp == VM_OP3_POP_N)
+        return 2;
+      if (subOp >= VM_OP3_AWAIT_RESERVED)
+        return 0;
+      return 1;
+    case VM_OP_CALL_5:
+      return 3;
+    default:
+      return 1;
+  }
 }
 
-static void* vm_malloc(VM* vm, size_t size) {
-  void* result = MVM_CONTEXTUAL_MALLOC(size, vm->context);
+#define INSTRUCTION_LOAD_LITERAL ((VM_OP_EXTENDED_3 << 4) | VM_OP3_LOAD_LITERAL)
+#define INSTRUCTION_OBJECT_GET_1 ((VM_OP_EXTENDED_1 << 4) | VM_OP1_OBJECT_GET_1)
 
-  #if MVM_SAFE_MODE && MVM_USE_SINGLE_RAM_PAGE
-    // See comment on MVM_RAM_PAGE_ADDR in microvium_port_example.h
-    VM_ASSERT(vm, (intptr_t)result - (intptr_t)MVM_RAM_PAGE_ADDR <= 0xFFFF);
-  #endif
-  return result;
+/**
+ * The superinstruction (mvm_TeSuperinstruction) for the pair of consecutive
+ * instructions starting with the given opcode bytes, or 0 if there isn't one.
+ */
+static uint8_t vm_superinstruction2(uint8_t first, uint8_t second) {
+  if ((first == INSTRUCTION_LOAD_LITERAL) && (second == INSTRUCTION_OBJECT_GET_1))
+    return MVM_SUPERINSTRUCTION_LOAD_LITERAL_GET;
+  if ((second >> 4) == VM_OP_LOAD_VAR_1) {
+    if ((first >> 4) == VM_OP_LOAD_VAR_1)
+      return MVM_SUPERINSTRUCTION_LOAD_VAR_2;
+    if ((first >> 4) == VM_OP_STORE_VAR_1)
+      return MVM_SUPERINSTRUCTION_STORE_LOAD_VAR;
+  }
+  return 0;
 }
 
-// Note: mvm_free frees the VM, while vm_free is the counterpart to vm_malloc
-static void vm_free(VM* vm, void* ptr) {
-  // Capture the context before freeing the ptr, since the pointer could be the vm
-  void* context = vm->context;
+/**
+ * The superinstruction (mvm_TeSuperinstruction) for the three consecutive
+ * instructions starting with the given opcode bytes, or 0 if there isn't one.
+ */
+static uint8_t vm_superinstruction3(uint8_t first, uint8_t second, uint8_t third) {
+  if ((second == INSTRUCTION_LOAD_LITERAL) && (third == INSTRUCTION_OBJECT_GET_1)) {
+    if ((first >> 4) == VM_OP_LOAD_ARG_1)
+      return MVM_SUPERINSTRUCTION_LOAD_ARG_GET;
+    if ((first >> 4) == VM_OP_LOAD_VAR_1)
+      return MVM_SUPERINSTRUCTION_LOAD_VAR_GET;
+  }
+  if (((first >> 4) == VM_OP_LOAD_VAR_1) &&
+    ((second >> 4) == VM_OP_LOAD_SMALL_LITERAL) && ((second & 0xF) < smallLiteralsSize) &&
+    ((third >> 4) == VM_OP_NUM_OP) && ((third & 0xF) < VM_NUM_OP_END)
+  ) {
+    return MVM_SUPERINSTRUCTION_LOAD_VAR_NUM_OP;
+  }
+  return 0;
+}
+#endif // MVM_PROFILE || MVM_SUPERINSTRUCTIONS
 
-  #if MVM_SAFE_MODE && MVM_USE_SINGLE_RAM_PAGE
-    // See comment on MVM_RAM_PAGE_ADDR in microvium_port_example.h
-    VM_ASSERT(vm, !ptr || ((intptr_t)ptr - (intptr_t)MVM_RAM_PAGE_ADDR <= 0xFFFF));
-  #endif
+#if MVM_SUPERINSTRUCTIONS
+static inline uint16_t vm_fusedFunctionsSize(VM* vm) {
+  // One bit for each word of the ROM section
+  return (getSectionSize(vm, BCS_ROM) + 15) / 16;
+}
 
-  MVM_CONTEXTUAL_FREE(ptr, context);
+/**
+ * Called by vm_restore to point the VM at a RAM copy of the bytecode, which
+ * vm_fuseFunction can rewrite.
+ */
+static TeError vm_copyBytecode(VM* vm) {
+  CODE_COVERAGE_UNTESTED(746); // Not hit
+  uint16_t bytecodeSize = getBytecodeSize(vm);
+  uint16_t fusedFunctionsSize = vm_fusedFunctionsSize(vm);
+  uint8_t* pCopy = vm_malloc(vm, bytecodeSize + fusedFunctionsSize);
+  if (!pCopy) {
+    CODE_COVERAGE_ERROR_PATH(747); // Not hit
+    return MVM_E_MALLOC_FAIL;
+  }
+  memcpy_long(pCopy, vm->lpBytecode, bytecodeSize);
+  memset(pCopy + bytecodeSize, 0, fusedFunctionsSize);
+
+  vm->lpOriginalBytecode = vm->lpBytecode;
+  vm->pBytecodeCopy = pCopy;
+  vm->pFusedFunctions = pCopy + bytecodeSize;
+  vm->superinstructionMask = MVM_SUPERINSTRUCTION_MASK;
+  vm->lpBytecode = LongPtr_new(pCopy);
+  return MVM_E_SUCCESS;
 }
 
-static mvm_TeError vm_uint8ArrayNew(VM* vm, Value* slot) {
-  CODE_COVERAGE(344); // Hit
+#define BITMAP_SET(p, i) ((p)[(i) >> 3] |= (uint8_t)(1 << ((i) & 7)))
+#define BITMAP_TEST(p, i) ((p)[(i) >> 3] & (1 << ((i) & 7)))
 
-  uint16_t size = *slot;
-  if (!Value_isVirtualUInt12(size)) {
-    CODE_COVERAGE_ERROR_PATH(345); // Not hit
-    return MVM_E_INVALID_UINT8_ARRAY_LENGTH;
+/**
+ * Rewrites the code of a function with superinstructions, the first time it's
+ * called. This is done lazily rather than at restore time because functions
+ * can only be found by following references from the code that runs.
+ *
+ * The function is decoded from start to end, which relies on the compiler
+ * laying out the blocks of a function one after the other. Anything
+ * unexpected (an unknown opcode, an instruction that runs past the end of the
+ * function, or a jump that doesn't land on an instruction) leaves the
+ * function as it is. A sequence is only fused if nothing jumps into the
+ * middle of it; the other entry points into a function (the return address
+ * of a call, a catch block) can't be in the middle of one of the sequences,
+ * since only the first instruction of a sequence can be a call or a jump.
+ */
+static void vm_fuseFunction(VM* vm, uint16_t functionAddress) {
+  uint16_t romStart = getSectionOffset(vm->lpBytecode, BCS_ROM);
+  uint16_t romSize = getSectionSize(vm, BCS_ROM);
+  uint16_t bit = (uint16_t)(functionAddress - romStart) / 2;
+  if (((uint16_t)(functionAddress - romStart) >= romSize) || BITMAP_TEST(vm->pFusedFunctions, bit)) {
+    CODE_COVERAGE_UNTESTED(748); // Not hit
+    return;
   }
-  size = VirtualInt14_decode(vm, size);
+  CODE_COVERAGE_UNTESTED(749); // Not hit
+  BITMAP_SET(vm->pFusedFunctions, bit);
 
-  uint8_t* p = gc_allocateWithHeader(vm, size, TC_REF_UINT8_ARRAY);
-  *slot = ShortPtr_encode(vm, p);
-  memset(p, 0, size);
+  uint8_t mask = vm->superinstructionMask;
+  if (!mask) {
+    CODE_COVERAGE_UNTESTED(750); // Not hit
+    return;
+  }
 
-  return MVM_E_SUCCESS;
-}
+  uint8_t* pCode = vm->pBytecodeCopy + functionAddress;
+  uint16_t headerWord = *(uint16_t*)(pCode - 2);
+  uint16_t size = vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
+  if ((vm_getTypeCodeFromHeaderWord(headerWord) != TC_REF_FUNCTION) ||
+    ((uint32_t)functionAddress + size > (uint32_t)romStart + romSize)
+  ) {
+    CODE_COVERAGE_ERROR_PATH(751); // Not hit
+    return;
+  }
 
-mvm_Value mvm_uint8ArrayFromBytes(mvm_VM* vm, const uint8_t* data, size_t sizeBytes) {
-  CODE_COVERAGE(346); // Hit
-  if (sizeBytes >= (MAX_ALLOCATION_SIZE + 1)) {
-    MVM_FATAL_ERROR(vm, MVM_E_ALLOCATION_TOO_LARGE);
-    return VM_VALUE_UNDEFINED;
+  // Bitmaps over the bytes of the function: where each instruction starts,
+  // and which instructions are jumped to
+  uint16_t mapSize = (size + 7) / 8;
+  uint8_t* pStarts = vm_malloc(vm, mapSize * 2);
+  if (!pStarts) {
+    CODE_COVERAGE_ERROR_PATH(752); // Not hit
+    return; // The function just runs unfused
   }
-  // Note: gc_allocateWithHeader will also check the size
-  uint8_t* p = gc_allocateWithHeader(vm, (uint16_t)sizeBytes, TC_REF_UINT8_ARRAY);
-  Value result = ShortPtr_encode(vm, p);
-  memcpy(p, data, sizeBytes);
-  return result;
-}
+  uint8_t* pTargets = pStarts + mapSize;
+  memset(pStarts, 0, mapSize * 2);
 
-mvm_TeError mvm_uint8ArrayToBytes(mvm_VM* vm, mvm_Value uint8ArrayValue, uint8_t** out_data, size_t* out_size) {
-  CODE_COVERAGE(348); // Hit
+  // The code starts after the required frame size byte
+  uint16_t i = 1;
+  while (i < size) {
+    uint8_t n = vm_instructionSize(LongPtr_new(&pCode[i]));
+    if (!n || (i + n > size)) {
+      CODE_COVERAGE_ERROR_PATH(753); // Not hit
+      goto SUB_EXIT;
+    }
+    BITMAP_SET(pStarts, i);
 
-  // Note: while it makes sense to allow Uint8Arrays in general to live in ROM,
-  // I think we can require that those that hit the FFI boundary are never
-  // optimized into ROM. For efficiency and because I imagine that it's a very
-  // limited use case to have constant data accessed through this API.
+    int32_t target;
+    switch (pCode[i]) {
+      case (VM_OP_EXTENDED_2 << 4) | VM_OP2_BRANCH_1:
+      case (VM_OP_EXTENDED_2 << 4) | VM_OP2_JUMP_1:
+        target = i + n + (int8_t)pCode[i + 1];
+        break;
+      case (VM_OP_EXTENDED_3 << 4) | VM_OP3_JUMP_2:
+      case (VM_OP_EXTENDED_3 << 4) | VM_OP3_BRANCH_2:
+        target = i + n + (int16_t)(pCode[i + 1] | (pCode[i + 2] << 8));
+        break;
+      case (VM_OP_EXTENDED_2 << 4) | VM_OP2_EXTENDED_4:
+        // The catch target of a START_TRY is a bytecode address
+        if (pCode[i + 1] != VM_OP4_START_TRY)
+          goto SUB_NEXT;
+        target = (int32_t)((pCode[i + 2] | (pCode[i + 3] << 8)) & 0xFFFE) - functionAddress;
+        break;
+      default:
+        goto SUB_NEXT;
+    }
+    if ((target < 1) || (target >= size)) {
+      CODE_COVERAGE_ERROR_PATH(754); // Not hit
+      goto SUB_EXIT;
+    }
+    BITMAP_SET(pTargets, target);
+  SUB_NEXT:
+    i += n;
+  }
 
-  if (!Value_isShortPtr(uint8ArrayValue)) {
-    CODE_COVERAGE_ERROR_PATH(574); // Not hit
-    return MVM_E_TYPE_ERROR;
+  for (i = 0; i < mapSize; i++) {
+    if (pTargets[i] & ~pStarts[i]) {
+      CODE_COVERAGE_ERROR_PATH(755); // Not hit
+      goto SUB_EXIT;
+    }
   }
 
-  void* p = ShortPtr_decode(vm, uint8ArrayValue);
-  uint16_t headerWord = readAllocationHeaderWord(p);
-  TeTypeCode typeCode = vm_getTypeCodeFromHeaderWord(headerWord);
-  if (typeCode != TC_REF_UINT8_ARRAY) {
-    CODE_COVERAGE_ERROR_PATH(575); // Not hit
-    return MVM_E_TYPE_ERROR;
+  i = 1;
+  while (i < size) {
+    uint16_t i2 = i + vm_instructionSize(LongPtr_new(&pCode[i]));
+    uint16_t i3 = size;
+    uint8_t superinstruction = 0;
+    if ((i2 < size) && !BITMAP_TEST(pTargets, i2)) {
+      i3 = i2 + vm_instructionSize(LongPtr_new(&pCode[i2]));
+      if ((i3 < size) && !BITMAP_TEST(pTargets, i3))
+        superinstruction = vm_superinstruction3(pCode[i], pCode[i2], pCode[i3]) & mask;
+      if (!superinstruction)
+        superinstruction = vm_superinstruction2(pCode[i], pCode[i2]) & mask;
+    }
+
+    switch (superinstruction) {
+      case MVM_SUPERINSTRUCTION_LOAD_VAR_NUM_OP:
+        // The NUM_OP byte stays where it is
+        pCode[i + 1] = (uint8_t)((pCode[i] << 4) | (pCode[i + 1] & 0xF));
+        pCode[i] = (VM_OP_EXTENDED_3 << 4) | VM_OP3_FUSED_LOAD_VAR_NUM_OP;
+        i = i3 + 1;
+        break;
+      case MVM_SUPERINSTRUCTION_LOAD_LITERAL_GET:
+        // The literal and the OBJECT_GET_1 byte stay where they are
+        pCode[i] = (VM_OP_EXTENDED_3 << 4) | VM_OP3_FUSED_LOAD_LITERAL_GET;
+        i = i2 + 1;
+        break;
+      case MVM_SUPERINSTRUCTION_LOAD_ARG_GET:
+      case MVM_SUPERINSTRUCTION_LOAD_VAR_GET:
+        // The index replaces the LOAD_LITERAL byte
+        pCode[i + 1] = pCode[i] & 0xF;
+        pCode[i] = (VM_OP_EXTENDED_3 << 4) | ((superinstruction == MVM_SUPERINSTRUCTION_LOAD_ARG_GET)
+          ? VM_OP3_FUSED_LOAD_ARG_GET
+          : VM_OP3_FUSED_LOAD_VAR_GET);
+        i = i3 + 1;
+        break;
+      case MVM_SUPERINSTRUCTION_LOAD_VAR_2:
+      case MVM_SUPERINSTRUCTION_STORE_LOAD_VAR:
+        pCode[i + 1] = (uint8_t)((pCode[i] << 4) | (pCode[i + 1] & 0xF));
+        pCode[i] = (superinstruction == MVM_SUPERINSTRUCTION_LOAD_VAR_2)
+          ? ((VM_OP_EXTENDED_1 << 4) | VM_OP1_FUSED_LOAD_VAR_2)
+          : ((VM_OP_EXTENDED_2 << 4) | VM_OP2_FUSED_STORE_LOAD_VAR);
+        i = i2 + 1;
+        break;
+      default:
+        i = i2;
+        break;
+    }
   }
 
-  *out_size = (size_t)vm_getAllocationSizeExcludingHeaderFromHeaderWord(headerWord);
-  *out_data = p;
-  return MVM_E_SUCCESS;
+SUB_EXIT:
+  vm_free(vm, pStarts);
 }
 
-#ifdef MVM_GAS_COUNTER
-void mvm_stopAfterNInstructions(mvm_VM* vm, int32_t n) {
-  vm->stopAfterNInstructions = n;
-}
+void mvm_setSuperinstructions(VM* vm, uint8_t mask) {
+  CODE_COVERAGE_UNTESTED(756); // Not hit
+  VM_ASSERT(vm, !vm->stack);
+  vm->superinstructionMask = mask & MVM_SUPERINSTRUCTION_ALL;
 
-int32_t mvm_getInstructionCountRemaining(mvm_VM* vm) {
-  return vm->stopAfterNInstructions;
+  // Only the ROM section is ever rewritten, so restoring it from the original
+  // undoes any fusion
+  uint16_t romStart = getSectionOffset(vm->lpBytecode, BCS_ROM);
+  memcpy_long(vm->pBytecodeCopy + romStart, LongPtr_add(vm->lpOriginalBytecode, romStart), getSectionSize(vm, BCS_ROM));
+  memset(vm->pFusedFunctions, 0, vm_fusedFunctionsSize(vm));
+
+  #if MVM_RECYCLE_NUMBER_BOXES
+  // The address of the instruction after the last box may no longer be the
+  // start of an instruction
+  vm->numberBox = 0;
+  #endif
 }
-#endif // MVM_GAS_COUNTER
+#endif // MVM_SUPERINSTRUCTIONS
@@ -72,6 +72,11 @@ typedef enum mvm_TeError {
   /* 49 */ MVM_E_WRONG_BYTECODE_VERSION, // The version of bytecode is different to what the engine supports
   /* 50 */ MVM_E_USING_NEW_ON_NON_CLASS, // The `new` operator can only be used on classes
   /* 51 */ MVM_E_INSTRUCTION_COUNT_REACHED, // The instruction count set by `mvm_stopAfterNInstructions` has been reached
+  /* 52 */ MVM_E_INVALID_HIBERNATION_IMAGE, // The image passed to `mvm_restoreHibernated` is corrupt or was created by a different build
+  /* 53 */ MVM_E_YIELDED, // The instruction count set by `mvm_yieldAfterNInstructions` has been reached. The call is suspended until `mvm_resume`
+  /* 54 */ MVM_E_NOT_SUSPENDED, // `mvm_resume` was called but there is no suspended call to resume
+  /* 55 */ MVM_E_HOST_PENDING, // Returned by an async host function to suspend the call until `mvm_completeHostCall`, and then by the call itself
+  /* 56 */ MVM_E_CANNOT_SUSPEND, // An async host function returned MVM_E_HOST_PENDING in a reentrant call, which can't be suspended
 } mvm_TeError;
 
 typedef enum mvm_TeType {
@@ -87,10 +92,36 @@ typedef enum mvm_TeType {
   VM_T_CLASS       = 9,
   VM_T_SYMBOL      = 10, // Reserved
   VM_T_BIG_INT     = 11, // Reserved
+  VM_T_TYPED_ARRAY = 12, // See mvm_typedArrayFromElements
 
   VM_T_END,
 } mvm_TeType;
 
+// Element types of the typed arrays created by mvm_typedArrayFromElements
+typedef enum mvm_TeTypedArrayKind {
+  MVM_TA_INT16   = 0, // Int16Array
+  MVM_TA_UINT16  = 1, // Uint16Array
+  MVM_TA_INT32   = 2, // Int32Array
+  MVM_TA_FLOAT32 = 3, // Float32Array (requires MVM_SUPPORT_FLOAT)
+  MVM_TA_UINT8   = 4, // Uint8Array (mainly for mvm_typedArrayFromExternal)
+
+  MVM_TA_END,
+} mvm_TeTypedArrayKind;
+
+// Instruction sequences that MVM_SUPERINSTRUCTIONS can fuse, as bit flags for
+// mvm_setSuperinstructions and mvm_suggestSuperinstructions
+typedef enum mvm_TeSuperinstruction {
+  MVM_SUPERINSTRUCTION_LOAD_VAR_NUM_OP     = 1 << 0, // e.g. `i + 1`, `i < 10`
+  MVM_SUPERINSTRUCTION_LOAD_LITERAL_GET    = 1 << 1, // e.g. `<expr>.x`
+  MVM_SUPERINSTRUCTION_LOAD_ARG_GET        = 1 << 2, // e.g. `arg.x`
+  MVM_SUPERINSTRUCTION_LOAD_VAR_GET        = 1 << 3, // e.g. `obj.x`
+  MVM_SUPERINSTRUCTION_LOAD_VAR_2          = 1 << 4, // e.g. `a + b`
+  MVM_SUPERINSTRUCTION_STORE_LOAD_VAR      = 1 << 5, // e.g. `x = ...; x ...`
+
+  MVM_SUPERINSTRUCTION_COUNT = 6,
+  MVM_SUPERINSTRUCTION_ALL = (1 << MVM_SUPERINSTRUCTION_COUNT) - 1,
+} mvm_TeSuperinstruction;
+
 // Prefix to attach to exported microvium API functions. If a user doesn't
 // specify this, we just set it up as the empty macro.
 #ifndef MVM_EXPORT
@@ -146,12 +177,65 @@ typedef struct mvm_TsMemoryStats {
   // Current total size of virtual heap (will expand as needed up to a max of MVM_MAX_HEAP_SIZE)
   size_t virtualHeapAllocatedCapacity;
 
+  // Total bytes allocated in the virtual heap since the VM was restored,
+  // including allocations that have since been collected. This starts from the
+  // heap in the snapshot, which is not counted.
+  size_t allocatedBytes;
+
+  // RAM allocated to the hash index over interned strings (MVM_INTERN_INDEX),
+  // or zero if there is no index
+  size_t internIndexSize;
+
+  // RAM allocated to the copy of the bytecode that MVM_SUPERINSTRUCTIONS
+  // rewrites, or zero if the feature is not included
+  size_t bytecodeCopySize;
+
+  // RAM allocated to the handle table (see mvm_initializeHandle), or zero if no
+  // handle has been initialized
+  size_t handleTableSize;
+
+  // Number of heap boxes for intermediate number results that were given back
+  // for reuse rather than left for the garbage collector, since the VM was
+  // restored. Always zero unless the port file enables
+  // MVM_RECYCLE_NUMBER_BOXES.
+  size_t numberBoxesRecycled;
+
+  // Number of major (full) garbage collections so far. A "squeeze" collection
+  // counts as two if the heap size needed adjusting.
+  size_t gcMajorCollections;
+
+  // Number of minor (nursery) collections so far. Always zero unless the port
+  // file enables MVM_GENERATIONAL_GC.
+  size_t gcMinorCollections;
+
+  // Total and longest pause time of each kind of collection, in microseconds.
+  // These are zero unless the port file defines MVM_GC_CLOCK_US.
+  size_t gcMajorPauseTotal;
+  size_t gcMajorPauseMax;
+  size_t gcMinorPauseTotal;
+  size_t gcMinorPauseMax;
+
+  // Number of calls to mvm_gcStep, and the total and longest time spent in
+  // them (microseconds, as above). Completing an incremental collection outside
+  // of mvm_gcStep is also counted as a step. Always zero unless the port file
+  // enables MVM_INCREMENTAL_GC.
+  size_t gcIncrementalSteps;
+  size_t gcStepPauseTotal;
+  size_t gcStepPauseMax;
+
+  // Number of major collections started by the GC policy (see mvm_setGCPolicy)
+  // rather than by the host or by the heap reaching MVM_MAX_HEAP_SIZE. These
+  // are also counted in gcMajorCollections. Always zero unless the port file
+  // enables MVM_GC_POLICY.
+  size_t gcPolicyCollections;
+
 } mvm_TsMemoryStats;
 
 /**
- * A handle holds a value that must not be garbage collected.
+ * A handle holds a value that must not be garbage collected. The value is kept
+ * in a slot of the VM's handle table, which the handle points to.
  */
-typedef struct mvm_Handle { struct mvm_Handle* _next; mvm_Value _value; } mvm_Handle;
+typedef struct mvm_Handle { mvm_Value* _slot; uint16_t _index; } mvm_Handle;
 
 #include "microvium_port.h"
 
@@ -203,13 +287,24 @@ MVM_EXPORT void* mvm_getContext(mvm_VM* vm);
 /**
  * Handle operations. Handles are used to hold values that must not be garbage
  * collected. See `doc\handles-and-garbage-collection.md` for more information.
+ *
+ * Initializing and releasing a handle take constant time, in any order. The
+ * handle table grows a page of MVM_HANDLE_PAGE_SIZE slots at a time and doesn't
+ * shrink until the VM is freed.
  */
 MVM_EXPORT void mvm_initializeHandle(mvm_VM* vm, mvm_Handle* handle); // Handle must be released by mvm_releaseHandle
 MVM_EXPORT void mvm_cloneHandle(mvm_VM* vm, mvm_Handle* target, const mvm_Handle* source); // Target must be released by mvm_releaseHandle
 MVM_EXPORT mvm_TeError mvm_releaseHandle(mvm_VM* vm, mvm_Handle* handle);
-static inline mvm_Value mvm_handleGet(const mvm_Handle* handle) { return handle->_value; }
-static inline mvm_Value* mvm_handleAt(mvm_Handle* handle) { return &handle->_value; }
-static inline void mvm_handleSet(mvm_Handle* handle, mvm_Value value) { handle->_value = value; }
+#if MVM_INCREMENTAL_GC
+// Not inline, since they complete a collection in progress (see mvm_gcStep)
+MVM_EXPORT mvm_Value mvm_handleGet(const mvm_Handle* handle);
+MVM_EXPORT mvm_Value* mvm_handleAt(mvm_Handle* handle);
+MVM_EXPORT void mvm_handleSet(mvm_Handle* handle, mvm_Value value);
+#else
+static inline mvm_Value mvm_handleGet(const mvm_Handle* handle) { return *handle->_slot; }
+static inline mvm_Value* mvm_handleAt(mvm_Handle* handle) { return handle->_slot; }
+static inline void mvm_handleSet(mvm_Handle* handle, mvm_Value value) { *handle->_slot = value; }
+#endif
 
 /**
  * Roughly like the `typeof` operator in JS, except with distinct values for
@@ -342,6 +437,79 @@ MVM_EXPORT mvm_Value mvm_uint8ArrayFromBytes(mvm_VM* vm, const uint8_t* data, si
  */
 MVM_EXPORT mvm_TeError mvm_uint8ArrayToBytes(mvm_VM* vm, mvm_Value uint8ArrayValue, uint8_t** out_data, size_t* out_size);
 
+/**
+ * Creates a typed array (Int16Array, Uint16Array, Int32Array or Float32Array,
+ * according to `kind`) of `length` elements, which must be at least 1. Like a
+ * Uint8Array, the elements are stored natively rather than as individual
+ * values, and it is mutable but cannot be resized. If `data` is not NULL, the
+ * new array contains a *copy* of the `length` elements that it points to,
+ * otherwise the elements are zero.
+ *
+ * The script reads and writes the elements by index and can read the `length`
+ * property. Values written to an integer array are converted like
+ * `mvm_toInt32` and then truncated to the element size.
+ *
+ * WARNING: the result is eligible for garbage collection the next time the VM
+ * has control. See `doc\handles-and-garbage-collection.md` for more information.
+ *
+ * See also: mvm_typedArrayToElements
+ */
+MVM_EXPORT mvm_Value mvm_typedArrayFromElements(mvm_VM* vm, mvm_TeTypedArrayKind kind, const void* data, size_t length);
+
+/**
+ * Given a typed array, this will give its kind, a pointer to its elements and
+ * the number of elements.
+ *
+ * Warning: the elements are only guaranteed to be 2-byte aligned, so the
+ * elements of an Int32Array or Float32Array must be accessed with `memcpy`
+ * rather than through an `int32_t*` or `float*`. As with
+ * mvm_uint8ArrayToBytes, the pointer should be considered invalid on the next
+ * call to any of the Microvium API methods.
+ *
+ * For an array created by mvm_typedArrayFromExternal, this gives the host
+ * memory that it was created with.
+ *
+ * See also: mvm_typedArrayFromElements
+ */
+MVM_EXPORT mvm_TeError mvm_typedArrayToElements(mvm_VM* vm, mvm_Value typedArrayValue, mvm_TeTypedArrayKind* out_kind, void** out_data, size_t* out_length);
+
+#if MVM_EXTERNAL_BUFFERS
+/**
+ * Called when the VM no longer references a buffer that was passed to
+ * mvm_typedArrayFromExternal, so that the host can reuse or free it.
+ *
+ * Note: this is called during garbage collection (or from `mvm_free`), so it
+ * must not call back into the VM.
+ */
+typedef void (*mvm_TfReleaseExternal)(void* data, void* context);
+
+/**
+ * Creates a typed array whose `length` elements are in host memory at `data`,
+ * rather than in the VM heap, so that a buffer produced by a peripheral (e.g.
+ * by `IOBUF_ReadNextFragment` or `IODEV_ReadPeripheralBuf`) can be handed to
+ * the script without copying it. The script indexes it like any other typed
+ * array of the given kind (use MVM_TA_UINT8 for a Uint8Array), and writes go
+ * straight to the host memory.
+ *
+ * `data` must stay valid until the VM calls `release` with `data` and
+ * `context`, which happens after a garbage collection finds that the array is
+ * unreachable, or when the VM is freed. `release` may be NULL.
+ *
+ * `length` must be between 1 and 8191, since that is the range of array
+ * indexes in Microvium. Larger buffers can be passed as several arrays (e.g.
+ * one per fragment).
+ *
+ * The memory is not part of a snapshot: in a VM restored from a snapshot, an
+ * external array has a length of zero.
+ *
+ * WARNING: the result is eligible for garbage collection the next time the VM
+ * has control. See `doc\handles-and-garbage-collection.md` for more information.
+ *
+ * See also: mvm_typedArrayToElements
+ */
+MVM_EXPORT mvm_Value mvm_typedArrayFromExternal(mvm_VM* vm, mvm_TeTypedArrayKind kind, void* data, size_t length, mvm_TfReleaseExternal release, void* context);
+#endif // MVM_EXTERNAL_BUFFERS
+
 /**
  * Resolves (finds) the values exported by the VM, identified by ID.
  *
@@ -367,6 +535,84 @@ MVM_EXPORT mvm_TeError mvm_resolveExports(mvm_VM* vm, const mvm_VMExportID* ids,
  */
 MVM_EXPORT void mvm_runGC(mvm_VM* vm, bool squeeze);
 
+#if MVM_INCREMENTAL_GC
+/**
+ * Do a bounded amount of garbage collection work, so that a full collection
+ * can be spread over many short pauses while the VM is otherwise idle (e.g. one
+ * step per RTOS tick).
+ *
+ * The first call starts a collection. Each call then processes about
+ * `budgetBytes` bytes of roots (2 bytes for each global and handle table slot)
+ * and then of the allocations moved so far, moving what they reference in
+ * turn. At least one root or allocation is processed per call. Each pointer
+ * processed copies at most one allocation (under 4 kB), so the pause of a step
+ * depends on the budget rather than on the size of the heap. Returns
+ * `true` when the collection is complete, after which the next call starts a
+ * new one.
+ *
+ * This does not let scripts run during a collection. Calling `mvm_call`, any
+ * other function that reads or creates values (or `mvm_runGC`), or reading or
+ * writing a handle completes the rest of the collection in one go, with a pause
+ * that depends on the size of the heap like that of `mvm_runGC`. So the pauses
+ * are only bounded if the host keeps calling `mvm_gcStep` until it returns
+ * `true` before using the VM again. A pointer returned by `mvm_handleAt` must
+ * not be kept across a call to `mvm_gcStep`. The host benchmark
+ * host/bench/incremental_bench.c compares the pauses of each case.
+ *
+ * If called from a host function while the VM is running, this performs the
+ * whole collection and returns `true`.
+ */
+MVM_EXPORT bool mvm_gcStep(mvm_VM* vm, uint16_t budgetBytes);
+#endif // MVM_INCREMENTAL_GC
+
+#if MVM_GC_POLICY
+/**
+ * When the VM runs a major garbage collection by itself, other than when the
+ * heap would otherwise grow past MVM_MAX_HEAP_SIZE. The policy is checked each
+ * time the heap needs to grow by a bucket, and measures the heap against what
+ * it was after the last major collection. A zero field disables its trigger,
+ * and the VM starts with all of them zero.
+ */
+typedef struct mvm_TsGCPolicy {
+  // Collect rather than let the heap grow past the larger of these: a fixed
+  // size in bytes, and a percentage of the heap size after the last major
+  // collection (e.g. 200 to collect once the heap has doubled). The growth
+  // limit adapts to the amount of live data; the fixed size keeps a small heap
+  // from being collected at every bucket.
+  uint16_t targetHeapSize;
+  uint16_t growthPercent;
+
+  // Collect when, since the last major collection, at least
+  // `allocationRateBytes` have been allocated, at an average of at least
+  // `allocationRateBytes` per `allocationRatePeriodUs` microseconds. A burst of
+  // allocation is mostly short-lived garbage, which is cheap to collect, and
+  // collecting it early keeps the peak heap size down. Without MVM_GC_CLOCK_US
+  // in the port file, this collects every `allocationRateBytes` bytes.
+  uint16_t allocationRateBytes;
+  uint32_t allocationRatePeriodUs;
+
+  // For mvm_gcIdle: collect when the heap has grown by at least
+  // `idleCollectBytes` since the last major collection, doing the collection
+  // `idleStepBytes` at a time with mvm_gcStep if MVM_INCREMENTAL_GC is enabled
+  // and `idleStepBytes` is not zero.
+  uint16_t idleCollectBytes;
+  uint16_t idleStepBytes;
+} mvm_TsGCPolicy;
+
+MVM_EXPORT void mvm_setGCPolicy(mvm_VM* vm, const mvm_TsGCPolicy* policy);
+MVM_EXPORT void mvm_getGCPolicy(mvm_VM* vm, mvm_TsGCPolicy* out_policy);
+
+/**
+ * Lets the VM collect garbage while the host is idle (e.g. from the VM task
+ * when it has nothing else to do), as configured by the `idle` fields of the
+ * GC policy, so that the collections that the allocator would otherwise run
+ * in the middle of a call happen less often. Returns `false` if the collection
+ * was done in a step and isn't complete yet, in which case calling again
+ * continues it, or `true` if there is nothing more to do for now.
+ */
+MVM_EXPORT bool mvm_gcIdle(mvm_VM* vm);
+#endif // MVM_GC_POLICY
+
 /**
  * Compares two values for equality. The same semantics as JavaScript `===`
  */
@@ -407,6 +653,39 @@ MVM_EXPORT void mvm_getMemoryStats(mvm_VM* vm, mvm_TsMemoryStats* out_stats);
  * a call to *free*.
  */
 MVM_EXPORT void* mvm_createSnapshot(mvm_VM* vm, size_t* out_size);
+
+/**
+ * Create a hibernation image of the VM, for a later warm restart with
+ * mvm_restoreHibernated.
+ *
+ * The image contains a snapshot (as per mvm_createSnapshot) together with the
+ * table of host functions resolved by `mvm_restore`. Since the table holds
+ * native function pointers, the image can only be restored by the same build
+ * of the host firmware, which is identified by `buildId` (e.g. a hash of the
+ * firmware image and the bytecode it was restored from).
+ *
+ * Note: The result is malloc'd on the host heap, and so needs to be freed with
+ * a call to *free*.
+ */
+MVM_EXPORT void* mvm_hibernate(mvm_VM* vm, uint32_t buildId, size_t* out_size);
+
+/**
+ * Restore a VM from an image created by mvm_hibernate.
+ *
+ * This is faster than mvm_restore because the imports are not resolved again,
+ * the heap pointers are not re-validated and the CRC of the snapshot is not
+ * recomputed: it's only compared with the one that mvm_hibernate saved next to
+ * the build ID. So the header and import table are checked, but corruption of
+ * the rest of the image after it was written is not detected. Returns
+ * MVM_E_INVALID_HIBERNATION_IMAGE if the image is corrupt or `buildId` doesn't
+ * match, in which case the host should fall back to mvm_restore.
+ *
+ * As with mvm_restore, the image is not copied and must outlive the VM.
+ *
+ * @param imageSize The size of the memory holding the image, which may be
+ * larger than the image itself (e.g. a flash partition).
+ */
+MVM_EXPORT mvm_TeError mvm_restoreHibernated(mvm_VM** result, MVM_LONG_PTR_TYPE image, size_t imageSize, uint32_t buildId, void* context);
 #endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
 
 #if MVM_INCLUDE_DEBUG_CAPABILITY
@@ -488,8 +767,270 @@ MVM_EXPORT void mvm_stopAfterNInstructions(mvm_VM* vm, int32_t n);
  * The return value will be negative if the countdown is currently disabled.
  */
 MVM_EXPORT int32_t mvm_getInstructionCountRemaining(mvm_VM* vm);
+
+/**
+ * mvm_yieldAfterNInstructions
+ *
+ * Like `mvm_stopAfterNInstructions`, except that when the count reaches zero
+ * the call is suspended rather than unwound: `mvm_call` returns MVM_E_YIELDED
+ * with the script's stack and registers kept in the VM, and `mvm_resume`
+ * continues it from the next instruction. This lets the host run several
+ * long-running scripts in turn on one task, giving each a time slice of `n`
+ * instructions.
+ *
+ * The countdown stays in yield mode until `mvm_stopAfterNInstructions` is
+ * called, so typically the host calls `mvm_yieldAfterNInstructions` again to
+ * give the next slice before each `mvm_resume`. A resume with the count still
+ * at zero yields again without executing anything.
+ *
+ * Only the outermost `mvm_call` yields. If the count reaches zero in a
+ * reentrant call (the VM calls the host which calls the VM again), that call
+ * runs to completion and the outer call yields at its next instruction.
+ *
+ * While a call is suspended, the host can still make other calls into the VM
+ * (e.g. for an urgent event). They run on top of the suspended call's stack and
+ * never yield. A snapshot or hibernation image taken while a call is suspended
+ * doesn't include the suspended call.
+ */
+MVM_EXPORT void mvm_yieldAfterNInstructions(mvm_VM* vm, int32_t n);
 #endif // MVM_GAS_COUNTER
 
+/**
+ * mvm_resume
+ *
+ * Continue the call that returned MVM_E_YIELDED. Returns the same as `mvm_call`
+ * would have (including MVM_E_YIELDED again if the count runs out), and
+ * `out_result` receives the result of the original call. Returns
+ * MVM_E_NOT_SUSPENDED if there is no suspended call, or MVM_E_HOST_PENDING if
+ * the call is waiting for an async host function (see mvm_completeHostCall).
+ *
+ * To abandon a suspended call, call `mvm_stopAfterNInstructions(vm, 0)` and
+ * then `mvm_resume` (or `mvm_completeHostCall`), which unwinds it and returns
+ * MVM_E_INSTRUCTION_COUNT_REACHED.
+ */
+MVM_EXPORT mvm_TeError mvm_resume(mvm_VM* vm, mvm_Value* out_result);
+
+/**
+ * mvm_completeHostCall
+ *
+ * Continue the call that is waiting for an async host function, with `result`
+ * as the result of the host function.
+ *
+ * A host function is async if it returns MVM_E_HOST_PENDING (typically after
+ * starting some I/O). Rather than failing, the outermost `mvm_call` is then
+ * suspended in the same way as by `mvm_yieldAfterNInstructions` and returns
+ * MVM_E_HOST_PENDING, so that the task can get on with other work (e.g. running
+ * other VMs) until the I/O completes. The host function must keep the VM
+ * pointer if it needs to know which call to complete, and must not write to
+ * its `result`.
+ *
+ * Returns the same as `mvm_resume`, including MVM_E_HOST_PENDING if the script
+ * goes on to call another async host function. Returns MVM_E_NOT_SUSPENDED if
+ * no call is waiting for a host function.
+ *
+ * A VM has only one stack, so it can only have one host call pending at a
+ * time. A host function that returns MVM_E_HOST_PENDING in a reentrant call
+ * (the VM calls the host which calls the VM again) fails that call with
+ * MVM_E_CANNOT_SUSPEND.
+ */
+MVM_EXPORT mvm_TeError mvm_completeHostCall(mvm_VM* vm, mvm_Value result, mvm_Value* out_result);
+
+/**
+ * mvm_isSuspended
+ *
+ * True if a call into the VM has yielded or is waiting for an async host
+ * function, and can be resumed. False while another call made on top of the
+ * suspended one is running.
+ */
+MVM_EXPORT bool mvm_isSuspended(mvm_VM* vm);
+
+#if MVM_PROFILE
+/**
+ * An entry in the execution profile, reported by mvm_getProfile. Each entry is
+ * either an opcode or a bytecode function.
+ */
+typedef struct mvm_TsProfileEntry {
+  // Opcode name (e.g. "VM_OP1_RETURN"), or NULL for a function
+  const char* name;
+  // Bytecode address of the function, or 0 for time spent in functions that
+  // the profiler has no room to track (see MVM_PROFILE_MAX_FUNCTIONS)
+  uint16_t functionAddress;
+  // Number of times the opcode was executed, or the function was called
+  uint32_t count;
+  // Time spent, in units of MVM_PROFILE_CLOCK. For a function this excludes
+  // the functions it calls, but includes host functions and garbage
+  // collection.
+  uint32_t cycles;
+} mvm_TsProfileEntry;
+
+typedef void (*mvm_TfProfileCallback)(void* context, const mvm_TsProfileEntry* entry);
+
+/**
+ * Reports the execution profile gathered since the VM was restored (or since
+ * mvm_resetProfile), calling `callback` once for each opcode and each function
+ * that has been executed. The function addresses match the disassembly output
+ * of the Microvium compiler.
+ */
+MVM_EXPORT void mvm_getProfile(mvm_VM* vm, mvm_TfProfileCallback callback, void* context);
+
+/**
+ * Clears the execution profile.
+ */
+MVM_EXPORT void mvm_resetProfile(mvm_VM* vm);
+
+/**
+ * Picks the superinstructions worth fusing for the workload profiled so far:
+ * those whose instruction sequence accounted for at least `minPercent` percent
+ * of the executed instructions. The result can be passed to
+ * mvm_setSuperinstructions on a VM built with MVM_SUPERINSTRUCTIONS (or used
+ * for its MVM_SUPERINSTRUCTION_MASK). Sequences are only counted while they
+ * run unfused, so profile with MVM_SUPERINSTRUCTIONS off or with a mask of 0.
+ */
+MVM_EXPORT uint8_t mvm_suggestSuperinstructions(mvm_VM* vm, uint8_t minPercent);
+#endif // MVM_PROFILE
+
+#if MVM_SUPERINSTRUCTIONS
+/**
+ * Selects which superinstructions to fuse (a combination of
+ * mvm_TeSuperinstruction flags). The default is MVM_SUPERINSTRUCTION_MASK.
+ * Functions that have already run are restored from the original bytecode
+ * and fused again on their next call. Must not be called from a host function
+ * while the VM is running.
+ */
+MVM_EXPORT void mvm_setSuperinstructions(mvm_VM* vm, uint8_t mask);
+#endif // MVM_SUPERINSTRUCTIONS
+
+#if MVM_SAMPLING_PROFILER
+/**
+ * Called with one line of folded-stack output, without the line terminator.
+ * Each line is a call stack, outermost frame first, in the form
+ * `0x00a8;0x00c4;0x00d2 1`. The last address is the instruction that was about
+ * to run, and the others are the return addresses of the calls leading to it.
+ * The addresses match the disassembly output of the Microvium compiler, which
+ * is needed to map them to function names. Identical stacks are not merged;
+ * flame graph tools add them up.
+ */
+typedef void (*mvm_TfFoldedStackCallback)(void* context, const char* line);
+
+/**
+ * Allocates the sample ring (MVM_SAMPLE_RING_SIZE samples) so that
+ * mvm_requestSample starts recording.
+ */
+MVM_EXPORT mvm_TeError mvm_startSampling(mvm_VM* vm);
+
+/**
+ * Frees the sample ring, discarding any samples that have not been drained.
+ */
+MVM_EXPORT void mvm_stopSampling(mvm_VM* vm);
+
+/**
+ * Asks the VM to record its call stack. This only sets a flag, so it is safe
+ * to call from a timer interrupt or a signal handler. The sample is taken at
+ * the start of the next bytecode instruction, so time spent in a host
+ * function is attributed to the instruction after the call. Requests made
+ * while the VM is not running are discarded by the next mvm_call.
+ */
+MVM_EXPORT void mvm_requestSample(mvm_VM* vm);
+
+/**
+ * Passes each recorded sample to `callback` as a line of folded-stack output
+ * and empties the ring. Call this often enough that the ring doesn't fill up
+ * (while the VM is not running, or from a host function). Returns the number
+ * of samples lost since the last drain because the ring was full.
+ */
+MVM_EXPORT uint32_t mvm_drainFoldedStacks(mvm_VM* vm, mvm_TfFoldedStackCallback callback, void* context);
+#endif // MVM_SAMPLING_PROFILER
+
+#if MVM_HEAP_PROFILE
+/**
+ * An allocation site in the heap profile, reported by mvm_getHeapProfile. A
+ * site is an instruction together with the type of allocation it made there.
+ * Sizes include the allocation headers.
+ */
+typedef struct mvm_TsHeapProfileSite {
+  // Allocation type (e.g. "TC_REF_CLOSURE"), or NULL for the allocations that
+  // were in the heap before mvm_startHeapProfile, plus any made at sites that
+  // the profiler has no room to track (see MVM_HEAP_PROFILE_MAX_SITES)
+  const char* typeName;
+  // Bytecode address of the allocating instruction, as from
+  // mvm_getCurrentAddress, so it may point just past the opcode. 0 for
+  // allocations made by the host outside of a call (e.g. mvm_newString).
+  uint16_t bytecodeAddress;
+  // Allocations made at the site since mvm_startHeapProfile
+  uint32_t allocationCount;
+  uint32_t allocatedBytes;
+  // Allocations from the site that are still in the heap: those that survived
+  // the last collection, plus those made since
+  uint32_t liveCount;
+  uint32_t liveBytes;
+  // Bytes from the site that garbage collections kept and that they reclaimed,
+  // added up over all collections. An allocation counts once for each
+  // collection it survives. survivedBytes / (survivedBytes + reclaimedBytes)
+  // is the survival rate of the site.
+  uint32_t survivedBytes;
+  uint32_t reclaimedBytes;
+} mvm_TsHeapProfileSite;
+
+typedef void (*mvm_TfHeapProfileCallback)(void* context, const mvm_TsHeapProfileSite* site);
+
+/**
+ * Allocates the heap profiler state, so that each allocation is tagged with its
+ * site from then on. The state takes MVM_MAX_HEAP_SIZE bytes for the tags plus
+ * the site table.
+ */
+MVM_EXPORT mvm_TeError mvm_startHeapProfile(mvm_VM* vm);
+
+/**
+ * Frees the heap profiler state.
+ */
+MVM_EXPORT void mvm_stopHeapProfile(mvm_VM* vm);
+
+/**
+ * Calls `callback` once for each allocation site recorded since
+ * mvm_startHeapProfile. The addresses match the disassembly output of the
+ * Microvium compiler. The counts are as of the last collection, so run
+ * mvm_runGC first for an up-to-date picture of what's live.
+ */
+MVM_EXPORT void mvm_getHeapProfile(mvm_VM* vm, mvm_TfHeapProfileCallback callback, void* context);
+#endif // MVM_HEAP_PROFILE
+
+#if MVM_HEAP_DUMP
+/**
+ * Heap dump format written by mvm_dumpHeap. All fields are little-endian
+ * uint16 unless noted.
+ *
+ *   Header: "MVHD" (4 bytes), version, heap size in bytes, root count
+ *   Roots:  per root, kind (uint8, MVM_HEAP_DUMP_ROOT_*), index (the global
+ *           variable slot or handle table slot), target
+ *   Heap:   per allocation, in address order, the allocation header word (type
+ *           code in the top 4 bits, size excluding the header in the low 12),
+ *           and for container types (type codes 0x9 and up) a reference count
+ *           followed by a (word index in the allocation, target) pair for
+ *           each reference
+ *
+ * A target is the heap offset of the referenced allocation, excluding its
+ * header. The first allocation is at offset 2, and each following one starts
+ * where the previous one ends (its size plus the header, rounded up to an even
+ * number).
+ *
+ * Roots on the stack are not listed. An allocation that isn't reachable from
+ * the listed roots is referenced from the stack, which only happens when the
+ * dump is taken during a call (e.g. from a host function).
+ */
+#define MVM_HEAP_DUMP_VERSION 1
+#define MVM_HEAP_DUMP_ROOT_GLOBAL 0
+#define MVM_HEAP_DUMP_ROOT_HANDLE 1
+
+typedef void (*mvm_TfHeapDumpWrite)(void* context, const void* data, size_t size);
+
+/**
+ * Runs a garbage collection and then writes a dump of the heap (see the format
+ * above) through `write`, a few bytes at a time. The dump is at most about
+ * twice the size of the heap.
+ */
+MVM_EXPORT void mvm_dumpHeap(mvm_VM* vm, mvm_TfHeapDumpWrite write, void* context);
+#endif // MVM_HEAP_DUMP
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -216,6 +216,225 @@ fixes and improvement from the original github or npm repository.
 #define MVM_SWITCH(tag, upper) switch (tag)
 #define MVM_CASE(value) case value
 
+/**
+ * Set to 1 to dispatch instructions in the interpreter loop through a table of
+ * label addresses (the GCC "labels as values" extension), jumping directly to
+ * the handler for each opcode rather than going through a central `switch`.
+ * This avoids the bounds check and gives each dispatch point its own indirect
+ * branch, which tends to predict better on loop-heavy scripts.
+ *
+ * Has no effect on compilers other than GCC and clang, where the VM falls back
+ * to MVM_SWITCH.
+ */
+#define MVM_COMPUTED_GOTO 1
+
+/**
+ * Number of entries in the inline property cache, or 0 to disable the cache.
+ * Must be a power of 2.
+ *
+ * The cache remembers where a property was found the last time each property
+ * read instruction in the bytecode was executed, so that a read that keeps
+ * hitting the same property of the same object doesn't need to search the
+ * object's property lists (and prototypes) again. A property is cached whether
+ * the object owns it or inherits it from its prototype chain. Reads that are
+ * answered by a different object (static properties of a class, or methods of
+ * an array from the array prototype) are not cached. Entries are direct-mapped
+ * by bytecode address and are cleared on each GC collection and whenever a
+ * property is added to an object.
+ *
+ * Each entry takes 6 bytes plus the size of MVM_LONG_PTR_TYPE in the VM
+ * structure.
+ */
+#define MVM_PROPERTY_CACHE_SIZE 16
+
+/**
+ * Number of entries in the scoped variable cache, or 0 to disable the cache.
+ * Must be a power of 2.
+ *
+ * A closure variable is found by walking the chain of parent scopes until the
+ * variable index lands in one of them, so each access to a variable captured
+ * from an outer function costs one step per level of nesting. The cache
+ * remembers the slot that each variable index resolved to from the current
+ * closure, making repeated accesses constant-time. Entries are cleared on each
+ * GC collection.
+ *
+ * Each entry takes 4 bytes plus the size of MVM_LONG_PTR_TYPE in the VM
+ * structure.
+ */
+#define MVM_SCOPE_CACHE_SIZE 16
+
+/**
+ * Number of handle slots allocated from the host at a time (see
+ * mvm_initializeHandle). Each page takes 4 bytes per slot.
+ */
+#define MVM_HANDLE_PAGE_SIZE 16
+
+/**
+ * Set to 1 to keep a hash index over the strings that are interned at runtime
+ * (e.g. property names built with string concatenation), so that finding the
+ * interned copy of a string doesn't need a linear search of every such string.
+ *
+ * The index is malloc'd separately from the VM heap (2 bytes per slot, at most
+ * half full) and is rebuilt after each garbage collection.
+ */
+#define MVM_INTERN_INDEX 1
+
+/**
+ * Set to 1 to enable generational garbage collection. Allocations made since
+ * the last collection are kept in a "nursery" that is collected on its own
+ * (a minor collection) when it reaches MVM_GC_NURSERY_SIZE bytes, so that
+ * short-lived temporaries are reclaimed without copying the whole heap. A full
+ * (major) collection is still done when the heap reaches MVM_MAX_HEAP_SIZE.
+ *
+ * Requires MVM_NATIVE_POINTER_IS_16_BIT and MVM_USE_SINGLE_RAM_PAGE to be 0.
+ */
+#define MVM_GENERATIONAL_GC 1
+
+/**
+ * The amount of young allocations (in bytes) that triggers a minor collection.
+ */
+#define MVM_GC_NURSERY_SIZE MVM_ALLOCATION_BUCKET_SIZE
+
+/**
+ * Number of old-generation slots that can be remembered as pointing into the
+ * nursery between collections (2 bytes each in the VM structure). If more are
+ * written, the next minor collection scans the whole old generation instead.
+ */
+#define MVM_GC_REMEMBERED_SET_SIZE 16
+
+/**
+ * Set to 1 to include `mvm_gcStep`, which spreads a full garbage collection
+ * over many calls with a bounded amount of work each, so that the VM task
+ * doesn't stall other tasks on the same core for the duration of a collection
+ * while it's idle. This makes the handle accessors (`mvm_handleGet` etc.)
+ * function calls rather than inline.
+ */
+#define MVM_INCREMENTAL_GC 1
+
+/**
+ * Set to 1 to include `mvm_setGCPolicy`, a runtime-configurable policy for when
+ * the VM runs a major collection by itself (target heap size, growth factor
+ * and allocation rate), and the `mvm_gcIdle` hook for collecting while the VM
+ * task is idle.
+ */
+#define MVM_GC_POLICY 1
+
+/**
+ * Optional. A timestamp in microseconds, used to report garbage collection
+ * pause times in mvm_getMemoryStats.
+ */
+#include "esp_timer.h"
+#define MVM_GC_CLOCK_US() esp_timer_get_time()
+
+/**
+ * Set to 1 to count the executions and the time spent in each opcode and in
+ * each bytecode function, reported by `mvm_getProfile`. This adds a clock read
+ * to every instruction, so it is only meant for profiling builds.
+ */
+#define MVM_PROFILE 0
+
+/**
+ * Maximum number of distinct bytecode functions tracked by the profiler.
+ * Functions called after the table is full are counted together.
+ */
+#define MVM_PROFILE_MAX_FUNCTIONS 32
+
+/**
+ * Optional. A free-running counter used by the profiler, here CPU cycles.
+ */
+#include "esp_cpu.h"
+#define MVM_PROFILE_CLOCK() esp_cpu_get_cycle_count()
+
+/**
+ * Set to 1 to include the sampling profiler (`mvm_requestSample`), which
+ * records the bytecode call stack when asked to by a timer, for flame graphs.
+ * When included, it costs one flag test per instruction.
+ */
+#define MVM_SAMPLING_PROFILER 0
+
+/**
+ * Number of call stacks that the sampling profiler can hold between calls to
+ * `mvm_drainFoldedStacks`, and the number of frames kept from each (deeper
+ * frames are dropped). Each sample takes 2 + 2 * MVM_SAMPLE_MAX_DEPTH bytes.
+ */
+#define MVM_SAMPLE_RING_SIZE 64
+#define MVM_SAMPLE_MAX_DEPTH 8
+
+/**
+ * Set to 1 to include the heap profiler (`mvm_startHeapProfile`), which tags
+ * each allocation with the bytecode address and type of its allocating
+ * instruction and reports, per site, the allocations made, the bytes still
+ * live and the survival rate across garbage collections. When included, it
+ * costs a pointer test per allocation while the profiler is not started.
+ */
+#define MVM_HEAP_PROFILE 0
+
+/**
+ * Maximum number of distinct allocation sites tracked by the heap profiler
+ * (at most 255). Sites found after the table is full are counted together.
+ */
+#define MVM_HEAP_PROFILE_MAX_SITES 32
+
+/**
+ * Set to 1 to include `mvm_dumpHeap`, which writes the reachable heap with the
+ * type, size and references of each allocation, for comparison of two dumps
+ * with the host-side `heap_diff` tool.
+ */
+#define MVM_HEAP_DUMP 0
+
+/**
+ * Set to 1 to run the bytecode from a RAM copy in which common sequences of
+ * instructions are fused into superinstructions, each dispatched once (see
+ * `mvm_TeSuperinstruction`). A function is rewritten the first time it's
+ * called. The copy costs as much RAM as the bytecode image, and replaces
+ * running the image in place from flash, so this is off by default.
+ */
+#define MVM_SUPERINSTRUCTIONS 0
+
+/**
+ * The superinstructions to use, as `mvm_TeSuperinstruction` flags. A profiling
+ * build can pick these for a given script with `mvm_suggestSuperinstructions`.
+ */
+#define MVM_SUPERINSTRUCTION_MASK MVM_SUPERINSTRUCTION_ALL
+
+/**
+ * Set to 1 to recycle the heap boxes of intermediate number results. A number
+ * outside the 14-bit integer range is boxed on the heap, so an expression such
+ * as `now - last > 1000` on millisecond timestamps allocates for the
+ * subtraction even though its result is only compared and dropped. With this
+ * option, a box allocated by an arithmetic instruction and consumed straight
+ * away by the next one is given back to the heap, so that the next result can
+ * take its place. Costs a few bytes in the VM structure.
+ */
+#define MVM_RECYCLE_NUMBER_BOXES 1
+
+/**
+ * Set to 1 to defer string concatenation. Without this, every `+` on strings
+ * copies both sides into a new string, so building up a log line or a payload
+ * piece by piece copies the start of it over and over again. With this option,
+ * the result of a concatenation is a small node that refers to the two sides
+ * (a "rope"), and the bytes are only copied into one piece when they're needed
+ * that way (`mvm_toStringUtf8`, or using the string as a property key).
+ *
+ * A rope costs 8 bytes of heap, so a concatenation is still copied if both
+ * sides are shorter than MVM_ROPE_MIN_SIZE, and short pieces appended to a rope
+ * are merged into its last piece until they reach that size. The pieces of a
+ * rope take a little more heap than the flat string would, so with a small
+ * MVM_MAX_HEAP_SIZE the longest string that can be built and then flattened is
+ * slightly shorter (about 400 rather than 450 bytes of a 1 kB heap).
+ */
+#define MVM_STRING_ROPES 1
+#define MVM_ROPE_MIN_SIZE 64
+
+/**
+ * Set to 1 to include `mvm_typedArrayFromExternal`, which lets the script index
+ * a buffer in host memory (e.g. a DMA capture frame) without copying it into
+ * the VM heap. The VM keeps a small table of these buffers, malloc'd from the
+ * host (16 bytes per entry), and checks it after each garbage collection to
+ * release the buffers that the script no longer references.
+ */
+#define MVM_EXTERNAL_BUFFERS 1
+
 /**
  * Macro that evaluates to true if the CRC of the given data matches the
  * expected value. Note that this is evaluated against the bytecode, so lpData
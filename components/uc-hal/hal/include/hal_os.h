@@ -62,6 +62,18 @@
  */
 #define OS_GetSystemTime()      OS_PORT_GetSystemTime()
 
+/**
+ * Returns the time that elapsed since reset in microseconds, for measurements
+ * that need a finer resolution than the system tick.
+ */
+#define OS_GetTimeUs()          OS_PORT_GetTimeUs()
+
+/**
+ * Number of processor cores that tasks can be pinned to (see
+ * \ref OSTASK_CreatePinned).
+ */
+#define OS_CORE_COUNT           OS_PORT_CORE_COUNT
+
 /*@}*/
 
 // -----------------------------------------------------------------------------
@@ -85,6 +97,18 @@
  */
 #define OSTASK_Create(task_impl, priority, stack_size, arg)     OSTASK_PORT_Create(task_impl, priority, stack_size, arg)
 
+/** 
+ *  Creates a new task that only runs on the given processor core.
+ *  @returns handle of a newly created task
+ *  
+ *  @param task_impl pointer to the task implementation function
+ *  @param priority task priority
+ *  @param stack_size stack size (in bytes)
+ *  @param arg task argument
+ *  @param core processor core, from 0 to OS_CORE_COUNT - 1
+ */
+#define OSTASK_CreatePinned(task_impl, priority, stack_size, arg, core) OSTASK_PORT_CreatePinned(task_impl, priority, stack_size, arg, core)
+
 /** 
  *  Destroys a task
  *  
@@ -167,6 +191,13 @@
  */
 #define OSSEM_Give(sem)                     OSSEM_PORT_Give(sem)
 
+/** 
+ *  Gives the binary semaphore from an interrupt handler.
+ *  
+ *  @param sem binary semaphore to give
+ */
+#define OSSEM_GiveFromISR(sem)              OSSEM_PORT_GiveFromISR(sem)
+
 /**
  *  Takes the binary semaphore. If the semaphore is not immediately available, the task
  *  from which the call was made is blocked. The maximum time spent waiting for the
@@ -49,7 +49,7 @@ void TIM_Init(TIMDevice tim, uint32_t TickTimeBase) {
 #if (HAL_TIM_USE_TASK_EVENTS)
         if (tim->TskEvents) {
             // this TIM object supports task-level events
-            DIAG_DEBUG_ASSERT_AND_EXECUTE(tim->IntEvents->EventTable) {
+            DIAG_DEBUG_ASSERT_AND_EXECUTE(tim->TskEvents->EventTable) {
                 // clear task-level events associated with the timer
                 tim->TskEvents->InstalledEvents = 0;
                 tim->TskEvents->NextEvent.id = TIM_NO_EVENT;
@@ -144,6 +144,7 @@ TIM_EventID TIM_InitEvent(TIMDevice tim, void (*handler)(TIMDevice tim, TIM_Even
 // -----------------------------------------------------------------------------
 void TIM_DeinitEvent(TIMDevice tim, TIM_EventID event_id) {
     TIM_EventTable *Events;
+    TIM_Event *event;
 
     Events = NULL;
 
@@ -164,10 +165,22 @@ void TIM_DeinitEvent(TIMDevice tim, TIM_EventID event_id) {
         if (Events) {
             DIAG_DEBUG_ASSERT_AND_EXECUTE(((event_id.index >= 0) && (event_id.index < Events->MaxEvents))) {
                 CORE_EnterCritical();
+                // remove event from queue
+                if (Events->NextEvent.id == event_id.id) {
+                    Events->NextEvent = Events->EventTable[event_id.index].next_event;
+                } else if (Events->NextEvent.id != TIM_NO_EVENT) {
+                    event = &Events->EventTable[Events->NextEvent.index];
+                    while ((event->next_event.id != TIM_NO_EVENT) && (event->next_event.id != event_id.id)) {
+                        event = &Events->EventTable[event->next_event.index];
+                    }
+                    if (event->next_event.id == event_id.id) {
+                        event->next_event = Events->EventTable[event_id.index].next_event;
+                    }
+                }
+                Events->EventTable[event_id.index].next_event.id = TIM_NO_EVENT;
                 // this deinitializes the event, by disconnecting the event handler func
                 Events->EventTable[event_id.index].handler = NULL;
                 Events->InstalledEvents--;
-                // TODO: CRITICAL! remove event from queue
                 CORE_ExitCritical();
             }
         } // if (Events)
@@ -213,8 +226,8 @@ int TIM_ScheduleEvent(TIMDevice tim, TIM_EventID event_id, TIM_Time delta_time)
 int TIM_ScheduleEventAt(TIMDevice tim, TIM_EventID event_id, TIM_Time abs_time) {
     int32_t i;
     TIM_Event *event;
+    TIM_Event *prev;
     TIM_EventTable *Events;
-    int found;
 
     Events = NULL;
 
@@ -239,26 +252,29 @@ int TIM_ScheduleEventAt(TIMDevice tim, TIM_EventID event_id, TIM_Time abs_time)
                 // some events are already scheduled
                 // insert event into the queue
                 event = &Events->EventTable[Events->NextEvent.index];
+                prev = NULL;
                 i = 0;
                 while (i < Events->InstalledEvents) {
                     if ((abs_time.counter_periods < event->expires.counter_periods) ||
                             ((abs_time.counter_periods == event->expires.counter_periods) && (abs_time.counter_ticks < event->expires.counter_ticks)))
                     {
-                        found = 1;
-                        // insert event here
+                        // insert event before this one
                         Events->EventTable[event_id.index].expires = abs_time;
-                        Events->EventTable[event_id.index].next_event = event->next_event;
-                        event->next_event = event_id;
-                        if (i == 0) {
+                        if (prev == NULL) {
                             // this event is the first in queue
+                            Events->EventTable[event_id.index].next_event = Events->NextEvent;
                             Events->NextEvent = event_id;
                             tim->ScheduleEvent(tim, abs_time);
+                        } else {
+                            Events->EventTable[event_id.index].next_event = prev->next_event;
+                            prev->next_event = event_id;
                         }
                         CORE_ExitCritical();
                         return 0;
                     } else {
                         // check next event in queue
                         if (event->next_event.id != TIM_NO_EVENT) {
+                            prev = event;
                             event = &Events->EventTable[event->next_event.index];
                         } else {
                             // insert event at the end of the queue
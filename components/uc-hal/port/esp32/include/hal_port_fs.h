@@ -14,9 +14,12 @@
 #define HAL_PORT_FS_H_
 
 #include "hal_port_fs.h"
+#include "esp_partition.h"
 
 #define MOUNT_POINT           "/littlefs"
 #define PARTITION_LABEL       "littlefs"
+#define SCRIPT_PARTITION_LABEL "script"
+#define HIBERNATE_PARTITION_LABEL "hibernate"
 
 #define fs_init()             littlefs_init()
 #define fs_open(FN, OT)       littlefs_fopen(FN, OT)
@@ -24,6 +27,11 @@
 #define fs_remove(FN)         littlefs_remove(FN)
 #define fs_rename(ON, NN)     littlefs_rename(ON, NN)
 #define fs_ls()               littlefs_ls()
+#define fs_map(PL, SZ, HN)    partition_map(PL, SZ, HN)
+#define fs_unmap(HN)          partition_unmap(HN)
+#define fs_write_partition(PL, DT, SZ) partition_write(PL, DT, SZ)
+
+typedef esp_partition_mmap_handle_t fs_map_handle_t;
 
   int littlefs_init(void);
  void littlefs_deinit(void);
@@ -33,4 +41,25 @@ FILE* littlefs_freopen(const char *filename, const char *opentype, FILE *stream)
   int littlefs_remove(const char *file);
   int littlefs_rename(const char *file, char *newname);
 
+/**
+ * Map a raw data partition into the data address space, read-only.
+ *
+ * @param label partition label (see partitions.csv)
+ * @param size receives the size of the partition
+ * @param handle receives the handle to pass to partition_unmap
+ * @return pointer to the mapped partition or NULL if not found
+ */
+const void* partition_map(const char *label, size_t *size, fs_map_handle_t *handle);
+       void partition_unmap(fs_map_handle_t handle);
+
+/**
+ * Erase a raw data partition and write data at its start.
+ *
+ * @param label partition label (see partitions.csv)
+ * @param data data to write
+ * @param size size of data
+ * @return ESP_OK on success
+ */
+        int partition_write(const char *label, const void *data, size_t size);
+
 #endif /* HAL_PORT_FS_H_ */
@@ -22,6 +22,7 @@
 
 #include "hal_port_fs.h"
 #include "esp_littlefs.h"
+#include "esp_partition.h"
 
 static const char *TAG = "littlefs";
 
@@ -120,3 +121,49 @@ int littlefs_rename(const char *file, char *newname) {
     sprintf(route_new, "%s/%s", MOUNT_POINT, newname);
     return rename(route_old, route_new);
 }
+
+const void* partition_map(const char *label, size_t *size, fs_map_handle_t *handle) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "Partition not found: %s", label);
+        return NULL;
+    }
+
+    const void *ptr;
+    esp_err_t ret = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &ptr, handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map partition %s (%s)", label, esp_err_to_name(ret));
+        return NULL;
+    }
+
+    *size = partition->size;
+    return ptr;
+}
+
+void partition_unmap(fs_map_handle_t handle) {
+    esp_partition_munmap(handle);
+}
+
+int partition_write(const char *label, const void *data, size_t size) {
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL) {
+        ESP_LOGE(TAG, "Partition not found: %s", label);
+        return ESP_FAIL;
+    }
+    if (size > partition->size) {
+        ESP_LOGE(TAG, "Data too large for partition %s: %d", label, size);
+        return ESP_FAIL;
+    }
+
+    // Erase whole sectors
+    size_t eraseSize = (size + partition->erase_size - 1) / partition->erase_size * partition->erase_size;
+    esp_err_t ret = esp_partition_erase_range(partition, 0, eraseSize);
+    if (ret == ESP_OK)
+        ret = esp_partition_write(partition, 0, data, size);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write partition %s (%s)", label, esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
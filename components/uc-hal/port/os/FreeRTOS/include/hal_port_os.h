@@ -14,7 +14,9 @@
 #define HAL_PORT_OS_H
 
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 
 #define OS_PORT_MS_TO_TICK(ms_time)             ((ms_time * configTICK_RATE_HZ)/1000)
 
@@ -28,6 +30,8 @@ typedef TickType_t OSTime;
 #define OS_PORT_Stop()                          vTaskEndScheduler()
 #define OS_PORT_Sleep(ticks)                    vTaskDelay(ticks)
 #define OS_PORT_GetSystemTime()                 xTaskGetTickCount()
+#define OS_PORT_GetTimeUs()                     ((uint64_t) esp_timer_get_time())
+#define OS_PORT_CORE_COUNT                      portNUM_PROCESSORS
 void OS_PORT_SleepUntil(OSTime time);
 
 // -----------------------------------------------------------------------------
@@ -38,6 +42,20 @@ typedef TaskHandle_t OSTask;
 
 OSTask OSTASK_PORT_Create(TaskFunction_t task_impl, int priority, size_t stack_size, void *arg);
 
+static inline OSTask OSTASK_PORT_CreatePinned(TaskFunction_t task_impl, int priority, size_t stack_size, void *arg, int core) {
+    OSTask task;
+
+    if (stack_size == 0) {
+        stack_size = configMINIMAL_STACK_SIZE;
+    }
+    priority += tskIDLE_PRIORITY;
+    if (pdPASS != xTaskCreatePinnedToCore(task_impl, "", stack_size, arg, priority, &task, core)) {
+        return NULL;
+    }
+
+    return task;
+}
+
 #define OSTASK_PORT_Destroy(task)               vTaskDelete((task))
 #define OSTASK_PORT_Suspend(task)               vTaskSuspend((task))
 #define OSTASK_PORT_Resume(task)                vTaskResume((task))
@@ -55,6 +73,7 @@ typedef SemaphoreHandle_t OSSem;
 #define OSSEM_PORT_Create()                     xQueueCreate((unsigned portBASE_TYPE)1, semSEMAPHORE_QUEUE_ITEM_LENGTH)
 #define OSSEM_PORT_Destroy(sem)                 do { } while (0)
 #define OSSEM_PORT_Give(sem)                    xSemaphoreGive((sem))
+#define OSSEM_PORT_GiveFromISR(sem)             do { BaseType_t woken = pdFALSE; xSemaphoreGiveFromISR((sem), &woken); if (woken) portYIELD_FROM_ISR(); } while (0)
 #define OSSEM_PORT_Take(sem, timeout)           ((xSemaphoreTake((sem), OS_PORT_MS_TO_TICK(timeout)) == pdTRUE) ? 0 : 1)
 
 // -----------------------------------------------------------------------------
@@ -0,0 +1,179 @@
+/*
+ * @file async_bench.c
+ * @brief async host functions: one task multiplexing many VMs (host)
+ * @details
+ * Runs the same export in several VMs, where every host function the script
+ * calls stands in for slow I/O that blocks for `io-ms`. First the host
+ * functions block the task in turn, as synchronous host functions do. Then
+ * they are async (see microvium_hal_async.h): each VM's call is suspended
+ * while its I/O runs on an I/O task, and one task continues the VMs as their
+ * I/O completes.
+ *
+ *   async_bench [vms] [io-ms] [bytecode-file] [export-id]
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hal_os.h"
+#include "microvium.h"
+#include "microvium_hal_async.h"
+#include "microvium_hal_image.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_VMS       8
+#define DEFAULT_IO_MS     20
+#define DEFAULT_EXPORT_ID 1234
+
+static microvium_hal_async_t *async;
+static uint32_t io_ms;
+static long host_calls;
+
+static void io_work(void *arg) {
+    OS_Sleep(io_ms);
+}
+
+static mvm_Value io_finish(mvm_VM *vm, void *arg) {
+    return mvm_newInt32(vm, (int32_t) io_ms);
+}
+
+static mvm_TeError io_sync(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    host_calls++;
+    io_work(NULL);
+    *result = io_finish(vm, NULL);
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError io_async(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    host_calls++;
+    return microvium_hal_async_start(async, vm, io_work, io_finish, NULL);
+}
+
+static mvm_TeError resolveSync(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = io_sync;
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveAsync(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = io_async;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Restore `count` VMs and resolve the export in each. Returns false on error.
+static bool restore(microvium_hal_image_t *bytecode, mvm_TfResolveImport resolve, mvm_VMExportID exportId, mvm_VM **vms,
+        mvm_Value *funcs, int count) {
+    for (int i = 0; i < count; i++) {
+        mvm_TeError err = mvm_restore(&vms[i], bytecode->bytecode, bytecode->size, NULL, resolve);
+        if (err == MVM_E_SUCCESS)
+            err = mvm_resolveExports(vms[i], &exportId, &funcs[i], 1);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "VM %d: restore error: %d\n", i, err);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_VMS;
+    io_ms = argc > 2 ? (uint32_t) atoi(argv[2]) : DEFAULT_IO_MS;
+    const char *path = argc > 3 ? argv[3] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 4 ? (mvm_VMExportID) atoi(argv[4]) : DEFAULT_EXPORT_ID;
+    microvium_hal_image_t bytecode;
+    mvm_TeError err;
+    mvm_Value result;
+    int status = 1;
+
+    if (count <= 0) {
+        fprintf(stderr, "vms must be at least 1\n");
+        return 1;
+    }
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    mvm_VM **vms = calloc(count, sizeof(*vms));
+    mvm_Value *funcs = calloc(count, sizeof(*funcs));
+    async = microvium_hal_async_create(count, count, 0, 0);
+    if (vms == NULL || funcs == NULL || async == NULL) {
+        fprintf(stderr, "cannot create the async context\n");
+        goto done;
+    }
+
+    // Synchronous: each host call blocks the task
+    if (!restore(&bytecode, resolveSync, exportId, vms, funcs, count))
+        goto done;
+    host_calls = 0;
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        err = mvm_call(vms[i], funcs[i], &result, NULL, 0);
+        if (err != MVM_E_SUCCESS)
+            fprintf(stderr, "VM %d: mvm_call error: %d\n", i, err);
+    }
+    double sync = now() - start;
+    long syncCalls = host_calls;
+    for (int i = 0; i < count; i++) {
+        mvm_free(vms[i]);
+        vms[i] = NULL;
+    }
+
+    // Async: every VM is started, then continued as its I/O completes
+    if (!restore(&bytecode, resolveAsync, exportId, vms, funcs, count))
+        goto done;
+    host_calls = 0;
+    start = now();
+    int running = 0;
+    for (int i = 0; i < count; i++) {
+        err = mvm_call(vms[i], funcs[i], &result, NULL, 0);
+        if (err == MVM_E_HOST_PENDING)
+            running++;
+        else if (err != MVM_E_SUCCESS)
+            fprintf(stderr, "VM %d: mvm_call error: %d\n", i, err);
+    }
+    while (running > 0) {
+        mvm_VM *vm = microvium_hal_async_run(async, 1000, &err, &result);
+        if (vm == NULL)
+            continue;
+        if (err != MVM_E_HOST_PENDING)
+            running--;
+        if (err != MVM_E_SUCCESS && err != MVM_E_HOST_PENDING)
+            fprintf(stderr, "mvm_completeHostCall error: %d\n", err);
+    }
+    double multiplexed = now() - start;
+
+    printf("%d VMs, %ld host calls of %u ms each\n", count, syncCalls, (unsigned) io_ms);
+    printf("  synchronous: %8.1f ms\n", sync * 1000);
+    printf("  async:       %8.1f ms (%ld host calls)\n", multiplexed * 1000, host_calls);
+    status = 0;
+
+done:
+    if (async != NULL)
+        microvium_hal_async_destroy(async);
+    for (int i = 0; vms != NULL && i < count; i++) {
+        if (vms[i] != NULL)
+            mvm_free(vms[i]);
+    }
+    free(vms);
+    free(funcs);
+    microvium_hal_image_release(&bytecode);
+    return status;
+}
@@ -0,0 +1,249 @@
+/*
+ * @file bench_suite.c
+ * @brief benchmark suite for the engine (host)
+ * @details
+ * Runs each workload in a fresh VM and reports instruction throughput, heap
+ * allocation, number boxes recycled rather than allocated per second (see
+ * MVM_RECYCLE_NUMBER_BOXES), garbage collector pauses and peak heap size, as a
+ * table on stdout and optionally as JSON so that results can be compared
+ * across commits.
+ *
+ *   bench_suite [--calls N] [--label TEXT] [--json FILE] [NAME=BYTECODE[@EXPORT]]...
+ *
+ * A workload is an exported function (default export ID 1) of a bytecode
+ * image, called N times. The sources of the standard workloads are in
+ * `bench/workloads`; see host/CMakeLists.txt for how they are compiled. With
+ * no workloads on the command line, the test script is run on its own.
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "microvium.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_WORKLOAD  "hello=" MVM_BENCH_DEFAULT_BYTECODE "@1234"
+#define DEFAULT_EXPORT_ID 1
+#define DEFAULT_CALLS     10000
+
+typedef struct bench_result_s {
+    const char *name;
+    long calls;
+    uint64_t instructions;
+    double seconds;
+    mvm_TsMemoryStats stats;
+} bench_result_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Runs one workload, given as NAME=BYTECODE[@EXPORT]. The spec is modified in
+ * place. Returns false if the workload could not be run.
+ */
+static bool run_workload(char *spec, long calls, bench_result_t *out) {
+    mvm_VMExportID exportId = DEFAULT_EXPORT_ID;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+
+    char *path = strchr(spec, '=');
+    if (path == NULL) {
+        fprintf(stderr, "%s: expected NAME=BYTECODE[@EXPORT]\n", spec);
+        return false;
+    }
+    *path++ = '\0';
+    char *exportStr = strrchr(path, '@');
+    if (exportStr != NULL) {
+        *exportStr++ = '\0';
+        exportId = (mvm_VMExportID) atoi(exportStr);
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->name = spec;
+    out->calls = calls;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "%s: cannot read %s\n", spec, path);
+        return false;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "%s: mvm_restore error: %d\n", spec, err);
+        free(bytecode);
+        return false;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "%s: mvm_resolveExports error: %d\n", spec, err);
+        goto fail;
+    }
+
+    double start = now();
+    for (long i = 0; i < calls; i++) {
+        // The gas counter doubles as an instruction counter
+        mvm_stopAfterNInstructions(vm, INT32_MAX);
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "%s: mvm_call error: %d\n", spec, err);
+            goto fail;
+        }
+        out->instructions += INT32_MAX - mvm_getInstructionCountRemaining(vm);
+    }
+    out->seconds = now() - start;
+
+    mvm_getMemoryStats(vm, &out->stats);
+    mvm_free(vm);
+    free(bytecode);
+    return true;
+
+fail:
+    mvm_free(vm);
+    free(bytecode);
+    return false;
+}
+
+static void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char) *s >= 0x20)
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void write_json(FILE *f, const char *label, const bench_result_t *results, int count) {
+    fprintf(f, "{\n  \"label\": ");
+    print_json_string(f, label);
+    fprintf(f, ",\n  \"engine\": {\"computedGoto\": %d, \"propertyCacheSize\": %d, \"internIndex\": %d, "
+            "\"generationalGC\": %d, \"incrementalGC\": %d, \"superinstructions\": %d, \"recycleNumberBoxes\": %d, "
+            "\"stringRopes\": %d, \"maxHeapSize\": %d},\n",
+            MVM_COMPUTED_GOTO, MVM_PROPERTY_CACHE_SIZE, MVM_INTERN_INDEX, MVM_GENERATIONAL_GC, MVM_INCREMENTAL_GC,
+            MVM_SUPERINSTRUCTIONS, MVM_RECYCLE_NUMBER_BOXES, MVM_STRING_ROPES, MVM_MAX_HEAP_SIZE);
+    fprintf(f, "  \"workloads\": [");
+    for (int i = 0; i < count; i++) {
+        const bench_result_t *r = &results[i];
+        const mvm_TsMemoryStats *s = &r->stats;
+        fprintf(f, "%s\n    {\"name\": ", i ? "," : "");
+        print_json_string(f, r->name);
+        fprintf(f, ", \"calls\": %ld, \"instructions\": %llu, \"seconds\": %.6f, \"instructionsPerSecond\": %.0f, "
+                "\"allocatedBytes\": %zu, \"boxesRecycled\": %zu, \"boxesRecycledPerSecond\": %.0f, "
+                "\"peakHeap\": %zu, \"peakStack\": %zu, \"gcMajor\": %zu, \"gcMajorPauseTotalUs\": %zu, \"gcMajorPauseMaxUs\": %zu, "
+                "\"gcMinor\": %zu, \"gcMinorPauseTotalUs\": %zu, \"gcMinorPauseMaxUs\": %zu}", r->calls,
+                (unsigned long long) r->instructions, r->seconds, r->instructions / r->seconds, s->allocatedBytes,
+                s->numberBoxesRecycled, s->numberBoxesRecycled / r->seconds, s->virtualHeapHighWaterMark, s->stackHighWaterMark, s->gcMajorCollections, s->gcMajorPauseTotal,
+                s->gcMajorPauseMax, s->gcMinorCollections, s->gcMinorPauseTotal, s->gcMinorPauseMax);
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    long calls = DEFAULT_CALLS;
+    const char *label = "";
+    const char *jsonPath = NULL;
+    char defaultWorkload[] = DEFAULT_WORKLOAD;
+    char *defaultSpecs[] = { defaultWorkload };
+    char **specs = argv + 1;
+    int specCount = 0;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc)
+            calls = atol(argv[++i]);
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+            label = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+            specs[specCount++] = argv[i];
+    }
+    if (specCount == 0) {
+        specs = defaultSpecs;
+        specCount = 1;
+    }
+
+    bench_result_t *results = (bench_result_t*) calloc(specCount, sizeof(bench_result_t));
+    int count = 0;
+
+    printf("%-12s %12s %10s %12s %12s %8s %8s %10s %8s %10s\n", "workload", "instructions", "M instr/s", "allocated",
+            "recycled/s", "peak", "major", "major max", "minor", "minor max");
+    for (int i = 0; i < specCount; i++) {
+        bench_result_t *r = &results[count];
+        if (!run_workload(specs[i], calls, r)) {
+            failed++;
+            continue;
+        }
+        count++;
+        printf("%-12s %12llu %10.2f %12zu %12.0f %8zu %8zu %8zuus %8zu %8zuus\n", r->name,
+                (unsigned long long) r->instructions, r->instructions / r->seconds / 1e6, r->stats.allocatedBytes,
+                r->stats.numberBoxesRecycled / r->seconds, r->stats.virtualHeapHighWaterMark,
+                r->stats.gcMajorCollections, r->stats.gcMajorPauseMax, r->stats.gcMinorCollections,
+                r->stats.gcMinorPauseMax);
+    }
+
+    if (jsonPath != NULL) {
+        FILE *f = fopen(jsonPath, "w");
+        if (f == NULL) {
+            fprintf(stderr, "cannot write %s\n", jsonPath);
+            return 1;
+        }
+        write_json(f, label, results, count);
+        fclose(f);
+    }
+
+    free(results);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * @file dispatch_bench.c
+ * @brief interpreter dispatch benchmark (host)
+ * @details
+ * Runs an exported function of a bytecode image repeatedly and reports the
+ * instruction throughput of `mvm_call`. The same source is built once against
+ * an engine using `switch` dispatch, once against an engine using computed
+ * goto and once with superinstructions added (see host/CMakeLists.txt), so all
+ * modes run the same bytecode. With superinstructions, compare the times
+ * rather than the instruction rates, since a superinstruction counts as one
+ * instruction.
+ *
+ *   dispatch_bench_<mode> [bytecode-file] [export-id] [iterations]
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "microvium.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_EXPORT_ID  1234
+#define DEFAULT_ITERATIONS 200000
+
+#if MVM_SUPERINSTRUCTIONS
+#define DISPATCH_MODE "superinstr"
+#elif MVM_COMPUTED_GOTO
+#define DISPATCH_MODE "computed-goto"
+#else
+#define DISPATCH_MODE "switch"
+#endif
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    long iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        return 1;
+    }
+
+    uint64_t instructions = 0;
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        // The gas counter doubles as an instruction counter
+        mvm_stopAfterNInstructions(vm, INT32_MAX);
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "mvm_call error: %d\n", err);
+            return 1;
+        }
+        instructions += INT32_MAX - mvm_getInstructionCountRemaining(vm);
+    }
+    double elapsed = now() - start;
+
+    printf("%-14s %ld calls, %llu instructions, %.3f s, %.2f M instructions/s\n", DISPATCH_MODE, iterations,
+            (unsigned long long) instructions, elapsed, instructions / elapsed / 1e6);
+
+    mvm_free(vm);
+    free(bytecode);
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * @file events_bench.c
+ * @brief event queue throughput, drops and latency (host)
+ * @details
+ * Producer threads post events to an event queue (see microvium_hal_events.h)
+ * as fast as they can for a fixed time, while the main thread dispatches them
+ * to an export of the script, once with one event per call and once in
+ * batches. Reports the events dispatched per second, the events dropped
+ * because the ring was full and the latency histogram of each run.
+ *
+ *   events_bench [producers] [duration-ms] [capacity] [bytecode-file] [export-id]
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "hal_os.h"
+#include "microvium.h"
+#include "microvium_hal_events.h"
+#include "microvium_hal_image.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_PRODUCERS   2
+#define DEFAULT_DURATION_MS 500
+#define DEFAULT_CAPACITY    256
+#define DEFAULT_EXPORT_ID   1234
+
+typedef struct producer {
+    microvium_hal_events_t *events;
+    uint16_t type;
+    atomic_bool *stop;
+    OSSem exited;
+} producer_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void producer_task(void *arg) {
+    producer_t *p = (producer_t*) arg;
+    int32_t value = 0;
+
+    while (!atomic_load(p->stop)) {
+        microvium_hal_events_post(p->events, p->type, value++);
+        // Leave the consumer some CPU on a single core
+        if ((value & 0xFF) == 0)
+            OSTASK_Yield();
+    }
+
+    OSSEM_Give(p->exited);
+    OSTASK_Destroy(NULL);
+}
+
+static void run(mvm_VM *vm, mvm_Handle *handler, int producers, uint32_t duration_ms, uint32_t capacity, int max_batch) {
+    microvium_hal_events_t *events = microvium_hal_events_create(capacity);
+    producer_t *p = calloc(producers, sizeof(*p));
+    atomic_bool stop = false;
+    mvm_TeError err = MVM_E_SUCCESS;
+
+    if (events == NULL || p == NULL) {
+        fprintf(stderr, "cannot create the event queue\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < producers; i++) {
+        p[i].events = events;
+        p[i].type = (uint16_t) i;
+        p[i].stop = &stop;
+        p[i].exited = OSSEM_Create();
+        OSTASK_Create(producer_task, 0, 0, &p[i]);
+    }
+
+    double start = now();
+    while (now() - start < duration_ms / 1000.0 && err == MVM_E_SUCCESS) {
+        if (microvium_hal_events_wait(events, 10))
+            microvium_hal_events_dispatch(events, vm, handler, max_batch, &err);
+    }
+    atomic_store(&stop, true);
+    for (int i = 0; i < producers; i++) {
+        while (OSSEM_Take(p[i].exited, 1000) != 0)
+            ;
+        OSSEM_Destroy(p[i].exited);
+    }
+    // Whatever is left
+    while (microvium_hal_events_dispatch(events, vm, handler, max_batch, &err) > 0 && err == MVM_E_SUCCESS)
+        ;
+    double seconds = now() - start;
+    if (err != MVM_E_SUCCESS)
+        fprintf(stderr, "mvm_call error: %d\n", err);
+
+    microvium_hal_events_stats_t stats;
+    microvium_hal_events_get_stats(events, &stats);
+    printf("batch %2d: %10.0f events/s, %u posted, %u dropped (%.1f%%), %u calls, max batch %u\n", max_batch,
+            stats.dispatched / seconds, (unsigned) stats.posted, (unsigned) stats.dropped,
+            stats.posted ? 100.0 * stats.dropped / stats.posted : 0.0, (unsigned) stats.batches,
+            (unsigned) stats.max_batch);
+    printf("  latency:");
+    for (int i = 0; i < MICROVIUM_HAL_EVENTS_LATENCY_BUCKETS; i++) {
+        if (stats.latency[i])
+            printf(" <%uus:%u", 2u << i, (unsigned) stats.latency[i]);
+    }
+    printf("\n");
+
+    free(p);
+    microvium_hal_events_destroy(events);
+}
+
+int main(int argc, char **argv) {
+    int producers = argc > 1 ? atoi(argv[1]) : DEFAULT_PRODUCERS;
+    uint32_t duration_ms = argc > 2 ? (uint32_t) atoi(argv[2]) : DEFAULT_DURATION_MS;
+    uint32_t capacity = argc > 3 ? (uint32_t) atoi(argv[3]) : DEFAULT_CAPACITY;
+    const char *path = argc > 4 ? argv[4] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 5 ? (mvm_VMExportID) atoi(argv[5]) : DEFAULT_EXPORT_ID;
+    microvium_hal_image_t bytecode;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Handle handler;
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+    if (err == MVM_E_SUCCESS)
+        err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "restore error: %d\n", err);
+        microvium_hal_image_release(&bytecode);
+        return 1;
+    }
+
+    printf("%d producers, %u ms, ring of %u events\n", producers, (unsigned) duration_ms, (unsigned) capacity);
+    mvm_initializeHandle(vm, &handler);
+    mvm_handleSet(&handler, func);
+    run(vm, &handler, producers, duration_ms, capacity, 1);
+    run(vm, &handler, producers, duration_ms, capacity, MICROVIUM_HAL_EVENTS_MAX_BATCH);
+
+    mvm_releaseHandle(vm, &handler);
+    mvm_free(vm);
+    microvium_hal_image_release(&bytecode);
+    return 0;
+}
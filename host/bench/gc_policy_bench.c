@@ -0,0 +1,167 @@
+/*
+ * @file gc_policy_bench.c
+ * @brief garbage collection policy comparison (host)
+ * @details
+ * Drives a VM the way an event-driven script does, handling events that each
+ * allocate some short-lived temporaries and replace one entry of a long-lived
+ * table, with idle time between events, and reports for several GC policies
+ * how many collections of each kind ran, the peak heap size, and the time
+ * spent handling events (which includes the collections that the allocator
+ * runs in the middle of them) and in the idle hook:
+ *
+ *   gc_policy_bench [events] [temporaries-per-event] [bytecode-file]
+ *
+ * The first rows are without a policy: the allocator only collecting when the
+ * heap is full, and a host collecting with its own mvm_runGC calls after every
+ * event or every 8 (counted as idle time). A policy collects more often than
+ * the first, to keep the peak lower, and far less often than a host collecting
+ * after every event. A fixed interval can do as well as a policy when it's
+ * tuned to the workload, as every 8 events is here; the policy's limits are in
+ * bytes, so they hold whatever the events allocate. The last row is the
+ * policy in main/main.c.
+ *
+ * The host allocates the values itself, so any bytecode image will do. All
+ * host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "microvium.h"
+#include "microvium_hal_image.h"
+
+#if !MVM_GC_POLICY
+#error This benchmark needs an engine built with MVM_GC_POLICY
+#endif
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_EVENTS      20000
+#define DEFAULT_TEMPORARIES 12
+#define TABLE_SIZE          16
+
+typedef struct {
+    const char *name;
+    mvm_TsGCPolicy policy;
+    bool idle;
+    int runGCEvery; // Events between the host's own mvm_runGC calls, or 0
+} config_t;
+
+static const config_t configs[] = {
+    { "none (legacy)",            { 0 },                                                        false, 0 },
+    { "mvm_runGC every event",    { 0 },                                                        false, 1 },
+    { "mvm_runGC every 8 events", { 0 },                                                        false, 8 },
+    { "target 768, growth 200%",  { .targetHeapSize = 768, .growthPercent = 200 },              false, 0 },
+    { "target 640",               { .targetHeapSize = 640 },                                    false, 0 },
+    { "target 512, growth 250%",  { .targetHeapSize = 512, .growthPercent = 250 },              false, 0 },
+    { "rate 512 B / 50 us",       { .allocationRateBytes = 512, .allocationRatePeriodUs = 50 }, false, 0 },
+    { "idle 256 B",               { .idleCollectBytes = 256 },                                  true,  0 },
+    { "idle 256 B, steps 64 B",   { .idleCollectBytes = 256, .idleStepBytes = 64 },             true,  0 },
+    { "main/main.c",              { .targetHeapSize = 768, .growthPercent = 200,
+                                    .idleCollectBytes = 256, .idleStepBytes = 64 },             true,  0 },
+};
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int run(const config_t *config, const microvium_hal_image_t *bytecode, long events, int temporaries) {
+    mvm_Handle table[TABLE_SIZE];
+    mvm_TsMemoryStats stats;
+    double eventTime = 0, idleTime = 0;
+    char text[16];
+    mvm_VM *vm;
+
+    mvm_TeError err = mvm_restore(&vm, bytecode->bytecode, bytecode->size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "restore error: %d\n", err);
+        return 1;
+    }
+    mvm_setGCPolicy(vm, &config->policy);
+    for (int i = 0; i < TABLE_SIZE; i++)
+        mvm_initializeHandle(vm, &table[i]);
+
+    for (long e = 0; e < events; e++) {
+        double start = now();
+        for (int i = 0; i < temporaries; i++)
+            mvm_newInt32(vm, 1000000 + i);
+        int length = snprintf(text, sizeof text, "event %ld", e);
+        mvm_handleSet(&table[e % TABLE_SIZE], mvm_newString(vm, text, length));
+        eventTime += now() - start;
+
+        if (config->runGCEvery && (e + 1) % config->runGCEvery == 0) {
+            start = now();
+            mvm_runGC(vm, false);
+            idleTime += now() - start;
+        }
+
+        if (config->idle) {
+            start = now();
+            while (!mvm_gcIdle(vm))
+                ;
+            idleTime += now() - start;
+        }
+    }
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        const char *s = mvm_toStringUtf8(vm, mvm_handleGet(&table[i]), NULL);
+        if (atol(s + 6) % TABLE_SIZE != i) {
+            fprintf(stderr, "%s: table entry %d lost its value\n", config->name, i);
+            return 1;
+        }
+    }
+
+    mvm_getMemoryStats(vm, &stats);
+    printf("%-26s %6zu %6zu %6zu %6zu B %9.0f %9.0f\n", config->name, stats.gcMajorCollections,
+            stats.gcMinorCollections, stats.gcPolicyCollections, stats.virtualHeapHighWaterMark, eventTime * 1e9 / events,
+            idleTime * 1e9 / events);
+
+    for (int i = 0; i < TABLE_SIZE; i++)
+        mvm_releaseHandle(vm, &table[i]);
+    mvm_free(vm);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long events = argc > 1 ? atol(argv[1]) : DEFAULT_EVENTS;
+    int temporaries = argc > 2 ? atoi(argv[2]) : DEFAULT_TEMPORARIES;
+    const char *path = argc > 3 ? argv[3] : MVM_BENCH_DEFAULT_BYTECODE;
+    microvium_hal_image_t bytecode;
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    printf("%ld events, %d temporaries each, %d live entries\n", events, temporaries, TABLE_SIZE);
+    printf("%-26s %6s %6s %6s %8s %9s %9s\n", "policy", "major", "minor", "policy", "peak", "event ns", "idle ns");
+    for (size_t i = 0; i < sizeof configs / sizeof configs[0]; i++) {
+        if (run(&configs[i], &bytecode, events, temporaries))
+            return 1;
+    }
+
+    microvium_hal_image_release(&bytecode);
+    return 0;
+}
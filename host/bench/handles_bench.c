@@ -0,0 +1,145 @@
+/*
+ * @file handles_bench.c
+ * @brief handle initialize/release and GC root scanning cost (host)
+ * @details
+ * Keeps a number of handles alive in a VM, as a host that caches callbacks and
+ * objects does, and measures the time to initialize them all, to run a
+ * collection with them all as roots, and to release them all in a random
+ * order. Each handle holds either its own index or a shared heap-allocated
+ * number, and the values are checked after each collection.
+ *
+ *   handles_bench [handles] [rounds] [bytecode-file]
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "microvium.h"
+#include "microvium_hal_image.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_HANDLES 500
+#define DEFAULT_ROUNDS  200
+
+// Outside the range of values that are stored without a heap allocation
+#define BOXED_VALUE 123456789
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// One handle in 8 holds the shared number, in no regular pattern
+static bool isBoxed(int i) {
+    return ((uint32_t) i * 2654435761u) >> 29 == 0;
+}
+
+static int32_t expected(int i) {
+    return isBoxed(i) ? BOXED_VALUE : i;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_HANDLES;
+    long rounds = argc > 2 ? atol(argv[2]) : DEFAULT_ROUNDS;
+    const char *path = argc > 3 ? argv[3] : MVM_BENCH_DEFAULT_BYTECODE;
+    microvium_hal_image_t bytecode;
+    mvm_TsMemoryStats stats;
+    mvm_VM *vm;
+    double initTime = 0, gcTime = 0, releaseTime = 0;
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    mvm_TeError err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "restore error: %d\n", err);
+        return 1;
+    }
+
+    mvm_Handle *handles = malloc(count * sizeof *handles);
+    int *order = malloc(count * sizeof *order);
+    srand(1);
+
+    for (long round = 0; round < rounds; round++) {
+        mvm_Value boxed = mvm_newInt32(vm, BOXED_VALUE);
+
+        double start = now();
+        for (int i = 0; i < count; i++)
+            mvm_initializeHandle(vm, &handles[i]);
+        initTime += now() - start;
+
+        for (int i = 0; i < count; i++)
+            mvm_handleSet(&handles[i], isBoxed(i) ? boxed : mvm_newInt32(vm, i));
+
+        start = now();
+        mvm_runGC(vm, false);
+        gcTime += now() - start;
+
+        for (int i = 0; i < count; i++) {
+            if (mvm_toInt32(vm, mvm_handleGet(&handles[i])) != expected(i)) {
+                fprintf(stderr, "handle %d lost its value\n", i);
+                return 1;
+            }
+        }
+
+        // Random order, so that each release finds its handle anywhere
+        for (int i = 0; i < count; i++)
+            order[i] = i;
+        for (int i = count - 1; i > 0; i--) {
+            int j = rand() % (i + 1);
+            int t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+        }
+
+        start = now();
+        for (int i = 0; i < count; i++) {
+            err = mvm_releaseHandle(vm, &handles[order[i]]);
+            if (err != MVM_E_SUCCESS) {
+                fprintf(stderr, "release error: %d\n", err);
+                return 1;
+            }
+        }
+        releaseTime += now() - start;
+    }
+
+    mvm_getMemoryStats(vm, &stats);
+
+    printf("%d handles, %ld rounds\n", count, rounds);
+    printf("initialize: %8.1f ns per handle\n", initTime * 1e9 / ((double) rounds * count));
+    printf("release:    %8.1f ns per handle (random order)\n", releaseTime * 1e9 / ((double) rounds * count));
+    printf("collection: %8.2f us with all handles live\n", gcTime * 1e6 / rounds);
+    printf("handle table: %zu B\n", stats.handleTableSize);
+
+    free(order);
+    free(handles);
+    mvm_free(vm);
+    microvium_hal_image_release(&bytecode);
+    return 0;
+}
@@ -0,0 +1,428 @@
+/*
+ * @file heap_diff.c
+ * @brief compare two heap dumps from mvm_dumpHeap (host)
+ * @details
+ * Loads two heap dumps of the same script, taken some time apart, and reports
+ * what grew between them: by allocation type, and by path from the roots.
+ *
+ *   heap_diff before.dump after.dump [depth] [rows]
+ *
+ * Allocations move on every collection, so they can't be matched between
+ * dumps by address. Instead each dump is reduced to a spanning tree of the
+ * heap, found breadth-first from the roots (global variables first, then
+ * handles), and allocations are matched by their path in the tree: the root,
+ * then the word index of each reference and the type of what it points to,
+ * down to `depth` references (default 3). The retained size of an allocation
+ * is its own size plus that of everything below it in the tree. This is an
+ * approximation: something shared between two paths is only counted under the
+ * one that the search found first.
+ *
+ * The retained size of a type adds up the retained sizes of the allocations
+ * of that type that are not below another allocation of the same type.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// Same as in microvium.h, which isn't needed otherwise
+#define HEAP_DUMP_VERSION     1
+#define HEAP_DUMP_ROOT_GLOBAL 0
+#define HEAP_DUMP_ROOT_HANDLE 1
+
+#define DEFAULT_DEPTH 3
+#define DEFAULT_ROWS  20
+
+// Type codes from the allocation headers, as in microvium.c
+#define TYPE_COUNT             16
+#define FIRST_CONTAINER_TYPE   0x9
+
+static const char *typeNames[TYPE_COUNT] = {
+    "TC_REF_TOMBSTONE",
+    "TC_REF_INT32",
+    "TC_REF_FLOAT64",
+    "TC_REF_STRING",
+    "TC_REF_INTERNED_STRING",
+    "TC_REF_FUNCTION",
+    "TC_REF_HOST_FUNC",
+    "TC_REF_UINT8_ARRAY",
+    "TC_REF_SYMBOL",
+    "TC_REF_CLASS",
+    "TC_REF_TYPED_ARRAY",
+    "TC_REF_ROPE",
+    "TC_REF_PROPERTY_LIST",
+    "TC_REF_ARRAY",
+    "TC_REF_FIXED_LENGTH_ARRAY",
+    "TC_REF_CLOSURE",
+};
+
+typedef struct {
+    uint8_t kind;
+    uint16_t index;
+    uint16_t target;
+} root_t;
+
+typedef struct {
+    uint16_t slot;
+    uint16_t target;
+} ref_t;
+
+typedef struct {
+    uint16_t header;
+    uint16_t size;       // including the header
+    uint32_t firstRef;
+    uint16_t refCount;
+    int32_t parent;      // -1 at the top of the tree
+    uint16_t parentSlot;
+    int32_t root;        // -1 if only reachable from the stack
+    uint16_t depth;
+    uint16_t typesAbove; // bit mask of the types of the allocations above
+    uint32_t retained;
+    char *path;          // NULL below the depth of interest
+} allocation_t;
+
+typedef struct {
+    uint16_t heapSize;
+    uint16_t rootCount;
+    root_t *roots;
+    uint32_t count;
+    allocation_t *allocations;
+    ref_t *refs;
+    uint32_t *order;     // allocations in the order found by the search
+    int32_t *byOffset;   // allocation at each heap offset / 2, or -1
+} dump_t;
+
+typedef struct {
+    const char *path;
+    uint32_t count;
+    uint32_t retained;
+} path_total_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t bytes;
+    uint32_t retained;
+} type_total_t;
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static void fail(const char *path, const char *message) {
+    fprintf(stderr, "%s: %s\n", path, message);
+    exit(1);
+}
+
+typedef struct {
+    const char *path;
+    const uint8_t *data;
+    long size;
+    long pos;
+} reader_t;
+
+static uint16_t read16(reader_t *r) {
+    if (r->pos + 2 > r->size)
+        fail(r->path, "truncated dump");
+    uint16_t value = r->data[r->pos] | (r->data[r->pos + 1] << 8);
+    r->pos += 2;
+    return value;
+}
+
+static uint8_t read8(reader_t *r) {
+    if (r->pos + 1 > r->size)
+        fail(r->path, "truncated dump");
+    return r->data[r->pos++];
+}
+
+static char* concat(const char *a, const char *b) {
+    char *s = malloc(strlen(a) + strlen(b) + 1);
+    strcpy(s, a);
+    strcat(s, b);
+    return s;
+}
+
+static void load(dump_t *dump, const char *path, int depth) {
+    long size;
+    uint8_t *data = readFile(path, &size);
+    if (data == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        exit(1);
+    }
+    reader_t r = { path, data, size, 0 };
+
+    if (size < 4 || memcmp(data, "MVHD", 4) != 0)
+        fail(path, "not a heap dump");
+    r.pos = 4;
+    if (read16(&r) != HEAP_DUMP_VERSION)
+        fail(path, "unsupported heap dump version");
+    dump->heapSize = read16(&r);
+    dump->rootCount = read16(&r);
+
+    dump->roots = calloc(dump->rootCount, sizeof *dump->roots);
+    for (uint16_t i = 0; i < dump->rootCount; i++) {
+        dump->roots[i].kind = read8(&r);
+        dump->roots[i].index = read16(&r);
+        dump->roots[i].target = read16(&r);
+    }
+
+    // Every allocation is at least 4 bytes, and every reference takes 4 bytes
+    // in the dump
+    uint32_t maxAllocations = dump->heapSize / 4 + 1;
+    dump->allocations = calloc(maxAllocations, sizeof *dump->allocations);
+    dump->refs = calloc((size - r.pos) / 4 + 1, sizeof *dump->refs);
+    dump->byOffset = malloc((dump->heapSize / 2 + 1) * sizeof *dump->byOffset);
+    for (uint32_t i = 0; i <= dump->heapSize / 2; i++)
+        dump->byOffset[i] = -1;
+
+    uint32_t offset = 0;
+    uint32_t refCount = 0;
+    dump->count = 0;
+    while (offset < dump->heapSize) {
+        if (dump->count == maxAllocations)
+            fail(path, "corrupt heap dump");
+        allocation_t *a = &dump->allocations[dump->count];
+        a->header = read16(&r);
+        a->size = (((a->header & 0xFFF) + 3) & 0xFFFE);
+        a->firstRef = refCount;
+        a->parent = -1;
+        a->root = -1;
+        if ((a->header >> 12) >= FIRST_CONTAINER_TYPE) {
+            a->refCount = read16(&r);
+            for (uint16_t i = 0; i < a->refCount; i++) {
+                dump->refs[refCount].slot = read16(&r);
+                dump->refs[refCount].target = read16(&r);
+                refCount++;
+            }
+        }
+        dump->byOffset[(offset + 2) / 2] = dump->count;
+        dump->count++;
+        offset += a->size;
+    }
+    if (offset != dump->heapSize || r.pos != size)
+        fail(path, "corrupt heap dump");
+
+    // Breadth-first search from the roots, and then from whatever is left,
+    // which is only reachable from the stack
+    uint8_t *found = calloc(dump->count, 1);
+    dump->order = malloc(dump->count * sizeof *dump->order);
+    uint32_t head = 0, tail = 0;
+    for (uint32_t i = 0; i < dump->rootCount + dump->count; i++) {
+        int32_t top;
+        int32_t root = -1;
+        if (i < dump->rootCount) {
+            uint16_t target = dump->roots[i].target;
+            if (target >= dump->heapSize || (top = dump->byOffset[target / 2]) < 0)
+                fail(path, "root does not point to an allocation");
+            root = i;
+        } else {
+            top = i - dump->rootCount;
+        }
+        if (found[top])
+            continue;
+        found[top] = 1;
+        dump->allocations[top].root = root;
+        dump->order[tail++] = top;
+
+        while (head != tail) {
+            allocation_t *a = &dump->allocations[dump->order[head++]];
+            for (uint16_t j = 0; j < a->refCount; j++) {
+                const ref_t *ref = &dump->refs[a->firstRef + j];
+                int32_t child;
+                if (ref->target >= dump->heapSize || (child = dump->byOffset[ref->target / 2]) < 0)
+                    fail(path, "reference does not point to an allocation");
+                if (found[child])
+                    continue;
+                found[child] = 1;
+                allocation_t *c = &dump->allocations[child];
+                c->parent = a - dump->allocations;
+                c->parentSlot = ref->slot;
+                c->root = a->root;
+                c->depth = a->depth + 1;
+                c->typesAbove = a->typesAbove | (1 << (a->header >> 12));
+                dump->order[tail++] = child;
+            }
+        }
+    }
+    free(found);
+
+    // Paths, in search order so that the parent's is known
+    for (uint32_t i = 0; i < dump->count; i++) {
+        allocation_t *a = &dump->allocations[dump->order[i]];
+        const char *type = typeNames[a->header >> 12];
+        if (a->depth > depth)
+            continue;
+        char label[48];
+        if (a->parent >= 0) {
+            snprintf(label, sizeof label, " > [%u] %s", a->parentSlot, type);
+            a->path = concat(dump->allocations[a->parent].path, label);
+        } else if (a->root < 0) {
+            snprintf(label, sizeof label, "(stack) %s", type);
+            a->path = concat("", label);
+        } else {
+            const root_t *root = &dump->roots[a->root];
+            snprintf(label, sizeof label, "%s %u %s", root->kind == HEAP_DUMP_ROOT_GLOBAL ? "global" : "handle",
+                    root->index, type);
+            a->path = concat("", label);
+        }
+    }
+
+    // Retained sizes, bottom up
+    for (uint32_t i = dump->count; i-- > 0;) {
+        allocation_t *a = &dump->allocations[dump->order[i]];
+        a->retained += a->size;
+        if (a->parent >= 0)
+            dump->allocations[a->parent].retained += a->retained;
+    }
+
+    free(data);
+}
+
+static void release(dump_t *dump) {
+    for (uint32_t i = 0; i < dump->count; i++)
+        free(dump->allocations[i].path);
+    free(dump->roots);
+    free(dump->allocations);
+    free(dump->refs);
+    free(dump->order);
+    free(dump->byOffset);
+}
+
+static void type_totals(const dump_t *dump, type_total_t *totals) {
+    memset(totals, 0, TYPE_COUNT * sizeof *totals);
+    for (uint32_t i = 0; i < dump->count; i++) {
+        const allocation_t *a = &dump->allocations[i];
+        uint8_t type = a->header >> 12;
+        totals[type].count++;
+        totals[type].bytes += a->size;
+        if (!(a->typesAbove & (1 << type)))
+            totals[type].retained += a->retained;
+    }
+}
+
+static int by_path(const void *a, const void *b) {
+    return strcmp(((const path_total_t*) a)->path, ((const path_total_t*) b)->path);
+}
+
+// Retained size by path, sorted by path, with the allocations that share a
+// path added together
+static uint32_t path_totals(const dump_t *dump, path_total_t **out) {
+    path_total_t *totals = malloc((dump->count + 1) * sizeof *totals);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < dump->count; i++) {
+        const allocation_t *a = &dump->allocations[i];
+        if (a->path == NULL)
+            continue;
+        totals[n].path = a->path;
+        totals[n].count = 1;
+        totals[n].retained = a->retained;
+        n++;
+    }
+    qsort(totals, n, sizeof *totals, by_path);
+
+    uint32_t merged = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (merged && strcmp(totals[merged - 1].path, totals[i].path) == 0) {
+            totals[merged - 1].count += totals[i].count;
+            totals[merged - 1].retained += totals[i].retained;
+        } else {
+            totals[merged++] = totals[i];
+        }
+    }
+    *out = totals;
+    return merged;
+}
+
+typedef struct {
+    const char *path;
+    uint32_t before;
+    uint32_t after;
+    long delta;
+} path_diff_t;
+
+static int by_growth(const void *a, const void *b) {
+    long x = ((const path_diff_t*) a)->delta;
+    long y = ((const path_diff_t*) b)->delta;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s before.dump after.dump [depth] [rows]\n", argv[0]);
+        return 1;
+    }
+    int depth = argc > 3 ? atoi(argv[3]) : DEFAULT_DEPTH;
+    int rows = argc > 4 ? atoi(argv[4]) : DEFAULT_ROWS;
+    dump_t before, after;
+    type_total_t typesBefore[TYPE_COUNT], typesAfter[TYPE_COUNT];
+
+    load(&before, argv[1], depth);
+    load(&after, argv[2], depth);
+
+    printf("heap: %u B -> %u B (%+ld B), %u -> %u allocations\n\n", before.heapSize, after.heapSize,
+            (long) after.heapSize - before.heapSize, before.count, after.count);
+
+    type_totals(&before, typesBefore);
+    type_totals(&after, typesAfter);
+    printf("%-26s %8s %8s %10s %10s %10s\n", "type", "count", "+count", "bytes", "+bytes", "+retained");
+    for (int t = 0; t < TYPE_COUNT; t++) {
+        if (!typesBefore[t].count && !typesAfter[t].count)
+            continue;
+        printf("%-26s %8u %+8ld %10u %+10ld %+10ld\n", typeNames[t], typesAfter[t].count,
+                (long) typesAfter[t].count - typesBefore[t].count, typesAfter[t].bytes,
+                (long) typesAfter[t].bytes - typesBefore[t].bytes,
+                (long) typesAfter[t].retained - typesBefore[t].retained);
+    }
+
+    // Merge join of the paths of both dumps
+    path_total_t *pathsBefore, *pathsAfter;
+    uint32_t nBefore = path_totals(&before, &pathsBefore);
+    uint32_t nAfter = path_totals(&after, &pathsAfter);
+    path_diff_t *diffs = malloc((nBefore + nAfter + 1) * sizeof *diffs);
+    uint32_t n = 0, i = 0, j = 0;
+    while (i < nBefore || j < nAfter) {
+        int cmp = i == nBefore ? 1 : j == nAfter ? -1 : strcmp(pathsBefore[i].path, pathsAfter[j].path);
+        path_diff_t *d = &diffs[n++];
+        d->path = cmp <= 0 ? pathsBefore[i].path : pathsAfter[j].path;
+        d->before = cmp <= 0 ? pathsBefore[i++].retained : 0;
+        d->after = cmp >= 0 ? pathsAfter[j++].retained : 0;
+        d->delta = (long) d->after - d->before;
+    }
+    qsort(diffs, n, sizeof *diffs, by_growth);
+
+    printf("\n%10s %10s %10s  %s\n", "retained", "before", "+retained", "path");
+    for (uint32_t k = 0; k < n && (int) k < rows; k++) {
+        if (diffs[k].delta <= 0)
+            break;
+        printf("%10u %10u %+10ld  %s\n", diffs[k].after, diffs[k].before, diffs[k].delta, diffs[k].path);
+    }
+
+    free(diffs);
+    free(pathsBefore);
+    free(pathsAfter);
+    release(&before);
+    release(&after);
+    return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * @file heap_profile.c
+ * @brief allocation-site heap profiler driver (host)
+ * @details
+ * Runs an exported function of a bytecode image repeatedly against an engine
+ * built with MVM_HEAP_PROFILE, collecting garbage every few calls, and prints
+ * the allocation sites by allocated bytes with what is still live and the
+ * share of collected bytes that survived:
+ *
+ *   heap_profile [bytecode-file] [export-id] [iterations] [gc-every]
+ *
+ * By default it profiles `run` in the gc_churn workload
+ * (bench/workloads/gc_churn.mvm.js), whose profile is in heap_profile.expected.
+ * The address of a site is that of the end of the instruction that allocated,
+ * which can be matched to the disassembly from the Microvium compiler. The
+ * "(other)" row holds what was allocated before the profile started, here the
+ * Array prototype from the image. All host imports resolve to a stub that
+ * returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "microvium.h"
+
+#if !MVM_HEAP_PROFILE
+#error This tool needs an engine built with MVM_HEAP_PROFILE
+#endif
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_EXPORT_ID  1
+#define DEFAULT_ITERATIONS 10000
+#define DEFAULT_GC_EVERY   100
+#define MAX_SITES          256
+
+static mvm_TsHeapProfileSite sites[MAX_SITES];
+static int siteCount;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static void collect_site(void *context, const mvm_TsHeapProfileSite *site) {
+    if (siteCount < MAX_SITES)
+        sites[siteCount++] = *site;
+}
+
+// Ties are broken by address and type, so that the order is the same whatever
+// qsort does with equal elements
+static int by_allocated_bytes(const void *a, const void *b) {
+    const mvm_TsHeapProfileSite *x = a;
+    const mvm_TsHeapProfileSite *y = b;
+    if (x->allocatedBytes != y->allocatedBytes)
+        return x->allocatedBytes < y->allocatedBytes ? 1 : -1;
+    if (x->bytecodeAddress != y->bytecodeAddress)
+        return x->bytecodeAddress < y->bytecodeAddress ? -1 : 1;
+    return strcmp(x->typeName ? x->typeName : "", y->typeName ? y->typeName : "");
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    long iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    long gcEvery = argc > 4 ? atol(argv[4]) : DEFAULT_GC_EVERY;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_startHeapProfile(vm);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_startHeapProfile error: %d\n", err);
+        return 1;
+    }
+
+    for (long i = 1; i <= iterations; i++) {
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "mvm_call error: %d\n", err);
+            return 1;
+        }
+        if (gcEvery > 0 && i % gcEvery == 0)
+            mvm_runGC(vm, false);
+    }
+    mvm_runGC(vm, false);
+
+    mvm_getHeapProfile(vm, collect_site, NULL);
+    qsort(sites, siteCount, sizeof sites[0], by_allocated_bytes);
+
+    printf("%-8s %-24s %10s %12s %8s %10s %9s\n", "address", "type", "allocs", "bytes", "live", "live B", "survived");
+    for (int i = 0; i < siteCount; i++) {
+        const mvm_TsHeapProfileSite *site = &sites[i];
+        uint32_t collected = site->survivedBytes + site->reclaimedBytes;
+        char address[8];
+
+        if (site->typeName == NULL)
+            snprintf(address, sizeof address, "-");
+        else
+            snprintf(address, sizeof address, "%04x", site->bytecodeAddress);
+        printf("%-8s %-24s %10u %12u %8u %10u ", address, site->typeName ? site->typeName : "(other)",
+                site->allocationCount, site->allocatedBytes, site->liveCount, site->liveBytes);
+        if (collected)
+            printf("%8.1f%%\n", 100.0 * site->survivedBytes / collected);
+        else
+            printf("%9s\n", "-");
+    }
+
+    mvm_stopHeapProfile(vm);
+    mvm_free(vm);
+    free(bytecode);
+    return 0;
+}
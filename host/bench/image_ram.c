@@ -0,0 +1,96 @@
+/*
+ * @file image_ram.c
+ * @brief bytecode image RAM usage (host)
+ * @details
+ * Restores a VM from the same bytecode file twice: once read into a malloc'd
+ * buffer, as main.c does when the script partition is empty, and once mapped
+ * read-only with the host stand-in for the flash partition mapping. Reports the
+ * RAM used in each case, and checks that both VMs run the exported function.
+ *
+ *   image_ram [bytecode-file] [export-id]
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "microvium.h"
+#include "microvium_hal_image.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_EXPORT_ID 1234
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static bool run(const char *mode, microvium_hal_image_t *image, mvm_VMExportID exportId) {
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    mvm_TsMemoryStats stats;
+
+    err = mvm_restore(&vm, image->bytecode, image->size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "%s: mvm_restore error: %d\n", mode, err);
+        return false;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err == MVM_E_SUCCESS)
+        err = mvm_call(vm, func, &result, NULL, 0);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "%s: error: %d\n", mode, err);
+        mvm_free(vm);
+        return false;
+    }
+
+    mvm_getMemoryStats(vm, &stats);
+    size_t imageRam = image->mapped ? 0 : image->size;
+    printf("%-7s bytecode in RAM: %5zu B, VM: %5zu B, total: %5zu B\n", mode, imageRam, stats.totalSize,
+            imageRam + stats.totalSize);
+
+    mvm_free(vm);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    microvium_hal_image_t image;
+    bool ok;
+
+    if (!microvium_hal_image_read(&image, path)) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+    ok = run("read", &image, exportId);
+    microvium_hal_image_release(&image);
+
+    if (!microvium_hal_image_map(&image, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+    ok = run("mapped", &image, exportId) && ok;
+    microvium_hal_image_release(&image);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/*
+ * @file incremental_bench.c
+ * @brief garbage collection pause times with and without mvm_gcStep (host)
+ * @details
+ * Keeps a number of strings alive in handles and measures the pauses of a
+ * major collection done three ways:
+ *
+ *   - in one go with mvm_runGC;
+ *   - with mvm_gcStep, the VM staying idle until the collection is complete;
+ *   - with mvm_gcStep, calling an exported function after the first step, as
+ *     a host would if an event arrived in the middle of a collection.
+ *
+ * In the last case the call completes the collection before the script runs,
+ * so the pause that the script sees is the time of the whole call, which is
+ * reported next to the time of the same call with no collection in progress.
+ * The first step of a collection also sets up tospace, so it's reported apart
+ * from the steps that follow it. The 99th percentile is given next to the
+ * maximum, which is often an interruption by the OS rather than the VM:
+ *
+ *   incremental_bench [strings] [budget-bytes] [rounds] [bytecode-file] [export-id]
+ *
+ * Built against an engine with a larger MVM_MAX_HEAP_SIZE than the ESP32
+ * port, so that a collection takes long enough to time. All host imports
+ * resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "microvium.h"
+
+#if !MVM_INCREMENTAL_GC
+#error This benchmark needs an engine built with MVM_INCREMENTAL_GC
+#endif
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_STRINGS   300
+#define DEFAULT_BUDGET    256
+#define DEFAULT_ROUNDS    200
+#define DEFAULT_EXPORT_ID 1234
+#define TEMPORARIES       20
+
+typedef struct {
+    long collections;
+    long pauses;
+    long capacity;
+    double total;
+    double *samples;
+} pauses_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void record(pauses_t *p, double start) {
+    double t = now() - start;
+    if (p->pauses == p->capacity) {
+        p->capacity = p->capacity ? p->capacity * 2 : 256;
+        p->samples = realloc(p->samples, p->capacity * sizeof *p->samples);
+        if (p->samples == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    p->samples[p->pauses++] = t;
+    p->total += t;
+}
+
+static int by_time(const void *a, const void *b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void print(const char *mode, pauses_t *p) {
+    if (p->pauses == 0)
+        return;
+    qsort(p->samples, p->pauses, sizeof *p->samples, by_time);
+    printf("%-28s %11ld %8ld %10.0f %10.0f %10.0f\n", mode, p->collections, p->pauses, p->total * 1e9 / p->pauses,
+            p->samples[(p->pauses - 1) * 99 / 100] * 1e9, p->samples[p->pauses - 1] * 1e9);
+    free(p->samples);
+}
+
+// Leaves some garbage in the heap, as the script would between collections
+static void makeGarbage(mvm_VM *vm) {
+    for (int i = 0; i < TEMPORARIES; i++)
+        mvm_newInt32(vm, 1000000 + i);
+}
+
+static bool call(mvm_VM *vm, mvm_Value func) {
+    mvm_Value result;
+    mvm_TeError err = mvm_call(vm, func, &result, NULL, 0);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_call error: %d\n", err);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int strings = argc > 1 ? atoi(argv[1]) : DEFAULT_STRINGS;
+    uint16_t budget = argc > 2 ? (uint16_t) atoi(argv[2]) : DEFAULT_BUDGET;
+    long rounds = argc > 3 ? atol(argv[3]) : DEFAULT_ROUNDS;
+    const char *path = argc > 4 ? argv[4] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 5 ? (mvm_VMExportID) atoi(argv[5]) : DEFAULT_EXPORT_ID;
+    pauses_t runGC = { 0 }, firstStep = { 0 }, idle = { 0 }, script = { 0 }, plainCall = { 0 };
+    mvm_TsMemoryStats stats;
+    mvm_Handle *live;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    char text[40];
+    long size;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        return 1;
+    }
+
+    live = malloc(strings * sizeof *live);
+    if (live == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < strings; i++) {
+        int length = snprintf(text, sizeof text, "live string number %08d", i);
+        mvm_initializeHandle(vm, &live[i]);
+        mvm_handleSet(&live[i], mvm_newString(vm, text, length));
+    }
+    mvm_runGC(vm, false);
+    mvm_getMemoryStats(vm, &stats);
+
+    for (long r = 0; r < rounds; r++) {
+        double start;
+
+        makeGarbage(vm);
+        start = now();
+        mvm_runGC(vm, false);
+        record(&runGC, start);
+        runGC.collections++;
+
+        makeGarbage(vm);
+        start = now();
+        bool done = mvm_gcStep(vm, budget);
+        record(&firstStep, start);
+        firstStep.collections++;
+        while (!done) {
+            start = now();
+            done = mvm_gcStep(vm, budget);
+            record(&idle, start);
+        }
+        idle.collections++;
+
+        // The call completes the collection that the first step started
+        makeGarbage(vm);
+        mvm_gcStep(vm, budget);
+        start = now();
+        if (!call(vm, func))
+            return 1;
+        record(&script, start);
+        script.collections++;
+
+        start = now();
+        if (!call(vm, func))
+            return 1;
+        record(&plainCall, start);
+    }
+
+    for (int i = 0; i < strings; i++) {
+        size_t length;
+        const char *s = mvm_toStringUtf8(vm, mvm_handleGet(&live[i]), &length);
+        if (length != 27 || atoi(s + 19) != i) {
+            fprintf(stderr, "live string %d lost its value\n", i);
+            return 1;
+        }
+    }
+
+    printf("%d live strings, %zu B heap after collection, step budget %u B\n", strings, stats.virtualHeapUsed, budget);
+    printf("%-28s %11s %8s %10s %10s %10s\n", "mode", "collections", "pauses", "mean ns", "p99 ns", "max ns");
+    print("mvm_runGC", &runGC);
+    print("mvm_gcStep, first step", &firstStep);
+    print("mvm_gcStep, later steps", &idle);
+    print("mvm_gcStep, then a call", &script);
+    print("script call, no collection", &plainCall);
+
+    for (int i = 0; i < strings; i++)
+        mvm_releaseHandle(vm, &live[i]);
+    free(live);
+    mvm_free(vm);
+    free(bytecode);
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * @file pool_bench.c
+ * @brief VM pool throughput and fairness (host)
+ * @details
+ * Runs several VMs restored from the same bytecode image on a VM pool (see
+ * microvium_hal_pool.h), posting the same number of jobs to each, and reports
+ * per VM the time spent running its jobs, how often it was stolen by another
+ * worker and the longest wait for a job to start, together with the overall
+ * throughput and Jain's fairness index of the CPU time (1.0 when all the VMs
+ * got the same share).
+ *
+ * All the VMs start on worker 0, so the other workers only get work by
+ * stealing it. Each job calls the export `calls` times.
+ *
+ *   pool_bench [workers] [vms] [jobs] [calls] [bytecode-file] [export-id]
+ *
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "hal_os.h"
+#include "microvium.h"
+#include "microvium_hal_image.h"
+#include "microvium_hal_pool.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_WORKERS   2
+#define DEFAULT_VMS       8
+#define DEFAULT_JOBS      200
+#define DEFAULT_CALLS     200
+#define DEFAULT_EXPORT_ID 1234
+
+typedef struct bench_vm {
+    mvm_VM *vm;
+    mvm_Value func;
+    long calls;
+    mvm_TeError err;
+} bench_vm_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void job(mvm_VM *vm, void *arg) {
+    bench_vm_t *b = (bench_vm_t*) arg;
+    mvm_Value result;
+
+    for (long i = 0; i < b->calls && b->err == MVM_E_SUCCESS; i++)
+        b->err = mvm_call(vm, b->func, &result, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int workers = argc > 1 ? atoi(argv[1]) : DEFAULT_WORKERS;
+    int vms = argc > 2 ? atoi(argv[2]) : DEFAULT_VMS;
+    long jobs = argc > 3 ? atol(argv[3]) : DEFAULT_JOBS;
+    long calls = argc > 4 ? atol(argv[4]) : DEFAULT_CALLS;
+    const char *path = argc > 5 ? argv[5] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 6 ? (mvm_VMExportID) atoi(argv[6]) : DEFAULT_EXPORT_ID;
+    microvium_hal_image_t bytecode;
+    mvm_TeError err;
+    int result = 1;
+
+    if (workers <= 0 || vms <= 0) {
+        fprintf(stderr, "workers and vms must be at least 1\n");
+        return 1;
+    }
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    bench_vm_t *b = calloc(vms, sizeof(*b));
+    int *ids = calloc(vms, sizeof(*ids));
+    microvium_hal_pool_t *pool = microvium_hal_pool_create(workers, vms, 0, 0);
+    if (b == NULL || ids == NULL || pool == NULL) {
+        fprintf(stderr, "cannot create the pool\n");
+        goto done;
+    }
+
+    for (int i = 0; i < vms; i++) {
+        err = mvm_restore(&b[i].vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+        if (err == MVM_E_SUCCESS)
+            err = mvm_resolveExports(b[i].vm, &exportId, &b[i].func, 1);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "VM %d: restore error: %d\n", i, err);
+            goto done;
+        }
+        b[i].calls = calls;
+        ids[i] = microvium_hal_pool_add(pool, b[i].vm, 0);
+    }
+
+    // Round-robin over the VMs, waiting for space in a VM's queue when it's
+    // full
+    double start = now();
+    for (long j = 0; j < jobs; j++) {
+        for (int i = 0; i < vms; i++) {
+            while (!microvium_hal_pool_post(pool, ids[i], job, &b[i]))
+                OS_Sleep(0);
+        }
+    }
+    microvium_hal_pool_wait_idle(pool);
+    double seconds = now() - start;
+
+    printf("%d workers, %d VMs, %ld jobs of %ld calls each: %.3f s, %.0f calls/s\n", workers, vms, jobs, calls, seconds,
+            (double) vms * jobs * calls / seconds);
+    printf("%4s %12s %8s %8s %14s\n", "vm", "cpu ms", "jobs", "steals", "max wait ms");
+
+    double sum = 0, sumSquares = 0;
+    for (int i = 0; i < vms; i++) {
+        microvium_hal_pool_stats_t stats;
+        microvium_hal_pool_get_stats(pool, ids[i], &stats);
+        printf("%4d %12.3f %8u %8u %14.3f\n", i, stats.cpu_us / 1000.0, (unsigned) stats.jobs, (unsigned) stats.steals,
+                stats.max_wait_us / 1000.0);
+        if (b[i].err != MVM_E_SUCCESS)
+            fprintf(stderr, "VM %d: mvm_call error: %d\n", i, b[i].err);
+        sum += stats.cpu_us;
+        sumSquares += (double) stats.cpu_us * stats.cpu_us;
+    }
+    printf("fairness (Jain's index of cpu time): %.3f\n", sumSquares > 0 ? sum * sum / (vms * sumSquares) : 1.0);
+    result = 0;
+
+done:
+    if (pool != NULL)
+        microvium_hal_pool_destroy(pool);
+    for (int i = 0; b != NULL && i < vms; i++) {
+        if (b[i].vm != NULL)
+            mvm_free(b[i].vm);
+    }
+    free(b);
+    free(ids);
+    microvium_hal_image_release(&bytecode);
+    return result;
+}
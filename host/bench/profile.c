@@ -0,0 +1,153 @@
+/*
+ * @file profile.c
+ * @brief per-opcode execution profile (host)
+ * @details
+ * Runs an exported function of a bytecode image repeatedly against an engine
+ * built with MVM_PROFILE and prints the profile from `mvm_getProfile`, with
+ * the opcodes sorted by the time spent in them.
+ *
+ *   profile [bytecode-file] [export-id] [iterations]
+ *
+ * Times are in nanoseconds (see MVM_PROFILE_CLOCK in host/microvium_port.h).
+ * The superinstructions suggested for the workload (those covering at least 1%
+ * of the instructions) are printed at the end.
+ * All host imports resolve to a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "microvium.h"
+
+#if !MVM_PROFILE
+#error This tool needs an engine built with MVM_PROFILE
+#endif
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_EXPORT_ID  1234
+#define DEFAULT_ITERATIONS 10000
+#define MAX_ENTRIES        256
+
+typedef struct profile_s {
+    mvm_TsProfileEntry entries[MAX_ENTRIES];
+    int count;
+} profile_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static void collect(void *context, const mvm_TsProfileEntry *entry) {
+    profile_t *profile = (profile_t*) context;
+    if (profile->count < MAX_ENTRIES)
+        profile->entries[profile->count++] = *entry;
+}
+
+static int by_cycles(const void *a, const void *b) {
+    const mvm_TsProfileEntry *x = (const mvm_TsProfileEntry*) a;
+    const mvm_TsProfileEntry *y = (const mvm_TsProfileEntry*) b;
+    return (x->cycles < y->cycles) - (x->cycles > y->cycles);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    long iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    static profile_t profile;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        return 1;
+    }
+
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "mvm_call error: %d\n", err);
+            return 1;
+        }
+    }
+
+    mvm_getProfile(vm, collect, &profile);
+    qsort(profile.entries, profile.count, sizeof(profile.entries[0]), by_cycles);
+
+    uint64_t total = 0;
+    for (int i = 0; i < profile.count; i++)
+        if (profile.entries[i].name != NULL)
+            total += profile.entries[i].cycles;
+
+    printf("%-30s %12s %12s %7s\n", "opcode", "count", "ns", "%");
+    for (int i = 0; i < profile.count; i++) {
+        const mvm_TsProfileEntry *e = &profile.entries[i];
+        if (e->name != NULL)
+            printf("%-30s %12lu %12lu %6.1f%%\n", e->name, (unsigned long) e->count, (unsigned long) e->cycles,
+                    total ? 100.0 * e->cycles / total : 0.0);
+    }
+
+    printf("\n%-30s %12s %12s %7s\n", "function", "calls", "ns", "%");
+    for (int i = 0; i < profile.count; i++) {
+        const mvm_TsProfileEntry *e = &profile.entries[i];
+        if (e->name == NULL)
+            printf("0x%04x%24s %12lu %12lu %6.1f%%\n", e->functionAddress, "", (unsigned long) e->count,
+                    (unsigned long) e->cycles, total ? 100.0 * e->cycles / total : 0.0);
+    }
+
+    printf("\nsuggested MVM_SUPERINSTRUCTION_MASK: 0x%02x\n", mvm_suggestSuperinstructions(vm, 1));
+
+    mvm_free(vm);
+    free(bytecode);
+    return 0;
+}
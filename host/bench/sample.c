@@ -0,0 +1,148 @@
+/*
+ * @file sample.c
+ * @brief sampling profiler driver (host)
+ * @details
+ * Runs an exported function of a bytecode image repeatedly against an engine
+ * built with MVM_SAMPLING_PROFILER, requesting a sample from a SIGPROF
+ * interval timer, and writes the samples as folded stacks:
+ *
+ *   sample [bytecode-file] [export-id] [iterations] [interval-us] > out.folded
+ *   flamegraph.pl out.folded > out.svg
+ *
+ * The addresses in the output can be matched to functions with the
+ * disassembly from the Microvium compiler. All host imports resolve to a stub
+ * that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "microvium.h"
+
+#if !MVM_SAMPLING_PROFILER
+#error This tool needs an engine built with MVM_SAMPLING_PROFILER
+#endif
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE "script.mvm-bc"
+#endif
+
+#define DEFAULT_EXPORT_ID   1234
+#define DEFAULT_ITERATIONS  100000
+#define DEFAULT_INTERVAL_US 100
+
+static mvm_VM *volatile sampled_vm;
+static unsigned long lines;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static void on_timer(int signal) {
+    mvm_VM *vm = sampled_vm;
+    if (vm != NULL)
+        mvm_requestSample(vm);
+}
+
+static void write_line(void *context, const char *line) {
+    fprintf((FILE*) context, "%s\n", line);
+    lines++;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    long iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    long interval = argc > 4 ? atol(argv[4]) : DEFAULT_INTERVAL_US;
+    unsigned long dropped = 0;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        return 1;
+    }
+
+    err = mvm_startSampling(vm);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_startSampling error: %d\n", err);
+        return 1;
+    }
+
+    // The timer counts CPU time of this process, so samples are only requested
+    // while it is running
+    struct itimerval timer = { { 0, interval }, { 0, interval } };
+    signal(SIGPROF, on_timer);
+    sampled_vm = vm;
+    setitimer(ITIMER_PROF, &timer, NULL);
+
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "mvm_call error: %d\n", err);
+            return 1;
+        }
+        dropped += mvm_drainFoldedStacks(vm, write_line, stdout);
+    }
+
+    timer.it_value.tv_usec = 0;
+    setitimer(ITIMER_PROF, &timer, NULL);
+    sampled_vm = NULL;
+
+    fprintf(stderr, "%lu samples, %lu dropped\n", lines, dropped);
+
+    mvm_stopSampling(vm);
+    mvm_free(vm);
+    free(bytecode);
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * @file timers_bench.c
+ * @brief timers: task wakes with and without coalescing (host)
+ * @details
+ * Sets intervals with periods spread over a few ms, as a script with several
+ * periodic jobs would (see microvium_hal_timers.h), and runs them for a fixed
+ * time with a range of slacks. The task sleeps for the time given by
+ * microvium_hal_timers_next between runs. Reports how often the task woke up,
+ * the callbacks run and the most a callback ran late, next to a loop that
+ * polls the timers every ms.
+ *
+ *   timers_bench [timers] [duration-ms] [bytecode-file] [export-id]
+ *
+ * The export is the callback of every timer. All other host imports resolve to
+ * a stub that returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "hal_os.h"
+#include "hal_tim.h"
+#include "microvium.h"
+#include "microvium_hal_image.h"
+#include "microvium_hal_timers.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_TIMERS      8
+#define DEFAULT_DURATION_MS 1000
+#define DEFAULT_EXPORT_ID   1234
+#define BASE_PERIOD_MS      20
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    switch (funcID) {
+        case MICROVIUM_HAL_ID_TIMERS_SET_TIMEOUT:
+            *out = microvium_timers_set_timeout;
+            break;
+        case MICROVIUM_HAL_ID_TIMERS_SET_INTERVAL:
+            *out = microvium_timers_set_interval;
+            break;
+        case MICROVIUM_HAL_ID_TIMERS_CLEAR:
+            *out = microvium_timers_clear;
+            break;
+        default:
+            *out = stub;
+            break;
+    }
+    return MVM_E_SUCCESS;
+}
+
+// Returns false on error. `poll` wakes the task every ms instead of sleeping
+// until the next timer.
+static bool run(mvm_VM *vm, mvm_Value callback, int count, uint32_t duration_ms, uint32_t slack_ms, bool poll) {
+    microvium_hal_timers_t *timers = microvium_hal_timers_create(vm, HAL_TIM_HOST, count, slack_ms);
+    mvm_TeError err = MVM_E_SUCCESS;
+    long wakes = 0;
+
+    if (timers == NULL) {
+        fprintf(stderr, "cannot create the timers\n");
+        return false;
+    }
+
+    // Periods of BASE_PERIOD_MS, BASE_PERIOD_MS + 1, ..., as the script would
+    // set them with setInterval(callback, period)
+    for (int i = 0; i < count && err == MVM_E_SUCCESS; i++) {
+        mvm_Value args[2] = { callback, mvm_newInt32(vm, BASE_PERIOD_MS + i) };
+        mvm_Value id;
+        err = microvium_timers_set_interval(vm, MICROVIUM_HAL_ID_TIMERS_SET_INTERVAL, &id, args, 2);
+    }
+
+    uint64_t end = OS_GetTimeUs() + (uint64_t) duration_ms * 1000;
+    while (err == MVM_E_SUCCESS && OS_GetTimeUs() < end) {
+        uint32_t wait = poll ? 1 : microvium_hal_timers_next(timers, 1000);
+        if (wait > 0)
+            OS_Sleep(wait);
+        wakes++;
+        microvium_hal_timers_run(timers, &err);
+    }
+    if (err != MVM_E_SUCCESS)
+        fprintf(stderr, "error: %d\n", err);
+
+    microvium_hal_timers_stats_t stats;
+    microvium_hal_timers_get_stats(timers, &stats);
+    if (poll)
+        printf("  poll every ms:");
+    else
+        printf("  slack %3u ms: ", (unsigned) slack_ms);
+    printf(" %6.0f wakes/s, %6.0f callbacks/s, %5u TIM events, %5u coalesced, late by at most %6.2f ms\n",
+            wakes * 1000.0 / duration_ms, stats.callbacks * 1000.0 / duration_ms, (unsigned) stats.wakes,
+            (unsigned) stats.coalesced, stats.late_max_us / 1000.0);
+
+    microvium_hal_timers_destroy(timers);
+    return err == MVM_E_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_TIMERS;
+    uint32_t duration_ms = argc > 2 ? (uint32_t) atoi(argv[2]) : DEFAULT_DURATION_MS;
+    const char *path = argc > 3 ? argv[3] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 4 ? (mvm_VMExportID) atoi(argv[4]) : DEFAULT_EXPORT_ID;
+    static const uint32_t slacks[] = { 0, 2, 5, 10, 20 };
+    microvium_hal_image_t bytecode;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value callback;
+
+    if (count <= 0) {
+        fprintf(stderr, "timers must be at least 1\n");
+        return 1;
+    }
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+    if (err == MVM_E_SUCCESS)
+        err = mvm_resolveExports(vm, &exportId, &callback, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "restore error: %d\n", err);
+        microvium_hal_image_release(&bytecode);
+        return 1;
+    }
+
+    // 1 us ticks
+    TIM_Init(HAL_TIM_HOST, 1000);
+
+    printf("%d intervals of %d..%d ms, %u ms\n", count, BASE_PERIOD_MS, BASE_PERIOD_MS + count - 1, (unsigned) duration_ms);
+    bool ok = run(vm, callback, count, duration_ms, 0, true);
+    for (int i = 0; ok && i < sizeof(slacks) / sizeof(slacks[0]); i++)
+        ok = run(vm, callback, count, duration_ms, slacks[i], false);
+
+    mvm_free(vm);
+    microvium_hal_image_release(&bytecode);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+ * @file warm_start.c
+ * @brief cold vs warm start latency (host)
+ * @details
+ * Measures the time to restore a VM, and from restoring it to the return of
+ * the first call to an exported function, for a cold start (mvm_restore of the
+ * bytecode) and for a warm start (mvm_restoreHibernated of a hibernation image
+ * of the same VM, taken before its first call). Both images are mapped
+ * read-only with the host stand-in for the flash partition mapping, as on the
+ * ESP32.
+ *
+ *   warm_start [bytecode-file] [export-id] [iterations] [hibernation-file]
+ *
+ * The default is the sensors workload, which has a heap and imports for
+ * mvm_restore to copy and resolve. All host imports resolve to a stub that
+ * returns `undefined`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "microvium.h"
+#include "microvium_hal_image.h"
+
+#ifndef MVM_BENCH_DEFAULT_BYTECODE
+#define MVM_BENCH_DEFAULT_BYTECODE SCRIPT_PARTITION_LABEL
+#endif
+
+#define DEFAULT_EXPORT_ID  1
+#define DEFAULT_ITERATIONS 100000
+
+// Stands in for a hash of the firmware image
+#define BUILD_ID 0x12345678
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static mvm_TeError firstCall(mvm_VM *vm, mvm_VMExportID exportId) {
+    mvm_Value func;
+    mvm_Value result;
+    mvm_TeError err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS)
+        return err;
+    return mvm_call(vm, func, &result, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : MVM_BENCH_DEFAULT_BYTECODE;
+    mvm_VMExportID exportId = argc > 2 ? (mvm_VMExportID) atoi(argv[2]) : DEFAULT_EXPORT_ID;
+    long iterations = argc > 3 ? atol(argv[3]) : DEFAULT_ITERATIONS;
+    const char *hibernationPath = argc > 4 ? argv[4] : HIBERNATE_PARTITION_LABEL;
+    microvium_hal_image_t bytecode;
+    microvium_hal_image_t hibernated;
+    mvm_TeError err;
+    mvm_VM *vm;
+
+    if (!microvium_hal_image_map(&bytecode, path)) {
+        fprintf(stderr, "cannot map %s\n", path);
+        return 1;
+    }
+
+    // Cold start, then hibernate before any script code runs, as main.c does
+    err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "cold start error: %d\n", err);
+        return 1;
+    }
+    if (!microvium_hal_image_hibernate(vm, BUILD_ID, hibernationPath)) {
+        fprintf(stderr, "cannot write %s\n", hibernationPath);
+        return 1;
+    }
+    mvm_free(vm);
+
+    if (!microvium_hal_image_map_hibernated(&hibernated, hibernationPath)) {
+        fprintf(stderr, "cannot map %s\n", hibernationPath);
+        return 1;
+    }
+
+    // A different build must be rejected
+    err = mvm_restoreHibernated(&vm, hibernated.bytecode, hibernated.size, BUILD_ID + 1, NULL);
+    if (err != MVM_E_INVALID_HIBERNATION_IMAGE) {
+        fprintf(stderr, "build ID mismatch not detected: %d\n", err);
+        return 1;
+    }
+
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "cold start error: %d\n", err);
+            return 1;
+        }
+        mvm_free(vm);
+    }
+    double coldRestore = (now() - start) / iterations;
+
+    start = now();
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_restoreHibernated(&vm, hibernated.bytecode, hibernated.size, BUILD_ID, NULL);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "warm start error: %d\n", err);
+            return 1;
+        }
+        mvm_free(vm);
+    }
+    double warmRestore = (now() - start) / iterations;
+
+    start = now();
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_restore(&vm, bytecode.bytecode, bytecode.size, NULL, resolveImport);
+        if (err == MVM_E_SUCCESS)
+            err = firstCall(vm, exportId);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "cold start error: %d\n", err);
+            return 1;
+        }
+        mvm_free(vm);
+    }
+    double cold = (now() - start) / iterations;
+
+    start = now();
+    for (long i = 0; i < iterations; i++) {
+        err = mvm_restoreHibernated(&vm, hibernated.bytecode, hibernated.size, BUILD_ID, NULL);
+        if (err == MVM_E_SUCCESS)
+            err = firstCall(vm, exportId);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "warm start error: %d\n", err);
+            return 1;
+        }
+        mvm_free(vm);
+    }
+    double warm = (now() - start) / iterations;
+
+    printf("cold start: %.3f us restore, %.3f us to first call (%zu B bytecode)\n", coldRestore * 1e6, cold * 1e6,
+            bytecode.size);
+    printf("warm start: %.3f us restore, %.3f us to first call (%zu B hibernation image)\n", warmRestore * 1e6, warm * 1e6,
+            hibernated.size);
+
+    microvium_hal_image_release(&hibernated);
+    microvium_hal_image_release(&bytecode);
+    return 0;
+}
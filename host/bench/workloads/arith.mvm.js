@@ -0,0 +1,16 @@
+// arith.mvm.js
+//
+// Integer and floating point arithmetic in tight loops.
+
+function run() {
+  let sum = 0;
+  for (let i = 0; i < 500; i++) {
+    sum = (sum + i * 3) % 10007;
+  }
+  let x = 1.5;
+  for (let i = 0; i < 100; i++) {
+    x = x * 1.01 + 0.25;
+  }
+  return sum;
+}
+vmExport(1, run);
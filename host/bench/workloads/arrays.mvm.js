@@ -0,0 +1,17 @@
+// arrays.mvm.js
+//
+// Array push and pop on a stack that grows and shrinks every call.
+
+const stack = [];
+
+function run() {
+  for (let i = 0; i < 32; i++) {
+    stack.push(i);
+  }
+  let total = 0;
+  while (stack.length > 0) {
+    total += stack.pop();
+  }
+  return total;
+}
+vmExport(1, run);
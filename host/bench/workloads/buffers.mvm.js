@@ -0,0 +1,16 @@
+// buffers.mvm.js
+//
+// Summing the elements of a typed array passed in by the host, such as a
+// capture frame from mvm_typedArrayFromExternal, and overwriting each with its
+// index. Used by the external buffer tests rather than the bench suite, since
+// it needs an argument.
+
+function sum(frame) {
+  let total = 0;
+  for (let i = 0; i < frame.length; i++) {
+    total = total + frame[i];
+    frame[i] = i;
+  }
+  return total;
+}
+vmExport(1, sum);
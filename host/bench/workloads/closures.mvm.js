@@ -0,0 +1,23 @@
+// closures.mvm.js
+//
+// Creating closures and calling them through captured variables.
+
+function makeCounter(step) {
+  let count = 0;
+  return () => {
+    count += step;
+    return count;
+  };
+}
+
+function run() {
+  let total = 0;
+  for (let i = 0; i < 8; i++) {
+    const counter = makeCounter(i);
+    for (let j = 0; j < 8; j++) {
+      total = (total + counter()) % 1000;
+    }
+  }
+  return total;
+}
+vmExport(1, run);
@@ -0,0 +1,17 @@
+// gc_churn.mvm.js
+//
+// Short-lived objects and arrays, so that most of the time goes into
+// allocation and collection.
+
+let survivor = undefined;
+
+function run() {
+  for (let i = 0; i < 50; i++) {
+    const o = { a: i, b: [i, i + 1] };
+    if (i % 10 === 0) {
+      survivor = o;
+    }
+  }
+  return survivor.a;
+}
+vmExport(1, run);
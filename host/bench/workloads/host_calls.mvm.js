@@ -0,0 +1,13 @@
+// host_calls.mvm.js
+//
+// Calls from the VM into a host function. The harness resolves every import
+// to a stub that returns `undefined`.
+
+const hostFunction = vmImport(1);
+
+function run() {
+  for (let i = 0; i < 100; i++) {
+    hostFunction(i);
+  }
+}
+vmExport(1, run);
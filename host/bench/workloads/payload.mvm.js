@@ -0,0 +1,16 @@
+// payload.mvm.js
+//
+// Building a telemetry payload piece by piece with `+`, which copies the whole
+// string so far on every step unless concatenation is deferred (see
+// MVM_STRING_ROPES). The payload is returned so that the tests can check it.
+
+function run() {
+  let payload = '{"readings":[';
+  for (let i = 0; i < 12; i++) {
+    if (i > 0) payload = payload + ',';
+    payload = payload + '{"ch":' + i + ',"v":' + (i * 37 + 1000) + '}';
+  }
+  payload = payload + ']}';
+  return payload;
+}
+vmExport(1, run);
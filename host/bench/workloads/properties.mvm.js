@@ -0,0 +1,21 @@
+// properties.mvm.js
+//
+// Property reads and writes on a handful of long-lived objects.
+
+const points = [];
+for (let i = 0; i < 4; i++) {
+  points.push({ x: i, y: i * 2, z: 0 });
+}
+
+function run() {
+  let total = 0;
+  for (let n = 0; n < 50; n++) {
+    for (let i = 0; i < points.length; i++) {
+      const p = points[i];
+      p.z = p.x + p.y;
+      total = (total + p.z) % 1000;
+    }
+  }
+  return total;
+}
+vmExport(1, run);
@@ -0,0 +1,54 @@
+// scopes.mvm.js
+//
+// Updating a variable captured 1, 3 and 6 scope levels up from the function
+// that uses it. Each depth is its own export (1, 3 and 6), run as a separate
+// workload.
+
+function nest1() {
+  let a = 0;
+  return () => {
+    for (let i = 0; i < 32; i++) a = (a + i) % 1000;
+    return a;
+  };
+}
+
+function nest3() {
+  let a = 0;
+  return (() => {
+    let b = 1;
+    return (() => {
+      let c = 2;
+      return () => {
+        for (let i = 0; i < 32; i++) a = (a + b + c + i) % 1000;
+        return a;
+      };
+    })();
+  })();
+}
+
+function nest6() {
+  let a = 0;
+  return (() => {
+    let b = 1;
+    return (() => {
+      let c = 2;
+      return (() => {
+        let d = 3;
+        return (() => {
+          let e = 4;
+          return (() => {
+            let f = 5;
+            return () => {
+              for (let i = 0; i < 32; i++) a = (a + b + c + d + e + f + i) % 1000;
+              return a;
+            };
+          })();
+        })();
+      })();
+    })();
+  })();
+}
+
+vmExport(1, nest1());
+vmExport(3, nest3());
+vmExport(6, nest6());
@@ -0,0 +1,39 @@
+// sensors.mvm.js
+//
+// A table of channels set up when the script is compiled, so that the snapshot
+// starts with a heap, and a tick that samples and publishes each channel
+// through the host. Used by warm_start and the hibernation tests rather than
+// the bench suite. The harness resolves every import to a stub that returns
+// `undefined`.
+
+const now = vmImport(1);
+const sample = vmImport(2);
+const publish = vmImport(3);
+const log = vmImport(4);
+const setLed = vmImport(5);
+
+const channels = [];
+for (let pin = 0; pin < 12; pin++) {
+  channels.push({
+    name: 'channel-' + pin,
+    pin,
+    count: 0,
+    history: [0, 0, 0, 0, 0, 0, 0, 0],
+  });
+}
+
+function tick() {
+  const t = now();
+  let total = 0;
+  for (let i = 0; i < 12; i++) {
+    const ch = channels[i];
+    sample(ch.pin);
+    ch.count = ch.count + 1;
+    total = total + ch.count * ch.pin;
+    publish(ch.name, ch.count);
+  }
+  log(t);
+  setLed(total);
+  return total;
+}
+vmExport(1, tick);
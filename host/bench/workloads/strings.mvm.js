@@ -0,0 +1,12 @@
+// strings.mvm.js
+//
+// String concatenation, building a new string every iteration.
+
+function run() {
+  let s = '';
+  for (let i = 0; i < 16; i++) {
+    s = s + 'ab' + i;
+  }
+  return s.length;
+}
+vmExport(1, run);
@@ -0,0 +1,22 @@
+// timestamps.mvm.js
+//
+// Arithmetic on numbers outside the 14-bit integer range, like millisecond
+// timestamps and scaled sensor readings, which are boxed on the heap.
+
+let last = 100000;
+
+function run() {
+  let fired = 0;
+  for (let t = 100000; t < 101000; t += 7) {
+    if (t - last > 100) {
+      last = t;
+      fired++;
+    }
+  }
+  let reading = 0;
+  for (let i = 0; i < 50; i++) {
+    reading = (i * 40000 + 12345) / 1000;
+  }
+  return fired + reading;
+}
+vmExport(1, run);
@@ -0,0 +1,262 @@
+/*
+ * Microvium port file for building the engine on a Linux host.
+ *
+ * This is used by the host-side tools in this directory (benchmarks etc.) and
+ * is not part of the ESP32 build, which uses
+ * `components/microvium/microvium_port.h`. The two files should be kept in
+ * step with each other, apart from the settings that are specific to running
+ * on a desktop machine.
+ *
+ * Options that the host tools need to vary between builds are wrapped in
+ * `#ifndef` so that they can be overridden from the compiler command line.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+/**
+ * The version of the port interface that this file is implementing.
+ */
+#define MVM_PORT_VERSION 1
+
+/**
+ * Number of bytes to use for the stack.
+ */
+#define MVM_STACK_SIZE 256
+
+/**
+ * Minimum size of the blocks malloc'd from the host when the VM heap grows.
+ */
+#define MVM_ALLOCATION_BUCKET_SIZE 256
+
+/**
+ * The maximum size of the virtual heap before an MVM_E_OUT_OF_MEMORY error is
+ * given. Kept the same as the ESP32 port so that GC behavior is comparable.
+ */
+#ifndef MVM_MAX_HEAP_SIZE
+#define MVM_MAX_HEAP_SIZE 1024
+#endif
+
+#define MVM_NATIVE_POINTER_IS_16_BIT 0
+
+#define MVM_SUPPORT_FLOAT 1
+
+#if MVM_SUPPORT_FLOAT
+#define MVM_FLOAT64 double
+#define MVM_FLOAT64_NAN ((MVM_FLOAT64)(INFINITY * 0.0))
+#endif // MVM_SUPPORT_FLOAT
+
+/**
+ * Safe mode is off by default on the host so that measurements reflect a
+ * release build of the engine.
+ */
+#ifndef MVM_SAFE_MODE
+#define MVM_SAFE_MODE 0
+#endif
+
+#ifndef MVM_DONT_TRUST_BYTECODE
+#define MVM_DONT_TRUST_BYTECODE 0
+#endif
+
+/**
+ * On in the tests' checked engine, which then asserts if the heap is corrupted.
+ */
+#ifndef MVM_VERY_EXPENSIVE_MEMORY_CHECKS
+#define MVM_VERY_EXPENSIVE_MEMORY_CHECKS 0
+#endif
+
+/**
+ * Bytecode is directly addressable on the host.
+ */
+#define MVM_LONG_PTR_TYPE void*
+#define MVM_LONG_PTR_NEW(p) ((MVM_LONG_PTR_TYPE)p)
+#define MVM_LONG_PTR_TRUNCATE(p) ((void*)p)
+#define MVM_LONG_PTR_ADD(p, s) ((MVM_LONG_PTR_TYPE)((uint8_t*)p + (intptr_t)s))
+#define MVM_LONG_PTR_SUB(p2, p1) ((int16_t)((uint8_t*)p2 - (uint8_t*)p1))
+#define MVM_READ_LONG_PTR_1(lpSource) (*((uint8_t *)lpSource))
+#define MVM_READ_LONG_PTR_2(lpSource) (*((uint16_t *)lpSource))
+#define MVM_LONG_MEM_CMP(p1, p2, size) memcmp(p1, p2, size)
+#define MVM_LONG_MEM_CPY(target, source, size) memcpy(target, source, size)
+
+#define MVM_FATAL_ERROR(vm, e) (assert(false), exit(e))
+
+#define MVM_ALL_ERRORS_FATAL 0
+
+#define MVM_SWITCH(tag, upper) switch (tag)
+#define MVM_CASE(value) case value
+
+/**
+ * Set to 1 to dispatch instructions through a table of label addresses. See
+ * `components/microvium/microvium_port.h`. The host tools build the engine
+ * both ways to compare them.
+ */
+#ifndef MVM_COMPUTED_GOTO
+#define MVM_COMPUTED_GOTO 1
+#endif
+
+/**
+ * Number of entries in the inline property cache (power of 2, or 0 to
+ * disable it). Own and inherited properties are cached; class statics and
+ * array prototype reads are not.
+ */
+#ifndef MVM_PROPERTY_CACHE_SIZE
+#define MVM_PROPERTY_CACHE_SIZE 16
+#endif
+
+/**
+ * Number of entries in the scoped variable cache (power of 2, or 0 to disable
+ * it).
+ */
+#ifndef MVM_SCOPE_CACHE_SIZE
+#define MVM_SCOPE_CACHE_SIZE 16
+#endif
+
+/**
+ * Set to 1 to keep a hash index over the RAM interned strings.
+ */
+#ifndef MVM_INTERN_INDEX
+#define MVM_INTERN_INDEX 1
+#endif
+
+/**
+ * Generational collection, as on the ESP32.
+ */
+#ifndef MVM_GENERATIONAL_GC
+#define MVM_GENERATIONAL_GC 1
+#endif
+#define MVM_GC_NURSERY_SIZE MVM_ALLOCATION_BUCKET_SIZE
+#define MVM_GC_REMEMBERED_SET_SIZE 16
+
+/**
+ * Include `mvm_gcStep`, as on the ESP32.
+ */
+#ifndef MVM_INCREMENTAL_GC
+#define MVM_INCREMENTAL_GC 1
+#endif
+
+/**
+ * GC policy and idle hook (`mvm_setGCPolicy`, `mvm_gcIdle`), as on the ESP32.
+ */
+#ifndef MVM_GC_POLICY
+#define MVM_GC_POLICY 1
+#endif
+
+#include <time.h>
+static inline uint32_t mvm_hostClockUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000);
+}
+#define MVM_GC_CLOCK_US() mvm_hostClockUs()
+
+/**
+ * Per-opcode profiler (`mvm_getProfile`). Off by default so that the
+ * benchmarks are not skewed by it; the clock is in nanoseconds.
+ */
+#ifndef MVM_PROFILE
+#define MVM_PROFILE 0
+#endif
+#define MVM_PROFILE_MAX_FUNCTIONS 32
+
+static inline uint32_t mvm_hostClockNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+#define MVM_PROFILE_CLOCK() mvm_hostClockNs()
+
+/**
+ * Sampling profiler (`mvm_requestSample`), driven by a POSIX timer in the
+ * host tools.
+ */
+#ifndef MVM_SAMPLING_PROFILER
+#define MVM_SAMPLING_PROFILER 0
+#endif
+#define MVM_SAMPLE_RING_SIZE 64
+#define MVM_SAMPLE_MAX_DEPTH 16
+
+/**
+ * Heap profiler (`mvm_startHeapProfile`), off by default.
+ */
+#ifndef MVM_HEAP_PROFILE
+#define MVM_HEAP_PROFILE 0
+#endif
+#define MVM_HEAP_PROFILE_MAX_SITES 64
+
+/**
+ * Heap dumps (`mvm_dumpHeap`), off by default.
+ */
+#ifndef MVM_HEAP_DUMP
+#define MVM_HEAP_DUMP 0
+#endif
+
+/**
+ * Superinstructions, off by default so that the benchmarks measure the plain
+ * interpreter. Note that a superinstruction counts as a single instruction for
+ * the gas counter.
+ */
+#ifndef MVM_SUPERINSTRUCTIONS
+#define MVM_SUPERINSTRUCTIONS 0
+#endif
+
+/**
+ * Recycle the boxes of intermediate number results, as on the ESP32. The
+ * benchmark suite reports how many allocations this saves.
+ */
+#ifndef MVM_RECYCLE_NUMBER_BOXES
+#define MVM_RECYCLE_NUMBER_BOXES 1
+#endif
+
+/**
+ * Deferred string concatenation, as on the ESP32.
+ */
+#ifndef MVM_STRING_ROPES
+#define MVM_STRING_ROPES 1
+#endif
+#define MVM_ROPE_MIN_SIZE 64
+
+/**
+ * Buffers in host memory (`mvm_typedArrayFromExternal`), as on the ESP32.
+ */
+#ifndef MVM_EXTERNAL_BUFFERS
+#define MVM_EXTERNAL_BUFFERS 1
+#endif
+
+#define MVM_CHECK_CRC16_CCITT(lpData, size, expected) (crc16(lpData, size) == expected)
+
+static inline uint16_t crc16(MVM_LONG_PTR_TYPE lp, uint16_t size) {
+  uint16_t r = 0xFFFF;
+  while (size--)
+  {
+    r  = (uint8_t)(r >> 8) | (r << 8);
+    r ^= MVM_READ_LONG_PTR_1(lp);
+    lp = MVM_LONG_PTR_ADD(lp, 1);
+    r ^= (uint8_t)(r & 0xff) >> 4;
+    r ^= (r << 8) << 4;
+    r ^= ((r & 0xff) << 4) << 1;
+  }
+  return r;
+}
+
+#define MVM_INCLUDE_SNAPSHOT_CAPABILITY 1
+
+#define MVM_INCLUDE_DEBUG_CAPABILITY 0
+
+#if MVM_INCLUDE_SNAPSHOT_CAPABILITY
+#define MVM_CALC_CRC16_CCITT(pData, size) (crc16(pData, size))
+#endif // MVM_INCLUDE_SNAPSHOT_CAPABILITY
+
+#define MVM_USE_SINGLE_RAM_PAGE 0
+
+#define MVM_CONTEXTUAL_MALLOC(size, context) MVM_MALLOC(size)
+#define MVM_CONTEXTUAL_FREE(ptr, context) MVM_FREE(ptr)
+
+/**
+ * The host tools use the gas counter to count executed instructions.
+ */
+#define MVM_GAS_COUNTER
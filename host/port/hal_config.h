@@ -0,0 +1,32 @@
+/*
+ * @file hal_config.h
+ * @brief HAL CONFIG port (Linux host stand-in)
+ * @details
+ * Enables only the HAL modules that the host tools build: the OS module (see
+ * hal_port_os.h) and the TIM module (see hal_port_tim.h).
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef HAL_CONFIG_H
+#define HAL_CONFIG_H
+
+#define HAL_CORE_USE_POWER_MANAGEMENT   0
+#define HAL_ENABLE_GPIO                 0
+#define HAL_ENABLE_DIAG                 0
+#define HAL_ENABLE_IOBUF                0
+#define HAL_ENABLE_IO                   0
+#define HAL_IO_OS_INTEGRATION           0
+#define HAL_ENABLE_TIM                  1
+#define HAL_ENABLE_OS                   1
+
+// Interrupt-level events need a hardware timer
+#define HAL_TIM_USE_INTERRUPT_EVENTS    0
+#define HAL_TIM_USE_TASK_EVENTS         1
+
+#endif /* HAL_CONFIG_H */
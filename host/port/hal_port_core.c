@@ -0,0 +1,37 @@
+/*
+ * @file hal_port_core.c
+ * @brief CORE port (Linux host stand-in)
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <pthread.h>
+
+#include "hal_core.h"
+
+static pthread_mutex_t core_port_critical;
+static pthread_once_t core_port_critical_once = PTHREAD_ONCE_INIT;
+
+static void core_port_critical_init(void) {
+    pthread_mutexattr_t attr;
+
+    // Critical sections nest
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&core_port_critical, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void core_port_enter_critical(void) {
+    pthread_once(&core_port_critical_once, core_port_critical_init);
+    pthread_mutex_lock(&core_port_critical);
+}
+
+void core_port_exit_critical(void) {
+    pthread_mutex_unlock(&core_port_critical);
+}
@@ -0,0 +1,27 @@
+/*
+ * @file hal_port_core.h
+ * @brief CORE port (Linux host stand-in)
+ * @details
+ * Only critical sections are provided, as one recursive mutex shared by all
+ * threads.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef HAL_PORT_CORE_H
+#define HAL_PORT_CORE_H
+
+#include "hal_core.h"
+
+#define CORE_PORT_EnterCritical()               core_port_enter_critical()
+#define CORE_PORT_ExitCritical()                core_port_exit_critical()
+
+void core_port_enter_critical(void);
+void core_port_exit_critical(void);
+
+#endif /* HAL_PORT_CORE_H */
@@ -0,0 +1,57 @@
+/*
+ * @file hal_port_fs.c
+ * @brief FILESYSTEM port (Linux host stand-in)
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hal_port_fs.h"
+
+const void* partition_map(const char *label, size_t *size, fs_map_handle_t *handle) {
+    int fd = open(label, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // Read-only, like flash: the VM must never write to the bytecode
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    handle->addr = addr;
+    handle->size = st.st_size;
+    *size = st.st_size;
+    return addr;
+}
+
+void partition_unmap(fs_map_handle_t handle) {
+    munmap(handle.addr, handle.size);
+}
+
+int partition_write(const char *label, const void *data, size_t size) {
+    FILE *f = fopen(label, "wb");
+    if (f == NULL)
+        return -1;
+
+    size_t written = fwrite(data, 1, size, f);
+    if (fclose(f) != 0 || written != size)
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * @file hal_port_fs.h
+ * @brief FILESYSTEM port (Linux host stand-in)
+ * @details
+ * Lets the host tools build code that uses `hal_fs.h`. A "partition" is a
+ * file, which `fs_map` maps read-only with `mmap`, in the same way that the
+ * ESP32 port maps a flash partition into the data address space.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef HAL_PORT_FS_H_
+#define HAL_PORT_FS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define SCRIPT_PARTITION_LABEL "script.mvm-bc"
+#define HIBERNATE_PARTITION_LABEL "hibernate.bin"
+
+#define fs_open(FN, OT)       fopen(FN, OT)
+#define fs_map(PL, SZ, HN)    partition_map(PL, SZ, HN)
+#define fs_unmap(HN)          partition_unmap(HN)
+#define fs_write_partition(PL, DT, SZ) partition_write(PL, DT, SZ)
+
+typedef struct fs_map_handle {
+    void *addr;
+    size_t size;
+} fs_map_handle_t;
+
+/**
+ * Map a file read-only.
+ *
+ * @param label file name
+ * @param size receives the size of the file
+ * @param handle receives the handle to pass to partition_unmap
+ * @return pointer to the mapped file or NULL if it can't be mapped
+ */
+const void* partition_map(const char *label, size_t *size, fs_map_handle_t *handle);
+       void partition_unmap(fs_map_handle_t handle);
+
+/**
+ * Replace the contents of a file.
+ *
+ * @param label file name
+ * @param data data to write
+ * @param size size of data
+ * @return 0 on success
+ */
+        int partition_write(const char *label, const void *data, size_t size);
+
+#endif /* HAL_PORT_FS_H_ */
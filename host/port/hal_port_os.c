@@ -0,0 +1,137 @@
+/*
+ * @file hal_port_os.c
+ * @brief OS port (Linux host stand-in)
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+
+#include "hal_port_os.h"
+
+struct os_port_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned count;
+    unsigned max;
+};
+
+typedef struct os_port_task_start {
+    void (*task_impl)(void*);
+    void *arg;
+} os_port_task_start_t;
+
+void os_port_sleep(OSTime ms) {
+    struct timespec ts = { ms / 1000, (long) (ms % 1000) * 1000000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+        ;
+}
+
+uint64_t os_port_time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000u + ts.tv_nsec / 1000;
+}
+
+static void* os_port_task_main(void *arg) {
+    os_port_task_start_t start = *(os_port_task_start_t*) arg;
+    free(arg);
+    start.task_impl(start.arg);
+    return NULL;
+}
+
+_Static_assert(sizeof(pthread_t) <= sizeof(OSTask), "pthread_t doesn't fit in OSTask");
+
+OSTask OSTASK_PORT_Create(void (*task_impl)(void*), int priority, size_t stack_size, void *arg) {
+    // The priority and stack size are for the RTOS; threads get the defaults
+    pthread_t thread;
+    os_port_task_start_t *start = malloc(sizeof(*start));
+    if (start == NULL)
+        return NULL;
+
+    start->task_impl = task_impl;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, os_port_task_main, start) != 0) {
+        free(start);
+        return NULL;
+    }
+
+    // Like a FreeRTOS task, the thread is never joined
+    pthread_detach(thread);
+    return (OSTask) (uintptr_t) thread;
+}
+
+void os_port_task_exit(void) {
+    pthread_exit(NULL);
+}
+
+OSCntSem os_port_sem_create(unsigned init, unsigned max) {
+    OSCntSem sem = malloc(sizeof(*sem));
+    if (sem == NULL)
+        return NULL;
+
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = init;
+    sem->max = max;
+    return sem;
+}
+
+void os_port_sem_destroy(OSCntSem sem) {
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
+
+void os_port_sem_give(OSCntSem sem) {
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max) {
+        sem->count++;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+}
+
+int os_port_sem_take(OSCntSem sem, uint32_t timeout) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long) (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int result = 0;
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count == 0) {
+        if (pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline) == ETIMEDOUT) {
+            result = 1;
+            break;
+        }
+    }
+    if (result == 0)
+        sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+
+    return result;
+}
+
+OSMutex os_port_mutex_create(void) {
+    OSMutex mutex = malloc(sizeof(*mutex));
+    if (mutex != NULL)
+        pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+void os_port_mutex_destroy(OSMutex mutex) {
+    pthread_mutex_destroy(mutex);
+    free(mutex);
+}
@@ -0,0 +1,107 @@
+/*
+ * @file hal_port_os.h
+ * @brief OS port (Linux host stand-in)
+ * @details
+ * Lets the host tools build code that uses `hal_os.h`, with POSIX threads in
+ * place of FreeRTOS tasks. Only the parts of the OS module that the host tools
+ * use are provided: tasks, binary and counting semaphores, mutexes and the
+ * clock. Tasks can't be pinned to a core, so `OSTASK_CreatePinned` leaves the
+ * choice of core to the Linux scheduler.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef HAL_PORT_OS_H
+#define HAL_PORT_OS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+// -----------------------------------------------------------------------------
+//  OS CORE PORT
+// -----------------------------------------------------------------------------
+
+typedef uint32_t OSTime;
+
+#define OS_PORT_Sleep(ticks)                    os_port_sleep(ticks)
+#define OS_PORT_GetSystemTime()                 ((OSTime) (os_port_time_us() / 1000))
+#define OS_PORT_GetTimeUs()                     os_port_time_us()
+#define OS_PORT_CORE_COUNT                      2
+
+void os_port_sleep(OSTime ms);
+uint64_t os_port_time_us(void);
+
+// -----------------------------------------------------------------------------
+//  OS TASK PORT
+// -----------------------------------------------------------------------------
+
+/**
+ * The thread ID, cast to a pointer (pthread_t is an integer on Linux), so that
+ * creating a task doesn't allocate anything that would have to be freed when
+ * it ends. A created task is never NULL.
+ */
+typedef void* OSTask;
+
+OSTask OSTASK_PORT_Create(void (*task_impl)(void*), int priority, size_t stack_size, void *arg);
+
+/**
+ * Only the calling task can be destroyed (`OSTASK_Destroy(NULL)`), which is how
+ * a FreeRTOS task ends itself.
+ */
+#define OSTASK_PORT_Destroy(task)               os_port_task_exit()
+#define OSTASK_PORT_Yield()                     sched_yield()
+#define OSTASK_PORT_CreatePinned(task_impl, priority, stack_size, arg, core) OSTASK_PORT_Create(task_impl, priority, stack_size, arg)
+
+void os_port_task_exit(void);
+
+// -----------------------------------------------------------------------------
+//  OS CNTSEM PORT
+// -----------------------------------------------------------------------------
+
+typedef struct os_port_sem *OSCntSem;
+
+#define OSCNTSEM_PORT_Create(init, max)         os_port_sem_create((init), (max))
+#define OSCNTSEM_PORT_Destroy(sem)              os_port_sem_destroy(sem)
+#define OSCNTSEM_PORT_Give(sem)                 os_port_sem_give(sem)
+#define OSCNTSEM_PORT_Take(sem, timeout)        os_port_sem_take((sem), (timeout))
+
+OSCntSem os_port_sem_create(unsigned init, unsigned max);
+    void os_port_sem_destroy(OSCntSem sem);
+    void os_port_sem_give(OSCntSem sem);
+     int os_port_sem_take(OSCntSem sem, uint32_t timeout);
+
+// -----------------------------------------------------------------------------
+//  OS SEM PORT
+// -----------------------------------------------------------------------------
+
+typedef OSCntSem OSSem;
+
+#define OSSEM_PORT_Create()                     os_port_sem_create(0, 1)
+#define OSSEM_PORT_Destroy(sem)                 os_port_sem_destroy(sem)
+#define OSSEM_PORT_Give(sem)                    os_port_sem_give(sem)
+#define OSSEM_PORT_GiveFromISR(sem)             os_port_sem_give(sem)
+#define OSSEM_PORT_Take(sem, timeout)           os_port_sem_take((sem), (timeout))
+
+// -----------------------------------------------------------------------------
+//  OS MUTEX PORT
+// -----------------------------------------------------------------------------
+
+typedef pthread_mutex_t* OSMutex;
+
+#define OSMUTEX_PORT_Create()                   os_port_mutex_create()
+#define OSMUTEX_PORT_Destroy(mutex)             os_port_mutex_destroy(mutex)
+#define OSMUTEX_PORT_Give(mutex)                pthread_mutex_unlock(mutex)
+// Note: waits for the mutex without a timeout
+#define OSMUTEX_PORT_Take(mutex, timeout)       (pthread_mutex_lock(mutex) != 0)
+
+OSMutex os_port_mutex_create(void);
+   void os_port_mutex_destroy(OSMutex mutex);
+
+#endif // HAL_PORT_OS_H
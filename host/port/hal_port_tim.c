@@ -0,0 +1,75 @@
+/*
+ * @file hal_port_tim.c
+ * @brief TIMER port (Linux host stand-in)
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#include <time.h>
+
+#include "hal_tim.h"
+
+static TIM_Event tim_host_event_table[HAL_TIM_HOST_MAX_EVENTS];
+static TIM_EventTable tim_host_events = {
+        .MaxEvents = HAL_TIM_HOST_MAX_EVENTS,
+        .NextEvent = { .id = TIM_NO_EVENT },
+        .EventTable = tim_host_event_table,
+};
+static uint64_t tim_host_start_ns;
+
+static uint64_t tim_host_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void tim_host_init(void *tim, uint32_t TickTimeBase) {
+    ((TIMDevice) tim)->TickTimeBase = TickTimeBase > 0 ? TickTimeBase : 1;
+    tim_host_start_ns = tim_host_now_ns();
+}
+
+static void tim_host_deinit(void *tim) {
+}
+
+static TIM_Time tim_host_get_time_elapsed(void *tim) {
+    uint64_t ticks = (tim_host_now_ns() - tim_host_start_ns) / ((TIMDevice) tim)->TickTimeBase;
+    TIM_Time time = { (uint32_t) (ticks >> 32), (uint32_t) ticks };
+    return time;
+}
+
+static void tim_host_reset_counter(void *tim) {
+    tim_host_start_ns = tim_host_now_ns();
+}
+
+static void tim_host_get_capabilities(void *tim, TIM_Capabilities *caps) {
+    caps->MinTickBase = 1;
+    caps->MaxTickBase = 0xffffffff;
+    caps->CounterRange = 0xffffffff;
+}
+
+static int32_t tim_host_get_error(void *tim, uint32_t TickTimeBase) {
+    return 0;
+}
+
+static int tim_host_schedule_event(void *tim, TIM_Time time) {
+    // No timer interrupt: task-level events are run by TIM_TaskEventProc
+    return 0;
+}
+
+static TIMDeviceDesc tim_host = {
+        .TskEvents = &tim_host_events,
+        .Init = tim_host_init,
+        .Deinit = tim_host_deinit,
+        .GetTimeElapsed = tim_host_get_time_elapsed,
+        .ResetCounter = tim_host_reset_counter,
+        .GetCapabilities = tim_host_get_capabilities,
+        .GetError = tim_host_get_error,
+        .ScheduleEvent = tim_host_schedule_event,
+};
+
+TIMDevice HAL_TIM_HOST = &tim_host;
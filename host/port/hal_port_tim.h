@@ -0,0 +1,31 @@
+/*
+ * @file hal_port_tim.h
+ * @brief TIMER port (Linux host stand-in)
+ * @details
+ * One timer, `HAL_TIM_HOST`, counting the monotonic clock in ticks of the time
+ * base given to `TIM_Init`. It has task-level events only: there is no timer
+ * interrupt, so the events are run by `TIM_TaskEventProc`.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ * @note This is based on other projects. See license files
+ */
+
+#ifndef HAL_PORT_TIM_H
+#define HAL_PORT_TIM_H
+
+// Before hal_tim.h, which has defaults for the HAL_TIM_USE_xxx settings
+#include "hal_config.h"
+#include "hal_tim.h"
+
+/// Number of task-level events of HAL_TIM_HOST
+#ifndef HAL_TIM_HOST_MAX_EVENTS
+#define HAL_TIM_HOST_MAX_EVENTS         64
+#endif
+
+extern TIMDevice HAL_TIM_HOST;
+
+#endif /* HAL_PORT_TIM_H */
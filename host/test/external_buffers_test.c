@@ -0,0 +1,157 @@
+/*
+ * @file external_buffers_test.c
+ * @brief checks typed arrays over host memory (host)
+ * @details
+ * Passes buffers created with mvm_typedArrayFromExternal to the buffers
+ * workload, which sums the elements and then overwrites each with its index,
+ * and checks that:
+ *
+ *   - the script reads and writes the host memory itself;
+ *   - a buffer is released by the first collection after it becomes
+ *     unreachable, and not before;
+ *   - a buffer held in a handle survives collections until the handle is
+ *     released;
+ *   - mvm_free releases the buffers that are still referenced.
+ *
+ *   external_buffers_test BYTECODE
+ *
+ * Exits with 1 on the first failed check.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "microvium.h"
+
+#define FRAME_LENGTH 64
+#define SUM_EXPORT_ID 1
+
+typedef struct frame {
+    uint8_t bytes[FRAME_LENGTH];
+    int16_t samples[FRAME_LENGTH];
+    int released;
+} frame_t;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        exit(1); \
+    } \
+} while (0)
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static void release(void *data, void *context) {
+    frame_t *frame = (frame_t*) context;
+    CHECK(data == frame->bytes || data == frame->samples);
+    frame->released++;
+}
+
+static void fill(frame_t *frame) {
+    for (int i = 0; i < FRAME_LENGTH; i++) {
+        frame->bytes[i] = 2 * i + 1;
+        frame->samples[i] = -100 * i;
+    }
+    frame->released = 0;
+}
+
+/*
+ * Calls the workload on `array` and checks the sum, and that the script has
+ * overwritten each element of the frame with its index.
+ */
+static void check_sum(mvm_VM *vm, mvm_Value sum, mvm_Value array, int32_t expected, bool samples, frame_t *frame) {
+    mvm_Value result;
+    CHECK(mvm_call(vm, sum, &result, &array, 1) == MVM_E_SUCCESS);
+    CHECK(mvm_toInt32(vm, result) == expected);
+    for (int i = 0; i < FRAME_LENGTH; i++)
+        CHECK(samples ? frame->samples[i] == i : frame->bytes[i] == i);
+}
+
+int main(int argc, char *argv[]) {
+    mvm_VMExportID exportId = SUM_EXPORT_ID;
+    mvm_VM *vm;
+    mvm_Value sum;
+    long size;
+    frame_t a, b;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: external_buffers_test BYTECODE\n");
+        return 1;
+    }
+    uint8_t *bytecode = readFile(argv[1], &size);
+    CHECK(bytecode != NULL);
+    CHECK(mvm_restore(&vm, bytecode, size, NULL, resolveImport) == MVM_E_SUCCESS);
+    CHECK(mvm_resolveExports(vm, &exportId, &sum, 1) == MVM_E_SUCCESS);
+
+    // An array that is only an argument is unreachable after the call
+    fill(&a);
+    mvm_Value array = mvm_typedArrayFromExternal(vm, MVM_TA_UINT8, a.bytes, FRAME_LENGTH, release, &a);
+    CHECK(mvm_typeOf(vm, array) == VM_T_TYPED_ARRAY);
+    check_sum(vm, sum, array, FRAME_LENGTH * FRAME_LENGTH, false, &a);
+    CHECK(a.released == 0);
+    mvm_runGC(vm, false);
+    CHECK(a.released == 1);
+    mvm_runGC(vm, true);
+    CHECK(a.released == 1);
+
+    // An array in a handle survives collections and calls
+    fill(&b);
+    mvm_Handle handle;
+    mvm_initializeHandle(vm, &handle);
+    mvm_handleSet(&handle, mvm_typedArrayFromExternal(vm, MVM_TA_INT16, b.samples, FRAME_LENGTH, release, &b));
+    mvm_runGC(vm, true);
+    check_sum(vm, sum, mvm_handleGet(&handle), -100 * FRAME_LENGTH * (FRAME_LENGTH - 1) / 2, true, &b);
+    mvm_runGC(vm, false);
+    CHECK(b.released == 0);
+
+    mvm_TeTypedArrayKind kind;
+    void *data;
+    size_t length;
+    CHECK(mvm_typedArrayToElements(vm, mvm_handleGet(&handle), &kind, &data, &length) == MVM_E_SUCCESS);
+    CHECK(kind == MVM_TA_INT16 && data == b.samples && length == FRAME_LENGTH);
+
+    mvm_releaseHandle(vm, &handle);
+    mvm_runGC(vm, false);
+    CHECK(b.released == 1);
+
+    // mvm_free releases whatever is still referenced
+    fill(&a);
+    mvm_initializeHandle(vm, &handle);
+    mvm_handleSet(&handle, mvm_typedArrayFromExternal(vm, MVM_TA_UINT8, a.bytes, FRAME_LENGTH, release, &a));
+    mvm_free(vm);
+    CHECK(a.released == 1);
+
+    free(bytecode);
+    return 0;
+}
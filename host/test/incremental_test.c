@@ -0,0 +1,190 @@
+/*
+ * @file incremental_test.c
+ * @brief checks collections spread over calls to mvm_gcStep (host)
+ * @details
+ * Keeps strings alive in handles and collects the heap with mvm_gcStep, with a
+ * budget small enough that the roots take several steps, and checks that:
+ *
+ *   - the steps complete the collection by themselves, the first step
+ *     included, with the strings intact;
+ *   - a handle copied to another mid-collection (which completes it) keeps
+ *     its value, whichever of the two the steps had already processed;
+ *   - the table of handles can grow mid-collection;
+ *   - a call, an allocation or mvm_runGC mid-collection completes it, and
+ *     the script runs as usual;
+ *   - mvm_free discards a collection in progress.
+ *
+ *   incremental_test BYTECODE
+ *
+ * The bytecode is the gc_churn workload, whose export 1 returns 40. Exits with
+ * 1 on the first failed check.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "microvium.h"
+
+#if !MVM_INCREMENTAL_GC
+#error This test needs an engine built with MVM_INCREMENTAL_GC
+#endif
+
+#define STRINGS     48
+#define EXTRA       24
+#define BUDGET      16
+#define RUN_EXPORT  1
+#define RUN_RESULT  40
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        exit(1); \
+    } \
+} while (0)
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    return MVM_E_UNRESOLVED_IMPORT;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+static int format(char *text, int i) {
+    return sprintf(text, "string %02d", i);
+}
+
+// Checks that `handle` holds the string made by format(i)
+static void check_string(mvm_VM *vm, mvm_Handle *handle, int i) {
+    char text[16];
+    size_t size;
+    int length = format(text, i);
+    const char *s = mvm_toStringUtf8(vm, mvm_handleGet(handle), &size);
+    CHECK(size == (size_t) length && memcmp(s, text, size) == 0);
+}
+
+// Starts a collection that is still in its roots after the first step
+static void start(mvm_VM *vm) {
+    CHECK(!mvm_gcStep(vm, BUDGET));
+}
+
+// Completes a collection with steps alone, returning the number of steps
+static long finish(mvm_VM *vm) {
+    long steps = 1;
+    while (!mvm_gcStep(vm, BUDGET))
+        steps++;
+    return steps;
+}
+
+int main(int argc, char *argv[]) {
+    mvm_VMExportID exportId = RUN_EXPORT;
+    mvm_Handle live[STRINGS];
+    mvm_Handle extra[EXTRA];
+    mvm_TsMemoryStats stats;
+    mvm_Value run, result;
+    mvm_VM *vm;
+    char text[16];
+    long size;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: incremental_test BYTECODE\n");
+        return 1;
+    }
+    uint8_t *bytecode = readFile(argv[1], &size);
+    CHECK(bytecode != NULL);
+    CHECK(mvm_restore(&vm, bytecode, size, NULL, resolveImport) == MVM_E_SUCCESS);
+    CHECK(mvm_resolveExports(vm, &exportId, &run, 1) == MVM_E_SUCCESS);
+
+    for (int i = 0; i < STRINGS; i++) {
+        int length = format(text, i);
+        mvm_initializeHandle(vm, &live[i]);
+        mvm_handleSet(&live[i], mvm_newString(vm, text, length));
+    }
+    mvm_runGC(vm, false);
+
+    // Each step processes about BUDGET / 2 roots, so it takes several to get
+    // through the handles
+    mvm_getMemoryStats(vm, &stats);
+    size_t steps = stats.gcIncrementalSteps;
+    size_t collections = stats.gcMajorCollections;
+    CHECK(finish(vm) > STRINGS * 2 / BUDGET);
+    mvm_getMemoryStats(vm, &stats);
+    CHECK(stats.gcMajorCollections == collections + 1);
+    CHECK(stats.gcIncrementalSteps > steps + STRINGS * 2 / BUDGET);
+    for (int i = 0; i < STRINGS; i++)
+        check_string(vm, &live[i], i);
+
+    // The first handles have been processed by the first step and the last
+    // ones haven't, so these copy both ways between the two
+    start(vm);
+    mvm_handleSet(&live[0], mvm_handleGet(&live[STRINGS - 1]));
+    start(vm);
+    mvm_handleSet(&live[STRINGS - 2], mvm_handleGet(&live[1]));
+    start(vm);
+    *mvm_handleAt(&live[2]) = mvm_handleGet(&live[STRINGS - 3]);
+    finish(vm);
+    mvm_runGC(vm, true);
+    check_string(vm, &live[0], STRINGS - 1);
+    check_string(vm, &live[STRINGS - 2], 1);
+    check_string(vm, &live[2], STRINGS - 3);
+    for (int i = 3; i < STRINGS - 3; i++)
+        check_string(vm, &live[i], i);
+
+    // New pages of handles and a call mid-collection
+    start(vm);
+    for (int i = 0; i < EXTRA; i++)
+        mvm_initializeHandle(vm, &extra[i]);
+    CHECK(!mvm_gcStep(vm, BUDGET));
+    CHECK(mvm_call(vm, run, &result, NULL, 0) == MVM_E_SUCCESS);
+    CHECK(mvm_toInt32(vm, result) == RUN_RESULT);
+    for (int i = 0; i < EXTRA; i++) {
+        mvm_handleSet(&extra[i], mvm_handleGet(&live[i]));
+        mvm_releaseHandle(vm, &live[i]);
+    }
+    finish(vm);
+    for (int i = 3; i < EXTRA; i++)
+        check_string(vm, &extra[i], i);
+
+    // An allocation and a full collection mid-collection
+    start(vm);
+    int length = format(text, STRINGS);
+    mvm_Value string = mvm_newString(vm, text, length);
+    mvm_handleSet(&extra[0], string);
+    start(vm);
+    mvm_runGC(vm, true);
+    check_string(vm, &extra[0], STRINGS);
+    for (int i = EXTRA; i < STRINGS - 3; i++)
+        check_string(vm, &live[i], i);
+
+    // Anything left over is freed with the VM
+    start(vm);
+    mvm_free(vm);
+
+    free(bytecode);
+    return 0;
+}
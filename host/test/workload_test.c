@@ -0,0 +1,318 @@
+/*
+ * @file workload_test.c
+ * @brief checks the results of a compiled workload (host)
+ * @details
+ * Calls an exported function of a bytecode image a number of times and checks
+ * the results of the first calls against the expected values given on the
+ * command line, one per call. A value is compared as a number unless the
+ * function returns a string, in which case it is compared as text.
+ *
+ *   workload_test [--calls N] [--gc none|full|step|policy] [--recycled] [--warm] BYTECODE[@EXPORT] EXPECTED...
+ *
+ * Between calls the heap is collected according to --gc:
+ *
+ *   - none: only when the VM needs to;
+ *   - full: with mvm_runGC, squeezing the heap every other time (default);
+ *   - step: with one mvm_gcStep of a small budget, so that the calls run
+ *     with a collection in progress (needs MVM_INCREMENTAL_GC);
+ *   - policy: never by the host, but by the GC policy of main/main.c during
+ *     the calls and with mvm_gcIdle between them, which must have started at
+ *     least one collection by the end (needs MVM_GC_POLICY).
+ *
+ * With --recycled, the number boxes recycled (see MVM_RECYCLE_NUMBER_BOXES)
+ * must be more than zero after the calls.
+ *
+ * With --warm, the calls are made on a VM restarted from a hibernation image of
+ * the restored one (see mvm_hibernate), which must also be rejected with
+ * another build ID or with a different snapshot CRC.
+ *
+ * The tests run this against the checked-in workloads with several engine
+ * builds (see host/CMakeLists.txt), including one in safe mode with the
+ * expensive memory checks, which asserts on a corrupted heap. All host
+ * imports resolve to a stub that returns `undefined`. Exits with 1 on any
+ * mismatch or error.
+ *
+ * @author Emiliano Gonzalez (egonzalez . hiperion @ gmail . com))
+ * @version 0.1
+ * @date 2023
+ * @copyright MIT License
+ * @see https://github.com/hiperiondev/esp32-microvium
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "microvium.h"
+
+#define DEFAULT_EXPORT_ID 1
+#define DEFAULT_CALLS     100
+#define GC_STEP_BUDGET    64
+#define BUILD_ID          0x12345678
+
+#if MVM_GC_POLICY
+// As in main/main.c
+static const mvm_TsGCPolicy GC_POLICY = {
+    .targetHeapSize = MVM_MAX_HEAP_SIZE / 4 * 3,
+    .growthPercent = 200,
+    .idleCollectBytes = MVM_MAX_HEAP_SIZE / 4,
+    .idleStepBytes = GC_STEP_BUDGET,
+};
+#endif
+
+typedef enum gc_mode {
+    GC_NONE,
+    GC_FULL,
+    GC_STEP,
+    GC_POLICY_IDLE,
+} gc_mode_t;
+
+static mvm_TeError stub(mvm_VM *vm, mvm_HostFunctionID funcID, mvm_Value *result, mvm_Value *args, uint8_t argCount) {
+    return MVM_E_SUCCESS;
+}
+
+static mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFunction *out) {
+    *out = stub;
+    return MVM_E_SUCCESS;
+}
+
+static uint8_t* readFile(const char *path, long *out_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0L, SEEK_SET);
+
+    uint8_t *data = (uint8_t*) malloc(size);
+    if (data != NULL && fread(data, 1, size, file) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *out_size = size;
+    return data;
+}
+
+/*
+ * Replaces the VM with one restarted from a hibernation image of it, checking
+ * that the image is rejected if it doesn't match. Returns the image, which
+ * must outlive the VM, or NULL on failure.
+ */
+static uint8_t* warm_restart(mvm_VM **vm) {
+    size_t size;
+    mvm_TeError err;
+    uint8_t *image = mvm_hibernate(*vm, BUILD_ID, &size);
+    if (image == NULL) {
+        fprintf(stderr, "mvm_hibernate failed\n");
+        return NULL;
+    }
+    mvm_free(*vm);
+    *vm = NULL;
+
+    err = mvm_restoreHibernated(vm, image, size, BUILD_ID + 1, NULL);
+    if (err != MVM_E_INVALID_HIBERNATION_IMAGE) {
+        fprintf(stderr, "another build ID: mvm_restoreHibernated error: %d\n", err);
+        goto fail;
+    }
+
+    // The snapshot's CRC, in its header after the import table
+    uint16_t importCount;
+    memcpy(&importCount, image + 8, sizeof importCount);
+    uint8_t *crc = image + 16 + importCount * sizeof (mvm_TfHostFunction) + 6;
+    crc[0] ^= 1;
+    err = mvm_restoreHibernated(vm, image, size, BUILD_ID, NULL);
+    crc[0] ^= 1;
+    if (err != MVM_E_INVALID_HIBERNATION_IMAGE) {
+        fprintf(stderr, "another snapshot CRC: mvm_restoreHibernated error: %d\n", err);
+        goto fail;
+    }
+
+    err = mvm_restoreHibernated(vm, image, size, BUILD_ID, NULL);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restoreHibernated error: %d\n", err);
+        goto fail;
+    }
+    return image;
+
+fail:
+    if (*vm != NULL)
+        mvm_free(*vm);
+    *vm = NULL;
+    free(image);
+    return NULL;
+}
+
+/*
+ * Compares a result with its expected value, printing both if they differ.
+ */
+static bool check_result(mvm_VM *vm, long call, mvm_Value result, const char *expected) {
+    if (mvm_typeOf(vm, result) == VM_T_STRING) {
+        size_t size;
+        const char *text = mvm_toStringUtf8(vm, result, &size);
+        if (size == strlen(expected) && memcmp(text, expected, size) == 0)
+            return true;
+        fprintf(stderr, "call %ld: got \"%.*s\", expected \"%s\"\n", call, (int) size, text, expected);
+        return false;
+    }
+
+    double value = mvm_toFloat64(vm, result);
+    double want = strtod(expected, NULL);
+    if (fabs(value - want) <= 1e-9 * fabs(want))
+        return true;
+    fprintf(stderr, "call %ld: got %.17g, expected %s\n", call, value, expected);
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    mvm_VMExportID exportId = DEFAULT_EXPORT_ID;
+    long calls = DEFAULT_CALLS;
+    gc_mode_t gc = GC_FULL;
+    bool recycled = false;
+    bool warm = false;
+    uint8_t *image = NULL;
+    mvm_TeError err;
+    mvm_VM *vm;
+    mvm_Value func;
+    mvm_Value result;
+    long size;
+    int arg = 1;
+
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--calls") == 0 && arg + 1 < argc) {
+            calls = atol(argv[++arg]);
+        } else if (strcmp(argv[arg], "--gc") == 0 && arg + 1 < argc) {
+            const char *mode = argv[++arg];
+            if (strcmp(mode, "none") == 0) {
+                gc = GC_NONE;
+            } else if (strcmp(mode, "full") == 0) {
+                gc = GC_FULL;
+            } else if (strcmp(mode, "step") == 0) {
+#if MVM_INCREMENTAL_GC
+                gc = GC_STEP;
+#else
+                fprintf(stderr, "--gc step needs MVM_INCREMENTAL_GC\n");
+                return 1;
+#endif
+            } else if (strcmp(mode, "policy") == 0) {
+#if MVM_GC_POLICY
+                gc = GC_POLICY_IDLE;
+#else
+                fprintf(stderr, "--gc policy needs MVM_GC_POLICY\n");
+                return 1;
+#endif
+            } else {
+                fprintf(stderr, "unknown --gc mode: %s\n", mode);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--recycled") == 0) {
+            recycled = true;
+        } else if (strcmp(argv[arg], "--warm") == 0) {
+            warm = true;
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: workload_test [--calls N] [--gc none|full|step|policy] [--recycled] [--warm] BYTECODE[@EXPORT] EXPECTED...\n");
+        return 1;
+    }
+
+    char *path = argv[arg++];
+    char *exportStr = strrchr(path, '@');
+    if (exportStr != NULL) {
+        *exportStr++ = '\0';
+        exportId = (mvm_VMExportID) atoi(exportStr);
+    }
+    char **expected = &argv[arg];
+    long expectedCount = argc - arg;
+    if (calls < expectedCount)
+        calls = expectedCount;
+
+    uint8_t *bytecode = readFile(path, &size);
+    if (bytecode == NULL) {
+        fprintf(stderr, "cannot read %s\n", path);
+        return 1;
+    }
+
+    err = mvm_restore(&vm, bytecode, size, NULL, resolveImport);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_restore error: %d\n", err);
+        free(bytecode);
+        return 1;
+    }
+
+    if (warm) {
+        image = warm_restart(&vm);
+        if (image == NULL) {
+            free(bytecode);
+            return 1;
+        }
+    }
+
+#if MVM_GC_POLICY
+    if (gc == GC_POLICY_IDLE)
+        mvm_setGCPolicy(vm, &GC_POLICY);
+#endif
+
+    bool ok = true;
+    err = mvm_resolveExports(vm, &exportId, &func, 1);
+    if (err != MVM_E_SUCCESS) {
+        fprintf(stderr, "mvm_resolveExports error: %d\n", err);
+        ok = false;
+    }
+
+    for (long i = 0; ok && i < calls; i++) {
+        err = mvm_call(vm, func, &result, NULL, 0);
+        if (err != MVM_E_SUCCESS) {
+            fprintf(stderr, "call %ld: mvm_call error: %d\n", i, err);
+            ok = false;
+            break;
+        }
+        if (i < expectedCount && !check_result(vm, i, result, expected[i]))
+            ok = false;
+
+        if (gc == GC_FULL) {
+            mvm_runGC(vm, i % 2);
+#if MVM_INCREMENTAL_GC
+        } else if (gc == GC_STEP) {
+            mvm_gcStep(vm, GC_STEP_BUDGET);
+#endif
+#if MVM_GC_POLICY
+        } else if (gc == GC_POLICY_IDLE) {
+            mvm_gcIdle(vm);
+#endif
+        }
+    }
+
+#if MVM_GC_POLICY
+    if (ok && gc == GC_POLICY_IDLE) {
+        mvm_TsMemoryStats stats;
+        mvm_getMemoryStats(vm, &stats);
+        if (stats.gcPolicyCollections == 0) {
+            fprintf(stderr, "the GC policy started no collections\n");
+            ok = false;
+        }
+    }
+#endif
+
+    if (ok && recycled) {
+        mvm_TsMemoryStats stats;
+        mvm_getMemoryStats(vm, &stats);
+        if (stats.numberBoxesRecycled == 0) {
+            fprintf(stderr, "no number boxes were recycled\n");
+            ok = false;
+        }
+    }
+
+    mvm_free(vm);
+    free(image);
+    free(bytecode);
+    return ok ? 0 : 1;
+}
@@ -21,9 +21,12 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_app_desc.h>
 
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -35,6 +38,7 @@
 
 #define MICROVIUM_HAL_WIFI
 #include "microvium_hal.h"
+#include "microvium_hal_image.h"
 
 static char TAG[] = "main";
 TaskHandle_t microviumtsk_handle;
@@ -97,6 +101,11 @@ const char *microvium_error[] = {
         EP(MVM_E_WRONG_BYTECODE_VERSION),                      //
         EP(MVM_E_USING_NEW_ON_NON_CLASS),                      //
         EP(MVM_E_INSTRUCTION_COUNT_REACHED),                   //
+        EP(MVM_E_INVALID_HIBERNATION_IMAGE),                   //
+        EP(MVM_E_YIELDED),                                     //
+        EP(MVM_E_NOT_SUSPENDED),                               //
+        EP(MVM_E_HOST_PENDING),                                //
+        EP(MVM_E_CANNOT_SUSPEND),                              //
 };
 
 const char *wifi_cypher[] = {
@@ -141,40 +150,120 @@ mvm_TeError resolveImport(mvm_HostFunctionID funcID, void *context, mvm_TfHostFu
     return microvium_hal_resolveImport(funcID, context, out);
 }
 
+/*
+ * Identifies this firmware build together with the script, since a
+ * hibernation image is only valid for the pair.
+ */
+static uint32_t build_id(const microvium_hal_image_t *script) {
+    const esp_app_desc_t *app = esp_app_get_description();
+    const uint8_t *bytecode = (const uint8_t*) script->bytecode;
+    uint32_t id;
+
+    memcpy(&id, app->app_elf_sha256, sizeof(id));
+    // bytecode CRC (offset 6 of the bytecode header)
+    return id ^ (bytecode[6] | (bytecode[7] << 8)) ^ ((uint32_t) script->size << 16);
+}
+
+#if MVM_GC_POLICY
+// Collect before the heap grows past 3/4 of MVM_MAX_HEAP_SIZE, or past twice
+// what was live after the last collection if that's more, rather than only
+// when it's full. When the task is idle, collect once the heap has grown by a
+// quarter of MVM_MAX_HEAP_SIZE, 64 bytes per step.
+static const mvm_TsGCPolicy GC_POLICY = {
+    .targetHeapSize = MVM_MAX_HEAP_SIZE / 4 * 3,
+    .growthPercent = 200,
+    .idleCollectBytes = MVM_MAX_HEAP_SIZE / 4,
+    .idleStepBytes = 64,
+};
+#endif
+
+#if MVM_SAMPLING_PROFILER
+// Sampling period of the profiler. The folded stacks are written to
+// PROFILE_FILE on the littlefs partition, which can be fetched over FTP.
+#define PROFILE_PERIOD_US 1000
+#define PROFILE_FILE      "profile.folded"
+
+static void profile_timer(void *arg) {
+    mvm_requestSample((mvm_VM*) arg);
+}
+
+static void profile_write(void *context, const char *line) {
+    fprintf((FILE*) context, "%s\n", line);
+}
+#endif
+
+#if MVM_HEAP_DUMP
+// Written after each boot to the littlefs partition, to be fetched over FTP and
+// compared with the dump of an earlier run with the heap_diff host tool
+#define HEAP_DUMP_FILE "heap.dump"
+
+static void heap_dump_write(void *context, const void *data, size_t size) {
+    fwrite(data, 1, size, (FILE*) context);
+}
+#endif
+
+#if MVM_HEAP_PROFILE
+static void heap_profile_log(void *context, const mvm_TsHeapProfileSite *site) {
+    ESP_LOGI(TAG, "heap site %04x %s: %u allocs, %u B, %u B live, %u B survived, %u B reclaimed", site->bytecodeAddress,
+            site->typeName ? site->typeName : "(other)", (unsigned) site->allocationCount, (unsigned) site->allocatedBytes,
+            (unsigned) site->liveBytes, (unsigned) site->survivedBytes, (unsigned) site->reclaimedBytes);
+}
+#endif
+
 void microvium_task(void *pvParameter) {
     mvm_TeError err;
     mvm_VM *vm;
-    uint8_t *snapshot = NULL;
+    microvium_hal_image_t snapshot;
+    microvium_hal_image_t hibernated;
+    uint32_t buildId;
+    bool warm = false;
     mvm_Value sayHello;
     mvm_Value result;
-    FILE *snapshotFile;
-    long snapshotSize;
-
-    // Read the bytecode from file
-    ESP_LOGI(TAG, "open file: script.mvm-bc");
-    snapshotFile = fs_open("script.mvm-bc", "rb");
-    if (snapshotFile == NULL) {
-        ESP_LOGI(TAG, "FILE NOT FOUND");
-        goto endofall;
-    }
+    int64_t start = esp_timer_get_time();
 
-    long int prev = ftell(snapshotFile);
-    fseek(snapshotFile, 0L, SEEK_END);
-    snapshotSize = ftell(snapshotFile);
-    fseek(snapshotFile, prev, SEEK_SET);
-    ESP_LOGI(TAG, "file length: %ld", snapshotSize);
+    // Execute the bytecode in place from the script partition if it has been
+    // written, so that only the globals and heap are copied to RAM. Otherwise
+    // read the bytecode from file.
+    ESP_LOGI(TAG, "map partition: %s", SCRIPT_PARTITION_LABEL);
+    if (microvium_hal_image_map(&snapshot, SCRIPT_PARTITION_LABEL)) {
+        ESP_LOGI(TAG, "bytecode length: %u (mapped)", (unsigned) snapshot.size);
+    } else {
+        ESP_LOGI(TAG, "open file: script.mvm-bc");
+        if (!microvium_hal_image_read(&snapshot, "script.mvm-bc")) {
+            ESP_LOGI(TAG, "FILE NOT FOUND");
+            goto endofall;
+        }
+        ESP_LOGI(TAG, "file length: %u", (unsigned) snapshot.size);
+    }
 
-    snapshot = (uint8_t*) malloc(snapshotSize);
-    fread(snapshot, 1, snapshotSize, snapshotFile);
-    fclose(snapshotFile);
+    // Warm start from the state saved by a previous boot, if there is one for
+    // this firmware and script
+    buildId = build_id(&snapshot);
+    if (microvium_hal_image_map_hibernated(&hibernated, HIBERNATE_PARTITION_LABEL)) {
+        err = mvm_restoreHibernated(&vm, hibernated.bytecode, hibernated.size, buildId, NULL);
+        if (err == MVM_E_SUCCESS) {
+            // The VM runs from the hibernation image, not the script
+            microvium_hal_image_release(&snapshot);
+            warm = true;
+        } else {
+            ESP_LOGI(TAG, "mvm_restoreHibernated error: %d [%s]", err, microvium_error[err]);
+            microvium_hal_image_release(&hibernated);
+        }
+    }
 
-    // Restore the VM from the snapshot
-    err = mvm_restore(&vm, snapshot, snapshotSize, NULL, resolveImport);
-    if (err != MVM_E_SUCCESS) {
-        ESP_LOGI(TAG, "mvm_restore error: %d [%s]", err, microvium_error[err]);
-        goto endofall;
+    // Otherwise restore the VM from the snapshot
+    if (!warm) {
+        err = mvm_restore(&vm, snapshot.bytecode, snapshot.size, NULL, resolveImport);
+        if (err != MVM_E_SUCCESS) {
+            ESP_LOGI(TAG, "mvm_restore error: %d [%s]", err, microvium_error[err]);
+            goto endofall;
+        }
     }
 
+#if MVM_GC_POLICY
+    mvm_setGCPolicy(vm, &GC_POLICY);
+#endif
+
     // Find the "sayHello" function exported by the VM
     err = mvm_resolveExports(vm, &SAY_HELLO, &sayHello, 1);
     if (err != MVM_E_SUCCESS) {
@@ -182,16 +271,77 @@ void microvium_task(void *pvParameter) {
         goto endofall;
     }
 
+    // Save the state after a cold start, for a warm start on the next boot.
+    // This is done before any script code runs, so that a warm start begins
+    // from the same state as a cold one rather than from wherever the first
+    // call left it. (After a warm start the VM runs from the hibernation
+    // partition, so it can't be overwritten.)
+    if (!warm) {
+        ESP_LOGI(TAG, "hibernate");
+        if (!microvium_hal_image_hibernate(vm, buildId, HIBERNATE_PARTITION_LABEL))
+            ESP_LOGI(TAG, "hibernate failed");
+    }
+
+#if MVM_SAMPLING_PROFILER
+    esp_timer_handle_t profileTimer = NULL;
+    const esp_timer_create_args_t profileTimerArgs = {
+            .callback = profile_timer,
+            .arg = vm,
+            .name = "mvm_profile"
+    };
+    if (mvm_startSampling(vm) == MVM_E_SUCCESS && esp_timer_create(&profileTimerArgs, &profileTimer) == ESP_OK)
+        esp_timer_start_periodic(profileTimer, PROFILE_PERIOD_US);
+#endif
+
+#if MVM_HEAP_PROFILE
+    if (mvm_startHeapProfile(vm) != MVM_E_SUCCESS)
+        ESP_LOGI(TAG, "mvm_startHeapProfile failed");
+#endif
+
     // Call "sayHello"
     err = mvm_call(vm, sayHello, &result, NULL, 0);
     if (err != MVM_E_SUCCESS) {
         ESP_LOGI(TAG, "mvm_call error: %d [%s]", err, microvium_error[err]);
         goto endofall;
     }
+    ESP_LOGI(TAG, "%s start to first call: %lld us", warm ? "warm" : "cold", esp_timer_get_time() - start);
+
+#if MVM_SAMPLING_PROFILER
+    if (profileTimer != NULL) {
+        esp_timer_stop(profileTimer);
+        esp_timer_delete(profileTimer);
+    }
+    FILE *profile = fs_open(PROFILE_FILE, "w");
+    if (profile != NULL) {
+        uint32_t dropped = mvm_drainFoldedStacks(vm, profile_write, profile);
+        fclose(profile);
+        ESP_LOGI(TAG, "profile written to %s (%u samples dropped)", PROFILE_FILE, (unsigned) dropped);
+    }
+    mvm_stopSampling(vm);
+#endif
+
+#if MVM_HEAP_PROFILE
+    // The live counts of the profile are as of the last collection
+    mvm_runGC(vm, false);
+    mvm_getHeapProfile(vm, heap_profile_log, NULL);
+    mvm_stopHeapProfile(vm);
+#endif
+
+#if MVM_HEAP_DUMP
+    FILE *heapDump = fs_open(HEAP_DUMP_FILE, "wb");
+    if (heapDump != NULL) {
+        mvm_dumpHeap(vm, heap_dump_write, heapDump);
+        fclose(heapDump);
+        ESP_LOGI(TAG, "heap dump written to %s", HEAP_DUMP_FILE);
+    }
+#endif
 
-    // Clean up
-    ESP_LOGI(TAG, "mvm_runGC");
-    mvm_runGC(vm, 1);
+#if MVM_GC_POLICY
+    // Nothing else to do, so let the GC policy collect
+    ESP_LOGI(TAG, "mvm_gcIdle");
+    while (!mvm_gcIdle(vm))
+        taskYIELD();
+#endif
 
     ESP_LOGI(TAG, "END");
 endofall: